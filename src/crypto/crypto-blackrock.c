@@ -50,6 +50,7 @@
 #include "crypto-blackrock.h"
 #include "../pixie/pixie-timer.h"
 #include "../util-data/fine-malloc.h"
+#include "../util-misc/cross.h"
 #include "../util-out/logger.h"
 #include <stdint.h>
 #include <string.h>
@@ -59,6 +60,11 @@
 #include <ctype.h>
 #include <time.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLACKROCK_X86_SIMD
+#include <immintrin.h>
+#endif
+
 #if defined(_MSC_VER)
 #define inline _inline
 #endif
@@ -96,6 +102,8 @@ const unsigned char sbox[256] = {
     0xf3, 0xf4, 0xc6, 0xbc, 0xa2, 0x51, 0x58, 0xe8, 0xae,
 };
 
+static void _blackrock1_init_lanes();
+
 /***************************************************************************
  ***************************************************************************/
 void blackrock1_init(BlackRock *br, uint64_t range, uint64_t seed,
@@ -146,6 +154,8 @@ void blackrock1_init(BlackRock *br, uint64_t range, uint64_t seed,
     br->rounds = rounds;
     br->seed   = seed;
     br->range  = range;
+
+    _blackrock1_init_lanes();
 }
 
 /***************************************************************************
@@ -262,6 +272,193 @@ uint64_t blackrock1_shuffle(const BlackRock *br, uint64_t m) {
     return c;
 }
 
+/***************************************************************************
+ * READ() is a XOR of substituted bytes shifted to fixed positions. So it could
+ * be done by lookups in 8 tables of 64-bit values, and the inputs of lookups
+ * are just bytes of R mixed with the round key. This makes it possible to
+ * compute READ() of several lanes with gather instructions.
+ ***************************************************************************/
+static uint64_t read_table[8][256];
+
+static void _read_table_init() {
+    unsigned v;
+
+    for (v = 0; v < 256; v++) {
+        uint64_t s = sbox[v];
+
+        read_table[0][v] = s;
+        read_table[1][v] = s << 8;
+        read_table[2][v] = s << 16;
+        read_table[3][v] = s << 24;
+        read_table[4][v] = s << 23;
+        read_table[5][v] = s << 31;
+        read_table[6][v] = s << 49;
+        read_table[7][v] = s << 57;
+    }
+}
+
+/**
+ * Mix R with the key of round r, then bytes of result are lookup indexes.
+ */
+static inline uint64_t ROUND_KEY(uint64_t r, uint64_t seed) {
+    return (seed << r) ^ (seed >> (64 - r)) ^
+           (((seed ^ r) & 0xFF) * 0x0101010101010101ULL);
+}
+
+static inline uint64_t READ_TABLE(uint64_t Y) {
+    return read_table[0][Y & 0xFF] ^ read_table[1][(Y >> 8) & 0xFF] ^
+           read_table[2][(Y >> 16) & 0xFF] ^ read_table[3][(Y >> 24) & 0xFF] ^
+           read_table[4][(Y >> 32) & 0xFF] ^ read_table[5][(Y >> 40) & 0xFF] ^
+           read_table[6][(Y >> 48) & 0xFF] ^ read_table[7][Y >> 56];
+}
+
+typedef void (*read_lanes_func)(uint64_t key, const uint64_t *R, uint64_t *F);
+
+/**
+ * READ() of BLACKROCK_LANES lanes in scalar.
+ */
+static void _read_lanes_scalar(uint64_t key, const uint64_t *R, uint64_t *F) {
+    unsigned k;
+
+    for (k = 0; k < BLACKROCK_LANES; k++)
+        F[k] = READ_TABLE(R[k] ^ key);
+}
+
+#if defined(BLACKROCK_X86_SIMD)
+/**
+ * READ() of BLACKROCK_LANES lanes with AVX2 gathers.
+ */
+__attribute__((target("avx2"))) static void
+_read_lanes_avx2(uint64_t key, const uint64_t *R, uint64_t *F) {
+    const __m256i mask = _mm256_set1_epi64x(0xFF);
+    const __m256i vkey = _mm256_set1_epi64x((long long)key);
+    unsigned      k, n;
+
+    for (k = 0; k < BLACKROCK_LANES; k += 4) {
+        __m256i Y   = _mm256_loadu_si256((const __m256i *)(R + k));
+        __m256i acc = _mm256_setzero_si256();
+
+        Y = _mm256_xor_si256(Y, vkey);
+        for (n = 0; n < 8; n++) {
+            __m256i idx = _mm256_and_si256(_mm256_srli_epi64(Y, n * 8), mask);
+            acc         = _mm256_xor_si256(
+                acc, _mm256_i64gather_epi64((const long long *)read_table[n],
+                                                    idx, 8));
+        }
+        _mm256_storeu_si256((__m256i *)(F + k), acc);
+    }
+}
+
+static int _has_avx2() { return __builtin_cpu_supports("avx2"); }
+#else
+static int _has_avx2() { return 0; }
+#define _read_lanes_avx2 _read_lanes_scalar
+#endif
+
+static read_lanes_func _read_lanes = _read_lanes_scalar;
+
+static volatile uint64_t _read_lanes_sink;
+
+static uint64_t _time_read_lanes(read_lanes_func read_lanes) {
+    uint64_t R[BLACKROCK_LANES] = {0};
+    uint64_t start, stop;
+    unsigned i;
+
+    start = pixie_nanotime();
+    for (i = 0; i < 4096; i++)
+        read_lanes(i, R, R);
+    stop = pixie_nanotime();
+    _read_lanes_sink = R[0];
+
+    return stop - start;
+}
+
+/**
+ * Called in init, so it happens before any shuffling in threads.
+ * Gathers are microcoded and slower than scalar loads on some CPUs (e.g. with
+ * mitigation of GDS). So choose the faster one by timing once instead of just
+ * checking the CPU feature. Both give the identical result.
+ */
+static void _blackrock1_init_lanes() {
+    static int is_inited = 0;
+
+    if (is_inited)
+        return;
+    is_inited = 1;
+
+    _read_table_init();
+
+    if (_has_avx2() && _time_read_lanes(_read_lanes_avx2) <
+                           _time_read_lanes(_read_lanes_scalar)) {
+        _read_lanes = _read_lanes_avx2;
+    } else {
+        _read_lanes = _read_lanes_scalar;
+    }
+}
+
+/***************************************************************************
+ * The same as ENCRYPT() but for BLACKROCK_LANES independent lanes. Rounds are
+ * in the outer loop, so long latency of divisions in different lanes could
+ * overlap.
+ ***************************************************************************/
+static void ENCRYPT_LANES(read_lanes_func read_lanes, unsigned r, uint64_t a,
+                          uint64_t b, const uint64_t *m, uint64_t *c,
+                          uint64_t seed) {
+    uint64_t L[BLACKROCK_LANES];
+    uint64_t R[BLACKROCK_LANES];
+    uint64_t F[BLACKROCK_LANES];
+    uint64_t mod;
+    unsigned j, k;
+
+    for (k = 0; k < BLACKROCK_LANES; k++) {
+        L[k] = m[k] % a;
+        R[k] = m[k] / a;
+    }
+
+    for (j = 1; j <= r; j++) {
+        read_lanes(ROUND_KEY(j, seed), R, F);
+        mod = (j & 1) ? a : b;
+        for (k = 0; k < BLACKROCK_LANES; k++) {
+            F[k] = (L[k] + F[k]) % mod;
+            L[k] = R[k];
+            R[k] = F[k];
+        }
+    }
+
+    for (k = 0; k < BLACKROCK_LANES; k++) {
+        if (r & 1) {
+            c[k] = a * L[k] + R[k];
+        } else {
+            c[k] = a * R[k] + L[k];
+        }
+    }
+}
+
+static void _shuffle_batch(read_lanes_func read_lanes, const BlackRock *br,
+                           uint64_t *idx, unsigned count) {
+    unsigned i, k;
+
+    for (i = 0; i + BLACKROCK_LANES <= count; i += BLACKROCK_LANES) {
+        ENCRYPT_LANES(read_lanes, br->rounds, br->a, br->b, idx + i, idx + i,
+                      br->seed);
+        /* cycle-walking is rare, do it for lanes out of range alone */
+        for (k = i; k < i + BLACKROCK_LANES; k++) {
+            while (idx[k] >= br->range)
+                idx[k] = ENCRYPT(br->rounds, br->a, br->b, idx[k], br->seed);
+        }
+    }
+
+    for (; i < count; i++)
+        idx[i] = blackrock1_shuffle(br, idx[i]);
+}
+
+/***************************************************************************
+ ***************************************************************************/
+void blackrock1_shuffle_batch(const BlackRock *br, uint64_t *idx,
+                              unsigned count) {
+    _shuffle_batch(_read_lanes, br, idx, count);
+}
+
 /***************************************************************************
  ***************************************************************************/
 uint64_t blackrock1_unshuffle(const BlackRock *br, uint64_t m) {
@@ -341,6 +538,50 @@ void blackrock1_benchmark(unsigned rounds) {
         printf("iterations/second = %5.3f-million\n", rate);
     }
 
+    /*
+     * Time the batch shuffling in lanes
+     */
+    {
+        static const struct {
+            const char     *name;
+            read_lanes_func func;
+            int (*is_supported)();
+        } kernels[] = {
+            {"scalar", _read_lanes_scalar, NULL},
+            {"avx2",   _read_lanes_avx2,   _has_avx2},
+        };
+        uint64_t buf[256];
+        unsigned k, j;
+
+        for (k = 0; k < ARRAY_SIZE(kernels); k++) {
+            if (kernels[k].is_supported && !kernels[k].is_supported())
+                continue;
+
+            result = 0;
+            start  = pixie_nanotime();
+            for (i = 0; i < ITERATIONS; i += ARRAY_SIZE(buf)) {
+                for (j = 0; j < ARRAY_SIZE(buf); j++)
+                    buf[j] = i + j;
+                _shuffle_batch(kernels[k].func, &br, buf, ARRAY_SIZE(buf));
+                result += buf[0];
+            }
+            stop = pixie_nanotime();
+
+            if (result) {
+                double elapsed = ((double)(stop - start)) / (1000000000.0);
+                double rate    = ITERATIONS / elapsed;
+
+                rate /= 1000000.0;
+
+                printf("batch(%s, %u lanes) iterations/second = "
+                       "%5.3f-million (%5.3f-million per lane)%s\n",
+                       kernels[k].name, BLACKROCK_LANES, rate,
+                       rate / BLACKROCK_LANES,
+                       kernels[k].func == _read_lanes ? " *" : "");
+            }
+        }
+    }
+
     putchar('\n');
 }
 
@@ -371,6 +612,46 @@ int blackrock1_selftest() {
         }
     }
 
+    /*
+     * READ() by tables must be the same, and shuffling in lanes must give the
+     * same results as the serial way for all kernels.
+     */
+    {
+        BlackRock br;
+        uint64_t  in[37], out1[37], out2[37];
+        unsigned  r;
+
+        blackrock1_init(&br, 1000003, 0x1234567890ABCDEFULL, 14);
+
+        for (i = 0; i < 1000; i++) {
+            uint64_t R = i * 0x9E3779B97F4A7C15ULL;
+            for (r = 1; r <= 14; r++) {
+                if (READ(r, R, br.seed) !=
+                    READ_TABLE(R ^ ROUND_KEY(r, br.seed))) {
+                    LOG(LEVEL_ERROR, "(BLACKROCK) table READ failed\n");
+                    return 1; /*fail*/
+                }
+            }
+        }
+
+        for (i = 0; i < ARRAY_SIZE(in); i++)
+            in[i] = (i * 27449) % br.range;
+        memcpy(out1, in, sizeof(in));
+        memcpy(out2, in, sizeof(in));
+        _shuffle_batch(_read_lanes_scalar, &br, out1, ARRAY_SIZE(out1));
+        if (_has_avx2())
+            _shuffle_batch(_read_lanes_avx2, &br, out2, ARRAY_SIZE(out2));
+        else
+            memcpy(out2, out1, sizeof(out2));
+        for (i = 0; i < ARRAY_SIZE(in); i++) {
+            if (out1[i] != blackrock1_shuffle(&br, in[i]) ||
+                out2[i] != out1[i]) {
+                LOG(LEVEL_ERROR, "(BLACKROCK) batch shuffle failed\n");
+                return 1; /*fail*/
+            }
+        }
+    }
+
     range = 3015 * 3;
 
     for (i = 0; i < 5; i++) {
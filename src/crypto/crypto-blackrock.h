@@ -46,6 +46,20 @@ void blackrock2_init(BlackRock *br, uint64_t range, uint64_t seed,
 uint64_t blackrock1_shuffle(const BlackRock *br, uint64_t index);
 uint64_t blackrock2_shuffle(const BlackRock *br, uint64_t index);
 
+/**
+ * Count of indexes shuffled in parallel by blackrock1_shuffle_batch.
+ */
+#define BLACKROCK_LANES 4
+
+/**
+ * Shuffle count of indexes in place the same as blackrock1_shuffle but in
+ * lanes of BLACKROCK_LANES. The round function of all lanes is done by AVX2 or
+ * by the scalar way, whichever is faster on this CPU. Both give the identical
+ * permutation.
+ */
+void blackrock1_shuffle_batch(const BlackRock *br, uint64_t *idx,
+                              unsigned count);
+
 /**
  * The reverse of the shuffle function above: given the shuffled/encrypted
  * integer, return the original index value before the shuffling/encryption.
@@ -0,0 +1,173 @@
+#include "bloom-dedup.h"
+#include "dedup-file.h"
+#include "../util-misc/cross.h"
+#include "../util-out/logger.h"
+#include "../util-data/fine-malloc.h"
+
+#include <math.h>
+#include <string.h>
+
+#define BLD_ALIGN 32
+
+typedef struct BloomBlock {
+    uint32_t words[BLD_WORDS];
+} BloomBlock;
+
+#define BLD_FILE_MAGIC "XTBLD002"
+
+struct BloomDedup {
+    /*both filters in one region*/
+    BloomBlock      *filters;
+    BloomBlock      *cur;
+    BloomBlock      *prev;
+    void            *raw;
+    /*mapped snapshot file if not NULL*/
+    DedupFileHeader *file;
+    uint64_t         block_count;
+    /*tuples put into the current filter*/
+    uint64_t         inserted;
+    uint64_t         capacity;
+};
+
+/*odd salts from the split block Bloom filter of Parquet*/
+static const uint32_t bld_salts[BLD_WORDS] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+};
+
+static BloomDedup *_bld_new(unsigned dedup_win, double fp_rate,
+                            uint64_t mem_limit) {
+    BloomDedup *bld = CALLOC(1, sizeof(BloomDedup));
+
+    if (fp_rate <= 0 || fp_rate >= 1)
+        fp_rate = BLD_DFT_FP_RATE;
+
+    /**
+     * Lookups check two filters, so each one takes half of the rate.
+     * A filter with b bits per key has rate (1-e^(-k/b))^k for k bits per key.
+     */
+    double bits = -BLD_WORDS / log(1.0 - pow(fp_rate / 2, 1.0 / BLD_WORDS));
+    bld->block_count =
+        (uint64_t)ceil((double)dedup_win * bits / (BLD_WORDS * 32));
+
+    if (mem_limit && bld->block_count * 2 * sizeof(BloomBlock) > mem_limit) {
+        bld->block_count = mem_limit / (2 * sizeof(BloomBlock));
+    }
+    if (bld->block_count == 0)
+        bld->block_count = 1;
+
+    bld->capacity = dedup_win;
+
+    bits = (double)bld->block_count * BLD_WORDS * 32 / dedup_win;
+    LOG(LEVEL_INFO,
+        "(dedup) bloom filters of %.2f-MB, expected false positive rate %g\n",
+        bld->block_count * 2.0 * sizeof(BloomBlock) / (1024 * 1024),
+        2 * pow(1.0 - exp(-BLD_WORDS / bits), BLD_WORDS));
+
+    return bld;
+}
+
+BloomDedup *bloomdedup_create(unsigned dedup_win, double fp_rate,
+                              uint64_t mem_limit) {
+    BloomDedup *bld = _bld_new(dedup_win, fp_rate, mem_limit);
+
+    bld->raw     = CALLOC(bld->block_count * 2 + 1, sizeof(BloomBlock));
+    bld->filters = (BloomBlock *)(((uintptr_t)bld->raw + BLD_ALIGN - 1) &
+                                  ~(uintptr_t)(BLD_ALIGN - 1));
+    bld->cur     = bld->filters;
+    bld->prev    = bld->filters + bld->block_count;
+
+    return bld;
+}
+
+BloomDedup *bloomdedup_open(unsigned dedup_win, double fp_rate,
+                            uint64_t mem_limit, const char *filename,
+                            uint64_t sharding) {
+    BloomDedup *bld = _bld_new(dedup_win, fp_rate, mem_limit);
+    bool        is_loaded;
+
+    bld->file = dedupfile_map(filename, BLD_FILE_MAGIC, bld->block_count,
+                              sharding,
+                              bld->block_count * 2 * sizeof(BloomBlock),
+                              &is_loaded);
+    if (!bld->file) {
+        FREE(bld);
+        return NULL;
+    }
+
+    bld->filters = dedupfile_data(bld->file);
+    bld->cur     = bld->filters;
+    bld->prev    = bld->filters + bld->block_count;
+
+    if (is_loaded) {
+        if (bld->file->state[0] == 1) {
+            bld->cur  = bld->filters + bld->block_count;
+            bld->prev = bld->filters;
+        }
+        bld->inserted = min(bld->file->state[1], bld->capacity - 1);
+    }
+
+    return bld;
+}
+
+void bloomdedup_destroy(BloomDedup *bld) {
+    if (!bld)
+        return;
+
+    if (bld->file) {
+        bld->file->state[0] = bld->cur != bld->filters;
+        bld->file->state[1] = bld->inserted;
+        dedupfile_unmap(bld->file);
+    } else {
+        FREE(bld->raw);
+    }
+
+    FREE(bld);
+}
+
+static inline bool _bld_check(const BloomBlock *block, const uint32_t *mask) {
+    uint32_t miss = 0;
+    for (unsigned i = 0; i < BLD_WORDS; i++)
+        miss |= ~block->words[i] & mask[i];
+    return miss == 0;
+}
+
+static inline void _bld_insert(BloomBlock *block, const uint32_t *mask) {
+    for (unsigned i = 0; i < BLD_WORDS; i++)
+        block->words[i] |= mask[i];
+}
+
+/**
+ * Clear the previous filter and use it as the current one.
+ */
+static void _bld_rotate(BloomDedup *bld) {
+    BloomBlock *tmp = bld->prev;
+
+    memset(tmp, 0, bld->block_count * sizeof(BloomBlock));
+
+    bld->prev     = bld->cur;
+    bld->cur      = tmp;
+    bld->inserted = 0;
+}
+
+bool bloomdedup_is_dup(BloomDedup *bld, uint64_t hash) {
+    /*upper bits for block and lower bits for bits in block*/
+    uint64_t idx = ((hash >> 32) * bld->block_count) >> 32;
+    uint32_t key = (uint32_t)hash;
+    uint32_t mask[BLD_WORDS];
+
+    for (unsigned i = 0; i < BLD_WORDS; i++)
+        mask[i] = 1u << ((key * bld_salts[i]) >> 27);
+
+    if (_bld_check(&bld->cur[idx], mask))
+        return true;
+
+    bool is_dup = _bld_check(&bld->prev[idx], mask);
+
+    /*also refresh tuples from the previous filter to keep them alive*/
+    _bld_insert(&bld->cur[idx], mask);
+    if (++bld->inserted >= bld->capacity)
+        _bld_rotate(bld);
+
+    return is_dup;
+}
@@ -0,0 +1,52 @@
+/*
+ Probabilistic dedup with a rotating pair of blocked Bloom filters
+
+ Exact backends keep every tuple of the window, that's tens of GB for a
+ window of hundreds of millions. Here we keep two split-block Bloom filters
+ (like Parquet and Impala): a block is 256 bits of BLD_WORDS words and a key
+ sets one bit in every word of its block, so a lookup touches one half of a
+ cache line.
+
+ New tuples go into the current filter and lookups check both. After
+ dedup_win tuples were put, the previous filter is cleared and becomes the
+ current one. So tuples seen in the last dedup_win to 2*dedup_win are
+ reported as duplicates, and the memory never grows whatever the scan lasts.
+
+ A false positive drops a genuine result. The filters are sized by the given
+ false positive rate, or by the memory limit if it's smaller, and the actual
+ expected rate will be logged.
+ */
+#ifndef BLOOM_DEDUP_H
+#define BLOOM_DEDUP_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BLD_WORDS       8
+#define BLD_DFT_FP_RATE 0.0001
+
+typedef struct BloomDedup BloomDedup;
+
+/**
+ * @param fp_rate expected false positive rate, 0 for BLD_DFT_FP_RATE.
+ * @param mem_limit max bytes of both filters, 0 for no limit.
+ */
+BloomDedup *bloomdedup_create(unsigned dedup_win, double fp_rate,
+                              uint64_t mem_limit);
+
+/**
+ * Create filters in a mapped snapshot file, see dedup-file.h.
+ * @return NULL if failed.
+ */
+BloomDedup *bloomdedup_open(unsigned dedup_win, double fp_rate,
+                            uint64_t mem_limit, const char *filename,
+                            uint64_t sharding);
+
+void bloomdedup_destroy(BloomDedup *bld);
+
+/**
+ * Check and record a tuple by its 64-bit hash.
+ * @return true if it was probably seen in dedup window.
+ */
+bool bloomdedup_is_dup(BloomDedup *bld, uint64_t hash);
+
+#endif
@@ -0,0 +1,110 @@
+#include "dedup-file.h"
+#include "../util-out/logger.h"
+#include "../util-misc/cross.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if defined(WIN32)
+
+DedupFileHeader *dedupfile_map(const char *filename, const char *magic,
+                               uint64_t layout, uint64_t sharding,
+                               size_t data_size, bool *is_loaded) {
+    UNUSEDPARM(filename);
+    UNUSEDPARM(magic);
+    UNUSEDPARM(layout);
+    UNUSEDPARM(sharding);
+    UNUSEDPARM(data_size);
+    *is_loaded = false;
+    LOG(LEVEL_ERROR, "(dedup file) not supported on Windows yet.\n");
+    return NULL;
+}
+
+void dedupfile_unmap(DedupFileHeader *hdr) { UNUSEDPARM(hdr); }
+
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+DedupFileHeader *dedupfile_map(const char *filename, const char *magic,
+                               uint64_t layout, uint64_t sharding,
+                               size_t data_size, bool *is_loaded) {
+    DedupFileHeader *hdr;
+    struct stat      st;
+    size_t           map_size = DEDUP_FILE_HEAD + data_size;
+    int              fd;
+
+    *is_loaded = false;
+
+    fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        LOGPERROR(filename);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        LOGPERROR(filename);
+        close(fd);
+        return NULL;
+    }
+
+    /*truncating to zero clears all old data*/
+    if ((size_t)st.st_size != map_size) {
+        if (ftruncate(fd, 0) < 0 || ftruncate(fd, map_size) < 0) {
+            LOGPERROR(filename);
+            close(fd);
+            return NULL;
+        }
+    }
+
+    hdr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        LOGPERROR(filename);
+        return NULL;
+    }
+
+    if ((size_t)st.st_size == map_size &&
+        memcmp(hdr->magic, magic, sizeof(hdr->magic)) == 0 &&
+        hdr->layout == layout && hdr->data_size == data_size) {
+        /*results of other shards would be output again silently*/
+        if (hdr->sharding != sharding) {
+            LOG(LEVEL_ERROR,
+                "(dedup file) %s was saved by another sharding of tables\n",
+                filename);
+            LOG(LEVEL_HINT, "keep the same --rx-thread-count, "
+                            "--rx-handler-count and --dedup-in-handler as "
+                            "the previous run, or remove old files.\n");
+            munmap(hdr, map_size);
+            return NULL;
+        }
+        *is_loaded = true;
+        LOG(LEVEL_INFO, "(dedup file) loaded %s\n", filename);
+        return hdr;
+    }
+
+    if ((size_t)st.st_size == map_size) {
+        LOG(LEVEL_WARN, "(dedup file) reset incompatible %s\n", filename);
+        memset(hdr, 0, map_size);
+    }
+
+    memcpy(hdr->magic, magic, sizeof(hdr->magic));
+    hdr->layout    = layout;
+    hdr->sharding  = sharding;
+    hdr->data_size = data_size;
+
+    return hdr;
+}
+
+void dedupfile_unmap(DedupFileHeader *hdr) {
+    size_t map_size = DEDUP_FILE_HEAD + hdr->data_size;
+
+    if (msync(hdr, map_size, MS_SYNC) < 0)
+        LOGPERROR("msync");
+    munmap(hdr, map_size);
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ Memory-mapped snapshot file of dedup tables
+
+ Flat dedup tables(fingerprint and bloom) could live in a shared mapping of
+ a file instead of heap. So all their changes are in page cache of the file
+ at once, and only a msync is needed on shutdown. The next run maps the same
+ file and goes on with old results without re-emitting them.
+
+ A file has a header of DEDUP_FILE_HEAD bytes and the data of table. The
+ header records the magic of backend and the layout of data. The file is
+ reset if it doesn't match the table we want, e.g. the window was changed.
+
+ Tables could be shards owned by different threads. The header also records
+ how targets were sharded, and a file from another sharding is refused,
+ because its old results belong to other shards now.
+ */
+#ifndef DEDUP_FILE_H
+#define DEDUP_FILE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*keep data aligned to page*/
+#define DEDUP_FILE_HEAD 4096
+
+/*sharding of tables by mode, count of shards and index of this one*/
+#define DEDUP_SHARDING(mode, count, index)                                     \
+    (((uint64_t)(mode) << 48) | ((uint64_t)(count) << 24) | (uint64_t)(index))
+
+typedef struct DedupFileHeader {
+    char     magic[8];
+    /*backend specific params of data layout, e.g. count of buckets*/
+    uint64_t layout;
+    uint64_t data_size;
+    /*see DEDUP_SHARDING*/
+    uint64_t sharding;
+    /*backend specific state saved on close*/
+    uint64_t state[4];
+} DedupFileHeader;
+
+/**
+ * Map a snapshot file with the given layout, create it or reset it if not
+ * compatible. Data begins at DEDUP_FILE_HEAD bytes after the header.
+ * @param magic backend magic of 8 chars.
+ * @param sharding see DEDUP_SHARDING.
+ * @param is_loaded set true if old data was kept.
+ * @return header of mapped file, or NULL if failed or sharded differently.
+ */
+DedupFileHeader *dedupfile_map(const char *filename, const char *magic,
+                               uint64_t layout, uint64_t sharding,
+                               size_t data_size, bool *is_loaded);
+
+/**
+ * Flush mapped file to disk and unmap it.
+ */
+void dedupfile_unmap(DedupFileHeader *hdr);
+
+static inline void *dedupfile_data(DedupFileHeader *hdr) {
+    return (char *)hdr + DEDUP_FILE_HEAD;
+}
+
+#endif
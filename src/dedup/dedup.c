@@ -1,7 +1,13 @@
 #include "dedup.h"
 #include "mas-dedup.h"
 #include "cachehash.h"
+#include "fp-dedup.h"
+#include "bloom-dedup.h"
 #include "../util-out/logger.h"
+#include "../util-data/fine-malloc.h"
+#include "../pixie/pixie-timer.h"
+
+#include <stdio.h>
 
 struct DedupItem_IPv4 {
     unsigned    type;
@@ -19,25 +25,188 @@ struct DedupItem_IPv6 {
     unsigned    port_me;
 };
 
-Dedup *dedup_init(unsigned dedup_win) {
+struct DedupBackend {
+    DedupType type;
+    /*round tagged into tuples*/
+    unsigned  round;
+    union {
+#ifndef NOT_FOUND_JUDY
+        cachehash *cache;
+#endif
+        DedupTable *table;
+        FpDedup    *fpd;
+        BloomDedup *bloom;
+    };
+};
+
+static const char *dedup_type_names[] = {
+    [Dedup_Default]     = "default",
+    [Dedup_Cachehash]   = "cachehash",
+    [Dedup_Masscan]     = "masscan",
+    [Dedup_Fingerprint] = "fingerprint",
+    [Dedup_Bloom]       = "bloom",
+};
+
+DedupType dedup_type_by_name(const char *name) {
+    for (unsigned i = 0; i < ARRAY_SIZE(dedup_type_names); i++) {
+        if (strcmp(dedup_type_names[i], name) == 0)
+            return (DedupType)i;
+    }
+
+    /*aliases*/
+    if (strcmp(name, "judy") == 0)
+        return Dedup_Cachehash;
+    if (strcmp(name, "fp") == 0)
+        return Dedup_Fingerprint;
+
+    return Dedup_Unknown;
+}
+
+const char *dedup_type_to_name(DedupType type) {
+    if (type >= Dedup_Unknown)
+        return "unknown";
+    return dedup_type_names[type];
+}
+
+bool dedup_type_is_available(DedupType type) {
+#ifdef NOT_FOUND_JUDY
+    if (type == Dedup_Cachehash)
+        return false;
+#endif
+    return type < Dedup_Unknown;
+}
+
+Dedup *dedup_init(DedupType type, unsigned dedup_win, double fp_rate,
+                  uint64_t mem_limit, const char *filename, uint64_t sharding) {
+    Dedup *dedup = CALLOC(1, sizeof(Dedup));
+
+    if (type == Dedup_Default) {
+#ifndef NOT_FOUND_JUDY
+        type = Dedup_Cachehash;
+#else
+        type = Dedup_Masscan;
+#endif
+    }
+
+    dedup->type = type;
+
+    if (filename) {
+        bool is_opened;
+        switch (type) {
+            case Dedup_Fingerprint:
+                dedup->fpd = fpdedup_open(dedup_win, filename, sharding);
+                is_opened  = dedup->fpd != NULL;
+                break;
+            case Dedup_Bloom:
+                dedup->bloom = bloomdedup_open(dedup_win, fp_rate, mem_limit,
+                                               filename, sharding);
+                is_opened = dedup->bloom != NULL;
+                break;
+            default:
+                LOG(LEVEL_ERROR, "(dedup) snapshot file needs --dedup-type "
+                                 "fingerprint or bloom.\n");
+                exit(1);
+        }
+
+        if (!is_opened) {
+            LOG(LEVEL_ERROR, "(dedup) failed to open snapshot file %s.\n",
+                filename);
+            exit(1);
+        }
+
+        return dedup;
+    }
+
+    switch (type) {
+        case Dedup_Cachehash:
 #ifndef NOT_FOUND_JUDY
-    return cachehash_init(dedup_win, NULL);
+            dedup->cache = cachehash_init(dedup_win, NULL);
+            break;
 #else
-    return dedup_create(dedup_win);
+            LOG(LEVEL_ERROR, "(dedup) cachehash needs libjudy.\n");
+            exit(1);
 #endif
+        case Dedup_Masscan:
+            dedup->table = dedup_create(dedup_win);
+            break;
+        case Dedup_Fingerprint:
+            dedup->fpd = fpdedup_create(dedup_win);
+            break;
+        case Dedup_Bloom:
+            dedup->bloom = bloomdedup_create(dedup_win, fp_rate, mem_limit);
+            break;
+        default:
+            LOG(LEVEL_ERROR, "(dedup) unknown type %d.\n", type);
+            exit(1);
+    }
+
+    return dedup;
 }
 
 void dedup_close(Dedup *dedup) {
+    if (!dedup)
+        return;
+
+    switch (dedup->type) {
 #ifndef NOT_FOUND_JUDY
-    cachehash_free(dedup, NULL);
-#else
-    dedup_destroy(dedup);
+        case Dedup_Cachehash:
+            cachehash_free(dedup->cache, NULL);
+            break;
 #endif
+        case Dedup_Masscan:
+            dedup_destroy(dedup->table);
+            break;
+        case Dedup_Fingerprint:
+            fpdedup_destroy(dedup->fpd);
+            break;
+        case Dedup_Bloom:
+            bloomdedup_destroy(dedup->bloom);
+            break;
+        default:
+            break;
+    }
+
+    FREE(dedup);
+}
+
+void dedup_set_round(Dedup *dedup, unsigned round) { dedup->round = round; }
+
+static inline uint64_t _fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+/**
+ * 64-bit hash of the meaningful part of a tuple.
+ */
+static uint64_t _dedup_hash(ipaddress ip_them, unsigned port_them,
+                            ipaddress ip_me, unsigned port_me, unsigned type) {
+    uint64_t hash;
+
+    hash = _fmix64(((uint64_t)type << 8 | ip_them.version) ^
+                   0x9E3779B97F4A7C15ull);
+    hash = _fmix64(hash ^ ((uint64_t)port_them << 32 | port_me));
+
+    if (ip_them.version == 4) {
+        hash = _fmix64(hash ^ ((uint64_t)ip_them.ipv4 << 32 | ip_me.ipv4));
+    } else {
+        hash = _fmix64(hash ^ ip_them.ipv6.hi);
+        hash = _fmix64(hash ^ ip_them.ipv6.lo);
+        hash = _fmix64(hash ^ ip_me.ipv6.hi);
+        hash = _fmix64(hash ^ ip_me.ipv6.lo);
+    }
+
+    return hash;
 }
 
-bool dedup_is_dup(Dedup *dedup, ipaddress ip_them, unsigned port_them,
-                  ipaddress ip_me, unsigned port_me, unsigned type) {
 #ifndef NOT_FOUND_JUDY
+static bool _cachehash_is_dup(cachehash *cache, ipaddress ip_them,
+                              unsigned port_them, ipaddress ip_me,
+                              unsigned port_me, unsigned type) {
     /**
      * Cachehash(Judy) from ZMap got hash from a complete struct. This would be
      * confused for our ipaddress which could be ipv4 and ipv6. And we couldn't
@@ -51,10 +220,10 @@ bool dedup_is_dup(Dedup *dedup, ipaddress ip_them, unsigned port_them,
                                       .ip_me     = ip_me.ipv4,
                                       .port_me   = port_me,
                                       .type      = type};
-        if (cachehash_get(dedup, &item, sizeof(struct DedupItem_IPv4))) {
+        if (cachehash_get(cache, &item, sizeof(struct DedupItem_IPv4))) {
             return true;
         } else {
-            cachehash_put(dedup, &item, sizeof(struct DedupItem_IPv4),
+            cachehash_put(cache, &item, sizeof(struct DedupItem_IPv4),
                           (void *)1);
             return false;
         }
@@ -64,20 +233,44 @@ bool dedup_is_dup(Dedup *dedup, ipaddress ip_them, unsigned port_them,
                                       .ip_me     = ip_me.ipv6,
                                       .port_me   = port_me,
                                       .type      = type};
-        if (cachehash_get(dedup, &item, sizeof(struct DedupItem_IPv6))) {
+        if (cachehash_get(cache, &item, sizeof(struct DedupItem_IPv6))) {
             return true;
         } else {
-            cachehash_put(dedup, &item, sizeof(struct DedupItem_IPv6),
+            cachehash_put(cache, &item, sizeof(struct DedupItem_IPv6),
                           (void *)1);
             return false;
         }
     }
 
     return false;
+}
+#endif
 
-#else
-    return dedup_is_duplicate(dedup, ip_them, port_them, ip_me, port_me, type);
+bool dedup_is_dup(Dedup *dedup, ipaddress ip_them, unsigned port_them,
+                  ipaddress ip_me, unsigned port_me, unsigned type) {
+    /*type of tuple is small, upper bits are free for round*/
+    type += dedup->round << 16;
+
+    switch (dedup->type) {
+#ifndef NOT_FOUND_JUDY
+        case Dedup_Cachehash:
+            return _cachehash_is_dup(dedup->cache, ip_them, port_them, ip_me,
+                                     port_me, type);
 #endif
+        case Dedup_Masscan:
+            return dedup_is_duplicate(dedup->table, ip_them, port_them, ip_me,
+                                      port_me, type);
+        case Dedup_Fingerprint:
+            return fpdedup_is_dup(
+                dedup->fpd,
+                _dedup_hash(ip_them, port_them, ip_me, port_me, type));
+        case Dedup_Bloom:
+            return bloomdedup_is_dup(
+                dedup->bloom,
+                _dedup_hash(ip_them, port_them, ip_me, port_me, type));
+        default:
+            return false;
+    }
 }
 
 /**
@@ -107,14 +300,14 @@ static unsigned _rand(unsigned *seed) {
  * We also do a simple deterministic test, but this still
  * is insufficient testing how duplicates age out and such.
  */
-int dedup_selftest() {
+static int _dedup_selftest_type(DedupType dedup_type) {
     Dedup   *dedup;
     unsigned seed = 0;
     size_t   i;
     unsigned found_match = 0;
     unsigned line        = 0;
 
-    dedup = dedup_init(1000000);
+    dedup = dedup_init(dedup_type, 1000000, 0, 0, NULL, 0);
 
     /* Deterministic test.
      *
@@ -237,11 +430,127 @@ int dedup_selftest() {
 
     dedup_close(dedup);
 
+    /* Test the window.
+     *
+     * Recent tuples should be kept and old ones should be evicted after
+     * many times of window. Not all backends are exact LRU, so there are
+     * some tolerances.
+     */
+    {
+        ipaddress ip_me     = {.version = 4, .ipv4 = 0x0a000001};
+        ipaddress ip_them   = {.version = 4};
+        unsigned  win       = 4096;
+        unsigned  total     = win * 10;
+        unsigned  recent    = 0;
+        unsigned  old       = 0;
+        unsigned  false_dup = 0;
+
+        dedup = dedup_init(dedup_type, win, 0, 0, NULL, 0);
+
+        for (i = 0; i < total; i++) {
+            ip_them.ipv4 = (unsigned)i;
+            false_dup += dedup_is_dup(dedup, ip_them, 80, ip_me, 12345, 0);
+        }
+        for (i = total - win / 4; i < total; i++) {
+            ip_them.ipv4 = (unsigned)i;
+            recent += dedup_is_dup(dedup, ip_them, 80, ip_me, 12345, 0);
+        }
+        for (i = 0; i < win; i++) {
+            ip_them.ipv4 = (unsigned)i;
+            old += dedup_is_dup(dedup, ip_them, 80, ip_me, 12345, 0);
+        }
+
+        dedup_close(dedup);
+
+        /*probabilistic backends have few false positives*/
+        if (false_dup > total / 1000 || recent < win / 4 * 9 / 10 ||
+            old > win / 10) {
+            line = __LINE__;
+            goto fail;
+        }
+    }
+
     /* All tests have passed */
     return 0; /* success :) */
 
 fail:
-    LOG(LEVEL_ERROR, "(dedup) selftest failed, file=%s, line=%u\n", __FILE__,
-        line);
+    LOG(LEVEL_ERROR, "(dedup) selftest failed for %s, file=%s, line=%u\n",
+        dedup_type_to_name(dedup_type), __FILE__, line);
     return 1;
+}
+
+int dedup_selftest() {
+    int err = 0;
+
+    for (DedupType t = Dedup_Cachehash; t < Dedup_Unknown; t++) {
+        if (dedup_type_is_available(t))
+            err += _dedup_selftest_type(t);
+    }
+
+    return err ? 1 : 0;
+}
+
+#define DEDUP_BENCH_LOOKUPS 10000000
+/*backends keeping whole tuples cost too much memory above this*/
+#define DEDUP_BENCH_MAX_WIN 10000000
+
+void dedup_benchmark() {
+    static const unsigned windows[] = {1000000, 10000000, 100000000};
+    ipaddress             ip_me     = {.version = 4, .ipv4 = 0x0a000001};
+    ipaddress             ip_them   = {.version = 4};
+    uint64_t              start, stop;
+    uint64_t              x;
+
+    puts("-- dedup --");
+
+    for (unsigned i = 0; i < ARRAY_SIZE(windows); i++) {
+        unsigned win = windows[i];
+
+        for (DedupType t = Dedup_Cachehash; t < Dedup_Unknown; t++) {
+            if (!dedup_type_is_available(t))
+                continue;
+            if ((t == Dedup_Cachehash || t == Dedup_Masscan) &&
+                win > DEDUP_BENCH_MAX_WIN) {
+                printf("%10u window %-12s: skipped for memory\n", win,
+                       dedup_type_to_name(t));
+                continue;
+            }
+
+            Dedup   *dedup     = dedup_init(t, win, 0, 0, NULL, 0);
+            unsigned false_dup = 0;
+            unsigned kept      = 0;
+            double   ns_insert, ns_hit;
+
+            /*fill the window with scattered unique tuples*/
+            start = pixie_nanotime();
+            for (unsigned n = 0; n < win; n++) {
+                ip_them.ipv4 = n * 2654435761u;
+                false_dup += dedup_is_dup(dedup, ip_them, 80, ip_me, 40000, 0);
+            }
+            stop      = pixie_nanotime();
+            ns_insert = (double)(stop - start) / win;
+
+            /*random lookups in the recent half of window*/
+            x     = 1;
+            start = pixie_nanotime();
+            for (unsigned n = 0; n < DEDUP_BENCH_LOOKUPS; n++) {
+                x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+                ip_them.ipv4 =
+                    (unsigned)(win - 1 - (((x >> 32) * (win / 2)) >> 32)) *
+                    2654435761u;
+                kept += dedup_is_dup(dedup, ip_them, 80, ip_me, 40000, 0);
+            }
+            stop   = pixie_nanotime();
+            ns_hit = (double)(stop - start) / DEDUP_BENCH_LOOKUPS;
+
+            printf("%10u window %-12s: insert %6.2f-ns, recent %6.2f-ns with "
+                   "%6.2f%% kept, false dup %u\n",
+                   win, dedup_type_to_name(t), ns_insert, ns_hit,
+                   kept * 100.0 / DEDUP_BENCH_LOOKUPS, false_dup);
+
+            dedup_close(dedup);
+        }
+    }
+
+    putchar('\n');
 }
\ No newline at end of file
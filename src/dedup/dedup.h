@@ -4,6 +4,8 @@
     between mas-dedup and judy-dedup from ZMap.
     So I decided to let users to enjoy both of them and give you guys the
     freedom of choice.
+    Then a fixed-memory table of fingerprints and probabilistic Bloom filters
+    were added and all of them could be selected at runtime.
 
     Created by sharkocha 2024
 */
@@ -12,19 +14,65 @@
 #include "../target/target-ipaddress.h"
 #include "../util-misc/cross.h"
 
-#ifndef NOT_FOUND_JUDY
-typedef struct cachehash_s Dedup;
-#else
-typedef struct DeduplicateTable Dedup;
-#endif
+/**
+ * Backends of dedup, selected by --dedup-type.
+ */
+typedef enum DedupType {
+    /*cachehash if built with libjudy, or masscan*/
+    Dedup_Default = 0,
+    /*cachehash(Judy) from ZMap, LRU of exact tuples*/
+    Dedup_Cachehash,
+    /*hash buckets from masscan*/
+    Dedup_Masscan,
+    /*cache-line buckets of fingerprints, see fp-dedup.h*/
+    Dedup_Fingerprint,
+    /*rotating pair of Bloom filters, see bloom-dedup.h*/
+    Dedup_Bloom,
+    Dedup_Unknown,
+} DedupType;
+
+typedef struct DedupBackend Dedup;
+
+/**
+ * @return Dedup_Unknown if no backend named it.
+ */
+DedupType dedup_type_by_name(const char *name);
+
+const char *dedup_type_to_name(DedupType type);
 
-Dedup *dedup_init(unsigned dedup_win);
+/**
+ * @return whether the backend was built in.
+ */
+bool dedup_type_is_available(DedupType type);
 
+/**
+ * @param fp_rate expected false positive rate for probabilistic backends,
+ * 0 for default.
+ * @param mem_limit max bytes for probabilistic backends, 0 for no limit.
+ * @param filename snapshot file to map the table in, NULL for heap. Only
+ * flat backends(fingerprint and bloom) support it, see dedup-file.h.
+ * @param sharding how the table is sharded among threads, see
+ * DEDUP_SHARDING. Only for snapshot file.
+ */
+Dedup *dedup_init(DedupType type, unsigned dedup_win, double fp_rate,
+                  uint64_t mem_limit, const char *filename, uint64_t sharding);
+
+/**
+ * Table would be saved to snapshot file if it has one.
+ */
 void dedup_close(Dedup *dedup);
 
+/**
+ * Tag tuples with the round of scan, so tuples of different rounds are
+ * never duplicates of each other. 0 for no tagging.
+ */
+void dedup_set_round(Dedup *dedup, unsigned round);
+
 bool dedup_is_dup(Dedup *dedup, ipaddress ip_them, unsigned port_them,
                   ipaddress ip_me, unsigned port_me, unsigned type);
 
 int dedup_selftest();
 
+void dedup_benchmark();
+
 #endif
@@ -0,0 +1,236 @@
+#include "fp-dedup.h"
+#include "dedup-file.h"
+#include "../util-misc/cross.h"
+#include "../util-data/fine-malloc.h"
+
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FPD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define FPD_NEON
+#endif
+
+#define FPD_LINE       64
+#define FPD_WAYS_MASK  ((1u << FPD_WAYS) - 1)
+#define FPD_GEN_MASK   0xFFull
+#define FPD_FILE_MAGIC "XTFPD002"
+
+/**
+ * One cache line. The last tag is always 0 for padding.
+ */
+typedef struct FpBucket {
+    uint8_t  tags[FPD_WAYS + 1];
+    uint64_t fps[FPD_WAYS];
+} FpBucket;
+
+struct FingerprintDedup {
+    FpBucket        *buckets;
+    void            *raw;
+    /*mapped snapshot file if not NULL*/
+    DedupFileHeader *file;
+    /*always even for bucket pairs*/
+    uint64_t         bucket_count;
+    uint64_t         gen_period;
+    uint64_t         gen_left;
+    uint8_t          gen;
+};
+
+static FpDedup *_fpd_new(unsigned dedup_win) {
+    FpDedup *fpd = CALLOC(1, sizeof(FpDedup));
+
+    /*keep load factor about 7/8 with a full window*/
+    uint64_t slots = (uint64_t)dedup_win + dedup_win / 7;
+    uint64_t count = (slots + FPD_WAYS - 1) / FPD_WAYS;
+    count          = (count + 1) & ~1ull;
+
+    fpd->bucket_count = count;
+    fpd->gen_period   = max(count * FPD_WAYS / FPD_GEN_SPLIT, 1ull);
+    fpd->gen_left     = fpd->gen_period;
+
+    return fpd;
+}
+
+FpDedup *fpdedup_create(unsigned dedup_win) {
+    FpDedup *fpd   = _fpd_new(dedup_win);
+    uint64_t count = fpd->bucket_count;
+
+    /*buckets must be aligned to cache line*/
+    fpd->raw     = CALLOC(count + 1, sizeof(FpBucket));
+    fpd->buckets = (FpBucket *)(((uintptr_t)fpd->raw + FPD_LINE - 1) &
+                                ~(uintptr_t)(FPD_LINE - 1));
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    /*random access over a large table is dominated by TLB misses*/
+    {
+        uintptr_t begin = ((uintptr_t)fpd->buckets + 4095) & ~(uintptr_t)4095;
+        uintptr_t end   = (uintptr_t)(fpd->buckets + count) & ~(uintptr_t)4095;
+        if (end > begin)
+            madvise((void *)begin, end - begin, MADV_HUGEPAGE);
+    }
+#endif
+
+    return fpd;
+}
+
+FpDedup *fpdedup_open(unsigned dedup_win, const char *filename,
+                      uint64_t sharding) {
+    FpDedup *fpd = _fpd_new(dedup_win);
+    bool     is_loaded;
+
+    fpd->file = dedupfile_map(filename, FPD_FILE_MAGIC, fpd->bucket_count,
+                              sharding, fpd->bucket_count * sizeof(FpBucket),
+                              &is_loaded);
+    if (!fpd->file) {
+        FREE(fpd);
+        return NULL;
+    }
+
+    fpd->buckets = dedupfile_data(fpd->file);
+
+    if (is_loaded && fpd->file->state[1] > 0 &&
+        fpd->file->state[1] <= fpd->gen_period) {
+        fpd->gen      = (uint8_t)fpd->file->state[0];
+        fpd->gen_left = fpd->file->state[1];
+    }
+
+    return fpd;
+}
+
+void fpdedup_destroy(FpDedup *fpd) {
+    if (!fpd)
+        return;
+
+    if (fpd->file) {
+        fpd->file->state[0] = fpd->gen;
+        fpd->file->state[1] = fpd->gen_left;
+        dedupfile_unmap(fpd->file);
+    } else {
+        FREE(fpd->raw);
+    }
+
+    FREE(fpd);
+}
+
+/**
+ * @return bitmap of slots whose tag equals to the given one.
+ */
+static inline unsigned _fpd_match(const FpBucket *b, uint8_t tag) {
+#if defined(FPD_SSE2)
+    __m128i tags = _mm_loadl_epi64((const __m128i *)b->tags);
+    __m128i eq   = _mm_cmpeq_epi8(tags, _mm_set1_epi8((char)tag));
+    return (unsigned)_mm_movemask_epi8(eq) & FPD_WAYS_MASK;
+#elif defined(FPD_NEON)
+    static const uint8_t bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x8_t eq = vceq_u8(vld1_u8(b->tags), vdup_n_u8(tag));
+    return (unsigned)vaddv_u8(vand_u8(eq, vld1_u8(bits))) & FPD_WAYS_MASK;
+#else
+    /*SWAR: get 0x80 in exactly the zero bytes of x*/
+    uint64_t x;
+    memcpy(&x, b->tags, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = __builtin_bswap64(x);
+#endif
+    x ^= 0x0101010101010101ull * tag;
+    uint64_t y = (x & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full;
+    y          = ~(y | x | 0x7F7F7F7F7F7F7F7Full);
+    /*gather bit 7 of every byte into the top byte*/
+    return (unsigned)(((y >> 7) * 0x0102040810204080ull) >> 56) &
+           FPD_WAYS_MASK;
+#endif
+}
+
+/**
+ * Find the fingerprint in a bucket pair and refresh its generation if found.
+ * Tags of both buckets are matched before any branch, so a hit in either
+ * bucket costs the same without misprediction.
+ */
+static inline bool _fpd_find(FpDedup *fpd, FpBucket *pair, uint8_t tag,
+                             uint64_t fp) {
+    unsigned mask = _fpd_match(&pair[0], tag) | _fpd_match(&pair[1], tag) << 8;
+
+    while (mask) {
+        unsigned  i = CTZ32(mask);
+        FpBucket *b = &pair[i >> 3];
+        if (((b->fps[i & 7] ^ fp) & ~FPD_GEN_MASK) == 0) {
+            b->fps[i & 7] = fp | fpd->gen;
+            return true;
+        }
+        mask &= mask - 1;
+    }
+
+    return false;
+}
+
+/**
+ * @return index of the oldest slot and its age.
+ */
+static unsigned _fpd_oldest(const FpDedup *fpd, const FpBucket *b,
+                            unsigned *age) {
+    unsigned oldest = 0;
+
+    *age = 0;
+    for (unsigned i = 0; i < FPD_WAYS; i++) {
+        unsigned a = (uint8_t)(fpd->gen - (uint8_t)b->fps[i]);
+        if (a >= *age) {
+            *age   = a;
+            oldest = i;
+        }
+    }
+
+    return oldest;
+}
+
+bool fpdedup_is_dup(FpDedup *fpd, uint64_t hash) {
+    /*upper bits for bucket, next 8 bits for tag and all for fingerprint*/
+    uint64_t  idx  = ((hash >> 32) * fpd->bucket_count) >> 32;
+    uint8_t   tag  = (uint8_t)(hash >> 24);
+    uint64_t  fp   = (hash * 0x9E3779B97F4A7C15ull) & ~FPD_GEN_MASK;
+    FpBucket *home = &fpd->buckets[idx];
+    FpBucket *next = &fpd->buckets[idx ^ 1];
+
+    /*0 is for empty slots*/
+    tag += !tag;
+
+    if (_fpd_find(fpd, &fpd->buckets[idx & ~1ull], tag, fp))
+        return true;
+
+    /*insert into an empty slot or the oldest one of bucket pair*/
+    FpBucket *b;
+    unsigned  i;
+    unsigned  empty;
+    if ((empty = _fpd_match(home, 0))) {
+        b = home;
+        i = CTZ32(empty);
+    } else if ((empty = _fpd_match(next, 0))) {
+        b = next;
+        i = CTZ32(empty);
+    } else {
+        unsigned age_home, age_next;
+        unsigned i_home = _fpd_oldest(fpd, home, &age_home);
+        unsigned i_next = _fpd_oldest(fpd, next, &age_next);
+        if (age_home >= age_next) {
+            b = home;
+            i = i_home;
+        } else {
+            b = next;
+            i = i_next;
+        }
+    }
+
+    b->tags[i] = tag;
+    b->fps[i]  = fp | fpd->gen;
+
+    if (--fpd->gen_left == 0) {
+        fpd->gen++;
+        fpd->gen_left = fpd->gen_period;
+    }
+
+    return false;
+}
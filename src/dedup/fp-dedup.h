@@ -0,0 +1,49 @@
+/*
+ Fixed-memory dedup table of fingerprints
+
+ Both cachehash(Judy) and the table from masscan keep the whole tuple of a
+ result and chase pointers or scan wide buckets for every lookup. This table
+ keeps only a 64-bit hash of the tuple:
+
+ - A bucket is one cache line with FPD_WAYS 8-bit tags and FPD_WAYS
+   fingerprints. Tags of a bucket are compared at once by SIMD(SSE2/NEON or
+   SWAR), so only fingerprints with the same tag are touched.
+ - A key could live in its home bucket or the neighbor one of the same
+   128-byte pair, so the table is still fine near full load.
+ - The low 8 bits of a fingerprint are the generation when it was last seen.
+   Generation increases every 1/FPD_GEN_SPLIT of capacity inserts, and the
+   oldest entry of the two buckets is evicted if both are full. This is
+   close to LRU with dedup window of the capacity.
+
+ Memory is about 10.5 bytes per entry of dedup window whatever the IP version.
+ False duplicates need two different tuples to share 56 bits of fingerprint
+ in the same bucket pair, it's negligible.
+ */
+#ifndef FP_DEDUP_H
+#define FP_DEDUP_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FPD_WAYS      7
+#define FPD_GEN_SPLIT 64
+
+typedef struct FingerprintDedup FpDedup;
+
+FpDedup *fpdedup_create(unsigned dedup_win);
+
+/**
+ * Create the table in a mapped snapshot file, see dedup-file.h.
+ * @return NULL if failed.
+ */
+FpDedup *fpdedup_open(unsigned dedup_win, const char *filename,
+                      uint64_t sharding);
+
+void fpdedup_destroy(FpDedup *fpd);
+
+/**
+ * Check and record a tuple by its 64-bit hash.
+ * @return true if it was seen in dedup window.
+ */
+bool fpdedup_is_dup(FpDedup *fpd, uint64_t hash);
+
+#endif
@@ -6,21 +6,24 @@
 #include "../target/target-set.h"
 #include "../target/target-rangev4.h"
 #include "../target/target-rangev6.h"
+#include "../target/target-trie.h"
 #include "../crypto/crypto-blackrock.h"
 
 Generator AddrStreamGen;
 
 struct AddrStreamConf {
-    FILE     *fp;
-    uint64_t  seed;
-    TargetSet targets;
-    uint64_t  index;
-    uint64_t  range_all;
-    BlackRock br_table;
-    unsigned  rounds;
-    char      splitter[10];
-    size_t    splitter_len;
-    unsigned  no_random : 1;
+    FILE       *fp;
+    uint64_t    seed;
+    TargetSet   targets;
+    /*trie of --exclude to filter the stream*/
+    TargetTrie *exclude;
+    uint64_t    index;
+    uint64_t    range_all;
+    BlackRock   br_table;
+    unsigned    rounds;
+    char        splitter[10];
+    size_t      splitter_len;
+    unsigned    no_random : 1;
 };
 
 static struct AddrStreamConf addrstream_conf = {0};
@@ -121,6 +124,10 @@ bool addrstream_init(const XConf *xconf, uint64_t *count_targets,
 
     addrstream_conf.seed = xconf->seed;
 
+    if (targetset_has_any_ipv4(&xconf->exclude) ||
+        targetset_has_any_ipv6(&xconf->exclude))
+        addrstream_conf.exclude = targettrie_create(&xconf->exclude);
+
     return true;
 }
 
@@ -170,6 +177,15 @@ bool addrstream_hasmore(unsigned tx_index, uint64_t index) {
             continue;
         }
 
+        if (addrstream_conf.exclude) {
+            targettrie_filter(addrstream_conf.exclude, cur_tgt);
+            if (!targetset_has_any_ipv4(cur_tgt) &&
+                !targetset_has_any_ipv6(cur_tgt)) {
+                LOG(LEVEL_DEBUG, "(stream generator) excluded: %s\n", s);
+                continue;
+            }
+        }
+
         err = targetset_add_port_string(cur_tgt, port_str, 0);
         if (err) {
             sub[0] = addrstream_conf.splitter[0];
@@ -208,24 +224,15 @@ bool addrstream_hasmore(unsigned tx_index, uint64_t index) {
     return true;
 }
 
-Target addrstream_generate(unsigned tx_index, uint64_t index, uint64_t repeat,
-                           struct source_t *src) {
+/**
+ * Pick up target & source by shuffled index xXx.
+ */
+static inline Target _addrstream_pick(uint64_t xXx, uint64_t index,
+                                      uint64_t repeat, struct source_t *src) {
     Target     target;
     TargetSet *cur_tgt = &addrstream_conf.targets;
-    uint64_t   xXx     = addrstream_conf.index;
     uint64_t   ck;
 
-    /*Actually it is impossible*/
-    while (xXx >= addrstream_conf.range_all) {
-        xXx -= addrstream_conf.range_all;
-    }
-
-    if (!addrstream_conf.no_random)
-        xXx = blackrock1_shuffle(&addrstream_conf.br_table, xXx);
-
-    /**
-     * Pick up target & source
-     */
     if (xXx < cur_tgt->ipv4_threshold) {
         target.ip_them.version = 4;
         target.ip_me.version   = 4;
@@ -274,9 +281,47 @@ Target addrstream_generate(unsigned tx_index, uint64_t index, uint64_t repeat,
      */
     target.ip_proto = get_actual_proto_port(&target.port_them);
 
+    return target;
+}
+
+Target addrstream_generate(unsigned tx_index, uint64_t index, uint64_t repeat,
+                           struct source_t *src) {
+    uint64_t xXx = addrstream_conf.index;
+
+    /*Actually it is impossible*/
+    while (xXx >= addrstream_conf.range_all) {
+        xXx -= addrstream_conf.range_all;
+    }
+
+    if (!addrstream_conf.no_random)
+        xXx = blackrock1_shuffle(&addrstream_conf.br_table, xXx);
+
     addrstream_conf.index++;
 
-    return target;
+    return _addrstream_pick(xXx, index, repeat, src);
+}
+
+/**
+ * Generate targets of current range in batch, it stops at the end of range
+ * and next range would be read by hasmore.
+ */
+unsigned addrstream_generate_batch(unsigned tx_index, uint64_t start,
+                                   uint64_t increment, unsigned count,
+                                   uint64_t repeat, struct source_t *src,
+                                   Target *out) {
+    unsigned n;
+
+    for (n = 0; n < count && addrstream_conf.index < addrstream_conf.range_all;
+         n++) {
+        uint64_t xXx = addrstream_conf.index++;
+
+        if (!addrstream_conf.no_random)
+            xXx = blackrock1_shuffle(&addrstream_conf.br_table, xXx);
+
+        out[n] = _addrstream_pick(xXx, start + n * increment, repeat, src);
+    }
+
+    return n;
 }
 
 void addrstream_close() {
@@ -284,6 +329,9 @@ void addrstream_close() {
         fclose(addrstream_conf.fp);
     }
     addrstream_conf.fp = NULL;
+
+    targettrie_destroy(addrstream_conf.exclude);
+    addrstream_conf.exclude = NULL;
 }
 
 Generator AddrStreamGen = {
@@ -297,10 +345,12 @@ Generator AddrStreamGen = {
             "AddrStream will do random picking by blackrock algorithm.\n"
             "NOTE: AddrStream will blocking the tx thread while waiting the "
             "stream to be readable, this would break the rule of scan rate. "
-            "However, the scan rate won't exceed the configured value.",
-
-    .init_cb     = &addrstream_init,
-    .hasmore_cb  = &addrstream_hasmore,
-    .generate_cb = &addrstream_generate,
-    .close_cb    = &addrstream_close,
+            "However, the scan rate won't exceed the configured value.\n"
+            "NOTE: Addresses in --exclude are filtered out of the stream.",
+
+    .init_cb           = &addrstream_init,
+    .hasmore_cb        = &addrstream_hasmore,
+    .generate_cb       = &addrstream_generate,
+    .generate_batch_cb = &addrstream_generate_batch,
+    .close_cb          = &addrstream_close,
 };
\ No newline at end of file
@@ -132,22 +132,14 @@ bool blackrock_hasmore(unsigned tx_index, uint64_t index) {
     return false;
 }
 
-Target blackrock_generate(unsigned tx_index, uint64_t index, uint64_t repeat,
-                          struct source_t *src) {
+/**
+ * Pick up target & source by shuffled index xXx.
+ */
+static inline Target _blackrock_pick(uint64_t xXx, uint64_t index,
+                                     uint64_t repeat, struct source_t *src) {
     Target   target;
-    uint64_t xXx = index;
     uint64_t ck;
 
-    while (xXx >= blackrock_conf.range_all) {
-        xXx -= blackrock_conf.range_all;
-    }
-
-    if (!blackrock_conf.no_random)
-        xXx = blackrock1_shuffle(&blackrock_conf.br_table, xXx);
-
-    /**
-     * Pick up target & source
-     */
     if (xXx < blackrock_conf.range_ipv6) {
         target.ip_them.version = 6;
         target.ip_me.version   = 6;
@@ -199,6 +191,50 @@ Target blackrock_generate(unsigned tx_index, uint64_t index, uint64_t repeat,
     return target;
 }
 
+Target blackrock_generate(unsigned tx_index, uint64_t index, uint64_t repeat,
+                          struct source_t *src) {
+    uint64_t xXx = index;
+
+    while (xXx >= blackrock_conf.range_all) {
+        xXx -= blackrock_conf.range_all;
+    }
+
+    if (!blackrock_conf.no_random)
+        xXx = blackrock1_shuffle(&blackrock_conf.br_table, xXx);
+
+    return _blackrock_pick(xXx, index, repeat, src);
+}
+
+/**
+ * Shuffle all indexes of the batch first and then pick up targets, so both
+ * loops are tight and free of range checking.
+ */
+unsigned blackrock_generate_batch(unsigned tx_index, uint64_t start,
+                                  uint64_t increment, unsigned count,
+                                  uint64_t repeat, struct source_t *src,
+                                  Target *out) {
+    uint64_t xXx[GENERATE_BATCH_MAX];
+    unsigned n;
+
+    /*the same as hasmore*/
+    if (start >= blackrock_conf.range_all)
+        return 0;
+    n = (unsigned)((blackrock_conf.range_all - start - 1) / increment + 1);
+    if (n > count)
+        n = count;
+
+    for (unsigned k = 0; k < n; k++)
+        xXx[k] = start + k * increment;
+
+    if (!blackrock_conf.no_random)
+        blackrock1_shuffle_batch(&blackrock_conf.br_table, xXx, n);
+
+    for (unsigned k = 0; k < n; k++)
+        out[k] = _blackrock_pick(xXx[k], start + k * increment, repeat, src);
+
+    return n;
+}
+
 Generator BlackRockGen = {
     .name       = "blackrock",
     .params     = blackrock_parameters,
@@ -219,8 +255,9 @@ Generator BlackRockGen = {
         "NOTE2: BlackRock generates targets in product of ip*port. So it cannot"
         " keep any relation between ip and port.",
 
-    .init_cb     = &blackrock_init,
-    .hasmore_cb  = &blackrock_hasmore,
-    .generate_cb = &blackrock_generate,
-    .close_cb    = &generate_close_nothing,
+    .init_cb           = &blackrock_init,
+    .hasmore_cb        = &blackrock_hasmore,
+    .generate_cb       = &blackrock_generate,
+    .generate_batch_cb = &blackrock_generate_batch,
+    .close_cb          = &generate_close_nothing,
 };
\ No newline at end of file
@@ -27,6 +27,9 @@
 
 typedef struct XtateConf XConf;
 
+/*max count of targets in a batch of `generate_batch` func*/
+#define GENERATE_BATCH_MAX 256
+
 struct source_t;
 
 /**
@@ -92,6 +95,33 @@ typedef Target (*generate_modules_generate)(unsigned tx_index, uint64_t index,
                                             uint64_t         repeat,
                                             struct source_t *src);
 
+/**
+ * !Optional.
+ * !Must be thread safe for itself.
+ * !Happens in Tx Threads.
+ *
+ * Generate targets for indexes start, start+increment, start+2*increment...
+ * in a batch. So that tx thread could generate, template and send targets in
+ * tight loops without calling `generate` func for every target.
+ * Generating stops early if generator has no more target for an index, as if
+ * `hasmore` func returned false. Tx thread will call `hasmore` func before
+ * every batch as before calling `generate` func.
+ * NOTE: Targets must be same as those from `generate` func of same indexes.
+ *
+ * @param tx_index index of tx thread
+ * @param start index of the first target
+ * @param increment step of indexes between targets
+ * @param count max count of targets to generate, not more than
+ * GENERATE_BATCH_MAX
+ * @param repeat current repeat count
+ * @param src info of source ip and port setting
+ * @param out room for count targets
+ * @return count of targets generated, could be less than count.
+ */
+typedef unsigned (*generate_modules_generate_batch)(
+    unsigned tx_index, uint64_t start, uint64_t increment, unsigned count,
+    uint64_t repeat, struct source_t *src, Target *out);
+
 /**
  * !Must be implemented.
  * !Happens in Main Thread.
@@ -109,6 +139,9 @@ typedef struct GenerateModule {
     generate_modules_hasmore  hasmore_cb;
     generate_modules_generate generate_cb;
     generate_modules_close    close_cb;
+
+    /*optional*/
+    generate_modules_generate_batch generate_batch_cb;
 } Generator;
 
 Generator *get_generate_module_by_name(const char *name);
@@ -6,19 +6,22 @@
 #include "../target/target-set.h"
 #include "../target/target-rangev4.h"
 #include "../target/target-rangev6.h"
+#include "../target/target-trie.h"
 #include "../crypto/crypto-blackrock.h"
 
 Generator IpStreamGen;
 
 struct IpStreamConf {
-    FILE     *fp;
-    uint64_t  seed;
-    TargetSet targets;
-    uint64_t  index;
-    uint64_t  range_all;
-    BlackRock br_table;
-    unsigned  rounds;
-    unsigned  no_random : 1;
+    FILE       *fp;
+    uint64_t    seed;
+    TargetSet   targets;
+    /*trie of --exclude to filter the stream*/
+    TargetTrie *exclude;
+    uint64_t    index;
+    uint64_t    range_all;
+    BlackRock   br_table;
+    unsigned    rounds;
+    unsigned    no_random : 1;
 };
 
 static struct IpStreamConf ipstream_conf = {0};
@@ -129,6 +132,10 @@ bool ipstream_init(const XConf *xconf, uint64_t *count_targets,
 
     ipstream_conf.seed = xconf->seed;
 
+    if (targetset_has_any_ipv4(&xconf->exclude) ||
+        targetset_has_any_ipv6(&xconf->exclude))
+        ipstream_conf.exclude = targettrie_create(&xconf->exclude);
+
     return true;
 }
 
@@ -164,8 +171,17 @@ bool ipstream_hasmore(unsigned tx_index, uint64_t index) {
             LOG(LEVEL_ERROR, "(stream generator) invalid ip in address: %s",
                 line);
             continue;
-        } else
-            break;
+        }
+
+        if (ipstream_conf.exclude) {
+            targettrie_filter(ipstream_conf.exclude, cur_tgt);
+            if (!targetset_has_any_ipv4(cur_tgt) &&
+                !targetset_has_any_ipv6(cur_tgt)) {
+                LOG(LEVEL_DEBUG, "(stream generator) excluded: %s", line);
+                continue;
+            }
+        }
+        break;
     }
 
     /*update relevant info*/
@@ -187,24 +203,15 @@ bool ipstream_hasmore(unsigned tx_index, uint64_t index) {
     return true;
 }
 
-Target ipstream_generate(unsigned tx_index, uint64_t index, uint64_t repeat,
-                         struct source_t *src) {
+/**
+ * Pick up target & source by shuffled index xXx.
+ */
+static inline Target _ipstream_pick(uint64_t xXx, uint64_t index,
+                                    uint64_t repeat, struct source_t *src) {
     Target     target;
     TargetSet *cur_tgt = &ipstream_conf.targets;
-    uint64_t   xXx     = ipstream_conf.index;
     uint64_t   ck;
 
-    /*Actually it is impossible*/
-    while (xXx >= ipstream_conf.range_all) {
-        xXx -= ipstream_conf.range_all;
-    }
-
-    if (!ipstream_conf.no_random)
-        xXx = blackrock1_shuffle(&ipstream_conf.br_table, xXx);
-
-    /**
-     * Pick up target & source
-     */
     if (xXx < cur_tgt->ipv4_threshold) {
         target.ip_them.version = 4;
         target.ip_me.version   = 4;
@@ -253,9 +260,47 @@ Target ipstream_generate(unsigned tx_index, uint64_t index, uint64_t repeat,
      */
     target.ip_proto = get_actual_proto_port(&target.port_them);
 
+    return target;
+}
+
+Target ipstream_generate(unsigned tx_index, uint64_t index, uint64_t repeat,
+                         struct source_t *src) {
+    uint64_t xXx = ipstream_conf.index;
+
+    /*Actually it is impossible*/
+    while (xXx >= ipstream_conf.range_all) {
+        xXx -= ipstream_conf.range_all;
+    }
+
+    if (!ipstream_conf.no_random)
+        xXx = blackrock1_shuffle(&ipstream_conf.br_table, xXx);
+
     ipstream_conf.index++;
 
-    return target;
+    return _ipstream_pick(xXx, index, repeat, src);
+}
+
+/**
+ * Generate targets of current range in batch, it stops at the end of range
+ * and next range would be read by hasmore.
+ */
+unsigned ipstream_generate_batch(unsigned tx_index, uint64_t start,
+                                 uint64_t increment, unsigned count,
+                                 uint64_t repeat, struct source_t *src,
+                                 Target *out) {
+    unsigned n;
+
+    for (n = 0; n < count && ipstream_conf.index < ipstream_conf.range_all;
+         n++) {
+        uint64_t xXx = ipstream_conf.index++;
+
+        if (!ipstream_conf.no_random)
+            xXx = blackrock1_shuffle(&ipstream_conf.br_table, xXx);
+
+        out[n] = _ipstream_pick(xXx, start + n * increment, repeat, src);
+    }
+
+    return n;
 }
 
 void ipstream_close() {
@@ -263,6 +308,9 @@ void ipstream_close() {
         fclose(ipstream_conf.fp);
     }
     ipstream_conf.fp = NULL;
+
+    targettrie_destroy(ipstream_conf.exclude);
+    ipstream_conf.exclude = NULL;
 }
 
 Generator IpStreamGen = {
@@ -277,10 +325,12 @@ Generator IpStreamGen = {
             "picking with port by blackrock algorithm.\n"
             "NOTE: IpStream will blocking the tx thread while waiting the "
             "stream to be readable, this would break the rule of scan rate. "
-            "However, the scan rate won't exceed the configured value.",
-
-    .init_cb     = &ipstream_init,
-    .hasmore_cb  = &ipstream_hasmore,
-    .generate_cb = &ipstream_generate,
-    .close_cb    = &ipstream_close,
+            "However, the scan rate won't exceed the configured value.\n"
+            "NOTE: Addresses in --exclude are filtered out of the stream.",
+
+    .init_cb           = &ipstream_init,
+    .hasmore_cb        = &ipstream_hasmore,
+    .generate_cb       = &ipstream_generate,
+    .generate_batch_cb = &ipstream_generate_batch,
+    .close_cb          = &ipstream_close,
 };
\ No newline at end of file
@@ -26,6 +26,9 @@
 
 #include "util-scan/initadapter.h"
 #include "util-scan/listtargets.h"
+#include "util-scan/rate-control.h"
+
+#include "util-misc/checksum.h"
 
 #include "util-out/logger.h"
 #include "util-out/xtatus.h"
@@ -56,6 +59,10 @@ unsigned volatile time_to_finish_rx = 0;
  * Use this if you need rough and not accurate current time.
  */
 time_t   global_now;
+/*
+ * Newest round of --repeat started by tx threads.
+ */
+unsigned volatile global_round = 0;
 /**
  * This is for some wrappered functions that use TemplateSet to create packets.
  * !Do not modify it unless u know what u are doing.
@@ -103,21 +110,23 @@ static int _main_scan(XConf *xconf) {
      * This is more efficient to got an all-zero var than memset and could got
      * a partial-zero var conveniently.
      */
-    bool       stop_tx         = true;
-    uint64_t   count_targets   = 0;
-    uint64_t   count_endpoints = 0;
-    uint64_t   scan_range      = 0;
-    bool       init_ipv4       = false;
-    bool       init_ipv6       = false;
-    time_t     now             = time(0);
-    TmplSet    tmplset         = {0};
-    Xtatus     status          = {.last = {0}};
-    XtatusItem status_item     = {0};
-    RxThread   rx_thread[1]    = {{0}};
-    TxThread  *tx_thread;
-    double     tx_free_entries;
-    double     rx_free_entries;
-    double     rx_queue_ratio_tmp;
+    bool        stop_tx         = true;
+    uint64_t    count_targets   = 0;
+    uint64_t    count_endpoints = 0;
+    uint64_t    scan_range      = 0;
+    bool        init_ipv4       = false;
+    bool        init_ipv6       = false;
+    time_t      now             = time(0);
+    TmplSet     tmplset         = {0};
+    Xtatus      status          = {.last = {0}};
+    XtatusItem  status_item     = {0};
+    RxThread    rx_thread[1]    = {{0}};
+    TxThread   *tx_thread;
+    RateBucket  rate_bucket;
+    RateControl rate_ctrl;
+    double      tx_free_entries;
+    double      rx_free_entries;
+    double      rx_queue_ratio_tmp;
 
     tx_thread = CALLOC(xconf->tx_thread_count, sizeof(TxThread));
 
@@ -197,6 +206,31 @@ static int _main_scan(XConf *xconf) {
      */
     targetset_optimize(&xconf->targets);
 
+    /*
+     * Put threads and memory on the NUMA node of the adapter. Memory policy
+     * is inherited by threads, so it covers rings of the adapter and
+     * everything allocated from now on. Main thread runs on the node while
+     * creating them and workers are bound to cpus of the node later.
+     */
+    if (!xconf->is_no_cpu_bind) {
+        char ifname[256];
+        int  node = xconf->numa_node;
+        if (node == XCONF_DFT_NUMA_NODE &&
+            initialize_adapter_name(xconf, ifname, sizeof(ifname)) == 0)
+            node = rawsock_get_adapter_numa(ifname);
+        if (node >= 0) {
+            int count = pixie_numa_get_cpus(node, xconf->numa_cpus,
+                                            XCONF_MAX_CPU_MAP);
+            xconf->numa_cpu_count = count > 0 ? (unsigned)count : 0;
+            pixie_numa_prefer_node(node);
+            if (xconf->numa_cpu_count && pixie_cpu_get_count() > 1)
+                pixie_cpu_set_affinity_list(xconf->numa_cpus,
+                                            xconf->numa_cpu_count);
+            LOG(LEVEL_DETAIL, "(numa) use node %d with %u cpus\n", node,
+                xconf->numa_cpu_count);
+        }
+    }
+
     if (initialize_adapter(xconf, init_ipv4, init_ipv6) != 0)
         exit(1);
     if (!xconf->nic.is_usable) {
@@ -222,13 +256,14 @@ static int _main_scan(XConf *xconf) {
      * create callback queue
      */
     xconf->stack = stack_create(xconf->nic.source_mac, &xconf->nic.src,
-                                xconf->stack_buf_count);
+                                xconf->stack_buf_count, xconf->idle_spin_usec);
 
     /*
      * create fast-timeout table
      */
     if (xconf->is_fast_timeout) {
-        xconf->ft_table = ft_init_table(xconf->ft_spec);
+        xconf->ft_table =
+            ft_init_table(xconf->ft_spec_ms, sizeof(ScanTmEvent));
     }
 
     /*
@@ -323,6 +358,14 @@ static int _main_scan(XConf *xconf) {
     /*
      * Prepare for tx threads
      */
+    throttler_bucket_init(&rate_bucket, xconf->max_rate,
+                          xconf->is_pacing ? xconf->pacing_burst : 0);
+    if (xconf->is_adaptive_rate) {
+        rate_control_init(&rate_ctrl,
+                          xconf->min_rate > 0 ? xconf->min_rate
+                                              : xconf->max_rate / 100.0,
+                          xconf->max_rate, pixie_gettime());
+    }
     for (unsigned index = 0; index < xconf->tx_thread_count; index++) {
         TxThread *parms           = &tx_thread[index];
         parms->xconf              = xconf;
@@ -330,6 +373,7 @@ static int _main_scan(XConf *xconf) {
         parms->my_index           = xconf->resume.index;
         parms->done_transmitting  = false;
         parms->thread_handle_xmit = 0;
+        parms->rate_bucket        = &rate_bucket;
     }
     /*
      * Prepare for rx thread
@@ -405,6 +449,7 @@ static int _main_scan(XConf *xconf) {
     status.print_queue    = xconf->is_status_queue;
     status.print_info_num = xconf->is_status_info_num;
     status.print_hit_rate = xconf->is_status_hit_rate;
+    status.print_jitter   = xconf->is_pacing;
     status.is_infinite    = xconf->is_infinite;
     status.no_ansi        = xconf->is_no_ansi;
 
@@ -420,6 +465,7 @@ static int _main_scan(XConf *xconf) {
         /* Find the min-index, repeat and rate */
         status_item.total_sent   = 0;
         status_item.cur_pps      = 0.0;
+        status_item.jitter       = 0.0;
         status_item.cur_count    = UINT64_MAX;
         status_item.repeat_count = UINT64_MAX;
         stop_tx                  = true;
@@ -433,9 +479,12 @@ static int _main_scan(XConf *xconf) {
                 status_item.repeat_count = parms->my_repeat;
 
             status_item.cur_pps += parms->throttler->current_rate;
+            status_item.jitter += parms->throttler->current_jitter /
+                                  xconf->tx_thread_count;
             status_item.total_sent += parms->total_sent;
 
-            stop_tx &= (!xconf->generator->hasmore_cb(i, parms->my_index));
+            stop_tx &= (!parms->has_pending &&
+                        !xconf->generator->hasmore_cb(i, parms->my_index));
         }
 
         /**
@@ -485,6 +534,25 @@ static int _main_scan(XConf *xconf) {
         status_item.max_count       = scan_range;
         status_item.print_in_json   = xconf->is_status_ndjson;
 
+        /**
+         * Adjust the rate by congestion signals
+         */
+        if (xconf->is_adaptive_rate) {
+            RateSignals sig = {
+                .rx_drops        = rawsock_get_drops(xconf->nic.adapter),
+                .dispatch_full   = rx_thread->total_dispatch_full,
+                .rx_queue_ratio  = status_item.rx_queue_ratio,
+                .tx_queue_ratio  = status_item.tx_queue_ratio,
+                .total_sent      = status_item.total_sent,
+                .total_responsed = status_item.total_successed +
+                                   status_item.total_failed +
+                                   status_item.total_info,
+            };
+            throttler_bucket_set_rate(
+                &rate_bucket,
+                rate_control_update(&rate_ctrl, &sig, pixie_gettime()));
+        }
+
         if (!xconf->is_no_status)
             xtatus_print(&status, &status_item);
 
@@ -514,6 +582,7 @@ static int _main_scan(XConf *xconf) {
         /* Find the min-index, repeat and rate */
         status_item.total_sent   = 0;
         status_item.cur_pps      = 0.0;
+        status_item.jitter       = 0.0;
         status_item.cur_count    = UINT64_MAX;
         status_item.repeat_count = UINT64_MAX;
         for (unsigned i = 0; i < xconf->tx_thread_count; i++) {
@@ -526,6 +595,8 @@ static int _main_scan(XConf *xconf) {
                 status_item.repeat_count = parms->my_repeat;
 
             status_item.cur_pps += parms->throttler->current_rate;
+            status_item.jitter += parms->throttler->current_jitter /
+                                  xconf->tx_thread_count;
             status_item.total_sent += parms->total_sent;
         }
 
@@ -616,6 +687,8 @@ static int _main_scan(XConf *xconf) {
         xconf->ft_table = NULL;
     }
 
+    template_packet_close(xconf->tmplset);
+
     rawsock_close_adapter(xconf->nic.adapter);
 
     LOG(LEVEL_INFO, "all threads exited...\n");
@@ -651,8 +724,12 @@ int main(int argc, char *argv[]) {
     if (is_backtrace)
         pixie_backtrace_init(argv[0]);
 
+    /* select checksum kernels before selftests or any thread */
+    checksum_init();
+
     //=================================================Define default params
     xconf->tx_thread_count    = XCONF_DFT_TX_THD_COUNT;
+    xconf->rx_thread_count    = XCONF_DFT_RX_THD_COUNT;
     xconf->rx_handler_count   = XCONF_DFT_RX_HDL_COUNT;
     xconf->stack_buf_count    = XCONF_DFT_STACK_BUF_COUNT;
     xconf->dispatch_buf_count = XCONF_DFT_DISPATCH_BUF_COUNT;
@@ -660,10 +737,22 @@ int main(int argc, char *argv[]) {
     xconf->dedup_win          = XCONF_DFT_DEDUP_WIN;
     xconf->shard.one          = XCONF_DFT_SHARD_ONE;
     xconf->shard.of           = XCONF_DFT_SHARD_OF;
-    xconf->ft_spec            = XCONF_DFT_FT_SPEC;
+    xconf->ft_spec_ms         = XCONF_DFT_FT_SPEC * 1000;
     xconf->wait               = XCONF_DFT_WAIT;
     xconf->nic.snaplen        = XCONF_DFT_SNAPLEN;
     xconf->max_packet_len     = XCONF_DFT_MAX_PKT_LEN;
+    xconf->idle_spin_usec     = XCONF_DFT_IDLE_SPIN_USEC;
+    xconf->pacing_burst       = XCONF_DFT_PACING_BURST;
+    xconf->prefix_v4_len      = XCONF_DFT_PREFIX_V4_LEN;
+    xconf->prefix_v6_len      = XCONF_DFT_PREFIX_V6_LEN;
+    xconf->numa_node          = XCONF_DFT_NUMA_NODE;
+
+    xconf->afp_opt.block_size     = XCONF_DFT_AFP_BLOCK_SIZE;
+    xconf->afp_opt.block_count    = XCONF_DFT_AFP_BLOCK_COUNT;
+    xconf->afp_opt.block_timeout  = XCONF_DFT_AFP_BLOCK_TIMEOUT;
+    xconf->afp_opt.tx_frame_count = XCONF_DFT_AFP_TX_FRAME_COUNT;
+    xconf->xdp_opt.queue_count    = XCONF_DFT_XDP_QUEUE_COUNT;
+    xconf->xdp_opt.frame_count    = XCONF_DFT_XDP_FRAME_COUNT;
 
     xconf_command_line(xconf, argc, argv);
 
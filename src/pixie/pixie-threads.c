@@ -14,6 +14,18 @@
 #include <errno.h>
 #endif
 
+#if defined(__linux__)
+#include <limits.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+#endif
+
+#if defined(_MSC_VER)
+#pragma comment(lib, "Synchronization.lib")
+#endif
+
 #if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) ||       \
     defined(__OpenBSD__)
 #include <sys/types.h>
@@ -33,6 +45,7 @@
 #include <inttypes.h>
 
 #include "../util-out/logger.h"
+#include "pixie-timer.h"
 
 /****************************************************************************
  ****************************************************************************/
@@ -101,6 +114,32 @@ void pixie_cpu_set_affinity(unsigned processor) {
 #endif
 }
 
+/****************************************************************************
+ * Set the current thread (implicit) to run on any of the explicit processors,
+ * e.g. all cpus of a NUMA node.
+ ****************************************************************************/
+void pixie_cpu_set_affinity_list(const unsigned *cpus, unsigned count) {
+#if defined(__linux__) && defined(__GNUC__) && !defined(__TERMUX__)
+    int       x;
+    pthread_t thread = pthread_self();
+    cpu_set_t cpuset;
+
+    CPU_ZERO(&cpuset);
+    for (unsigned i = 0; i < count; i++) {
+        if (cpus[i] < CPU_SETSIZE)
+            CPU_SET(cpus[i], &cpuset);
+    }
+
+    x = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
+    if (x != 0) {
+        LOG(LEVEL_ERROR, "(set_affinity) returned error linux:%d\n", errno);
+    }
+#else
+    UNUSEDPARM(cpus);
+    UNUSEDPARM(count);
+#endif
+}
+
 /****************************************************************************
  ****************************************************************************/
 unsigned pixie_cpu_get_count(void) {
@@ -189,6 +228,111 @@ unsigned pixie_cpu_get_count(void) {
 #endif
 }
 
+/****************************************************************************
+ * Same format as Linux cpulist and taskset -c, e.g. "0-3,8,10-11".
+ ****************************************************************************/
+int pixie_cpu_parse_list(const char *str, unsigned *cpus, unsigned max) {
+    unsigned count = 0;
+    char    *end;
+
+    while (*str) {
+        unsigned long first, last;
+
+        while (*str == ' ' || *str == '\t' || *str == '\n')
+            str++;
+        if (*str == '\0')
+            break;
+
+        if (*str < '0' || *str > '9')
+            return -1;
+        first = strtoul(str, &end, 10);
+        last  = first;
+        str   = end;
+        if (*str == '-') {
+            str++;
+            if (*str < '0' || *str > '9')
+                return -1;
+            last = strtoul(str, &end, 10);
+            str  = end;
+        }
+        if (last < first)
+            return -1;
+
+        for (unsigned long i = first; i <= last; i++) {
+            if (count >= max)
+                return -1;
+            cpus[count++] = (unsigned)i;
+        }
+
+        while (*str == ' ' || *str == '\t' || *str == '\n')
+            str++;
+        if (*str == ',')
+            str++;
+        else if (*str != '\0')
+            return -1;
+    }
+
+    return (int)count;
+}
+
+/****************************************************************************
+ ****************************************************************************/
+int pixie_numa_get_cpus(unsigned node, unsigned *cpus, unsigned max) {
+#if defined(__linux__)
+    char  path[64];
+    char  line[1024];
+    FILE *fp;
+    int   count = -1;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist",
+             node);
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        LOG(LEVEL_DEBUG, "(numa) no cpulist of node %u\n", node);
+        return -1;
+    }
+    if (fgets(line, sizeof(line), fp))
+        count = pixie_cpu_parse_list(line, cpus, max);
+    fclose(fp);
+
+    return count;
+#else
+    UNUSEDPARM(node);
+    UNUSEDPARM(cpus);
+    UNUSEDPARM(max);
+    return -1;
+#endif
+}
+
+/****************************************************************************
+ * Memory policy of a thread is inherited by threads created after it, so
+ * calling this in main thread before allocating and creating workers makes
+ * rings, pools and tables come from the node. It's just preferred, kernel
+ * would fall back to other nodes if the node is out of memory.
+ ****************************************************************************/
+bool pixie_numa_prefer_node(unsigned node) {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    unsigned long mask[4] = {0};
+
+    if (node >= sizeof(mask) * 8) {
+        LOG(LEVEL_ERROR, "(numa) node %u is out of range\n", node);
+        return false;
+    }
+    mask[node / (sizeof(unsigned long) * 8)] |=
+        1UL << (node % (sizeof(unsigned long) * 8));
+
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8)) {
+        LOGPERROR("set_mempolicy");
+        return false;
+    }
+    return true;
+#else
+    UNUSEDPARM(node);
+    return false;
+#endif
+}
+
 /****************************************************************************
  ****************************************************************************/
 size_t pixie_begin_thread(void (*worker_thread)(void *), unsigned flags,
@@ -465,4 +609,98 @@ bool pixie_delete_mutex(void *p_mutex) {
     FREE(p_mutex);
     return res == 0;
 #endif
-}
\ No newline at end of file
+}
+
+typedef struct PixieWaiter {
+    /*bumped by producers to wake parked consumers*/
+    volatile uint32_t seq;
+    volatile uint32_t sleepers;
+    uint64_t          spin_ns;
+} PixieWaiter;
+
+#if defined(_MSC_VER)
+#define _waiter_pause() YieldProcessor()
+#define _waiter_fence() MemoryBarrier()
+#else
+#define _waiter_pause() rte_pause()
+#define _waiter_fence() __sync_synchronize()
+#endif
+
+/*sleep time while no way to park*/
+#define WAITER_NAP_USEC 100
+
+static void _waiter_park(volatile uint32_t *addr, uint32_t val,
+                         unsigned park_msec) {
+#if defined(__linux__)
+    struct timespec ts = {
+        .tv_sec  = park_msec / 1000,
+        .tv_nsec = (park_msec % 1000) * 1000000L,
+    };
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+#elif defined(WIN32)
+    WaitOnAddress(addr, &val, sizeof(val), park_msec);
+#else
+    UNUSEDPARM(addr);
+    UNUSEDPARM(val);
+    UNUSEDPARM(park_msec);
+    pixie_usleep(WAITER_NAP_USEC);
+#endif
+}
+
+static void _waiter_unpark(volatile uint32_t *addr) {
+#if defined(__linux__)
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#elif defined(WIN32)
+    WakeByAddressAll((PVOID)addr);
+#else
+    UNUSEDPARM(addr);
+#endif
+}
+
+void *pixie_create_waiter(unsigned spin_usec) {
+    PixieWaiter *waiter = CALLOC(1, sizeof(PixieWaiter));
+    waiter->spin_ns     = (uint64_t)spin_usec * 1000ULL;
+    return waiter;
+}
+
+void pixie_wait_waiter(void *p_waiter, unsigned park_msec,
+                       bool (*is_ready)(void *), void *arg) {
+    PixieWaiter *waiter = p_waiter;
+
+    if (waiter->spin_ns) {
+        uint64_t start = pixie_nanotime();
+        do {
+            for (unsigned i = 0; i < 64; i++) {
+                if (is_ready(arg))
+                    return;
+                _waiter_pause();
+            }
+        } while (pixie_nanotime() - start < waiter->spin_ns);
+    }
+
+    /**
+     * Announce parking before checking again. Producers put work before
+     * checking sleepers, so one of us must see the other.
+     */
+    pixie_locked_add_u32(&waiter->sleepers, 1);
+    uint32_t seq = waiter->seq;
+    if (!is_ready(arg))
+        _waiter_park(&waiter->seq, seq, park_msec);
+    pixie_locked_add_u32(&waiter->sleepers, -1);
+}
+
+void pixie_wake_waiter(void *p_waiter) {
+    PixieWaiter *waiter = p_waiter;
+
+    _waiter_fence();
+    if (waiter->sleepers == 0)
+        return;
+
+    pixie_locked_add_u32(&waiter->seq, 1);
+    _waiter_unpark(&waiter->seq);
+}
+
+bool pixie_delete_waiter(void *p_waiter) {
+    FREE(p_waiter);
+    return true;
+}
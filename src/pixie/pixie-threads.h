@@ -16,7 +16,20 @@
  */
 unsigned pixie_cpu_get_count(void);
 void     pixie_cpu_set_affinity(unsigned processor);
+void     pixie_cpu_set_affinity_list(const unsigned *cpus, unsigned count);
 void     pixie_cpu_raise_priority(void);
+/**
+ * Parse cpu list like "0-3,8,10-11" in the format of Linux cpulist.
+ * @return count of cpus got, or -1 if bad format or more than max.
+ */
+int      pixie_cpu_parse_list(const char *str, unsigned *cpus, unsigned max);
+/**
+ * NUMA
+ * Get cpus of the node, or prefer memory of the node for current thread and
+ * threads created after it. Only work on Linux.
+ */
+int      pixie_numa_get_cpus(unsigned node, unsigned *cpus, unsigned max);
+bool     pixie_numa_prefer_node(unsigned node);
 /**
  * Launch and Join
  */
@@ -44,10 +57,28 @@ void    *pixie_create_mutex();
 void     pixie_acquire_mutex(void *p_mutex);
 void     pixie_release_mutex(void *p_mutex);
 bool     pixie_delete_mutex(void *p_mutex);
+/**
+ * waiter
+ * A consumer thread with nothing to do busy-polls for spin_usec, then parks
+ * until a producer wakes it up or park_msec passed. Parking is on futex on
+ * Linux and WaitOnAddress on Windows.
+ * @param is_ready check whether work arrived.
+ */
+void    *pixie_create_waiter(unsigned spin_usec);
+void     pixie_wait_waiter(void *p_waiter, unsigned park_msec,
+                           bool (*is_ready)(void *), void *arg);
+void     pixie_wake_waiter(void *p_waiter);
+bool     pixie_delete_waiter(void *p_waiter);
 
 #if defined(_MSC_VER)
 #define pixie_locked_add_u32(dst, src)                                         \
     _InterlockedExchangeAdd((volatile long *)(dst), (src))
+#define pixie_locked_add_u64(dst, src)                                         \
+    _InterlockedExchangeAdd64((volatile long long *)(dst), (src))
+#define pixie_atomic_load_u64(src)                                             \
+    ((uint64_t)_InterlockedCompareExchange64((volatile long long *)(src), 0, 0))
+#define pixie_atomic_store_u64(dst, val)                                       \
+    _InterlockedExchange64((volatile long long *)(dst), (long long)(val))
 #define pixie_locked_CAS32(dst, src, expected)                                 \
     (_InterlockedCompareExchange((volatile long *)dst, src, expected) ==       \
      (expected))
@@ -61,12 +92,19 @@ bool     pixie_delete_mutex(void *p_mutex);
 #elif defined(__GNUC__)
 #define pixie_locked_add_u32(dst, src)                                         \
     __sync_add_and_fetch((volatile int *)(dst), (int)(src));
+#define pixie_locked_add_u64(dst, src)                                         \
+    __sync_add_and_fetch((volatile uint64_t *)(dst), (uint64_t)(src))
+#define pixie_atomic_load_u64(src)                                             \
+    __atomic_load_n((volatile uint64_t *)(src), __ATOMIC_ACQUIRE)
+#define pixie_atomic_store_u64(dst, val)                                       \
+    __atomic_store_n((volatile uint64_t *)(dst), (uint64_t)(val),              \
+                     __ATOMIC_RELEASE)
 #define pixie_locked_CAS32(dst, src, expected)                                 \
     __sync_bool_compare_and_swap((volatile int *)(dst), (int)expected,         \
-                                 (int)src);
+                                 (int)src)
 #define pixie_locked_CAS64(dst, src, expected)                                 \
     __sync_bool_compare_and_swap((volatile long long int *)(dst),              \
-                                 (long long int)expected, (long long int)src);
+                                 (long long int)expected, (long long int)src)
 #define rte_atomic32_cmpset(dst, expected, src)                                \
     __sync_bool_compare_and_swap((volatile int *)(dst), (int)expected, (int)src)
 
@@ -81,6 +119,9 @@ bool     pixie_delete_mutex(void *p_mutex);
 #endif
 #else
 unsigned pixie_locked_add_u32(volatile unsigned *lhs, unsigned rhs);
+uint64_t pixie_locked_add_u64(volatile uint64_t *lhs, uint64_t rhs);
+uint64_t pixie_atomic_load_u64(volatile uint64_t *src);
+void     pixie_atomic_store_u64(volatile uint64_t *dst, uint64_t val);
 int pixie_locked_CAS32(volatile unsigned *dst, unsigned src, unsigned expected);
 int pixie_locked_CAS64(volatile uint64_t *dst, uint64_t src, uint64_t expected);
 #endif
@@ -1,18 +1,26 @@
 #include "rawsock.h"
 #include "rawsock-adapter.h"
+#include "rawsock-afpacket.h"
+#include "rawsock-afxdp.h"
 #include "../stub/stub-pcap.h"
 #include "../stub/stub-pcap-dlt.h"
 #include "../util-data/fine-malloc.h"
 
 /***************************************************************************
  ***************************************************************************/
-AdapterCache *rawsock_init_cache(bool is_sendq) {
+AdapterCache *rawsock_init_cache(Adapter *adapter, bool is_sendq) {
     AdapterCache *acache = CALLOC(1, sizeof(AdapterCache));
 #if defined(WIN32)
     if (is_sendq) {
         acache->sendq = PCAP.sendqueue_alloc(SENDQ_SIZE);
     }
 #endif
+    if (adapter && adapter->afp) {
+        acache->afp_tx = afpacket_tx_open(adapter->afp);
+    }
+    if (adapter && adapter->xdp) {
+        acache->xsk = afxdp_tx_attach(adapter->xdp);
+    }
     return acache;
 }
 
@@ -21,6 +29,17 @@ void rawsock_close_cache(AdapterCache *acache) {
         PCAP.sendqueue_destroy(acache->sendq);
     }
 
+    if (acache->afp_tx) {
+        afpacket_tx_close(acache->afp_tx);
+        acache->afp_tx = NULL;
+    }
+
+    /*XSK is owned by the adapter*/
+    if (acache->xsk) {
+        afxdp_tx_flush(acache->xsk);
+        acache->xsk = NULL;
+    }
+
     FREE(acache);
 }
 
@@ -4,25 +4,37 @@
 #define SENDQ_SIZE 65536 * 8
 
 typedef struct Adapter {
-    struct pcap     *pcap;
-    struct __pfring *ring;
-    unsigned         is_packet_trace : 1;
-    unsigned         is_vlan         : 1;
-    unsigned         vlan_id;
-    double           pt_start;
-    int              link_type;
+    struct pcap           *pcap;
+    struct __pfring       *ring;
+    struct AFPacketSocket *afp;
+    struct AFXDPContext   *xdp;
+    unsigned               is_packet_trace : 1;
+    unsigned               is_vlan         : 1;
+    unsigned               vlan_id;
+    double                 pt_start;
+    int                    link_type;
+    /*other sockets of the PACKET_FANOUT group for rx threads*/
+    struct Adapter       **fanout_members;
+    unsigned               fanout_count;
 } Adapter;
 
 /**
- * For every Tx thread to maintain its own cache for sendqueue or sendmmsg.
- * This solves the conflict while multiple Tx threads using sendqueue
- * mechanism.
+ * For every Tx thread to maintain its own cache for sendqueue, sendmmsg,
+ * PACKET_TX_RING or XSK.
+ * This solves the conflict while multiple Tx threads using sendqueue or tx
+ * ring mechanism.
  */
 typedef struct Adapter_Cache {
     struct pcap_send_queue *sendq;
+    struct AFPacketTxRing  *afp_tx;
+    struct XskSocket       *xsk;
 } AdapterCache;
 
-AdapterCache *rawsock_init_cache(bool is_sendq);
+/**
+ * @param adapter opened adapter for creating tx ring in AF_PACKET mode or
+ * choosing XSK in AF_XDP mode, could be NULL if no tx ring needed.
+ */
+AdapterCache *rawsock_init_cache(Adapter *adapter, bool is_sendq);
 
 void rawsock_close_cache(AdapterCache *acache);
 
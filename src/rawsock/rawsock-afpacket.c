@@ -0,0 +1,714 @@
+#include "rawsock-afpacket.h"
+#include "../stub/stub-pcap.h"
+#include "../stub/stub-pcap-dlt.h"
+#include "../util-data/safe-string.h"
+#include "../util-data/fine-malloc.h"
+#include "../util-out/logger.h"
+#include "../util-misc/cross.h"
+
+#include <string.h>
+
+unsigned afpacket_fanout_hash(ipaddress ip_them) {
+    uint32_t a = 0;
+
+    if (ip_them.version == 4) {
+        a = ip_them.ipv4;
+    } else if (ip_them.version == 6) {
+        a = (uint32_t)(ip_them.ipv6.hi >> 32) ^ (uint32_t)ip_them.ipv6.hi ^
+            (uint32_t)(ip_them.ipv6.lo >> 32) ^ (uint32_t)ip_them.ipv6.lo;
+    }
+    a ^= a >> 16;
+
+    return a;
+}
+
+/*****************************************************************************
+ *****************************************************************************/
+#if defined(__linux__)
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+#ifndef PACKET_FANOUT_DATA
+#define PACKET_FANOUT_DATA 22
+#endif
+
+#ifndef PACKET_FANOUT_CBPF
+#define PACKET_FANOUT_CBPF 6
+#endif
+
+/**
+ * Frame size is meaningless for variable-length frames of TPACKET_V3, but
+ * kernel still checks it while setting up the ring.
+ */
+#define AFP_FRAME_SIZE 2048
+
+/**
+ * Like the READ_TIMEOUT of pcap in rawsock.c, we just wait a short time if no
+ * block is ready. So that rx thread could do fast-timeout in real time.
+ */
+#define AFP_POLL_TIMEOUT 1
+
+#define AFP_VLAN_TAG_LEN 4
+
+/**
+ * Frames of tx ring are fixed-size and must hold the tpacket2_hdr and the
+ * whole packet. Larger packets go through send() directly.
+ */
+#define AFP_TX_FRAME_SIZE   2048
+#define AFP_TX_DATA_OFFSET  TPACKET_ALIGN(sizeof(struct tpacket2_hdr))
+#define AFP_TX_BLOCK_FRAMES 32
+
+/**
+ * Kick kernel after so many frames were filled. It amortizes the syscall
+ * while keeping the ring not too bursty for NIC.
+ */
+#define AFP_TX_KICK_BATCH 64
+
+struct AFPacketSocket {
+    int                        fd;
+    int                        ifindex;
+    int                        link_type;
+    /*rx ring*/
+    unsigned char             *rx_map;
+    size_t                     rx_map_len;
+    unsigned                   rx_block_size;
+    unsigned                   rx_block_count;
+    /*index of the block we are walking or waiting for*/
+    unsigned                   rx_block_idx;
+    /*block held by us and would be given back to kernel*/
+    struct tpacket_block_desc *rx_held;
+    struct tpacket3_hdr       *rx_next;
+    unsigned                   rx_left;
+    /*frames of tx ring for every tx thread, 0 for no tx ring*/
+    unsigned                   tx_frame_count;
+    /*counter of kernel is reset by reading, so we keep the total*/
+    uint64_t                   drops;
+};
+
+struct AFPacketTxRing {
+    int            fd;
+    unsigned char *map;
+    size_t         map_len;
+    unsigned       frame_count;
+    /*index of next frame to fill*/
+    unsigned       idx;
+    /*frames filled but not kicked*/
+    unsigned       pending;
+};
+
+/**
+ * Classic BPF program selecting the socket in our PACKET_FANOUT group.
+ * It loads source IP from network header and folds it just like
+ * afpacket_fanout_hash. Kernel takes the result modulo count of sockets.
+ * Non-IP packets(ARP, etc.) always go to the first socket.
+ */
+static struct sock_filter _fanout_insns[] = {
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 2),
+    /*ipv4: src ip*/
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+    BPF_JUMP(BPF_JMP | BPF_JA, 11, 0, 0),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IPV6, 0, 14),
+    /*ipv6: xor of 4 words of src ip*/
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 8),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 16),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 20),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    /*fold: a ^= a>>16*/
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+/**
+ * Join the fanout group of this process. All rx sockets on the interface
+ * share the group, so that packets from the same ip_them always go to the
+ * same socket.
+ */
+static int _join_fanout(int fd) {
+    int err;
+    int arg = (getpid() & 0xFFFF) | (PACKET_FANOUT_CBPF << 16);
+
+    err = setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg));
+    if (err) {
+        LOGPERROR("setsockopt(PACKET_FANOUT)");
+        LOG(LEVEL_HINT, "PACKET_FANOUT_CBPF needs Linux kernel 4.5 or later\n");
+        return err;
+    }
+
+    struct sock_fprog prog = {
+        .len    = ARRAY_SIZE(_fanout_insns),
+        .filter = _fanout_insns,
+    };
+    err = setsockopt(fd, SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof(prog));
+    if (err) {
+        LOGPERROR("setsockopt(PACKET_FANOUT_DATA)");
+        return err;
+    }
+
+    return 0;
+}
+
+static int _get_datalink(int fd, const char *ifname) {
+    struct ifreq ifr = {0};
+
+    safe_strcpy(ifr.ifr_name, IFNAMSIZ, ifname);
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
+        LOGPERROR("ioctl(SIOCGIFHWADDR)");
+        return PCAP_DLT_ETHERNET;
+    }
+
+    switch (ifr.ifr_hwaddr.sa_family) {
+        case ARPHRD_ETHER:
+        case ARPHRD_LOOPBACK:
+            return PCAP_DLT_ETHERNET;
+        case ARPHRD_NONE:
+            /*VPN tunnel, SOCK_RAW gives us raw ip packet*/
+            return PCAP_DLT_RAW;
+        default:
+            LOG(LEVEL_WARN,
+                "(af_packet:%s) unknown hardware type 0x%04x, treat as "
+                "ethernet\n",
+                ifname, ifr.ifr_hwaddr.sa_family);
+            return PCAP_DLT_ETHERNET;
+    }
+}
+
+AFPacket *afpacket_open(const char *ifname, const AFPacketOpt *opt) {
+    AFPacket *afp;
+    int       err;
+    long      page_size = sysconf(_SC_PAGESIZE);
+
+    if (opt->block_size == 0 || opt->block_size % page_size ||
+        opt->block_size % AFP_FRAME_SIZE) {
+        LOG(LEVEL_ERROR,
+            "(af_packet) block size %u must be a multiple of page size %ld\n",
+            opt->block_size, page_size);
+        return NULL;
+    }
+    if (opt->block_count == 0) {
+        LOG(LEVEL_ERROR, "(af_packet) block count cannot be zero\n");
+        return NULL;
+    }
+
+    afp                 = CALLOC(1, sizeof(AFPacket));
+    afp->fd             = -1;
+    afp->rx_block_size  = opt->block_size;
+    afp->rx_block_count = opt->block_count;
+    afp->tx_frame_count = opt->is_tx_ring ? opt->tx_frame_count : 0;
+
+    /**
+     * Protocol 0 means no packet would be queued until we bind the socket
+     * with ETH_P_ALL to our interface.
+     */
+    afp->fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (afp->fd < 0) {
+        LOGPERROR("socket(AF_PACKET)");
+        if (errno == EPERM) {
+            LOG(LEVEL_HINT, "need to sudo or run as root\n");
+        }
+        goto error;
+    }
+
+    afp->ifindex = if_nametoindex(ifname);
+    if (afp->ifindex == 0) {
+        LOG(LEVEL_ERROR, "(af_packet) no such interface: %s\n", ifname);
+        goto error;
+    }
+
+    afp->link_type = _get_datalink(afp->fd, ifname);
+
+    int version = TPACKET_V3;
+    err = setsockopt(afp->fd, SOL_PACKET, PACKET_VERSION, &version,
+                     sizeof(version));
+    if (err) {
+        LOGPERROR("setsockopt(PACKET_VERSION)");
+        LOG(LEVEL_HINT, "TPACKET_V3 needs Linux kernel 3.2 or later\n");
+        goto error;
+    }
+
+    /*room before every frame for re-inserting VLAN tag in place*/
+    int reserve = AFP_VLAN_TAG_LEN;
+    err = setsockopt(afp->fd, SOL_PACKET, PACKET_RESERVE, &reserve,
+                     sizeof(reserve));
+    if (err) {
+        LOGPERROR("setsockopt(PACKET_RESERVE)");
+        goto error;
+    }
+
+    struct tpacket_req3 req = {
+        .tp_block_size       = afp->rx_block_size,
+        .tp_block_nr         = afp->rx_block_count,
+        .tp_frame_size       = AFP_FRAME_SIZE,
+        .tp_frame_nr         = (afp->rx_block_size / AFP_FRAME_SIZE) *
+                       afp->rx_block_count,
+        .tp_retire_blk_tov   = opt->block_timeout,
+        .tp_sizeof_priv      = 0,
+        .tp_feature_req_word = 0,
+    };
+    err = setsockopt(afp->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+    if (err) {
+        LOGPERROR("setsockopt(PACKET_RX_RING)");
+        goto error;
+    }
+
+    afp->rx_map_len = (size_t)afp->rx_block_size * afp->rx_block_count;
+    afp->rx_map = mmap(NULL, afp->rx_map_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, afp->fd, 0);
+    if (afp->rx_map == MAP_FAILED) {
+        afp->rx_map = NULL;
+        LOGPERROR("mmap(PACKET_RX_RING)");
+        goto error;
+    }
+
+    struct sockaddr_ll sll = {
+        .sll_family   = AF_PACKET,
+        .sll_protocol = htons(ETH_P_ALL),
+        .sll_ifindex  = afp->ifindex,
+    };
+    err = bind(afp->fd, (struct sockaddr *)&sll, sizeof(sll));
+    if (err) {
+        LOGPERROR("bind(AF_PACKET)");
+        goto error;
+    }
+
+    /*must be bound before joining*/
+    if (opt->fanout_count > 1 && _join_fanout(afp->fd)) {
+        goto error;
+    }
+
+    /*promiscuous mode as we do in pcap*/
+    struct packet_mreq mreq = {
+        .mr_ifindex = afp->ifindex,
+        .mr_type    = PACKET_MR_PROMISC,
+    };
+    err = setsockopt(afp->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq,
+                     sizeof(mreq));
+    if (err) {
+        LOG(LEVEL_WARN, "(af_packet:%s) failed to set promiscuous mode: %s\n",
+            ifname, strerror(errno));
+    }
+
+    LOG(LEVEL_INFO,
+        "if(%s): af_packet: TPACKET_V3 rx ring with %u blocks * %u bytes, "
+        "timeout %ums\n",
+        ifname, afp->rx_block_count, afp->rx_block_size, opt->block_timeout);
+
+    return afp;
+
+error:
+    afpacket_close(afp);
+    return NULL;
+}
+
+/**
+ * Give the held block back to kernel and step to the next one.
+ */
+static void _release_block(AFPacket *afp) {
+    afp->rx_held->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    __sync_synchronize();
+    afp->rx_held      = NULL;
+    afp->rx_next      = NULL;
+    afp->rx_left      = 0;
+    afp->rx_block_idx = (afp->rx_block_idx + 1) % afp->rx_block_count;
+}
+
+/**
+ * Take the current block from kernel if it was retired.
+ * @return true if got a block.
+ */
+static bool _hold_block(AFPacket *afp) {
+    struct tpacket_block_desc *bd =
+        (struct tpacket_block_desc *)(afp->rx_map + (size_t)afp->rx_block_idx *
+                                                        afp->rx_block_size);
+
+    if (!(bd->hdr.bh1.block_status & TP_STATUS_USER)) {
+        struct pollfd pfd = {
+            .fd      = afp->fd,
+            .events  = POLLIN | POLLERR,
+            .revents = 0,
+        };
+        poll(&pfd, 1, AFP_POLL_TIMEOUT);
+
+        if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+            return false;
+    }
+
+    __sync_synchronize();
+    afp->rx_held = bd;
+    afp->rx_left = bd->hdr.bh1.num_pkts;
+    afp->rx_next = (struct tpacket3_hdr *)((unsigned char *)bd +
+                                           bd->hdr.bh1.offset_to_first_pkt);
+    return true;
+}
+
+static void _fill_frame(AFPacket *afp, struct tpacket3_hdr *hdr,
+                        RawFrame *frame) {
+    frame->packet = (unsigned char *)hdr + hdr->tp_mac;
+    frame->length = hdr->tp_snaplen;
+    frame->secs   = hdr->tp_sec;
+    frame->usecs  = hdr->tp_nsec / 1000;
+
+    /**
+     * Kernel strips VLAN tag into metadata. Put it back like libpcap does
+     * because we parse the tag ourselves. PACKET_RESERVE leaves room before
+     * the frame, so just move the MAC addresses forward in place.
+     */
+    if ((hdr->tp_status & TP_STATUS_VLAN_VALID) &&
+        afp->link_type == PCAP_DLT_ETHERNET && frame->length >= 12) {
+        unsigned char *mac  = (unsigned char *)hdr + hdr->tp_mac;
+        unsigned char *buf  = mac - AFP_VLAN_TAG_LEN;
+        unsigned       tpid = ETH_P_8021Q;
+
+        if (hdr->tp_status & TP_STATUS_VLAN_TPID_VALID)
+            tpid = hdr->hv1.tp_vlan_tpid;
+
+        memmove(buf, mac, 12);
+        buf[12] = (unsigned char)(tpid >> 8);
+        buf[13] = (unsigned char)(tpid & 0xFF);
+        buf[14] = (unsigned char)(hdr->hv1.tp_vlan_tci >> 8);
+        buf[15] = (unsigned char)(hdr->hv1.tp_vlan_tci & 0xFF);
+
+        frame->packet = buf;
+        frame->length += AFP_VLAN_TAG_LEN;
+    }
+}
+
+unsigned afpacket_recv_batch(AFPacket *afp, RawFrame *frames, unsigned max) {
+    unsigned n = 0;
+
+    if (afp->rx_left == 0) {
+        if (afp->rx_held)
+            _release_block(afp);
+        if (!_hold_block(afp))
+            return 0;
+    }
+
+    /*frames in one batch come from the same block held until next call*/
+    while (afp->rx_left && n < max) {
+        struct tpacket3_hdr *hdr = afp->rx_next;
+        afp->rx_left--;
+        afp->rx_next =
+            (struct tpacket3_hdr *)((unsigned char *)hdr + hdr->tp_next_offset);
+
+        struct sockaddr_ll *sll =
+            (struct sockaddr_ll *)((unsigned char *)hdr +
+                                   TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        if (sll->sll_pkttype == PACKET_OUTGOING)
+            continue;
+
+        _fill_frame(afp, hdr, &frames[n]);
+        n++;
+    }
+
+    return n;
+}
+
+int afpacket_recv_packet(AFPacket *afp, unsigned *length, unsigned *secs,
+                         unsigned *usecs, const unsigned char **packet) {
+    RawFrame frame;
+
+    if (afpacket_recv_batch(afp, &frame, 1) == 0)
+        return 1;
+
+    *packet = frame.packet;
+    *length = frame.length;
+    *secs   = frame.secs;
+    *usecs  = frame.usecs;
+    return 0;
+}
+
+int afpacket_send_packet(AFPacket *afp, const unsigned char *packet,
+                         unsigned length) {
+    ssize_t ret = send(afp->fd, packet, length, 0);
+    if (ret < 0) {
+        LOGPERROR("send(AF_PACKET)");
+        return -1;
+    }
+    return 0;
+}
+
+int afpacket_set_filter(AFPacket *afp, const struct bpf_program *bpfp) {
+    /*struct bpf_insn of libpcap has the same layout with sock_filter*/
+    struct sock_fprog fprog = {
+        .len    = (unsigned short)bpfp->bf_len,
+        .filter = (struct sock_filter *)bpfp->bf_insns,
+    };
+
+    int err = setsockopt(afp->fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog,
+                         sizeof(fprog));
+    if (err) {
+        LOGPERROR("setsockopt(SO_ATTACH_FILTER)");
+        return -1;
+    }
+    return 0;
+}
+
+int afpacket_ignore_transmits(AFPacket *afp) {
+    int one = 1;
+    /*outgoing packets are skipped in recv even if this failed(kernel<4.20)*/
+    return setsockopt(afp->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one,
+                      sizeof(one));
+}
+
+int afpacket_datalink(AFPacket *afp) { return afp->link_type; }
+
+uint64_t afpacket_drops(AFPacket *afp) {
+    struct tpacket_stats_v3 st  = {0};
+    socklen_t               len = sizeof(st);
+
+    if (getsockopt(afp->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0)
+        afp->drops += st.tp_drops;
+
+    return afp->drops;
+}
+
+void afpacket_close(AFPacket *afp) {
+    if (afp == NULL)
+        return;
+
+    if (afp->rx_map) {
+        munmap(afp->rx_map, afp->rx_map_len);
+        afp->rx_map = NULL;
+    }
+    if (afp->fd >= 0) {
+        close(afp->fd);
+        afp->fd = -1;
+    }
+
+    FREE(afp);
+}
+
+AFPacketTx *afpacket_tx_open(AFPacket *afp) {
+    AFPacketTx *tx;
+    int         err;
+
+    if (afp == NULL || afp->tx_frame_count == 0)
+        return NULL;
+
+    if (afp->tx_frame_count % AFP_TX_BLOCK_FRAMES) {
+        LOG(LEVEL_ERROR, "(af_packet) tx frames %u must be a multiple of %u\n",
+            afp->tx_frame_count, AFP_TX_BLOCK_FRAMES);
+        return NULL;
+    }
+
+    tx              = CALLOC(1, sizeof(AFPacketTx));
+    tx->frame_count = afp->tx_frame_count;
+
+    /*protocol 0 so that nothing would be queued for receiving*/
+    tx->fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (tx->fd < 0) {
+        LOGPERROR("socket(AF_PACKET)");
+        goto error;
+    }
+
+    /*V2 is enough for fixed-size tx frames and works on older kernels*/
+    int version = TPACKET_V2;
+    err = setsockopt(tx->fd, SOL_PACKET, PACKET_VERSION, &version,
+                     sizeof(version));
+    if (err) {
+        LOGPERROR("setsockopt(PACKET_VERSION)");
+        goto error;
+    }
+
+    struct tpacket_req req = {
+        .tp_block_size = AFP_TX_FRAME_SIZE * AFP_TX_BLOCK_FRAMES,
+        .tp_block_nr   = tx->frame_count / AFP_TX_BLOCK_FRAMES,
+        .tp_frame_size = AFP_TX_FRAME_SIZE,
+        .tp_frame_nr   = tx->frame_count,
+    };
+    err = setsockopt(tx->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+    if (err) {
+        LOGPERROR("setsockopt(PACKET_TX_RING)");
+        goto error;
+    }
+
+    tx->map_len = (size_t)AFP_TX_FRAME_SIZE * tx->frame_count;
+    tx->map = mmap(NULL, tx->map_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, tx->fd, 0);
+    if (tx->map == MAP_FAILED) {
+        tx->map = NULL;
+        LOGPERROR("mmap(PACKET_TX_RING)");
+        goto error;
+    }
+
+    struct sockaddr_ll sll = {
+        .sll_family   = AF_PACKET,
+        .sll_protocol = 0,
+        .sll_ifindex  = afp->ifindex,
+    };
+    err = bind(tx->fd, (struct sockaddr *)&sll, sizeof(sll));
+    if (err) {
+        LOGPERROR("bind(AF_PACKET)");
+        goto error;
+    }
+
+    LOG(LEVEL_DEBUG, "af_packet: TPACKET_V2 tx ring with %u frames\n",
+        tx->frame_count);
+
+    return tx;
+
+error:
+    afpacket_tx_close(tx);
+    return NULL;
+}
+
+static inline struct tpacket2_hdr *_tx_frame(AFPacketTx *tx, unsigned idx) {
+    return (struct tpacket2_hdr *)(tx->map + (size_t)idx * AFP_TX_FRAME_SIZE);
+}
+
+/**
+ * @param flags MSG_DONTWAIT for just queuing frames to kernel, 0 for waiting
+ * until all frames were transmitted.
+ */
+static void _tx_kick(AFPacketTx *tx, int flags) {
+    tx->pending = 0;
+    if (send(tx->fd, NULL, 0, flags) < 0) {
+        /*the qdisc is just busy, frames would be sent in next kick*/
+        if (errno != EAGAIN && errno != ENOBUFS && errno != EINTR)
+            LOGPERROR("send(PACKET_TX_RING)");
+    }
+}
+
+int afpacket_tx_send(AFPacketTx *tx, const unsigned char *packet,
+                     unsigned length) {
+    if (length > AFP_TX_FRAME_SIZE - AFP_TX_DATA_OFFSET) {
+        if (send(tx->fd, packet, length, 0) < 0) {
+            LOGPERROR("send(AF_PACKET)");
+            return -1;
+        }
+        return 0;
+    }
+
+    struct tpacket2_hdr *hdr = _tx_frame(tx, tx->idx);
+
+    /*ring is full, wait for kernel to give back frames*/
+    while (hdr->tp_status != TP_STATUS_AVAILABLE) {
+        if (hdr->tp_status & TP_STATUS_WRONG_FORMAT) {
+            LOG(LEVEL_WARN, "(af_packet) malformed frame in tx ring\n");
+            break;
+        }
+        if (hdr->tp_status == TP_STATUS_SEND_REQUEST) {
+            _tx_kick(tx, 0);
+        } else {
+            struct pollfd pfd = {
+                .fd      = tx->fd,
+                .events  = POLLOUT,
+                .revents = 0,
+            };
+            poll(&pfd, 1, AFP_POLL_TIMEOUT);
+        }
+        __sync_synchronize();
+    }
+
+    memcpy((unsigned char *)hdr + AFP_TX_DATA_OFFSET, packet, length);
+    hdr->tp_len     = length;
+    hdr->tp_snaplen = length;
+    __sync_synchronize();
+    hdr->tp_status = TP_STATUS_SEND_REQUEST;
+
+    tx->idx = tx->idx + 1 == tx->frame_count ? 0 : tx->idx + 1;
+    tx->pending++;
+
+    if (tx->pending >= AFP_TX_KICK_BATCH)
+        _tx_kick(tx, MSG_DONTWAIT);
+
+    return 0;
+}
+
+void afpacket_tx_flush(AFPacketTx *tx) {
+    if (tx->pending)
+        _tx_kick(tx, MSG_DONTWAIT);
+}
+
+void afpacket_tx_close(AFPacketTx *tx) {
+    if (tx == NULL)
+        return;
+
+    if (tx->map) {
+        /*make sure all queued frames are out before unmapping*/
+        if (tx->fd >= 0)
+            _tx_kick(tx, 0);
+        munmap(tx->map, tx->map_len);
+        tx->map = NULL;
+    }
+    if (tx->fd >= 0) {
+        close(tx->fd);
+        tx->fd = -1;
+    }
+
+    FREE(tx);
+}
+
+/*****************************************************************************
+ *****************************************************************************/
+#else
+
+AFPacket *afpacket_open(const char *ifname, const AFPacketOpt *opt) {
+    UNUSEDPARM(opt);
+    LOG(LEVEL_ERROR, "(af_packet:%s) AF_PACKET is only supported on Linux\n",
+        ifname);
+    return NULL;
+}
+
+unsigned afpacket_recv_batch(AFPacket *afp, RawFrame *frames, unsigned max) {
+    return 0;
+}
+
+int afpacket_recv_packet(AFPacket *afp, unsigned *length, unsigned *secs,
+                         unsigned *usecs, const unsigned char **packet) {
+    return 1;
+}
+
+int afpacket_send_packet(AFPacket *afp, const unsigned char *packet,
+                         unsigned length) {
+    return -1;
+}
+
+int afpacket_set_filter(AFPacket *afp, const struct bpf_program *bpfp) {
+    return -1;
+}
+
+int afpacket_ignore_transmits(AFPacket *afp) { return -1; }
+
+int afpacket_datalink(AFPacket *afp) { return PCAP_DLT_ETHERNET; }
+
+uint64_t afpacket_drops(AFPacket *afp) { return 0; }
+
+void afpacket_close(AFPacket *afp) {}
+
+AFPacketTx *afpacket_tx_open(AFPacket *afp) { return NULL; }
+
+int afpacket_tx_send(AFPacketTx *tx, const unsigned char *packet,
+                     unsigned length) {
+    return -1;
+}
+
+void afpacket_tx_flush(AFPacketTx *tx) {}
+
+void afpacket_tx_close(AFPacketTx *tx) {}
+
+#endif
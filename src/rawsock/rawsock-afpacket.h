@@ -0,0 +1,106 @@
+/*
+    Linux AF_PACKET socket with memory-mapped TPACKET_V3 receive ring
+
+    This is a native alternative to libpcap and PF_RING on Linux. The kernel
+    writes received frames into a ring of blocks shared with us by mmap, and
+    hands over a whole block at a time. So we could walk all packets in a
+    block without any syscall or copying, and just give the block back to
+    kernel after the last packet of it was consumed.
+
+    A block is handed over to us while it is full or the retire timeout is
+    reached, so that responses could be got in time even in low rate.
+
+    For transmitting, every tx thread could own a separated socket with its
+    own PACKET_TX_RING. Packets are just copied into frames of the ring and
+    a single send() kicks kernel to transmit all of them.
+
+    Multiple rx threads could receive from the same interface by sockets in
+    one PACKET_FANOUT group. Kernel spreads packets to them by hash of the
+    source IP, so responses from one target always go to the same thread.
+*/
+#ifndef RAWSOCK_AFPACKET_H
+#define RAWSOCK_AFPACKET_H
+
+#include "rawsock.h"
+
+struct bpf_program;
+
+typedef struct AFPacketSocket AFPacket;
+typedef struct AFPacketTxRing AFPacketTx;
+
+/**
+ * Open AF_PACKET socket on the interface and set up rx ring with TPACKET_V3.
+ * @param ifname name of the interface like "eth0".
+ * @param opt geometry of the rx ring.
+ * @return NULL if failed.
+ */
+AFPacket *afpacket_open(const char *ifname, const AFPacketOpt *opt);
+
+/**
+ * The hash kernel uses to choose socket in our PACKET_FANOUT group. Packets
+ * from ip_them go to the socket of index (hash % count of sockets).
+ */
+unsigned afpacket_fanout_hash(ipaddress ip_them);
+
+/**
+ * Get next packet from rx ring. The packet is good until the next call.
+ * It would wait for a very short time(ms) if no packet available.
+ * @return 0 for success, something else for no packet.
+ */
+int afpacket_recv_packet(AFPacket *afp, unsigned *length, unsigned *secs,
+                         unsigned *usecs, const unsigned char **packet);
+
+/**
+ * Get up to max packets from the current block of rx ring. Packets are good
+ * until the next call.
+ * @return count of packets got.
+ */
+unsigned afpacket_recv_batch(AFPacket *afp, RawFrame *frames, unsigned max);
+
+int afpacket_send_packet(AFPacket *afp, const unsigned char *packet,
+                         unsigned length);
+
+/**
+ * Attach a compiled BPF program(e.g. from pcap_compile) to the socket.
+ */
+int afpacket_set_filter(AFPacket *afp, const struct bpf_program *bpfp);
+
+/**
+ * Ask kernel not to deliver packets transmitted by ourselves.
+ */
+int afpacket_ignore_transmits(AFPacket *afp);
+
+/**
+ * @return PCAP_DLT_xxx of the interface.
+ */
+int afpacket_datalink(AFPacket *afp);
+
+/**
+ * @return count of packets dropped by kernel for full rx ring in total.
+ */
+uint64_t afpacket_drops(AFPacket *afp);
+
+void afpacket_close(AFPacket *afp);
+
+/**
+ * Open a new socket with PACKET_TX_RING on the same interface of afp.
+ * It is not thread safe, so every tx thread should have its own one.
+ * @return NULL if tx ring was not required or failed to set up.
+ */
+AFPacketTx *afpacket_tx_open(AFPacket *afp);
+
+/**
+ * Copy the packet into next free frame of tx ring. Kernel would be kicked
+ * only if enough frames were pending or the ring is full.
+ */
+int afpacket_tx_send(AFPacketTx *tx, const unsigned char *packet,
+                     unsigned length);
+
+/**
+ * Kick kernel to transmit all pending frames in tx ring.
+ */
+void afpacket_tx_flush(AFPacketTx *tx);
+
+void afpacket_tx_close(AFPacketTx *tx);
+
+#endif
@@ -0,0 +1,628 @@
+#include "rawsock-afxdp.h"
+#include "../stub/stub-pcap-dlt.h"
+#include "../util-data/fine-malloc.h"
+#include "../util-out/logger.h"
+#include "../util-misc/cross.h"
+#include "../pixie/pixie-threads.h"
+
+#include <string.h>
+
+/*****************************************************************************
+ *****************************************************************************/
+#if defined(__linux__)
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <net/if.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/**
+ * Every UMEM frame holds one packet. Rx frames and tx frames are the first
+ * and second half of UMEM.
+ */
+#define XDP_FRAME_SIZE 2048
+
+/**
+ * Like AF_PACKET mode, we just wait a short time if no packet is ready, so
+ * that rx thread could do fast-timeout in real time.
+ */
+#define XDP_POLL_TIMEOUT 1
+
+/**
+ * Kick kernel after so many frames were put on tx ring.
+ */
+#define XDP_TX_KICK_BATCH 64
+
+typedef struct XskRing {
+    uint32_t *producer;
+    uint32_t *consumer;
+    void     *ring;
+    uint32_t  mask;
+    void     *map;
+    size_t    map_len;
+} XskRing;
+
+struct XskSocket {
+    int            fd;
+    unsigned       queue_id;
+    unsigned char *umem;
+    size_t         umem_len;
+    XskRing        fill;
+    XskRing        comp;
+    XskRing        rx;
+    XskRing        tx;
+    /*stack of free tx frames*/
+    uint64_t      *tx_free;
+    unsigned       tx_free_count;
+    /*frames put on tx ring but not kicked*/
+    unsigned       tx_pending;
+    /*tx threads may share one XSK if we have less queues*/
+    volatile int   tx_lock;
+};
+
+struct AFXDPContext {
+    int       ifindex;
+    int       map_fd;
+    int       prog_fd;
+    int       link_fd;
+    unsigned  xsk_count;
+    Xsk      *xsks;
+    /*XSK to receive from in round robin*/
+    unsigned  rx_next;
+    /*frames of the last received packets to give back to fill ring*/
+    Xsk     **rx_held_xsk;
+    uint64_t *rx_held_addr;
+    unsigned  rx_held_count;
+    unsigned  rx_held_max;
+    /*XSK for next tx thread*/
+    unsigned  tx_next;
+};
+
+static int _bpf(int cmd, union bpf_attr *attr) {
+    return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * Create the XSKMAP and load the XDP program:
+ *
+ *     return bpf_redirect_map(&xsks_map, ctx->rx_queue_index, XDP_PASS);
+ *
+ * Packets on queues without XSK would go to kernel stack as usual.
+ */
+static int _load_prog(AFXDP *xdp, unsigned max_queues) {
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size    = sizeof(uint32_t);
+    attr.value_size  = sizeof(uint32_t);
+    attr.max_entries = max_queues;
+    xdp->map_fd      = _bpf(BPF_MAP_CREATE, &attr);
+    if (xdp->map_fd < 0) {
+        LOGPERROR("bpf(BPF_MAP_CREATE)");
+        return -1;
+    }
+
+    struct bpf_insn insns[] = {
+        /*r2 = ctx->rx_queue_index*/
+        {.code    = BPF_LDX | BPF_MEM | BPF_W,
+         .dst_reg = BPF_REG_2,
+         .src_reg = BPF_REG_1,
+         .off     = offsetof(struct xdp_md, rx_queue_index)},
+        /*r1 = &xsks_map*/
+        {.code    = BPF_LD | BPF_DW | BPF_IMM,
+         .dst_reg = BPF_REG_1,
+         .src_reg = BPF_PSEUDO_MAP_FD,
+         .imm     = xdp->map_fd},
+        {0},
+        /*r3 = XDP_PASS*/
+        {.code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_3, .imm = 2},
+        {.code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map},
+        {.code = BPF_JMP | BPF_EXIT},
+    };
+    static const char license[] = "GPL";
+    char              log_buf[1024] = {0};
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type            = BPF_PROG_TYPE_XDP;
+    attr.insn_cnt             = ARRAY_SIZE(insns);
+    attr.insns                = (uint64_t)(uintptr_t)insns;
+    attr.license              = (uint64_t)(uintptr_t)license;
+    attr.log_buf              = (uint64_t)(uintptr_t)log_buf;
+    attr.log_size             = sizeof(log_buf);
+    attr.log_level            = 1;
+    attr.expected_attach_type = BPF_XDP;
+    xdp->prog_fd              = _bpf(BPF_PROG_LOAD, &attr);
+    if (xdp->prog_fd < 0) {
+        LOGPERROR("bpf(BPF_PROG_LOAD)");
+        LOG(LEVEL_DEBUG, "(af_xdp) verifier: %s\n", log_buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int _attach_prog(AFXDP *xdp, bool is_native) {
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd        = xdp->prog_fd;
+    attr.link_create.target_ifindex = xdp->ifindex;
+    attr.link_create.attach_type    = BPF_XDP;
+    attr.link_create.flags =
+        is_native ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+    xdp->link_fd = _bpf(BPF_LINK_CREATE, &attr);
+    if (xdp->link_fd < 0) {
+        LOGPERROR("bpf(BPF_LINK_CREATE)");
+        if (errno == EBUSY)
+            LOG(LEVEL_HINT, "another XDP program is attached already\n");
+        else if (errno == EINVAL)
+            LOG(LEVEL_HINT, "XDP link needs Linux kernel 5.9 or later\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int _map_ring(XskRing *r, int fd, const struct xdp_ring_offset *off,
+                     unsigned size, size_t desc_size, off_t pgoff) {
+    r->map_len = off->desc + size * desc_size;
+    r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (r->map == MAP_FAILED) {
+        r->map = NULL;
+        return -1;
+    }
+
+    r->producer = (uint32_t *)((unsigned char *)r->map + off->producer);
+    r->consumer = (uint32_t *)((unsigned char *)r->map + off->consumer);
+    r->ring     = (unsigned char *)r->map + off->desc;
+    r->mask     = size - 1;
+
+    return 0;
+}
+
+static void _unmap_ring(XskRing *r) {
+    if (r->map) {
+        munmap(r->map, r->map_len);
+        r->map = NULL;
+    }
+}
+
+static void _fill_frame(Xsk *xsk, uint64_t addr) {
+    uint32_t prod = *xsk->fill.producer;
+
+    ((uint64_t *)xsk->fill.ring)[prod & xsk->fill.mask] = addr;
+    __atomic_store_n(xsk->fill.producer, prod + 1, __ATOMIC_RELEASE);
+}
+
+static int _xsk_open(AFXDP *xdp, Xsk *xsk, unsigned queue_id,
+                     unsigned frame_count, bool is_zerocopy) {
+    unsigned half = frame_count / 2;
+    int      err;
+
+    xsk->queue_id = queue_id;
+    xsk->fd       = socket(AF_XDP, SOCK_RAW, 0);
+    if (xsk->fd < 0) {
+        LOGPERROR("socket(AF_XDP)");
+        return -1;
+    }
+
+    xsk->umem_len = (size_t)frame_count * XDP_FRAME_SIZE;
+    xsk->umem = mmap(NULL, xsk->umem_len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (xsk->umem == MAP_FAILED) {
+        xsk->umem = NULL;
+        LOGPERROR("mmap(UMEM)");
+        return -1;
+    }
+
+    struct xdp_umem_reg mr = {
+        .addr       = (uint64_t)(uintptr_t)xsk->umem,
+        .len        = xsk->umem_len,
+        .chunk_size = XDP_FRAME_SIZE,
+        .headroom   = 0,
+        .flags      = 0,
+    };
+    err = setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr));
+    if (err) {
+        LOGPERROR("setsockopt(XDP_UMEM_REG)");
+        return -1;
+    }
+
+    int size = (int)half;
+    if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_FILL_RING, &size,
+                   sizeof(size)) ||
+        setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size,
+                   sizeof(size)) ||
+        setsockopt(xsk->fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) ||
+        setsockopt(xsk->fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size))) {
+        LOGPERROR("setsockopt(XDP_RING)");
+        return -1;
+    }
+
+    struct xdp_mmap_offsets off;
+    socklen_t               optlen = sizeof(off);
+    err = getsockopt(xsk->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen);
+    if (err) {
+        LOGPERROR("getsockopt(XDP_MMAP_OFFSETS)");
+        return -1;
+    }
+
+    if (_map_ring(&xsk->fill, xsk->fd, &off.fr, half, sizeof(uint64_t),
+                  XDP_UMEM_PGOFF_FILL_RING) ||
+        _map_ring(&xsk->comp, xsk->fd, &off.cr, half, sizeof(uint64_t),
+                  XDP_UMEM_PGOFF_COMPLETION_RING) ||
+        _map_ring(&xsk->rx, xsk->fd, &off.rx, half, sizeof(struct xdp_desc),
+                  XDP_PGOFF_RX_RING) ||
+        _map_ring(&xsk->tx, xsk->fd, &off.tx, half, sizeof(struct xdp_desc),
+                  XDP_PGOFF_TX_RING)) {
+        LOGPERROR("mmap(XDP_RING)");
+        return -1;
+    }
+
+    /*give all rx frames to kernel*/
+    for (unsigned i = 0; i < half; i++) {
+        _fill_frame(xsk, (uint64_t)i * XDP_FRAME_SIZE);
+    }
+
+    xsk->tx_free = MALLOC(half * sizeof(uint64_t));
+    for (unsigned i = 0; i < half; i++) {
+        xsk->tx_free[i] = (uint64_t)(half + i) * XDP_FRAME_SIZE;
+    }
+    xsk->tx_free_count = half;
+
+    struct sockaddr_xdp sxdp = {
+        .sxdp_family   = AF_XDP,
+        .sxdp_ifindex  = xdp->ifindex,
+        .sxdp_queue_id = queue_id,
+        .sxdp_flags    = is_zerocopy ? XDP_ZEROCOPY : XDP_COPY,
+    };
+    err = bind(xsk->fd, (struct sockaddr *)&sxdp, sizeof(sxdp));
+    if (err) {
+        LOGPERROR("bind(AF_XDP)");
+        LOG(LEVEL_HINT, "check if queue %u exists on the interface\n",
+            queue_id);
+        return -1;
+    }
+
+    uint32_t key = queue_id;
+    uint32_t val = xsk->fd;
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = xdp->map_fd;
+    attr.key    = (uint64_t)(uintptr_t)&key;
+    attr.value  = (uint64_t)(uintptr_t)&val;
+    err         = _bpf(BPF_MAP_UPDATE_ELEM, &attr);
+    if (err) {
+        LOGPERROR("bpf(BPF_MAP_UPDATE_ELEM)");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void _xsk_close(Xsk *xsk) {
+    _unmap_ring(&xsk->fill);
+    _unmap_ring(&xsk->comp);
+    _unmap_ring(&xsk->rx);
+    _unmap_ring(&xsk->tx);
+    if (xsk->fd >= 0) {
+        close(xsk->fd);
+        xsk->fd = -1;
+    }
+    if (xsk->umem) {
+        munmap(xsk->umem, xsk->umem_len);
+        xsk->umem = NULL;
+    }
+    FREE(xsk->tx_free);
+}
+
+AFXDP *afxdp_open(const char *ifname, const AFXDPOpt *opt) {
+    AFXDP *xdp;
+
+    if (opt->queue_count == 0) {
+        LOG(LEVEL_ERROR, "(af_xdp) queue count cannot be zero\n");
+        return NULL;
+    }
+    if (opt->frame_count < 64 || opt->frame_count & (opt->frame_count - 1)) {
+        LOG(LEVEL_ERROR, "(af_xdp) frame count must be power of 2 and >= 64\n");
+        return NULL;
+    }
+
+    xdp            = CALLOC(1, sizeof(AFXDP));
+    xdp->map_fd    = -1;
+    xdp->prog_fd   = -1;
+    xdp->link_fd   = -1;
+    xdp->xsk_count = opt->queue_count;
+    xdp->xsks      = CALLOC(xdp->xsk_count, sizeof(Xsk));
+    for (unsigned i = 0; i < xdp->xsk_count; i++) {
+        xdp->xsks[i].fd = -1;
+    }
+
+    xdp->ifindex = if_nametoindex(ifname);
+    if (xdp->ifindex == 0) {
+        LOG(LEVEL_ERROR, "(af_xdp) no such interface: %s\n", ifname);
+        goto error;
+    }
+
+    /*locked memory is charged to rlimit before Linux kernel 5.11*/
+    struct rlimit rlim = {RLIM_INFINITY, RLIM_INFINITY};
+    setrlimit(RLIMIT_MEMLOCK, &rlim);
+
+    if (_load_prog(xdp, xdp->xsk_count))
+        goto error;
+
+    for (unsigned i = 0; i < xdp->xsk_count; i++) {
+        if (_xsk_open(xdp, &xdp->xsks[i], i, opt->frame_count,
+                      opt->is_zerocopy))
+            goto error;
+    }
+
+    if (_attach_prog(xdp, opt->is_zerocopy))
+        goto error;
+
+    LOG(LEVEL_INFO,
+        "if(%s): af_xdp: %u queues with %u frames UMEM each, %s mode\n",
+        ifname, xdp->xsk_count, opt->frame_count,
+        opt->is_zerocopy ? "zero-copy" : "copy");
+
+    return xdp;
+
+error:
+    afxdp_close(xdp);
+    return NULL;
+}
+
+unsigned afxdp_recv_batch(AFXDP *xdp, RawFrame *frames, unsigned max) {
+    unsigned n = 0;
+
+    for (unsigned i = 0; i < xdp->rx_held_count; i++) {
+        _fill_frame(xdp->rx_held_xsk[i], xdp->rx_held_addr[i]);
+    }
+    xdp->rx_held_count = 0;
+
+    if (max > xdp->rx_held_max) {
+        xdp->rx_held_xsk  = REALLOC(xdp->rx_held_xsk, max * sizeof(Xsk *));
+        xdp->rx_held_addr = REALLOC(xdp->rx_held_addr, max * sizeof(uint64_t));
+        xdp->rx_held_max  = max;
+    }
+
+    for (unsigned k = 0; k < xdp->xsk_count && n < max; k++) {
+        Xsk *xsk = &xdp->xsks[xdp->rx_next];
+        if (++xdp->rx_next == xdp->xsk_count)
+            xdp->rx_next = 0;
+
+        uint32_t cons = *xsk->rx.consumer;
+        uint32_t prod = __atomic_load_n(xsk->rx.producer, __ATOMIC_ACQUIRE);
+
+        for (; cons != prod && n < max; cons++, n++) {
+            struct xdp_desc *desc =
+                &((struct xdp_desc *)xsk->rx.ring)[cons & xsk->rx.mask];
+
+            frames[n].packet = xsk->umem + desc->addr;
+            frames[n].length = desc->len;
+
+            xdp->rx_held_xsk[n] = xsk;
+            xdp->rx_held_addr[n] =
+                desc->addr & ~((uint64_t)XDP_FRAME_SIZE - 1);
+        }
+        __atomic_store_n(xsk->rx.consumer, cons, __ATOMIC_RELEASE);
+    }
+    xdp->rx_held_count = n;
+
+    if (n == 0) {
+        struct pollfd pfds[xdp->xsk_count];
+        for (unsigned i = 0; i < xdp->xsk_count; i++) {
+            pfds[i].fd      = xdp->xsks[i].fd;
+            pfds[i].events  = POLLIN;
+            pfds[i].revents = 0;
+        }
+        poll(pfds, xdp->xsk_count, XDP_POLL_TIMEOUT);
+        return 0;
+    }
+
+    /*no timestamp in rx descriptor, one clock for the whole batch*/
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    for (unsigned i = 0; i < n; i++) {
+        frames[i].secs  = (unsigned)ts.tv_sec;
+        frames[i].usecs = (unsigned)(ts.tv_nsec / 1000);
+    }
+
+    return n;
+}
+
+int afxdp_recv_packet(AFXDP *xdp, unsigned *length, unsigned *secs,
+                      unsigned *usecs, const unsigned char **packet) {
+    RawFrame frame;
+
+    if (afxdp_recv_batch(xdp, &frame, 1) == 0)
+        return 1;
+
+    *packet = frame.packet;
+    *length = frame.length;
+    *secs   = frame.secs;
+    *usecs  = frame.usecs;
+    return 0;
+}
+
+static void _tx_reclaim(Xsk *xsk) {
+    uint32_t cons = *xsk->comp.consumer;
+    uint32_t prod = __atomic_load_n(xsk->comp.producer, __ATOMIC_ACQUIRE);
+
+    while (cons != prod) {
+        xsk->tx_free[xsk->tx_free_count++] =
+            ((uint64_t *)xsk->comp.ring)[cons & xsk->comp.mask];
+        cons++;
+    }
+    __atomic_store_n(xsk->comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+static void _tx_kick(Xsk *xsk) {
+    xsk->tx_pending = 0;
+    if (sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0) {
+        /*driver is just busy, frames would be sent in next kick*/
+        if (errno != EAGAIN && errno != EBUSY && errno != ENOBUFS &&
+            errno != ENETDOWN)
+            LOGPERROR("sendto(AF_XDP)");
+    }
+}
+
+int afxdp_tx_send(Xsk *xsk, const unsigned char *packet, unsigned length) {
+    if (length > XDP_FRAME_SIZE) {
+        LOG(LEVEL_WARN, "(af_xdp) packet too large: %u\n", length);
+        return -1;
+    }
+
+    while (__sync_lock_test_and_set(&xsk->tx_lock, 1))
+        rte_pause();
+
+    if (xsk->tx_free_count == 0)
+        _tx_reclaim(xsk);
+
+    while (xsk->tx_free_count == 0) {
+        _tx_kick(xsk);
+        _tx_reclaim(xsk);
+        if (xsk->tx_free_count)
+            break;
+
+        struct pollfd pfd = {
+            .fd      = xsk->fd,
+            .events  = POLLOUT,
+            .revents = 0,
+        };
+        poll(&pfd, 1, XDP_POLL_TIMEOUT);
+        _tx_reclaim(xsk);
+    }
+
+    uint64_t addr = xsk->tx_free[--xsk->tx_free_count];
+    memcpy(xsk->umem + addr, packet, length);
+
+    uint32_t         prod = *xsk->tx.producer;
+    struct xdp_desc *desc =
+        &((struct xdp_desc *)xsk->tx.ring)[prod & xsk->tx.mask];
+    desc->addr    = addr;
+    desc->len     = length;
+    desc->options = 0;
+    __atomic_store_n(xsk->tx.producer, prod + 1, __ATOMIC_RELEASE);
+
+    xsk->tx_pending++;
+    if (xsk->tx_pending >= XDP_TX_KICK_BATCH)
+        _tx_kick(xsk);
+
+    __sync_lock_release(&xsk->tx_lock);
+
+    return 0;
+}
+
+void afxdp_tx_flush(Xsk *xsk) {
+    if (xsk->tx_pending == 0)
+        return;
+
+    while (__sync_lock_test_and_set(&xsk->tx_lock, 1))
+        rte_pause();
+    if (xsk->tx_pending)
+        _tx_kick(xsk);
+    __sync_lock_release(&xsk->tx_lock);
+}
+
+Xsk *afxdp_tx_attach(AFXDP *xdp) {
+    unsigned idx = __sync_fetch_and_add(&xdp->tx_next, 1);
+    return &xdp->xsks[idx % xdp->xsk_count];
+}
+
+int afxdp_send_packet(AFXDP *xdp, const unsigned char *packet,
+                      unsigned length) {
+    Xsk *xsk = &xdp->xsks[0];
+    int  err = afxdp_tx_send(xsk, packet, length);
+
+    /*no explicit flush without tx cache, so kick at once*/
+    afxdp_tx_flush(xsk);
+    return err;
+}
+
+int afxdp_datalink(AFXDP *xdp) {
+    UNUSEDPARM(xdp);
+    return PCAP_DLT_ETHERNET;
+}
+
+void afxdp_close(AFXDP *xdp) {
+    if (xdp == NULL)
+        return;
+
+    /*detach XDP program first to give packets back to kernel stack*/
+    if (xdp->link_fd >= 0)
+        close(xdp->link_fd);
+    if (xdp->prog_fd >= 0)
+        close(xdp->prog_fd);
+    if (xdp->map_fd >= 0)
+        close(xdp->map_fd);
+
+    for (unsigned i = 0; i < xdp->xsk_count; i++) {
+        _xsk_close(&xdp->xsks[i]);
+    }
+
+    FREE(xdp->rx_held_xsk);
+    FREE(xdp->rx_held_addr);
+    FREE(xdp->xsks);
+    FREE(xdp);
+}
+
+/*****************************************************************************
+ *****************************************************************************/
+#else
+
+AFXDP *afxdp_open(const char *ifname, const AFXDPOpt *opt) {
+    UNUSEDPARM(opt);
+    LOG(LEVEL_ERROR, "(af_xdp:%s) AF_XDP is only supported on Linux\n",
+        ifname);
+    return NULL;
+}
+
+unsigned afxdp_recv_batch(AFXDP *xdp, RawFrame *frames, unsigned max) {
+    return 0;
+}
+
+int afxdp_recv_packet(AFXDP *xdp, unsigned *length, unsigned *secs,
+                      unsigned *usecs, const unsigned char **packet) {
+    return 1;
+}
+
+int afxdp_send_packet(AFXDP *xdp, const unsigned char *packet,
+                      unsigned length) {
+    return -1;
+}
+
+int afxdp_datalink(AFXDP *xdp) { return PCAP_DLT_ETHERNET; }
+
+void afxdp_close(AFXDP *xdp) {}
+
+Xsk *afxdp_tx_attach(AFXDP *xdp) { return NULL; }
+
+int afxdp_tx_send(Xsk *xsk, const unsigned char *packet, unsigned length) {
+    return -1;
+}
+
+void afxdp_tx_flush(Xsk *xsk) {}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+    Linux AF_XDP socket adapter
+
+    An XDP program redirects packets received on the chosen queues of the
+    interface to our XSKs (AF_XDP sockets). Every XSK has its own UMEM shared
+    by its fill/completion/rx/tx rings, so packets are moved between kernel
+    and us only by passing descriptors of UMEM frames.
+
+    We load the tiny XDP program and the XSKMAP by bpf() syscall directly, so
+    libbpf/libxdp is not needed. The program is attached in generic(SKB) mode
+    and XSKs are bound in copy mode by default, which works on any driver
+    including veth. Native mode with zero-copy could be chosen for drivers
+    supporting it.
+
+    NOTE: All packets received on the bound queues are taken away from kernel
+    stack. So use a dedicated interface (or veth pair for testing).
+*/
+#ifndef RAWSOCK_AFXDP_H
+#define RAWSOCK_AFXDP_H
+
+#include "rawsock.h"
+
+typedef struct AFXDPContext AFXDP;
+typedef struct XskSocket    Xsk;
+
+/**
+ * Load XDP program, create XSKs for queues and attach them to the interface.
+ * @param ifname name of the interface like "eth0".
+ * @param opt queues and UMEM size.
+ * @return NULL if failed.
+ */
+AFXDP *afxdp_open(const char *ifname, const AFXDPOpt *opt);
+
+/**
+ * Get next packet from rx rings of all XSKs in round robin. The packet is in
+ * UMEM and good until the next call.
+ * It would wait for a very short time(ms) if no packet available.
+ * @return 0 for success, something else for no packet.
+ */
+int afxdp_recv_packet(AFXDP *xdp, unsigned *length, unsigned *secs,
+                      unsigned *usecs, const unsigned char **packet);
+
+/**
+ * Get up to max packets from rx rings of all XSKs. Packets are in UMEM and
+ * good until the next call.
+ * @return count of packets got.
+ */
+unsigned afxdp_recv_batch(AFXDP *xdp, RawFrame *frames, unsigned max);
+
+/**
+ * Transmit by the first XSK. It's for sending without tx thread cache.
+ */
+int afxdp_send_packet(AFXDP *xdp, const unsigned char *packet,
+                      unsigned length);
+
+int afxdp_datalink(AFXDP *xdp);
+
+void afxdp_close(AFXDP *xdp);
+
+/**
+ * Choose an XSK for a tx thread in round robin. Tx threads own different XSKs
+ * if we have enough queues, or they would share one with a spin lock.
+ */
+Xsk *afxdp_tx_attach(AFXDP *xdp);
+
+/**
+ * Copy the packet into a free UMEM frame and put it on tx ring. Kernel would
+ * be kicked only if enough frames were pending or no frame is free.
+ */
+int afxdp_tx_send(Xsk *xsk, const unsigned char *packet, unsigned length);
+
+/**
+ * Kick kernel to transmit all pending frames in tx ring.
+ */
+void afxdp_tx_flush(Xsk *xsk);
+
+#endif
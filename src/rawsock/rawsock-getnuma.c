@@ -0,0 +1,44 @@
+/*
+    get NUMA node of named network interface/adapter like "eth0"
+
+    Only Linux tells us this by sysfs. Virtual interfaces (lo, veth, tun...)
+    and single node machines report no node.
+*/
+#include "rawsock.h"
+#include "../util-data/safe-string.h"
+#include "../util-out/logger.h"
+
+#if defined(__linux__)
+#include <stdio.h>
+#include <stdlib.h>
+
+int rawsock_get_adapter_numa(const char *ifname) {
+    char  path[300];
+    char  line[32];
+    FILE *fp;
+    int   node = -1;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", ifname);
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        LOG(LEVEL_DEBUG, "(numa) no device node of %s\n", ifname);
+        return -1;
+    }
+
+    if (fgets(line, sizeof(line), fp))
+        node = atoi(line);
+    fclose(fp);
+
+    /*kernel says -1 if the device doesn't belong to any node*/
+    return node < 0 ? -1 : node;
+}
+
+#else
+
+int rawsock_get_adapter_numa(const char *ifname) {
+    UNUSEDPARM(ifname);
+    return -1;
+}
+
+#endif
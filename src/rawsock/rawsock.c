@@ -47,6 +47,8 @@ static int is_pcap_file = 0;
 #endif
 
 #include "rawsock-adapter.h"
+#include "rawsock-afpacket.h"
+#include "rawsock-afxdp.h"
 
 /**
  * KLUDGE
@@ -298,6 +300,14 @@ void rawsock_flush(Adapter *adapter, AdapterCache *acache) {
         PCAP.sendqueue_destroy(acache->sendq);
         acache->sendq = PCAP.sendqueue_alloc(SENDQ_SIZE);
     }
+
+    if (acache->afp_tx) {
+        afpacket_tx_flush(acache->afp_tx);
+    }
+
+    if (acache->xsk) {
+        afxdp_tx_flush(acache->xsk);
+    }
 }
 
 int rawsock_send_packet(Adapter *adapter, AdapterCache *acache,
@@ -347,6 +357,20 @@ int rawsock_send_packet(Adapter *adapter, AdapterCache *acache,
         return 0;
     }
 
+    /* AF_XDP */
+    if (acache->xsk)
+        return afxdp_tx_send(acache->xsk, packet, length);
+
+    if (adapter->xdp)
+        return afxdp_send_packet(adapter->xdp, packet, length);
+
+    /* AF_PACKET */
+    if (acache->afp_tx)
+        return afpacket_tx_send(acache->afp_tx, packet, length);
+
+    if (adapter->afp)
+        return afpacket_send_packet(adapter->afp, packet, length);
+
     /* LIBPCAP */
     if (adapter->pcap)
         return PCAP.sendpacket(adapter->pcap, packet, length);
@@ -381,6 +405,12 @@ int rawsock_recv_packet(Adapter *adapter, unsigned *length, unsigned *secs,
         *length = hdr.caplen;
         *secs   = (unsigned)hdr.ts.tv_sec;
         *usecs  = (unsigned)hdr.ts.tv_usec;
+    } else if (adapter->xdp) {
+        /* Take packet from UMEM by descriptor of rx ring */
+        return afxdp_recv_packet(adapter->xdp, length, secs, usecs, packet);
+    } else if (adapter->afp) {
+        /* Walk the memory-mapped ring without syscall or copying */
+        return afpacket_recv_packet(adapter->afp, length, secs, usecs, packet);
     } else if (adapter->pcap) {
         struct pcap_pkthdr *hdr;
 
@@ -413,6 +443,38 @@ int rawsock_recv_packet(Adapter *adapter, unsigned *length, unsigned *secs,
     return 0;
 }
 
+unsigned rawsock_recv_batch(Adapter *adapter, RawFrame *frames, unsigned max) {
+    if (max == 0)
+        return 0;
+
+    if (adapter->xdp)
+        return afxdp_recv_batch(adapter->xdp, frames, max);
+
+    if (adapter->afp)
+        return afpacket_recv_batch(adapter->afp, frames, max);
+
+    /*libpcap and PF_RING reuse their buffer in every call*/
+    if (rawsock_recv_packet(adapter, &frames[0].length, &frames[0].secs,
+                            &frames[0].usecs, &frames[0].packet))
+        return 0;
+
+    return 1;
+}
+
+Adapter *rawsock_get_rx_adapter(Adapter *adapter, unsigned index) {
+    if (index == 0 || index >= adapter->fanout_count)
+        return adapter;
+
+    return adapter->fanout_members[index - 1];
+}
+
+unsigned rawsock_fanout_index(const Adapter *adapter, ipaddress ip_them) {
+    if (adapter->fanout_count <= 1)
+        return 0;
+
+    return afpacket_fanout_hash(ip_them) % adapter->fanout_count;
+}
+
 /***************************************************************************
  * Used on Windows: network adapters have horrible names, so therefore we
  * use numeric indexes instead. You can which adapter you are looking for
@@ -470,6 +532,24 @@ void rawsock_ignore_transmits(Adapter *adapter, const char *ifname) {
         return;
     }
 
+    /* XDP program only sees ingress packets */
+    if (adapter->xdp) {
+        return;
+    }
+
+    if (adapter->afp) {
+        for (unsigned i = 1; i < adapter->fanout_count; i++) {
+            afpacket_ignore_transmits(adapter->fanout_members[i - 1]->afp);
+        }
+        if (afpacket_ignore_transmits(adapter->afp)) {
+            LOG(LEVEL_DEBUG,
+                "(%s) kernel cannot ignore transmits for %s, "
+                "skip them while receiving\n",
+                __func__, ifname);
+        }
+        return;
+    }
+
     if (adapter->pcap) {
         int err;
         err = PCAP.setdirection(adapter->pcap, PCAP_D_IN);
@@ -483,13 +563,52 @@ void rawsock_ignore_transmits(Adapter *adapter, const char *ifname) {
     }
 }
 
+/***************************************************************************
+ ***************************************************************************/
+uint64_t rawsock_get_drops(Adapter *adapter) {
+    uint64_t drops = 0;
+
+    if (!adapter)
+        return 0;
+
+    for (unsigned i = 1; i < adapter->fanout_count; i++) {
+        drops += rawsock_get_drops(adapter->fanout_members[i - 1]);
+    }
+
+    if (adapter->afp) {
+        drops += afpacket_drops(adapter->afp);
+    } else if (adapter->pcap) {
+        struct pcap_stat st = {0};
+        if (PCAP.stats(adapter->pcap, &st) == 0)
+            drops += (uint64_t)st.ps_drop + st.ps_ifdrop;
+    }
+
+    return drops;
+}
+
 /***************************************************************************
  ***************************************************************************/
 void rawsock_close_adapter(Adapter *adapter) {
+    if (adapter->fanout_members) {
+        for (unsigned i = 1; i < adapter->fanout_count; i++) {
+            if (adapter->fanout_members[i - 1])
+                rawsock_close_adapter(adapter->fanout_members[i - 1]);
+        }
+        FREE(adapter->fanout_members);
+        adapter->fanout_count = 0;
+    }
     if (adapter->ring) {
         PFRING.close(adapter->ring);
         adapter->ring = NULL;
     }
+    if (adapter->afp) {
+        afpacket_close(adapter->afp);
+        adapter->afp = NULL;
+    }
+    if (adapter->xdp) {
+        afxdp_close(adapter->xdp);
+        adapter->xdp = NULL;
+    }
     if (adapter->pcap) {
         PCAP.close(adapter->pcap);
         adapter->pcap = NULL;
@@ -542,9 +661,11 @@ static int is_pfring_dna(const char *name) {
 /***************************************************************************
  ***************************************************************************/
 Adapter *rawsock_init_adapter(const char *adapter_name, unsigned is_pfring,
-                              unsigned is_sendq, unsigned is_packet_trace,
-                              unsigned is_offline, unsigned is_vlan,
-                              unsigned vlan_id, unsigned snaplen) {
+                              const AFPacketOpt *afp_opt,
+                              const AFXDPOpt *xdp_opt, unsigned is_sendq,
+                              unsigned is_packet_trace, unsigned is_offline,
+                              unsigned is_vlan, unsigned vlan_id,
+                              unsigned snaplen) {
     Adapter *adapter;
     char     errbuf[PCAP_ERRBUF_SIZE] = "pcap";
 
@@ -658,6 +779,81 @@ Adapter *rawsock_init_adapter(const char *adapter_name, unsigned is_pfring,
         return adapter;
     }
 
+    /*----------------------------------------------------------------
+     * PORTABILITY: LINUX AF_XDP
+     *  XDP program redirects packets to XSKs bound on queues of the
+     *  interface. Packets are passed by descriptors of UMEM frames
+     *  without the kernel network stack.
+     *----------------------------------------------------------------*/
+    if (xdp_opt) {
+        if (is_pfring || afp_opt) {
+            LOG(LEVEL_ERROR,
+                "cannot use AF_XDP with PF_RING or AF_PACKET together.\n");
+            return 0;
+        }
+
+        LOG(LEVEL_DETAIL, "(af_xdp:'%s') opening...\n", adapter_name);
+        adapter->xdp = afxdp_open(adapter_name, xdp_opt);
+        if (adapter->xdp == NULL) {
+            LOG(LEVEL_ERROR, "(af_xdp:'%s') can't open adapter\n",
+                adapter_name);
+            return 0;
+        }
+        adapter->link_type = afxdp_datalink(adapter->xdp);
+
+        LOG(LEVEL_INFO, "if(%s): successfully opened\n", adapter_name);
+        return adapter;
+    }
+
+    /*----------------------------------------------------------------
+     * PORTABILITY: LINUX AF_PACKET
+     *  Native memory-mapped TPACKET_V3 ring. Kernel hands over received
+     *  packets in blocks, so that we could receive millions of packets
+     *  per second without per-packet syscall or copying of libpcap.
+     *----------------------------------------------------------------*/
+    if (afp_opt) {
+        if (is_pfring) {
+            LOG(LEVEL_ERROR, "cannot use PF_RING and AF_PACKET together.\n");
+            return 0;
+        }
+
+        LOG(LEVEL_DETAIL, "(af_packet:'%s') opening...\n", adapter_name);
+        adapter->afp = afpacket_open(adapter_name, afp_opt);
+        if (adapter->afp == NULL) {
+            LOG(LEVEL_ERROR, "(af_packet:'%s') can't open adapter\n",
+                adapter_name);
+            return 0;
+        }
+        adapter->link_type = afpacket_datalink(adapter->afp);
+
+        /*other sockets of the fanout group for rx threads*/
+        if (afp_opt->fanout_count > 1) {
+            adapter->fanout_count   = afp_opt->fanout_count;
+            adapter->fanout_members = CALLOC(afp_opt->fanout_count - 1,
+                                             sizeof(Adapter *));
+            for (unsigned i = 0; i < afp_opt->fanout_count - 1; i++) {
+                Adapter *member = CALLOC(1, sizeof(Adapter));
+
+                *member                = *adapter;
+                member->fanout_members = NULL;
+                member->fanout_count   = 0;
+                member->afp            = afpacket_open(adapter_name, afp_opt);
+                adapter->fanout_members[i] = member;
+                if (member->afp == NULL) {
+                    LOG(LEVEL_ERROR,
+                        "(af_packet:'%s') can't open fanout socket #%u\n",
+                        adapter_name, i + 1);
+                    return 0;
+                }
+            }
+            LOG(LEVEL_INFO, "if(%s): af_packet: %u sockets in fanout group\n",
+                adapter_name, afp_opt->fanout_count);
+        }
+
+        LOG(LEVEL_INFO, "if(%s): successfully opened\n", adapter_name);
+        return adapter;
+    }
+
     /*----------------------------------------------------------------
      * Kludge: for using files
      *----------------------------------------------------------------*/
@@ -806,7 +1002,13 @@ pcap_error:
 
 void rawsock_set_filter(Adapter *adapter, const char *scan_filter,
                         const char *user_filter) {
-    if (!adapter->pcap)
+    if (adapter->xdp) {
+        LOG(LEVEL_DEBUG, "(af_xdp) BPF filter is not applied, packets are "
+                         "checked by scan modules\n");
+        return;
+    }
+
+    if (!adapter->pcap && !adapter->afp)
         return;
 
     const char *final_filter;
@@ -826,6 +1028,37 @@ void rawsock_set_filter(Adapter *adapter, const char *scan_filter,
     int                err;
     struct bpf_program bpfp;
 
+    /**
+     * We borrow the compiler of libpcap and attach the program to AF_PACKET
+     * socket directly.
+     */
+    if (adapter->afp) {
+        pcap_t *dead = PCAP.open_dead(adapter->link_type, 65535);
+        if (dead == NULL) {
+            LOG(LEVEL_WARN, "(af_packet) BPF filter is unavailable without "
+                            "libpcap\n");
+            return;
+        }
+
+        err = PCAP.compile(dead, &bpfp, final_filter, 1, PCAP_NETMASK_UNKNOWN);
+        if (err) {
+            LOGPCAPERROR(dead, "pcap_compile");
+            exit(1);
+        }
+
+        err = afpacket_set_filter(adapter->afp, &bpfp);
+        for (unsigned i = 1; i < adapter->fanout_count && !err; i++) {
+            err = afpacket_set_filter(adapter->fanout_members[i - 1]->afp,
+                                      &bpfp);
+        }
+        PCAP.freecode(&bpfp);
+        PCAP.close(dead);
+        if (err) {
+            exit(1);
+        }
+        return;
+    }
+
     err = PCAP.compile(adapter->pcap, &bpfp, final_filter, 1, 0);
     if (err) {
         LOGPCAPERROR(adapter->pcap, "pcap_compile");
@@ -894,7 +1127,7 @@ int rawsock_selftest_if(const char *ifname) {
     /*
      * Initialize the adapter.
      */
-    adapter = rawsock_init_adapter(ifname, 0, 0, 0, 0, 0, 0, 65535);
+    adapter = rawsock_init_adapter(ifname, 0, NULL, NULL, 0, 0, 0, 0, 0, 65535);
     if (adapter == 0) {
         puts("pcap = failed");
         return -1;
@@ -902,7 +1135,7 @@ int rawsock_selftest_if(const char *ifname) {
         puts("pcap = opened");
     }
 
-    acache = rawsock_init_cache(false);
+    acache = rawsock_init_cache(adapter, false);
 
     /* IPv4 address */
     ipv4 = rawsock_get_adapter_ip(ifname);
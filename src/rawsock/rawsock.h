@@ -13,6 +13,46 @@ typedef struct Adapter       Adapter;
 typedef struct Adapter_Cache Adapter_Cache;
 typedef struct TemplateSet   TmplSet;
 
+/**
+ * Geometry of the memory-mapped TPACKET_V3 rx ring for AF_PACKET mode.
+ */
+typedef struct AFPacketOption {
+    /*bytes of one block, must be a multiple of page size*/
+    unsigned block_size;
+    /*count of blocks in the ring*/
+    unsigned block_count;
+    /*milliseconds before kernel retires a block that is not full*/
+    unsigned block_timeout;
+    /*frames of tx ring owned by each tx thread*/
+    unsigned tx_frame_count;
+    /*sockets in the PACKET_FANOUT group, one for each rx thread*/
+    unsigned fanout_count;
+    /*use PACKET_TX_RING in every adapter cache*/
+    unsigned is_tx_ring : 1;
+} AFPacketOpt;
+
+/**
+ * Queues and UMEM of AF_XDP mode.
+ */
+typedef struct AFXDPOption {
+    /*bind one XSK to each of queue 0 ~ queue_count-1*/
+    unsigned queue_count;
+    /*UMEM frames of each XSK, half for rx and half for tx*/
+    unsigned frame_count;
+    /*native XDP and zero-copy instead of generic XDP and copy mode*/
+    unsigned is_zerocopy : 1;
+} AFXDPOpt;
+
+/**
+ * A received packet from rawsock_recv_batch.
+ */
+typedef struct RawsockFrame {
+    const unsigned char *packet;
+    unsigned             length;
+    unsigned             secs;
+    unsigned             usecs;
+} RawFrame;
+
 void rawsock_init(void);
 
 /**
@@ -23,6 +63,12 @@ void rawsock_init(void);
  *      The name of the adapter, like "eth0" or "dna1".
  * @param is_pfring
  *      Whether we should attempt to use the PF_RING driver (Linux-only)
+ * @param afp_opt
+ *      Ring geometry if we should use AF_PACKET socket with memory-mapped
+ *      TPACKET_V3 ring instead of libpcap (Linux-only). NULL if not.
+ * @param xdp_opt
+ *      Queues and UMEM if we should use AF_XDP sockets instead of libpcap
+ *      (Linux-only). NULL if not.
  * @param is_sendq
  *      Whether we should attempt to use a ring-buffer for sending packets.
  *      Currently Windows-only, but it'll be enabled for Linux soon. Big
@@ -37,9 +83,11 @@ void rawsock_init(void);
  *      a fully instantiated network adapter
  */
 Adapter *rawsock_init_adapter(const char *adapter_name, unsigned is_pfring,
-                              unsigned is_sendq, unsigned is_packet_trace,
-                              unsigned is_offline, unsigned is_vlan,
-                              unsigned vlan_id, unsigned snaplen);
+                              const AFPacketOpt *afp_opt,
+                              const AFXDPOpt *xdp_opt, unsigned is_sendq,
+                              unsigned is_packet_trace, unsigned is_offline,
+                              unsigned is_vlan, unsigned vlan_id,
+                              unsigned snaplen);
 
 void rawsock_set_filter(Adapter *adapter, const char *scan_filter,
                         const char *user_filter);
@@ -70,6 +118,13 @@ ipv6address rawsock_get_adapter_ipv6(const char *ifname);
  */
 int rawsock_get_adapter_mac(const char *ifname, unsigned char *mac);
 
+/**
+ * Find the NUMA node which the network adapter is attached to, so that we
+ * could put our threads and memory near it.
+ * @return node number, or -1 if unknown or not a NUMA system.
+ */
+int rawsock_get_adapter_numa(const char *ifname);
+
 int rawsock_get_default_gateway(const char *ifname, unsigned *ipv4);
 int rawsock_get_default_interface(char *ifname, size_t sizeof_ifname);
 
@@ -79,7 +134,8 @@ int rawsock_is_adapter_names_equal(const char *lhs, const char *rhs);
 
 /**
  * Transmit any queued (but not yet transmitted) packets. Useful only when
- * using a high-speed transmit mechanism. Since flushing happens automatically
+ * using a high-speed transmit mechanism like sendqueue, PF_RING or the
+ * PACKET_TX_RING of AF_PACKET. Since flushing happens automatically
  * whenever the transmit queue is full, this is only needed in boundary
  * cases, like when shutting down.
  */
@@ -88,13 +144,14 @@ void rawsock_flush(Adapter *adapter, AdapterCache *acache);
 /***************************************************************************
  * wrapper for libpcap's sendpacket
  *
- * PORTABILITY: WINDOWS and PF_RING
- * For performance, Windows and PF_RING can queue up multiple packets, then
- * transmit them all in a chunk. If we stop and wait for a bit, we need
- * to flush the queue to force packets to be transmitted immediately.
- * NOTE: Every `flush` operate in sendqueue or PFRING will not be executed
- * in this function except the queue or cache is full. The explicit `flush`
- * operation is in `rawsock_flush` function.
+ * PORTABILITY: WINDOWS, PF_RING and AF_PACKET
+ * For performance, Windows, PF_RING and TX_RING of AF_PACKET can queue up
+ * multiple packets, then transmit them all in a chunk. If we stop and wait
+ * for a bit, we need to flush the queue to force packets to be transmitted
+ * immediately.
+ * NOTE: Every `flush` operate in sendqueue, PFRING or TX_RING will not be
+ * executed in this function except the queue or cache is full. The explicit
+ * `flush` operation is in `rawsock_flush` function.
  ***************************************************************************/
 int rawsock_send_packet(Adapter *adapter, AdapterCache *acache,
                         const unsigned char *packet, unsigned length);
@@ -122,6 +179,35 @@ int rawsock_send_packet(Adapter *adapter, AdapterCache *acache,
 int rawsock_recv_packet(Adapter *adapter, unsigned *length, unsigned *secs,
                         unsigned *usecs, const unsigned char **packet);
 
+/**
+ * Called to read a batch of packets from the network. Memory-mapped rings of
+ * AF_PACKET and AF_XDP give us many packets at once without copying, other
+ * adapters just give one packet per call.
+ * NOTE: packets are only good until the next call of receiving.
+ * @param frames
+ *      array to hold received packets.
+ * @param max
+ *      max count of packets to receive.
+ * @return
+ *      count of received packets, 0 if no packet.
+ */
+unsigned rawsock_recv_batch(Adapter *adapter, RawFrame *frames, unsigned max);
+
+/**
+ * Get the adapter for a receive thread. Packets are spread over sockets of
+ * the PACKET_FANOUT group by kernel, so every rx thread receives from its
+ * own one.
+ * @param index index of the rx thread, 0 is the adapter itself.
+ */
+Adapter *rawsock_get_rx_adapter(Adapter *adapter, unsigned index);
+
+/**
+ * Which rx adapter the packets from this IP would be delivered to. It's the
+ * same hash as kernel does in PACKET_FANOUT group.
+ * @return index of the rx adapter, always 0 if no fanout.
+ */
+unsigned rawsock_fanout_index(const Adapter *adapter, ipaddress ip_them);
+
 /**
  * Optimization functions to tell the underlying network stack
  * to not capture the packets we transmit. Most of the time, Ethernet
@@ -132,6 +218,13 @@ void rawsock_ignore_transmits(Adapter *adapter, const char *ifname);
 
 void rawsock_set_nonblock(Adapter *adapter);
 
+/**
+ * Get count of received packets dropped by kernel or libpcap for full
+ * buffers in total, of all rx adapters. It's for AF_PACKET and libpcap, and
+ * always 0 for others.
+ */
+uint64_t rawsock_get_drops(Adapter *adapter);
+
 void rawsock_close_adapter(Adapter *adapter);
 
 int rawsock_selftest_if(const char *ifname);
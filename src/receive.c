@@ -26,6 +26,7 @@
 #include "templ/templ-arp.h"
 
 #include "dedup/dedup.h"
+#include "dedup/dedup-file.h"
 #include "util-out/logger.h"
 #include "util-data/fine-malloc.h"
 #include "util-scan/ptrace.h"
@@ -33,6 +34,139 @@
 #include "timeout/fast-timeout.h"
 #include "output-modules/output-modules.h"
 
+/**
+ * Max count of packets to receive, enqueue or dequeue at once. So that the
+ * per-packet overhead of syscalls and ring operations is amortized across
+ * the whole rx -> dispatch -> handle chain.
+ */
+#define RX_BURST_SIZE 64
+
+/**
+ * A fixed-size pool of Recved with inline packet storage. Objects are cut
+ * from one cache-line aligned slab and recycled through a free list ring:
+ * rx thread is the only consumer and handle threads put them back. So the
+ * hot path never touches malloc under high response rates.
+ */
+typedef struct RecvedPool {
+    PACKET_QUEUE  *free_list;
+    unsigned char *slab_raw;
+    unsigned char *slab;
+    size_t         slab_len;
+    /*Recved and its packet storage, aligned to cache line*/
+    size_t         obj_size;
+    unsigned       max_packet_len;
+} RecvedPool;
+
+/**
+ * @param obj_count objects could be in flight at most.
+ */
+static RecvedPool *_recved_pool_create(uint64_t obj_count,
+                                       unsigned max_packet_len) {
+    RecvedPool *pool       = CALLOC(1, sizeof(RecvedPool));
+    /*ring holds ring_count-1 objects at most*/
+    unsigned    ring_count = 2;
+
+    /*keep ring in size limit, the rest falls back to heap*/
+    if (obj_count > RTE_RING_SZ_MASK / 2)
+        obj_count = RTE_RING_SZ_MASK / 2;
+    while (ring_count <= obj_count)
+        ring_count <<= 1;
+
+    pool->max_packet_len = max_packet_len;
+    pool->obj_size = (sizeof(Recved) + max_packet_len + CACHE_LINE_MASK) &
+                     ~(size_t)CACHE_LINE_MASK;
+    pool->slab_len = pool->obj_size * obj_count;
+    pool->slab_raw = MALLOC(pool->slab_len + CACHE_LINE_SIZE);
+    pool->slab =
+        (unsigned char *)(((uintptr_t)pool->slab_raw + CACHE_LINE_MASK) &
+                          ~(uintptr_t)CACHE_LINE_MASK);
+
+    pool->free_list = rte_ring_create(ring_count, RING_F_SC_DEQ);
+    for (unsigned i = 0; i < obj_count; i++) {
+        int err = rte_ring_sp_enqueue(pool->free_list,
+                                      pool->slab + i * pool->obj_size);
+        if (err) {
+            LOG(LEVEL_ERROR, "(recved pool) enqueue: error %d\n", err);
+        }
+    }
+
+    return pool;
+}
+
+static void _recved_pool_destroy(RecvedPool *pool) {
+    FREE(pool->free_list);
+    FREE(pool->slab_raw);
+    FREE(pool);
+}
+
+static inline bool _recved_is_pooled(const RecvedPool *pool,
+                                     const Recved *recved) {
+    const unsigned char *p = (const unsigned char *)recved;
+    return p >= pool->slab && p < pool->slab + pool->slab_len;
+}
+
+/**
+ * Get a zeroed Recved with room for the packet. Only rx thread calls it.
+ * Fall back to heap if all pooled objects are in flight.
+ */
+static Recved *_recved_get(RecvedPool *pool, unsigned length) {
+    Recved *recved = NULL;
+
+    if (length <= pool->max_packet_len &&
+        rte_ring_sc_dequeue(pool->free_list, (void **)&recved) == 0) {
+        memset(recved, 0, sizeof(Recved));
+        recved->packet = (unsigned char *)(recved + 1);
+        return recved;
+    }
+
+    recved         = CALLOC(1, sizeof(Recved));
+    recved->packet = MALLOC(length);
+    return recved;
+}
+
+static void _recved_put(RecvedPool *pool, Recved *recved) {
+    if (_recved_is_pooled(pool, recved)) {
+        rte_ring_mp_enqueue(pool->free_list, recved);
+    } else {
+        FREE(recved->packet);
+        FREE(recved);
+    }
+}
+
+/**
+ * Put back a burst of Recved to their own pools. They may come from different
+ * rx threads in fanout mode.
+ */
+static void _recved_put_burst(RecvedPool **pools, unsigned pool_count,
+                              Recved **burst, unsigned n) {
+    void    *pooled[RX_BURST_SIZE];
+    unsigned left = n;
+
+    for (unsigned p = 0; p < pool_count && left; p++) {
+        unsigned count = 0;
+
+        for (unsigned k = 0; k < n; k++) {
+            if (burst[k] && _recved_is_pooled(pools[p], burst[k])) {
+                pooled[count++] = burst[k];
+                burst[k]        = NULL;
+            }
+        }
+
+        if (count) {
+            rte_ring_mp_enqueue_bulk(pools[p]->free_list, pooled, count);
+            left -= count;
+        }
+    }
+
+    for (unsigned k = 0; k < n && left; k++) {
+        if (burst[k]) {
+            FREE(burst[k]->packet);
+            FREE(burst[k]);
+            left--;
+        }
+    }
+}
+
 static uint8_t _dispatch_hash(ipaddress addr) {
     uint64_t ret = 0;
 
@@ -49,11 +183,51 @@ static uint8_t _dispatch_hash(ipaddress addr) {
     return ret & 0xFF;
 }
 
+/**
+ * Sort a burst of Recved to handle queues by ip_them, so that packets from
+ * the same target always go to the same handle thread. Handle queues decide
+ * to be enqueued in single or multi producer mode by themselves.
+ * @param handle_w waiters of handle threads to be woken up.
+ * @param sorted room for handle_num*RX_BURST_SIZE Recved.
+ * @param sorted_count handle_num counters of zero, and would be reset.
+ */
+static void _dispatch_burst(PACKET_QUEUE **handle_q, void **handle_w,
+                            unsigned handle_num, Recved **burst, unsigned n,
+                            Recved **sorted, unsigned *sorted_count) {
+    unsigned mask = handle_num - 1;
+
+    for (unsigned k = 0; k < n; k++) {
+        unsigned i = _dispatch_hash(burst[k]->parsed.src_ip) & mask;
+
+        sorted[i * RX_BURST_SIZE + sorted_count[i]] = burst[k];
+        sorted_count[i]++;
+    }
+
+    for (unsigned i = 0; i < handle_num; i++) {
+        if (sorted_count[i] == 0)
+            continue;
+
+        void **objs = (void **)&sorted[i * RX_BURST_SIZE];
+        for (int err = -ENOBUFS; err == -ENOBUFS;) {
+            err = rte_ring_enqueue_bulk(handle_q[i], objs, sorted_count[i]);
+            if (err == -ENOBUFS) {
+                LOG(LEVEL_ERROR, "handle queue #%d full.\n", i);
+                pixie_usleep(RTE_XTATE_ENQ_USEC);
+            }
+        }
+        sorted_count[i] = 0;
+
+        pixie_wake_waiter(handle_w[i]);
+    }
+}
+
 typedef struct RxDispatchConfig {
+    const XConf   *xconf;
     PACKET_QUEUE **handle_queue;
     PACKET_QUEUE  *dispatch_queue;
+    void         **handle_waiter;
+    void          *dispatch_waiter;
     unsigned       recv_handle_num;
-    unsigned       recv_handle_mask;
     uint64_t       entropy;
 } DispatchConf;
 
@@ -62,40 +236,40 @@ static void dispatch_thread(void *v) {
     pixie_set_thread_name(XTATE_NAME "-dsp");
 
     DispatchConf *parms = v;
-    while (!time_to_finish_rx) {
-        int     err    = 1;
-        Recved *recved = NULL;
+    Recved       *burst[RX_BURST_SIZE];
 
-        err = rte_ring_sc_dequeue(parms->dispatch_queue, (void **)&recved);
-        if (err != 0) {
-            pixie_usleep(RTE_XTATE_DEQ_USEC);
-            continue;
-        }
+    xconf_bind_cpu(parms->xconf, CpuRole_Dispatch, 0);
 
-        if (recved == NULL) {
-            LOG(LEVEL_ERROR,
-                "got empty Recved in dispatch thread. (IMPOSSIBLE)\n");
-            fflush(stdout);
-            exit(1);
-        }
+    /*packets sorted for every handle queue*/
+    Recved  **sorted =
+        MALLOC(parms->recv_handle_num * RX_BURST_SIZE * sizeof(Recved *));
+    unsigned *sorted_count = CALLOC(parms->recv_handle_num, sizeof(unsigned));
 
-        /**
-         * Send packet to recv handle queue according to ip_them.
-         * Ensure same target ip was dispatched to same handle thread.
-         */
-        uint8_t dsp_hash = _dispatch_hash(recved->parsed.src_ip);
+    while (!time_to_finish_rx) {
+        unsigned n = rte_ring_sc_dequeue_burst(parms->dispatch_queue,
+                                               (void **)burst, RX_BURST_SIZE);
+        if (n == 0) {
+            pixie_wait_waiter(parms->dispatch_waiter, RTE_XTATE_PARK_MSEC,
+                              rte_ring_is_ready, parms->dispatch_queue);
+            continue;
+        }
 
-        for (err = 1; err != 0;) {
-            unsigned i = dsp_hash & parms->recv_handle_mask;
-            err        = rte_ring_sp_enqueue(parms->handle_queue[i], recved);
-            if (err != 0) {
+        for (unsigned k = 0; k < n; k++) {
+            if (burst[k] == NULL) {
                 LOG(LEVEL_ERROR,
-                    "handle queue #%d full from dispatch thread.\n", i);
-                pixie_usleep(RTE_XTATE_ENQ_USEC);
+                    "got empty Recved in dispatch thread. (IMPOSSIBLE)\n");
+                fflush(stdout);
+                exit(1);
             }
         }
+
+        _dispatch_burst(parms->handle_queue, parms->handle_waiter,
+                        parms->recv_handle_num, burst, n, sorted, sorted_count);
     }
 
+    FREE(sorted);
+    FREE(sorted_count);
+
     LOG(LEVEL_DEBUG, "exiting dispatch thread\n");
 }
 
@@ -106,14 +280,94 @@ typedef struct RxHandleConfig {
     const XConf  *xconf;
     Scanner      *scanner;
     PACKET_QUEUE *handle_queue;
+    void         *handle_waiter;
+    /*Recved pools of all rx threads*/
+    RecvedPool  **recved_pools;
+    unsigned      pool_count;
     FHandler     *ft_handler;
     STACK        *stack;
     OutConf      *out_conf;
+    /*dedup shard of our targets with --dedup-in-handler*/
+    Dedup        *dedup;
+    /*fast-timeout events of our targets with --dedup-in-handler*/
+    PACKET_QUEUE *tm_queue;
     uint64_t      entropy;
     /*unique index of the handle thread that count from 0*/
     unsigned      index;
 } HandleConf;
 
+/**
+ * Do timeout_cb for the event if it's not duplicate in the dedup table.
+ * @return true if timeout_cb was done.
+ */
+static bool _handle_tm_event(const XConf *xconf, Dedup *dedup,
+                             FHandler *ft_handler, ScanTmEvent *tm_event) {
+    OutConf *out_conf = (OutConf *)(&xconf->out_conf);
+    bool     is_done  = false;
+
+    if (xconf->is_nodedup ||
+        !dedup_is_dup(dedup, tm_event->target.ip_them,
+                      tm_event->target.port_them, tm_event->target.ip_me,
+                      tm_event->target.port_me, tm_event->dedup_type)) {
+        OutItem item = {
+            .target.ip_proto  = tm_event->target.ip_proto,
+            .target.ip_them   = tm_event->target.ip_them,
+            .target.ip_me     = tm_event->target.ip_me,
+            .target.port_them = tm_event->target.port_them,
+            .target.port_me   = tm_event->target.port_me,
+        };
+
+        xconf->scanner->timeout_cb(xconf->seed, tm_event, &item, xconf->stack,
+                                   ft_handler);
+        output_result(out_conf, &item);
+
+        is_done = true;
+    }
+
+    ft_free_event(tm_event);
+
+    return is_done;
+}
+
+/*modes of sharding recorded in dedup snapshot files*/
+#define RX_SHARD_BY_WORKER  1
+#define RX_SHARD_BY_HANDLER 2
+
+/**
+ * Create the dedup table of a shard, in its own snapshot file if wanted.
+ */
+static Dedup *_dedup_init_shard(const XConf *xconf, unsigned index) {
+    char     filename[sizeof(xconf->dedup_filename) + 16];
+    char    *fname = NULL;
+    uint64_t sharding;
+
+    if (xconf->is_dedup_in_handler)
+        sharding = DEDUP_SHARDING(RX_SHARD_BY_HANDLER, xconf->rx_handler_count,
+                                  index);
+    else
+        sharding =
+            DEDUP_SHARDING(RX_SHARD_BY_WORKER, xconf->rx_thread_count, index);
+
+    if (xconf->dedup_filename[0]) {
+        if (index == 0)
+            snprintf(filename, sizeof(filename), "%s", xconf->dedup_filename);
+        else
+            snprintf(filename, sizeof(filename), "%s.%u",
+                     xconf->dedup_filename, index);
+        fname = filename;
+    }
+
+    return dedup_init(xconf->dedup_type, xconf->dedup_win,
+                      xconf->dedup_fp_rate, xconf->dedup_mem_limit, fname,
+                      sharding);
+}
+
+static bool _handle_is_ready(void *v) {
+    HandleConf *parms = v;
+    return rte_ring_is_ready(parms->handle_queue) ||
+           (parms->tm_queue && rte_ring_is_ready(parms->tm_queue));
+}
+
 static void handle_thread(void *v) {
     HandleConf  *parms = v;
     const XConf *xconf = parms->xconf;
@@ -124,19 +378,7 @@ static void handle_thread(void *v) {
     snprintf(th_name, sizeof(th_name), XTATE_NAME "-hdl #%u", parms->index);
     pixie_set_thread_name(th_name);
 
-    /* Lock threads to the CPUs one by one in this order:
-     *     1.Tx threads
-     *     2.Rx thread
-     *     3.Rx handle threads
-     * TODO: Make CPU locking be settable.
-     */
-    if (pixie_cpu_get_count() > 1 && !xconf->is_no_cpu_bind) {
-        unsigned cpu_count = pixie_cpu_get_count();
-        unsigned cpu_index = xconf->tx_thread_count + parms->index + 1;
-        /* I think it is better to make (cpu>=cpu_count) threads free */
-        if (cpu_index < cpu_count)
-            pixie_cpu_set_affinity(cpu_index);
-    }
+    xconf_bind_cpu(xconf, CpuRole_Handle, parms->index);
 
     while (!time_to_finish_rx) {
         /**
@@ -144,308 +386,524 @@ static void handle_thread(void *v) {
          */
         parms->scanner->poll_cb(parms->index);
 
-        Recved *recved = NULL;
-        int err = rte_ring_sc_dequeue(parms->handle_queue, (void **)&recved);
-        if (err != 0) {
-            pixie_usleep(RTE_XTATE_DEQ_USEC);
-            continue;
+        if (parms->dedup && xconf->is_dedup_per_round)
+            dedup_set_round(parms->dedup, global_round);
+
+        if (parms->tm_queue) {
+            void    *events[RX_BURST_SIZE];
+            unsigned n = rte_ring_sc_dequeue_burst(parms->tm_queue, events,
+                                                   RX_BURST_SIZE);
+            for (unsigned k = 0; k < n; k++) {
+                _handle_tm_event(xconf, parms->dedup, parms->ft_handler,
+                                 events[k]);
+            }
         }
 
-        if (recved == NULL) {
-            LOG(LEVEL_ERROR,
-                "got empty Recved in handle thread #%d. (IMPOSSIBLE)\n",
-                parms->index);
-            fflush(stdout);
-            exit(1);
+        Recved  *burst[RX_BURST_SIZE];
+        unsigned n = rte_ring_sc_dequeue_burst(parms->handle_queue,
+                                               (void **)burst, RX_BURST_SIZE);
+        if (n == 0) {
+            pixie_wait_waiter(parms->handle_waiter, RTE_XTATE_PARK_MSEC,
+                              _handle_is_ready, parms);
+            continue;
         }
 
-        OutItem item = {
-            .target.ip_proto  = recved->parsed.ip_protocol,
-            .target.ip_them   = recved->parsed.src_ip,
-            .target.ip_me     = recved->parsed.dst_ip,
-            .target.port_them = recved->parsed.port_src,
-            .target.port_me   = recved->parsed.port_dst,
-        };
+        for (unsigned k = 0; k < n; k++) {
+            Recved *recved = burst[k];
+
+            if (recved == NULL) {
+                LOG(LEVEL_ERROR,
+                    "got empty Recved in handle thread #%d. (IMPOSSIBLE)\n",
+                    parms->index);
+                fflush(stdout);
+                exit(1);
+            }
+
+            if (recved->go_dedup &&
+                dedup_is_dup(parms->dedup, recved->dedup_ip_them,
+                             recved->dedup_port_them, recved->dedup_ip_me,
+                             recved->dedup_port_me, recved->dedup_type)) {
+                continue;
+            }
 
-        parms->scanner->handle_cb(parms->index, parms->entropy, recved, &item,
-                                  parms->stack, parms->ft_handler);
+            OutItem item = {
+                .target.ip_proto  = recved->parsed.ip_protocol,
+                .target.ip_them   = recved->parsed.src_ip,
+                .target.ip_me     = recved->parsed.dst_ip,
+                .target.port_them = recved->parsed.port_src,
+                .target.port_me   = recved->parsed.port_dst,
+            };
 
-        output_result(parms->out_conf, &item);
+            parms->scanner->handle_cb(parms->index, parms->entropy, recved,
+                                      &item, parms->stack, parms->ft_handler);
 
-        FREE(recved->packet);
-        FREE(recved);
+            output_result(parms->out_conf, &item);
+        }
+
+        _recved_put_burst(parms->recved_pools, parms->pool_count, burst, n);
     }
 
     LOG(LEVEL_DEBUG, "exiting handle thread #%u                    \n",
         parms->index);
 }
 
-void receive_thread(void *v) {
-    RxThread        *parms        = (RxThread *)v;
-    const XConf     *xconf        = parms->xconf;
-    OutConf         *out_conf     = (OutConf *)(&xconf->out_conf);
-    Adapter         *adapter      = xconf->nic.adapter;
-    int              data_link    = stack_if_datalink(adapter);
-    uint64_t         entropy      = xconf->seed;
-    STACK           *stack        = xconf->stack;
-    Scanner         *scan_module  = xconf->scanner;
-    Dedup           *dedup        = NULL;
-    struct PcapFile *pcapfile     = NULL;
-    ScanTmEvent     *tm_event     = NULL;
-    FHandler        *ft_handler   = NULL;
-    unsigned         handler_num  = xconf->rx_handler_count;
-    size_t          *handler      = MALLOC(handler_num * sizeof(size_t));
-    HandleConf      *handle_parms = MALLOC(handler_num * sizeof(HandleConf));
-    PACKET_QUEUE   **handle_q = MALLOC(handler_num * sizeof(PACKET_QUEUE *));
-    size_t           dispatcher;
-    DispatchConf     dispatch_parms;
-    PACKET_QUEUE    *dispatch_q;
-    Recved          *recved;
-
-    LOG(LEVEL_DEBUG, "starting receive thread\n");
+/**
+ * Every receive thread owns an adapter and its own dedup table, pcap file and
+ * Recved pool. There is only one receive thread in default, or multiple ones
+ * in a PACKET_FANOUT group with packets hashed by ip_them. So that dedup
+ * tables are shards without overlap.
+ * With --dedup-in-handler, dedup tables are owned by handle threads instead
+ * and sharded by _dispatch_hash of ip_them.
+ */
+typedef struct RxWorkerConfig {
+    RxThread              *rx;
+    Adapter               *adapter;
+    Dedup                 *dedup;
+    struct PcapFile       *pcapfile;
+    RecvedPool            *recved_pool;
+    FHandler              *ft_handler;
+    /*fast-timeout events of our targets forwarded from the first worker*/
+    PACKET_QUEUE          *tm_queue;
+    /*all workers for forwarding fast-timeout events*/
+    struct RxWorkerConfig *workers;
+    /*all handlers for forwarding fast-timeout events*/
+    HandleConf            *handlers;
+    /*packets sorted for every handle queue while no dispatch thread*/
+    Recved               **sorted;
+    unsigned              *sorted_count;
+    size_t                 thread_handle;
+    unsigned               index;
+} RxWorker;
+
+/**
+ * Forward the event to the handle thread owning the dedup shard of target.
+ */
+static void _rx_forward_tm_event(RxWorker *worker, ScanTmEvent *tm_event) {
+    unsigned    mask  = worker->rx->xconf->rx_handler_count - 1;
+    unsigned    owner = _dispatch_hash(tm_event->target.ip_them) & mask;
+    HandleConf *hdl   = &worker->handlers[owner];
+
+    while (rte_ring_sp_enqueue(hdl->tm_queue, tm_event) == -ENOBUFS) {
+        LOG(LEVEL_ERROR, "timeout queue of handle thread #%u full.\n", owner);
+        pixie_usleep(RTE_XTATE_ENQ_USEC);
+    }
 
-    pixie_set_thread_name(XTATE_NAME "-recv");
+    pixie_wake_waiter(hdl->handle_waiter);
+}
 
-    if (xconf->is_offline) {
-        while (!time_to_finish_rx)
-            pixie_usleep(10000);
-        parms->done_receiving = true;
+static void _rx_handle_fast_timeout(RxWorker *worker) {
+    const XConf *xconf = worker->rx->xconf;
+    ScanTmEvent *tm_event;
+
+    /*events forwarded to us*/
+    if (worker->tm_queue) {
+        void    *events[RX_BURST_SIZE];
+        unsigned n = rte_ring_sc_dequeue_burst(worker->tm_queue, events,
+                                               RX_BURST_SIZE);
+        for (unsigned k = 0; k < n; k++) {
+            _handle_tm_event(xconf, worker->dedup, worker->ft_handler,
+                             events[k]);
+        }
         return;
     }
 
-    /* Lock threads to the CPUs one by one in this order:
-     *     1.Tx threads
-     *     2.Rx thread
-     *     3.Rx handle threads
-     * TODO: Make CPU locking be settable.
-     */
-    if (pixie_cpu_get_count() > 1 && !xconf->is_no_cpu_bind) {
-        unsigned cpu_count = pixie_cpu_get_count();
-        unsigned cpu_index = xconf->tx_thread_count;
-        /* I think it is better to make (cpu>=cpu_count) threads free */
-        if (cpu_index < cpu_count)
-            pixie_cpu_set_affinity(cpu_index);
-    }
+    /*handle only one actual fast-timeout event to avoid blocking*/
+    while (!time_to_finish_rx) {
+        tm_event = ft_pop_event(worker->ft_handler);
 
-    if (xconf->pcap_filename[0]) {
-        pcapfile = pcapfile_openwrite(xconf->pcap_filename, 1);
-    }
+        if (tm_event == NULL)
+            break;
 
-    if (!xconf->is_nodedup)
-        dedup = dedup_init(xconf->dedup_win);
+        if (xconf->is_dedup_in_handler) {
+            _rx_forward_tm_event(worker, tm_event);
+            continue;
+        }
 
-    if (xconf->is_fast_timeout) {
-        ft_handler = ft_get_handler(xconf->ft_table);
-    }
+        /*target would be handled by its owner with the dedup shard*/
+        unsigned owner = rawsock_fanout_index(xconf->nic.adapter,
+                                              tm_event->target.ip_them);
+        if (owner != worker->index) {
+            PACKET_QUEUE *tm_queue = worker->workers[owner].tm_queue;
+            /*never touch dedup shard of others, just wait for the owner*/
+            while (rte_ring_sp_enqueue(tm_queue, tm_event) == -ENOBUFS) {
+                if (time_to_finish_rx)
+                    break;
+                LOG(LEVEL_ERROR, "timeout queue of rx thread #%u full.\n",
+                    owner);
+                pixie_usleep(RTE_XTATE_ENQ_USEC);
+            }
+            continue;
+        }
 
-    /**
-     * init dispatch and handle threads
-     */
-    dispatch_q = rte_ring_create(xconf->dispatch_buf_count,
-                                 RING_F_SP_ENQ | RING_F_SC_DEQ);
-    for (unsigned i = 0; i < handler_num; i++) {
-        handle_q[i] = rte_ring_create(xconf->dispatch_buf_count,
-                                      RING_F_SP_ENQ | RING_F_SC_DEQ);
+        if (_handle_tm_event(xconf, worker->dedup, worker->ft_handler,
+                             tm_event))
+            break;
     }
 
-    parms->dispatch_q = dispatch_q;
-    parms->handle_q   = handle_q;
+    worker->rx->total_tm_event = ft_event_count(worker->ft_handler);
+}
 
-    dispatch_parms.entropy          = entropy;
-    dispatch_parms.handle_queue     = handle_q;
-    dispatch_parms.dispatch_queue   = dispatch_q;
-    dispatch_parms.recv_handle_num  = handler_num;
-    dispatch_parms.recv_handle_mask = handler_num - 1;
+static void _rx_worker_loop(RxWorker *worker) {
+    RxThread    *parms       = worker->rx;
+    const XConf *xconf       = parms->xconf;
+    Adapter     *adapter     = worker->adapter;
+    int          data_link   = stack_if_datalink(adapter);
+    uint64_t     entropy     = xconf->seed;
+    STACK       *stack       = xconf->stack;
+    Scanner     *scan_module = xconf->scanner;
+    RecvedPool  *recved_pool = worker->recved_pool;
+    Recved      *recved;
+    RawFrame     frames[RX_BURST_SIZE];
+    Recved      *burst[RX_BURST_SIZE];
+
+    LOG(LEVEL_DEBUG, "(rx thread #%u) starting main loop\n", worker->index);
+    while (!time_to_finish_rx) {
+        if (worker->dedup && xconf->is_dedup_per_round)
+            dedup_set_round(worker->dedup, global_round);
 
-    dispatcher = pixie_begin_thread(dispatch_thread, 0, &dispatch_parms);
+        if (xconf->is_fast_timeout)
+            _rx_handle_fast_timeout(worker);
 
-    for (unsigned i = 0; i < handler_num; i++) {
-        /*handle threads just add tm_event, it's thread safe*/
-        handle_parms[i].ft_handler = xconf->is_fast_timeout ? ft_handler : NULL;
-        handle_parms[i].scanner    = xconf->scanner;
-        handle_parms[i].handle_queue = handle_q[i];
-        handle_parms[i].xconf        = xconf;
-        handle_parms[i].stack        = stack;
-        handle_parms[i].out_conf     = out_conf;
-        handle_parms[i].entropy      = entropy;
-        handle_parms[i].index        = i;
+        unsigned pkt_count =
+            rawsock_recv_batch(adapter, frames, RX_BURST_SIZE);
+        unsigned burst_count = 0;
 
-        handler[i] = pixie_begin_thread(handle_thread, 0, &handle_parms[i]);
-    }
+        for (unsigned k = 0; k < pkt_count; k++) {
+            if (frames[k].length > xconf->max_packet_len) {
+                continue;
+            }
 
-    LOG(LEVEL_DEBUG, "(rx thread) starting main loop\n");
-    while (!time_to_finish_rx) {
-        /*handle only one actual fast-timeout event to avoid blocking*/
-        while (xconf->is_fast_timeout && !time_to_finish_rx) {
-            tm_event = ft_pop_event(ft_handler, global_now);
+            /**
+             * recved will not be handle in this thread.
+             * and packet received from Adapters cannot exist too long.
+             */
+            recved         = _recved_get(recved_pool, frames[k].length);
+            recved->length = frames[k].length;
+            recved->secs   = frames[k].secs;
+            recved->usecs  = frames[k].usecs;
+            memcpy(recved->packet, frames[k].packet, frames[k].length);
+
+            unsigned x = preprocess_frame(recved->packet, recved->length,
+                                          data_link, &recved->parsed);
+            if (!x) {
+                _recved_put(recved_pool, recved);
+                continue; /* corrupt packet */
+            }
 
-            if (tm_event == NULL)
-                break;
+            ipaddress ip_them   = recved->parsed.src_ip;
+            ipaddress ip_me     = recved->parsed.dst_ip;
+            unsigned  port_them = recved->parsed.port_src;
+            unsigned  port_me   = recved->parsed.port_dst;
+
+            assert(ip_me.version != 0);
+            assert(ip_them.version != 0);
+
+            recved->is_myip   = is_my_ip(stack->src, ip_me);
+            recved->is_myport = is_my_port(stack->src, port_me);
+
+            /**
+             * Do response for special arp&ndp packets while bypassing OS
+             * protocol stack to announce our existing.
+             */
+            if (xconf->is_bypass_os) {
+                /*NDP Neighbor Solicitations to a multicast address */
+                if (!recved->is_myip && is_ipv6_multicast(ip_me) &&
+                    recved->parsed.found == FOUND_NDPv6 &&
+                    recved->parsed.icmp_type == ICMPv6_TYPE_NS) {
+                    stack_ndpv6_incoming_request(stack, &recved->parsed,
+                                                 recved->packet,
+                                                 recved->length);
+                }
 
-            if ((!xconf->is_nodedup &&
-                 !dedup_is_dup(dedup, tm_event->target.ip_them,
-                               tm_event->target.port_them,
-                               tm_event->target.ip_me, tm_event->target.port_me,
-                               tm_event->dedup_type)) ||
-                xconf->is_nodedup) {
-                OutItem item = {
-                    .target.ip_proto  = tm_event->target.ip_proto,
-                    .target.ip_them   = tm_event->target.ip_them,
-                    .target.ip_me     = tm_event->target.ip_me,
-                    .target.port_them = tm_event->target.port_them,
-                    .target.port_me   = tm_event->target.port_me,
-                };
-
-                scan_module->timeout_cb(entropy, tm_event, &item, stack,
-                                        ft_handler);
-                output_result(out_conf, &item);
-
-                FREE(tm_event);
+                if (recved->is_myip) {
+                    if (recved->parsed.found == FOUND_NDPv6 &&
+                        recved->parsed.icmp_type == ICMPv6_TYPE_NS) {
+                        /* When responses come back from our scans, the router
+                         * will send us these packets. We need to respond to
+                         * them, so that the router can then forward the
+                         * packets to us. If we don't respond, we'll get no
+                         * responses. */
+                        stack_ndpv6_incoming_request(stack, &recved->parsed,
+                                                     recved->packet,
+                                                     recved->length);
+                    }
+                    if (recved->parsed.found == FOUND_ARP &&
+                        recved->parsed.arp_info.opcode == ARP_OPCODE_REQUEST) {
+                        /* This function will transmit a "reply" to somebody's
+                         * ARP request for our IP address (as part of our
+                         * user-mode TCP/IP). Since we completely bypass the
+                         * TCP/IP stack, we have to handle ARPs ourself, or the
+                         * router will lose track of us.*/
+                        stack_arp_incoming_request(
+                            stack, ip_me.ipv4, stack->source_mac,
+                            recved->packet, recved->length);
+                    }
+                }
+            }
 
-                break;
+            PreHandle pre = {
+                .dedup_ip_them   = ip_them,
+                .dedup_port_them = port_them,
+                .dedup_ip_me     = ip_me,
+                .dedup_port_me   = port_me,
+                .dedup_type      = SM_DFT_DEDUP_TYPE,
+            };
+
+            scan_module->validate_cb(entropy, recved, &pre);
+
+            if (!pre.go_record) {
+                _recved_put(recved_pool, recved);
+                continue;
             }
 
-            FREE(tm_event);
-        }
+            if (parms->xconf->packet_trace)
+                packet_trace(stdout, parms->pt_start, recved->packet,
+                             recved->length, false);
 
-        if (xconf->is_fast_timeout)
-            parms->total_tm_event = ft_event_count(ft_handler);
+            /* Save raw packet in --pcap file */
+            if (worker->pcapfile && !pre.no_record) {
+                pcapfile_writeframe(worker->pcapfile, recved->packet,
+                                    recved->length, recved->length,
+                                    recved->secs, recved->usecs);
+            }
 
-        unsigned             pkt_len, pkt_secs, pkt_usecs;
-        const unsigned char *pkt_data;
+            if (!pre.go_dedup) {
+                _recved_put(recved_pool, recved);
+                continue;
+            }
 
-        int err = rawsock_recv_packet(adapter, &pkt_len, &pkt_secs, &pkt_usecs,
-                                      &pkt_data);
-        if (err != 0) {
-            continue;
+            if (!xconf->is_nodedup && !pre.no_dedup &&
+                xconf->is_dedup_in_handler) {
+                recved->go_dedup        = 1;
+                recved->dedup_ip_them   = pre.dedup_ip_them;
+                recved->dedup_port_them = pre.dedup_port_them;
+                recved->dedup_ip_me     = pre.dedup_ip_me;
+                recved->dedup_port_me   = pre.dedup_port_me;
+                recved->dedup_type      = pre.dedup_type;
+            } else if (!xconf->is_nodedup && !pre.no_dedup) {
+                if (dedup_is_dup(worker->dedup, pre.dedup_ip_them,
+                                 pre.dedup_port_them, pre.dedup_ip_me,
+                                 pre.dedup_port_me, pre.dedup_type)) {
+                    _recved_put(recved_pool, recved);
+                    continue;
+                }
+            }
+
+            burst[burst_count++] = recved;
         }
-        if (pkt_len > xconf->max_packet_len) {
+
+        if (burst_count == 0)
             continue;
-        }
 
         /**
-         * recved will not be handle in this thread.
-         * and packet received from Adapters cannot exist too long.
+         * give the whole burst to dispatcher, or to handlers directly
          */
-        recved         = CALLOC(1, sizeof(Recved));
-        recved->packet = MALLOC(pkt_len);
-        recved->length = pkt_len;
-        recved->secs   = pkt_secs;
-        recved->usecs  = pkt_usecs;
-        memcpy(recved->packet, pkt_data, pkt_len);
+        if (parms->dispatch_q == NULL) {
+            _dispatch_burst(parms->handle_q, parms->handle_waiter,
+                            xconf->rx_handler_count, burst, burst_count,
+                            worker->sorted, worker->sorted_count);
+            continue;
+        }
 
-        unsigned x = preprocess_frame(recved->packet, recved->length, data_link,
-                                      &recved->parsed);
-        if (!x) {
-            FREE(recved->packet);
-            FREE(recved);
-            continue; /* corrupt packet */
+        for (int err = -ENOBUFS; err == -ENOBUFS;) {
+            err = rte_ring_sp_enqueue_bulk(parms->dispatch_q, (void **)burst,
+                                           burst_count);
+            if (err == -ENOBUFS) {
+                pixie_locked_add_u64(&parms->total_dispatch_full, 1);
+                LOG(LEVEL_ERROR,
+                    "dispatch queue full from rx thread with too fast rate.\n");
+                pixie_usleep(RTE_XTATE_ENQ_USEC);
+                // exit(1);
+            }
         }
 
-        ipaddress ip_them   = recved->parsed.src_ip;
-        ipaddress ip_me     = recved->parsed.dst_ip;
-        unsigned  port_them = recved->parsed.port_src;
-        unsigned  port_me   = recved->parsed.port_dst;
+        pixie_wake_waiter(parms->dispatch_waiter);
+    }
+}
 
-        assert(ip_me.version != 0);
-        assert(ip_them.version != 0);
+static void rx_worker_thread(void *v) {
+    RxWorker *worker = v;
 
-        recved->is_myip   = is_my_ip(stack->src, ip_me);
-        recved->is_myport = is_my_port(stack->src, port_me);
+    LOG(LEVEL_DEBUG, "starting receive thread #%u\n", worker->index);
 
-        /**
-         * Do response for special arp&ndp packets while bypassing OS protocol
-         * stack to announce our existing.
-         */
-        if (xconf->is_bypass_os) {
-            /*NDP Neighbor Solicitations to a multicast address */
-            if (!recved->is_myip && is_ipv6_multicast(ip_me) &&
-                recved->parsed.found == FOUND_NDPv6 &&
-                recved->parsed.icmp_type == ICMPv6_TYPE_NS) {
-                stack_ndpv6_incoming_request(stack, &recved->parsed,
-                                             recved->packet, recved->length);
-            }
+    char th_name[30];
+    snprintf(th_name, sizeof(th_name), XTATE_NAME "-recv #%u", worker->index);
+    pixie_set_thread_name(th_name);
 
-            if (recved->is_myip) {
-                if (recved->parsed.found == FOUND_NDPv6 &&
-                    recved->parsed.icmp_type == ICMPv6_TYPE_NS) {
-                    /* When responses come back from our scans, the router will
-                     * send us these packets. We need to respond to them, so
-                     * that the router can then forward the packets to us. If we
-                     * don't respond, we'll get no responses. */
-                    stack_ndpv6_incoming_request(
-                        stack, &recved->parsed, recved->packet, recved->length);
-                }
-                if (recved->parsed.found == FOUND_ARP &&
-                    recved->parsed.arp_info.opcode == ARP_OPCODE_REQUEST) {
-                    /* This function will transmit a "reply" to somebody's ARP
-                     * request for our IP address (as part of our user-mode
-                     * TCP/IP). Since we completely bypass the TCP/IP stack, we
-                     * have to handle ARPs ourself, or the router will lose
-                     * track of us.*/
-                    stack_arp_incoming_request(stack, ip_me.ipv4,
-                                               stack->source_mac,
-                                               recved->packet, recved->length);
-                }
-            }
-        }
+    xconf_bind_cpu(worker->rx->xconf, CpuRole_Rx, worker->index);
 
-        PreHandle pre = {
-            .dedup_ip_them   = ip_them,
-            .dedup_port_them = port_them,
-            .dedup_ip_me     = ip_me,
-            .dedup_port_me   = port_me,
-            .dedup_type      = SM_DFT_DEDUP_TYPE,
-        };
+    _rx_worker_loop(worker);
 
-        scan_module->validate_cb(entropy, recved, &pre);
+    LOG(LEVEL_DEBUG, "exiting receive thread #%u\n", worker->index);
+}
 
-        if (!pre.go_record) {
-            FREE(recved->packet);
-            FREE(recved);
-            continue;
-        }
+void receive_thread(void *v) {
+    RxThread      *parms        = (RxThread *)v;
+    const XConf   *xconf        = parms->xconf;
+    OutConf       *out_conf     = (OutConf *)(&xconf->out_conf);
+    uint64_t       entropy      = xconf->seed;
+    STACK         *stack        = xconf->stack;
+    FHandler      *ft_handler   = NULL;
+    unsigned       handler_num  = xconf->rx_handler_count;
+    unsigned       worker_num   = xconf->rx_thread_count;
+    uint64_t       pool_count;
+    size_t        *handler      = MALLOC(handler_num * sizeof(size_t));
+    HandleConf    *handle_parms = MALLOC(handler_num * sizeof(HandleConf));
+    PACKET_QUEUE **handle_q = MALLOC(handler_num * sizeof(PACKET_QUEUE *));
+    void         **handle_w     = MALLOC(handler_num * sizeof(void *));
+    RxWorker      *workers      = CALLOC(worker_num, sizeof(RxWorker));
+    RecvedPool   **recved_pools = MALLOC(worker_num * sizeof(RecvedPool *));
+    size_t         dispatcher   = 0;
+    DispatchConf   dispatch_parms;
+    PACKET_QUEUE  *dispatch_q   = NULL;
 
-        if (parms->xconf->packet_trace)
-            packet_trace(stdout, parms->pt_start, recved->packet,
-                         recved->length, false);
+    LOG(LEVEL_DEBUG, "starting receive thread\n");
 
-        /* Save raw packet in --pcap file */
-        if (pcapfile && !pre.no_record) {
-            pcapfile_writeframe(pcapfile, recved->packet, recved->length,
-                                recved->length, recved->secs, recved->usecs);
-        }
+    pixie_set_thread_name(XTATE_NAME "-recv");
 
-        if (!pre.go_dedup) {
-            FREE(recved->packet);
-            FREE(recved);
-            continue;
-        }
+    if (xconf->is_offline) {
+        while (!time_to_finish_rx)
+            pixie_usleep(10000);
+        FREE(handler);
+        FREE(handle_parms);
+        FREE(handle_q);
+        FREE(handle_w);
+        FREE(workers);
+        FREE(recved_pools);
+        parms->done_receiving = true;
+        return;
+    }
 
-        if (!xconf->is_nodedup && !pre.no_dedup) {
-            if (dedup_is_dup(dedup, pre.dedup_ip_them, pre.dedup_port_them,
-                             pre.dedup_ip_me, pre.dedup_port_me,
-                             pre.dedup_type)) {
-                FREE(recved->packet);
-                FREE(recved);
-                continue;
+    xconf_bind_cpu(xconf, CpuRole_Rx, 0);
+
+    if (xconf->is_fast_timeout) {
+        ft_handler = ft_get_handler(xconf->ft_table);
+    }
+
+    /**
+     * A slow handler could hold objects of a worker in the dispatch queue and
+     * all handle queues, plus bursts taken out of queues and sorted ones.
+     */
+    pool_count = (uint64_t)handler_num * xconf->dispatch_buf_count +
+                 (2 * handler_num + 1) * RX_BURST_SIZE;
+    if (worker_num == 1 && !xconf->is_no_dispatch)
+        pool_count += xconf->dispatch_buf_count;
+
+    /**
+     * init receive workers
+     */
+    for (unsigned i = 0; i < worker_num; i++) {
+        RxWorker *worker = &workers[i];
+
+        worker->rx          = parms;
+        worker->index       = i;
+        worker->workers     = workers;
+        worker->adapter     = rawsock_get_rx_adapter(xconf->nic.adapter, i);
+        worker->recved_pool = _recved_pool_create(pool_count,
+                                                  xconf->max_packet_len);
+        recved_pools[i]     = worker->recved_pool;
+
+        worker->handlers    = handle_parms;
+
+        if (!xconf->is_nodedup && !xconf->is_dedup_in_handler)
+            worker->dedup = _dedup_init_shard(xconf, i);
+
+        if (xconf->pcap_filename[0]) {
+            if (i == 0) {
+                worker->pcapfile = pcapfile_openwrite(xconf->pcap_filename, 1);
+            } else {
+                char filename[sizeof(xconf->pcap_filename) + 16];
+                snprintf(filename, sizeof(filename), "%s.%u",
+                         xconf->pcap_filename, i);
+                worker->pcapfile = pcapfile_openwrite(filename, 1);
             }
         }
 
-        /**
-         * give it to dispatcher
-         */
-        for (err = 1; err != 0;) {
-            err = rte_ring_sp_enqueue(dispatch_q, recved);
-            if (err != 0) {
-                LOG(LEVEL_ERROR,
-                    "dispatch queue full from rx thread with too fast rate.\n");
-                pixie_usleep(RTE_XTATE_ENQ_USEC);
-                // exit(1);
+        if (xconf->is_fast_timeout) {
+            /*the first worker pops events and forwards them to owners*/
+            if (i == 0) {
+                worker->ft_handler = ft_handler;
+            } else {
+                worker->ft_handler = ft_get_handler(xconf->ft_table);
+                worker->tm_queue   = rte_ring_create(
+                    xconf->dispatch_buf_count, RING_F_SP_ENQ | RING_F_SC_DEQ);
             }
         }
+
+        if (worker_num > 1 || xconf->is_no_dispatch) {
+            worker->sorted =
+                MALLOC(handler_num * RX_BURST_SIZE * sizeof(Recved *));
+            worker->sorted_count = CALLOC(handler_num, sizeof(unsigned));
+        }
     }
 
+    /**
+     * init dispatch and handle threads.
+     * Rx threads enqueue to handle queues directly if no dispatch thread.
+     */
+    for (unsigned i = 0; i < handler_num; i++) {
+        handle_q[i] = rte_ring_create(
+            xconf->dispatch_buf_count,
+            worker_num > 1 ? RING_F_SC_DEQ : RING_F_SP_ENQ | RING_F_SC_DEQ);
+        handle_w[i] = pixie_create_waiter(xconf->idle_spin_usec);
+    }
+
+    if (worker_num == 1 && !xconf->is_no_dispatch) {
+        dispatch_q = rte_ring_create(xconf->dispatch_buf_count,
+                                     RING_F_SP_ENQ | RING_F_SC_DEQ);
+        parms->dispatch_waiter = pixie_create_waiter(xconf->idle_spin_usec);
+    }
+
+    parms->dispatch_q    = dispatch_q;
+    parms->handle_q      = handle_q;
+    parms->handle_waiter = handle_w;
+
+    if (dispatch_q) {
+        dispatch_parms.xconf           = xconf;
+        dispatch_parms.entropy         = entropy;
+        dispatch_parms.handle_queue    = handle_q;
+        dispatch_parms.dispatch_queue  = dispatch_q;
+        dispatch_parms.handle_waiter   = handle_w;
+        dispatch_parms.dispatch_waiter = parms->dispatch_waiter;
+        dispatch_parms.recv_handle_num = handler_num;
+
+        dispatcher = pixie_begin_thread(dispatch_thread, 0, &dispatch_parms);
+    }
+
+    for (unsigned i = 0; i < handler_num; i++) {
+        /*handle threads just add tm_event, it's thread safe*/
+        /*every thread adds events through its own handler*/
+        handle_parms[i].ft_handler =
+            xconf->is_fast_timeout ? ft_get_handler(xconf->ft_table) : NULL;
+        handle_parms[i].scanner    = xconf->scanner;
+        handle_parms[i].handle_queue  = handle_q[i];
+        handle_parms[i].handle_waiter = handle_w[i];
+        handle_parms[i].recved_pools = recved_pools;
+        handle_parms[i].pool_count   = worker_num;
+        handle_parms[i].xconf        = xconf;
+        handle_parms[i].stack        = stack;
+        handle_parms[i].out_conf     = out_conf;
+        handle_parms[i].entropy      = entropy;
+        handle_parms[i].index        = i;
+
+        if (xconf->is_dedup_in_handler) {
+            if (!xconf->is_nodedup)
+                handle_parms[i].dedup = _dedup_init_shard(xconf, i);
+            if (xconf->is_fast_timeout)
+                handle_parms[i].tm_queue = rte_ring_create(
+                    xconf->dispatch_buf_count, RING_F_SP_ENQ | RING_F_SC_DEQ);
+        }
+
+        handler[i] = pixie_begin_thread(handle_thread, 0, &handle_parms[i]);
+    }
+
+    for (unsigned i = 1; i < worker_num; i++) {
+        workers[i].thread_handle =
+            pixie_begin_thread(rx_worker_thread, 0, &workers[i]);
+    }
+
+    _rx_worker_loop(&workers[0]);
+
     LOG(LEVEL_DEBUG,
         "exiting receive thread and joining handlers               \n");
 
@@ -453,31 +911,301 @@ void receive_thread(void *v) {
      * cleanup
      */
 
-    /*stop reader and handlers*/
-    pixie_thread_join(dispatcher);
+    /*stop receivers, reader and handlers*/
+    for (unsigned i = 1; i < worker_num; i++) {
+        pixie_thread_join(workers[i].thread_handle);
+    }
+    if (dispatch_q) {
+        pixie_thread_join(dispatcher);
+    }
     for (unsigned i = 0; i < handler_num; i++) {
         pixie_thread_join(handler[i]);
     }
 
-    if (!xconf->is_nodedup && dedup) {
-        dedup_close(dedup);
-        dedup = NULL;
-    }
-    if (pcapfile) {
-        pcapfile_close(pcapfile);
-        pcapfile = NULL;
+    for (unsigned i = 0; i < worker_num; i++) {
+        RxWorker *worker = &workers[i];
+
+        if (!xconf->is_nodedup && worker->dedup) {
+            dedup_close(worker->dedup);
+            worker->dedup = NULL;
+        }
+        if (worker->pcapfile) {
+            pcapfile_close(worker->pcapfile);
+            worker->pcapfile = NULL;
+        }
+        if (worker->recved_pool) {
+            _recved_pool_destroy(worker->recved_pool);
+            worker->recved_pool = NULL;
+        }
+        if (worker->tm_queue) {
+            void *tm_event;
+            while (rte_ring_sc_dequeue(worker->tm_queue, &tm_event) == 0)
+                ft_free_event(tm_event);
+            FREE(worker->tm_queue);
+        }
+        if (i > 0 && worker->ft_handler) {
+            ft_close_handler(worker->ft_handler);
+            worker->ft_handler = NULL;
+        }
+        FREE(worker->sorted);
+        FREE(worker->sorted_count);
     }
     if (xconf->is_fast_timeout && ft_handler) {
         ft_close_handler(ft_handler);
         ft_handler = NULL;
     }
-    if (dispatch_q) {
-        parms->handle_q = NULL;
+    for (unsigned i = 0; i < handler_num; i++) {
+        if (handle_parms[i].dedup) {
+            dedup_close(handle_parms[i].dedup);
+            handle_parms[i].dedup = NULL;
+        }
+        if (handle_parms[i].tm_queue) {
+            PACKET_QUEUE *tm_queue = handle_parms[i].tm_queue;
+            void         *tm_event;
+            while (rte_ring_sc_dequeue(tm_queue, &tm_event) == 0)
+                ft_free_event(tm_event);
+            FREE(handle_parms[i].tm_queue);
+        }
+        if (handle_parms[i].ft_handler) {
+            ft_close_handler(handle_parms[i].ft_handler);
+            handle_parms[i].ft_handler = NULL;
+        }
+        pixie_delete_waiter(handle_w[i]);
     }
+    if (parms->dispatch_waiter) {
+        pixie_delete_waiter(parms->dispatch_waiter);
+    }
+    parms->handle_q        = NULL;
+    parms->dispatch_q      = NULL;
+    parms->handle_waiter   = NULL;
+    parms->dispatch_waiter = NULL;
     FREE(handler);
     FREE(handle_parms);
     FREE(handle_q);
+    FREE(handle_w);
+    FREE(workers);
+    FREE(recved_pools);
 
     /* Thread is about to exit */
     parms->done_receiving = true;
 }
+
+/***************************************************************************
+ * Benchmark of passing packets from rx thread to handle threads with or
+ * without dispatch thread. Handlers just measure the latency since packets
+ * were got by rx thread.
+ ***************************************************************************/
+#define RX_BENCH_PACKETS 1000000ULL
+
+typedef struct RxBenchStage {
+    PACKET_QUEUE  *queue;
+    PACKET_QUEUE **handle_q;
+    RecvedPool    *pool;
+    /*parks us when queue is empty*/
+    void          *waiter;
+    void         **handle_w;
+    unsigned       handle_num;
+    /*upstream has enqueued all packets*/
+    volatile bool *upstream_done;
+    /*we have passed all packets to downstream*/
+    volatile bool  is_done;
+    uint64_t       count;
+    uint64_t       latency_ns;
+} RxBenchStage;
+
+static void _bench_dispatch_thread(void *v) {
+    RxBenchStage *stage = v;
+    Recved       *burst[RX_BURST_SIZE];
+    Recved      **sorted =
+        MALLOC(stage->handle_num * RX_BURST_SIZE * sizeof(Recved *));
+    unsigned *sorted_count = CALLOC(stage->handle_num, sizeof(unsigned));
+
+    for (;;) {
+        bool     is_last = *stage->upstream_done;
+        unsigned n       = rte_ring_sc_dequeue_burst(
+            stage->queue, (void **)burst, RX_BURST_SIZE);
+        if (n == 0) {
+            if (is_last)
+                break;
+            pixie_wait_waiter(stage->waiter, RTE_XTATE_PARK_MSEC,
+                              rte_ring_is_ready, stage->queue);
+            continue;
+        }
+
+        _dispatch_burst(stage->handle_q, stage->handle_w, stage->handle_num,
+                        burst, n, sorted, sorted_count);
+    }
+
+    FREE(sorted);
+    FREE(sorted_count);
+
+    stage->is_done = true;
+    for (unsigned i = 0; i < stage->handle_num; i++)
+        pixie_wake_waiter(stage->handle_w[i]);
+}
+
+static void _bench_handle_thread(void *v) {
+    RxBenchStage *stage = v;
+    Recved       *burst[RX_BURST_SIZE];
+
+    for (;;) {
+        bool     is_last = *stage->upstream_done;
+        unsigned n       = rte_ring_sc_dequeue_burst(
+            stage->queue, (void **)burst, RX_BURST_SIZE);
+        if (n == 0) {
+            if (is_last)
+                break;
+            pixie_wait_waiter(stage->waiter, RTE_XTATE_PARK_MSEC,
+                              rte_ring_is_ready, stage->queue);
+            continue;
+        }
+
+        uint64_t now = pixie_nanotime();
+        for (unsigned k = 0; k < n; k++) {
+            uint64_t stamp;
+            memcpy(&stamp, burst[k]->packet, sizeof(stamp));
+            stage->latency_ns += now - stamp;
+        }
+        stage->count += n;
+
+        _recved_put_burst(&stage->pool, 1, burst, n);
+    }
+}
+
+static void _bench_pipeline(unsigned handle_num, bool is_dispatch) {
+    RecvedPool    *pool;
+    PACKET_QUEUE **handle_q;
+    void         **handle_w;
+    RxBenchStage  *handlers;
+    size_t        *threads;
+    Recved       **sorted;
+    unsigned      *sorted_count;
+    RxBenchStage   dispatcher = {0};
+    size_t         dsp_thread = 0;
+    volatile bool  rx_done    = false;
+    Recved        *burst[RX_BURST_SIZE];
+    uint64_t       start, stop;
+    uint64_t       count   = 0;
+    uint64_t       latency = 0;
+
+    pool = _recved_pool_create(XCONF_DFT_DISPATCH_BUF_COUNT,
+                               XCONF_DFT_MAX_PKT_LEN);
+    handle_q     = MALLOC(handle_num * sizeof(PACKET_QUEUE *));
+    handle_w     = MALLOC(handle_num * sizeof(void *));
+    handlers     = CALLOC(handle_num, sizeof(RxBenchStage));
+    threads      = MALLOC(handle_num * sizeof(size_t));
+    sorted       = MALLOC(handle_num * RX_BURST_SIZE * sizeof(Recved *));
+    sorted_count = CALLOC(handle_num, sizeof(unsigned));
+
+    for (unsigned i = 0; i < handle_num; i++) {
+        handle_q[i] = rte_ring_create(XCONF_DFT_DISPATCH_BUF_COUNT,
+                                      RING_F_SP_ENQ | RING_F_SC_DEQ);
+        handle_w[i] = pixie_create_waiter(XCONF_DFT_IDLE_SPIN_USEC);
+        handlers[i].queue         = handle_q[i];
+        handlers[i].waiter        = handle_w[i];
+        handlers[i].pool          = pool;
+        handlers[i].upstream_done = is_dispatch ? &dispatcher.is_done
+                                                : &rx_done;
+    }
+
+    if (is_dispatch) {
+        dispatcher.queue         = rte_ring_create(
+            XCONF_DFT_DISPATCH_BUF_COUNT, RING_F_SP_ENQ | RING_F_SC_DEQ);
+        dispatcher.waiter        = pixie_create_waiter(XCONF_DFT_IDLE_SPIN_USEC);
+        dispatcher.handle_q      = handle_q;
+        dispatcher.handle_w      = handle_w;
+        dispatcher.handle_num    = handle_num;
+        dispatcher.upstream_done = &rx_done;
+
+        dsp_thread = pixie_begin_thread(_bench_dispatch_thread, 0, &dispatcher);
+    }
+
+    for (unsigned i = 0; i < handle_num; i++) {
+        threads[i] = pixie_begin_thread(_bench_handle_thread, 0, &handlers[i]);
+    }
+
+    /*act as rx thread*/
+    start = pixie_nanotime();
+    for (uint64_t i = 0; i < RX_BENCH_PACKETS; i += RX_BURST_SIZE) {
+        /*wait for pooled Recved instead of heap, so queues are never full*/
+        while (rte_ring_sc_dequeue_bulk(pool->free_list, (void **)burst,
+                                        RX_BURST_SIZE))
+            pixie_usleep(RTE_XTATE_DEQ_USEC);
+
+        uint64_t stamp = pixie_nanotime();
+
+        for (unsigned k = 0; k < RX_BURST_SIZE; k++) {
+            Recved *recved = burst[k];
+
+            memset(recved, 0, sizeof(Recved));
+            recved->packet                = (unsigned char *)(recved + 1);
+            recved->length                = sizeof(stamp);
+            recved->parsed.src_ip.version = 4;
+            recved->parsed.src_ip.ipv4    = (unsigned)(i + k) * 2654435761U;
+            memcpy(recved->packet, &stamp, sizeof(stamp));
+        }
+
+        if (!is_dispatch) {
+            _dispatch_burst(handle_q, handle_w, handle_num, burst,
+                            RX_BURST_SIZE, sorted, sorted_count);
+            continue;
+        }
+
+        for (int err = -ENOBUFS; err == -ENOBUFS;) {
+            err = rte_ring_sp_enqueue_bulk(dispatcher.queue, (void **)burst,
+                                           RX_BURST_SIZE);
+            if (err == -ENOBUFS)
+                pixie_usleep(RTE_XTATE_ENQ_USEC);
+        }
+        pixie_wake_waiter(dispatcher.waiter);
+    }
+    rx_done = true;
+    if (is_dispatch)
+        pixie_wake_waiter(dispatcher.waiter);
+    else
+        for (unsigned i = 0; i < handle_num; i++)
+            pixie_wake_waiter(handle_w[i]);
+
+    if (is_dispatch)
+        pixie_thread_join(dsp_thread);
+    for (unsigned i = 0; i < handle_num; i++) {
+        pixie_thread_join(threads[i]);
+        count   += handlers[i].count;
+        latency += handlers[i].latency_ns;
+    }
+    stop = pixie_nanotime();
+
+    double elapsed = ((double)(stop - start)) / (1000000000.0);
+    printf("handlers = %u, %-11s: packets/second = %6.3f-million, "
+           "latency = %8.2f-us\n",
+           handle_num, is_dispatch ? "dispatch" : "no-dispatch",
+           count / elapsed / 1000000.0,
+           count ? latency / (double)count / 1000.0 : 0.0);
+
+    for (unsigned i = 0; i < handle_num; i++) {
+        FREE(handle_q[i]);
+        pixie_delete_waiter(handle_w[i]);
+    }
+    if (dispatcher.waiter)
+        pixie_delete_waiter(dispatcher.waiter);
+    FREE(dispatcher.queue);
+    FREE(handle_q);
+    FREE(handle_w);
+    FREE(handlers);
+    FREE(threads);
+    FREE(sorted);
+    FREE(sorted_count);
+    _recved_pool_destroy(pool);
+}
+
+void receive_benchmark() {
+    puts("-- rx pipeline --");
+    printf("packets = %llu, burst = %u\n", RX_BENCH_PACKETS, RX_BURST_SIZE);
+
+    for (unsigned handle_num = 1; handle_num <= 4; handle_num <<= 1) {
+        _bench_pipeline(handle_num, true);
+        _bench_pipeline(handle_num, false);
+    }
+
+    putchar('\n');
+}
@@ -10,19 +10,25 @@ typedef struct RxThreadConfig {
     /** This points to the central configuration. Note that it's 'const',
      * meaning that the thread cannot change the contents. That'd be
      * unsafe */
-    const XConf   *xconf;
+    const XConf      *xconf;
     /*start time info for packet trace*/
-    double         pt_start;
+    double            pt_start;
     /*unhandled fast-timeout event*/
-    uint64_t       total_tm_event;
-    /*all queue from dispatch thread to handle threads*/
-    PACKET_QUEUE **handle_q;
-    /*queue from rx thread to dispatch thread*/
-    PACKET_QUEUE  *dispatch_q;
+    uint64_t          total_tm_event;
+    /*times of dispatch queue full, for adaptive rate*/
+    volatile uint64_t total_dispatch_full;
+    /*all queue from dispatch thread(or rx threads) to handle threads*/
+    PACKET_QUEUE    **handle_q;
+    /*queue from rx thread to dispatch thread, NULL if no dispatch thread*/
+    PACKET_QUEUE     *dispatch_q;
+    /*waiters parking idle handle threads, one per handle queue*/
+    void            **handle_waiter;
+    /*waiter parking idle dispatch thread, NULL if no dispatch thread*/
+    void             *dispatch_waiter;
     /*thread handler(id for process)*/
-    size_t         thread_handle_recv;
+    size_t            thread_handle_recv;
     /*is finished*/
-    bool           done_receiving;
+    bool              done_receiving;
 } RxThread;
 
 /***************************************************************************
@@ -32,4 +38,10 @@ typedef struct RxThreadConfig {
  ***************************************************************************/
 void receive_thread(void *v);
 
+/**
+ * Benchmark of passing packets to handle threads with or without dispatch
+ * thread in different count of handle threads.
+ */
+void receive_benchmark();
+
 #endif
\ No newline at end of file
@@ -57,8 +57,13 @@ typedef struct ScanModuleTarget {
     unsigned index;
 } ScanTarget;
 
-/*a timeout event for scanning*/
+/**
+ * A timeout event for scanning.
+ * Allocate it by ft_alloc_event with the handler to add it.
+ */
 typedef struct ScanTimeoutEvent {
+    /*must be the first*/
+    FEntry   ft_entry;
     Target   target;
     unsigned dedup_type;
     unsigned need_timeout : 1;
@@ -98,6 +103,13 @@ typedef struct PacketReceived {
     unsigned       usecs;
     unsigned       is_myip   : 1;
     unsigned       is_myport : 1;
+    /*to be deduped in handle thread with --dedup-in-handler*/
+    unsigned       go_dedup  : 1;
+    unsigned       dedup_port_them;
+    unsigned       dedup_port_me;
+    unsigned       dedup_type;
+    ipaddress      dedup_ip_them;
+    ipaddress      dedup_ip_me;
 } Recved;
 
 /**
@@ -116,7 +128,9 @@ typedef struct PacketPreHandle {
     /*go on with(out) deduping*/
     unsigned  no_dedup  : 1;
     /**
-     * Info for deduplication
+     * Info for deduplication.
+     * NOTE: dedup_ip_them should be ip_them of the packet, because dedup
+     * tables with --dedup-in-handler are sharded by it like dispatching.
      */
     ipaddress dedup_ip_them;
     unsigned  dedup_port_them;
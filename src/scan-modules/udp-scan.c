@@ -192,7 +192,7 @@ static void udp_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
 
                 /*add timeout*/
                 if (handler) {
-                    ScanTmEvent *tm_event = CALLOC(1, sizeof(ScanTmEvent));
+                    ScanTmEvent *tm_event = ft_alloc_event(handler);
 
                     tm_event->target.ip_proto  = IP_PROTO_UDP;
                     tm_event->target.ip_them   = recved->parsed.src_ip;
@@ -203,7 +203,7 @@ static void udp_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
                     tm_event->need_timeout = 1;
                     tm_event->dedup_type   = 0;
 
-                    ft_add_event(handler, tm_event, global_now);
+                    ft_add_event(handler, tm_event);
                     tm_event = NULL;
                 }
             }
@@ -242,7 +242,7 @@ static void udp_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
 
             /*add timeout*/
             if (handler) {
-                ScanTmEvent *tm_event = CALLOC(1, sizeof(ScanTmEvent));
+                ScanTmEvent *tm_event = ft_alloc_event(handler);
 
                 tm_event->target.ip_proto  = IP_PROTO_UDP;
                 tm_event->target.ip_them   = recved->parsed.src_ip;
@@ -253,7 +253,7 @@ static void udp_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
                 tm_event->need_timeout = 1;
                 tm_event->dedup_type   = 0;
 
-                ft_add_event(handler, tm_event, global_now);
+                ft_add_event(handler, tm_event);
                 tm_event = NULL;
             }
 
@@ -326,7 +326,7 @@ static void udp_timeout(uint64_t entropy, ScanTmEvent *event, OutItem *item,
 
             /*add timeout*/
             if (handler) {
-                ScanTmEvent *tm_event = CALLOC(1, sizeof(ScanTmEvent));
+                ScanTmEvent *tm_event = ft_alloc_event(handler);
 
                 tm_event->target.ip_proto  = IP_PROTO_UDP;
                 tm_event->target.ip_them   = event->target.ip_them;
@@ -337,7 +337,7 @@ static void udp_timeout(uint64_t entropy, ScanTmEvent *event, OutItem *item,
                 tm_event->need_timeout = 1;
                 tm_event->dedup_type   = 0;
 
-                ft_add_event(handler, tm_event, global_now);
+                ft_add_event(handler, tm_event);
                 tm_event = NULL;
             }
         }
@@ -375,7 +375,7 @@ static void udp_timeout(uint64_t entropy, ScanTmEvent *event, OutItem *item,
 
         /*add timeout*/
         if (handler) {
-            ScanTmEvent *tm_event = CALLOC(1, sizeof(ScanTmEvent));
+            ScanTmEvent *tm_event = ft_alloc_event(handler);
 
             tm_event->target.ip_proto  = IP_PROTO_UDP;
             tm_event->target.ip_them   = event->target.ip_them;
@@ -386,7 +386,7 @@ static void udp_timeout(uint64_t entropy, ScanTmEvent *event, OutItem *item,
             tm_event->need_timeout = 1;
             tm_event->dedup_type   = 0;
 
-            ft_add_event(handler, tm_event, global_now);
+            ft_add_event(handler, tm_event);
             tm_event = NULL;
         }
 
@@ -357,7 +357,7 @@ static void zbanner_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
 
             /*add timeout for banner*/
             if (handler && !zbanner_conf.no_banner_timeout) {
-                ScanTmEvent *tm_event = CALLOC(1, sizeof(ScanTmEvent));
+                ScanTmEvent *tm_event = ft_alloc_event(handler);
 
                 tm_event->target.ip_proto  = IP_PROTO_TCP;
                 tm_event->target.ip_them   = recved->parsed.src_ip;
@@ -368,7 +368,7 @@ static void zbanner_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
                 tm_event->need_timeout = 1;
                 tm_event->dedup_type   = 1; /*1 for banner*/
 
-                ft_add_event(handler, tm_event, global_now);
+                ft_add_event(handler, tm_event);
                 tm_event = NULL;
             }
 
@@ -393,7 +393,7 @@ static void zbanner_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
 
                     /*add timeout for port*/
                     if (handler && zbanner_conf.is_port_timeout) {
-                        ScanTmEvent *tm_event = CALLOC(1, sizeof(ScanTmEvent));
+                        ScanTmEvent *tm_event = ft_alloc_event(handler);
 
                         tm_event->target.ip_proto  = IP_PROTO_TCP;
                         tm_event->target.ip_them   = recved->parsed.src_ip;
@@ -404,7 +404,7 @@ static void zbanner_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
                         tm_event->need_timeout = 1;
                         tm_event->dedup_type   = 0; /*0 for port*/
 
-                        ft_add_event(handler, tm_event, global_now);
+                        ft_add_event(handler, tm_event);
                         tm_event = NULL;
                     }
                 }
@@ -482,7 +482,7 @@ static void zbanner_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
 
                 /*add timeout for port*/
                 if (handler && zbanner_conf.is_port_timeout) {
-                    ScanTmEvent *tm_event = CALLOC(1, sizeof(ScanTmEvent));
+                    ScanTmEvent *tm_event = ft_alloc_event(handler);
 
                     tm_event->target.ip_proto  = IP_PROTO_TCP;
                     tm_event->target.ip_them   = recved->parsed.src_ip;
@@ -493,7 +493,7 @@ static void zbanner_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
                     tm_event->need_timeout = 1;
                     tm_event->dedup_type   = 0; /*0 for port*/
 
-                    ft_add_event(handler, tm_event, global_now);
+                    ft_add_event(handler, tm_event);
                     tm_event = NULL;
                 }
             }
@@ -518,7 +518,7 @@ static void zbanner_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
 
             /*add timeout for port*/
             if (handler && zbanner_conf.is_port_timeout) {
-                ScanTmEvent *tm_event = CALLOC(1, sizeof(ScanTmEvent));
+                ScanTmEvent *tm_event = ft_alloc_event(handler);
 
                 tm_event->target.ip_proto  = IP_PROTO_TCP;
                 tm_event->target.ip_them   = recved->parsed.src_ip;
@@ -529,7 +529,7 @@ static void zbanner_handle(unsigned th_idx, uint64_t entropy, Recved *recved,
                 tm_event->need_timeout = 1;
                 tm_event->dedup_type   = 0; /*0 for port*/
 
-                ft_add_event(handler, tm_event, global_now);
+                ft_add_event(handler, tm_event);
                 tm_event = NULL;
             }
         }
@@ -581,7 +581,7 @@ static void zbanner_timeout(uint64_t entropy, ScanTmEvent *event, OutItem *item,
 
             /*add timeout for port*/
             if (handler && zbanner_conf.is_port_timeout) {
-                ScanTmEvent *tm_event = CALLOC(1, sizeof(ScanTmEvent));
+                ScanTmEvent *tm_event = ft_alloc_event(handler);
 
                 tm_event->target.ip_proto  = IP_PROTO_TCP;
                 tm_event->target.ip_them   = event->target.ip_them;
@@ -592,7 +592,7 @@ static void zbanner_timeout(uint64_t entropy, ScanTmEvent *event, OutItem *item,
                 tm_event->need_timeout = 1;
                 tm_event->dedup_type   = 0; /*0 for port*/
 
-                ft_add_event(handler, tm_event, global_now);
+                ft_add_event(handler, tm_event);
                 tm_event = NULL;
             }
         }
@@ -615,7 +615,7 @@ static void zbanner_timeout(uint64_t entropy, ScanTmEvent *event, OutItem *item,
 
         /*add timeout for port*/
         if (handler && zbanner_conf.is_port_timeout) {
-            ScanTmEvent *tm_event = CALLOC(1, sizeof(ScanTmEvent));
+            ScanTmEvent *tm_event = ft_alloc_event(handler);
 
             tm_event->target.ip_proto  = IP_PROTO_TCP;
             tm_event->target.ip_them   = event->target.ip_them;
@@ -626,7 +626,7 @@ static void zbanner_timeout(uint64_t entropy, ScanTmEvent *event, OutItem *item,
             tm_event->need_timeout = 1;
             tm_event->dedup_type   = 0; /*0 for port*/
 
-            ft_add_event(handler, tm_event, global_now);
+            ft_add_event(handler, tm_event);
             tm_event = NULL;
         }
     }
@@ -37,6 +37,8 @@ void stack_transmit_pktbuf(STACK *stack, PktBuf *response) {
             pixie_usleep(1000);
         }
     }
+
+    pixie_wake_waiter(stack->transmit_waiter);
 }
 
 /***************************************************************************
@@ -93,8 +95,8 @@ void stack_flush_packets(STACK *stack, Adapter *adapter, AdapterCache *acache,
     }
 }
 
-STACK *stack_create(macaddress_t source_mac, StackSrc *src,
-                    unsigned buf_count) {
+STACK *stack_create(macaddress_t source_mac, StackSrc *src, unsigned buf_count,
+                    unsigned spin_usec) {
     STACK *stack;
     size_t i;
 
@@ -106,8 +108,9 @@ STACK *stack_create(macaddress_t source_mac, StackSrc *src,
      * NOTE:
      * We must consider multi-providers and multi-consumers now
      */
-    stack->packet_buffers = rte_ring_create(buf_count, 0);
-    stack->transmit_queue = rte_ring_create(buf_count, 0);
+    stack->packet_buffers  = rte_ring_create(buf_count, 0);
+    stack->transmit_queue  = rte_ring_create(buf_count, 0);
+    stack->transmit_waiter = pixie_create_waiter(spin_usec);
     for (i = 0; i < buf_count - 1; i++) {
         PktBuf *p;
         int     err;
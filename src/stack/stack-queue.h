@@ -23,6 +23,8 @@ typedef struct PacketBuffer {
 typedef struct StackWithQueue {
     PACKET_QUEUE *packet_buffers;
     PACKET_QUEUE *transmit_queue;
+    /*for tx threads to wait packets in transmit_queue*/
+    void         *transmit_waiter;
     macaddress_t  source_mac;
     StackSrc     *src;
 } STACK;
@@ -43,6 +45,11 @@ void stack_transmit_pktbuf(STACK *stack, PktBuf *response);
 void stack_flush_packets(STACK *stack, Adapter *adapter, AdapterCache *acache,
                          uint64_t *packets_sent, uint64_t *batchsize);
 
-STACK *stack_create(macaddress_t source_mac, StackSrc *src, unsigned buf_count);
+/**
+ * @param spin_usec time of busy-polling before parking for tx threads waiting
+ * packets in transmit_queue.
+ */
+STACK *stack_create(macaddress_t source_mac, StackSrc *src, unsigned buf_count,
+                    unsigned spin_usec);
 
 #endif
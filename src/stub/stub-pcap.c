@@ -99,6 +99,8 @@ static int (*null_PCAP_COMPILE)(pcap_t *p, struct bpf_program *fp,
                                 const char *str, int optimize,
                                 uint32_t netmask);
 static int (*null_PCAP_SETFILTER)(pcap_t *p, struct bpf_program *fp);
+static void (*null_PCAP_FREECODE)(struct bpf_program *fp);
+static pcap_t *(*null_PCAP_OPEN_DEAD)(int linktype, int snaplen);
 static int (*null_PCAP_SETNONBLOCK)(pcap_t *p, int nonblock, char *errbuf);
 #else
 static pcap_t *null_PCAP_CREATE(const char *source, char *errbuf) { return 0; }
@@ -121,6 +123,8 @@ static int null_PCAP_COMPILE(pcap_t *p, struct bpf_program *fp, const char *str,
     return 0;
 }
 static int null_PCAP_SETFILTER(pcap_t *p, struct bpf_program *fp) { return 0; }
+static void    null_PCAP_FREECODE(struct bpf_program *fp) {}
+static pcap_t *null_PCAP_OPEN_DEAD(int linktype, int snaplen) { return 0; }
 static int null_PCAP_SETNONBLOCK(pcap_t *p, int nonblock, char *errbuf) {
     return 0;
 }
@@ -279,6 +283,13 @@ static const char *null_PCAP_GETERR(pcap_t *p) {
     UNUSEDPARM(p);
     return "(unknown)";
 }
+static int null_PCAP_STATS(pcap_t *p, struct pcap_stat *ps) {
+#ifdef STATICPCAP
+    return pcap_stats(p, ps);
+#endif
+    my_null(2, p, ps);
+    return -1;
+}
 static const char *null_PCAP_DEV_NAME(const pcap_if_t *dev) {
     return dev->name;
 }
@@ -427,6 +438,7 @@ int pcap_init(void) {
     DOLINK(PCAP_DATALINK_VAL_TO_NAME, datalink_val_to_name);
     DOLINK(PCAP_PERROR, perror);
     DOLINK(PCAP_GETERR, geterr);
+    DOLINK(PCAP_STATS, stats);
 
     /* pseudo functions that don't exist in the libpcap interface */
     pl->dev_name        = null_PCAP_DEV_NAME;
@@ -453,6 +465,8 @@ int pcap_init(void) {
 
     DOLINK(PCAP_COMPILE, compile);
     DOLINK(PCAP_SETFILTER, setfilter);
+    DOLINK(PCAP_FREECODE, freecode);
+    DOLINK(PCAP_OPEN_DEAD, open_dead);
     DOLINK(PCAP_LOOKUPNET, lookupnet);
     DOLINK(PCAP_SETNONBLOCK, setnonblock);
     DOLINK(PCAP_NEXT_EX, next_ex);
@@ -87,6 +87,12 @@ enum {
 /* The packet header for capturing packets. Apple macOS inexplicably adds
  * an extra comment-field onto the end of this, so the definition needs
  * to be careful to match the real definition */
+struct pcap_stat {
+    unsigned ps_recv;
+    unsigned ps_drop;
+    unsigned ps_ifdrop;
+};
+
 struct pcap_pkthdr {
     struct pcap_timeval ts;
     unsigned            caplen;
@@ -124,6 +130,7 @@ typedef int (*PCAP_SETDIRECTION)(pcap_t *, pcap_direction_t);
 typedef const char *(*PCAP_DATALINK_VAL_TO_NAME)(int dlt);
 typedef void (*PCAP_PERROR)(pcap_t *p, char *prefix);
 typedef const char *(*PCAP_GETERR)(pcap_t *p);
+typedef int (*PCAP_STATS)(pcap_t *p, struct pcap_stat *ps);
 typedef const char *(*PCAP_DEV_NAME)(const pcap_if_t *dev);
 typedef const char *(*PCAP_DEV_DESCRIPTION)(const pcap_if_t *dev);
 typedef const pcap_if_t *(*PCAP_DEV_NEXT)(const pcap_if_t *dev);
@@ -149,6 +156,8 @@ typedef int (*PCAP_LOOKUPNET)(const char *device, uint32_t *netp,
 typedef int (*PCAP_COMPILE)(pcap_t *p, struct bpf_program *fp, const char *str,
                             int optimize, uint32_t netmask);
 typedef int (*PCAP_SETFILTER)(pcap_t *p, struct bpf_program *fp);
+typedef void (*PCAP_FREECODE)(struct bpf_program *fp);
+typedef pcap_t *(*PCAP_OPEN_DEAD)(int linktype, int snaplen);
 typedef int (*PCAP_SETNONBLOCK)(pcap_t *p, int nonblock, char *errbuf);
 typedef int (*PCAP_NEXT_EX)(pcap_t *p, struct pcap_pkthdr **h,
                             const unsigned char **pkt_data);
@@ -195,6 +204,7 @@ struct PcapFunctions {
     PCAP_DATALINK_VAL_TO_NAME datalink_val_to_name;
     PCAP_PERROR               perror;
     PCAP_GETERR               geterr;
+    PCAP_STATS                stats;
     /* Accessor functions for opaque data structure, don't really
      * exist in libpcap */
     PCAP_DEV_NAME             dev_name;
@@ -219,6 +229,8 @@ struct PcapFunctions {
     PCAP_LOOKUPNET            lookupnet;
     PCAP_COMPILE              compile;
     PCAP_SETFILTER            setfilter;
+    PCAP_FREECODE             freecode;
+    PCAP_OPEN_DEAD            open_dead;
     PCAP_SETNONBLOCK          setnonblock;
     PCAP_NEXT_EX              next_ex;
 };
@@ -190,4 +190,6 @@ void rangelist_sort(struct RangeList *targets);
 
 int ranges_selftest(void);
 
+void ranges_benchmark(void);
+
 #endif
@@ -5,6 +5,7 @@
 #include "target-rangev4.h"
 #include "../util-data/fine-malloc.h"
 #include "../util-out/logger.h"
+#include "../pixie/pixie-timer.h"
 #include "target-set.h"
 #include "target-parse.h"
 
@@ -161,7 +162,21 @@ int128_t targetset_count(TargetSet *targetset) {
  ***************************************************************************/
 bool range6list_is_contains(const struct Range6List *targets,
                             const ipv6address        ip) {
-    unsigned i;
+    size_t i;
+    size_t min = 0;
+    size_t max = targets->list_len;
+    size_t mid;
+
+    if (targets->is_sorted) {
+        while (min < max) {
+            mid = min + (max - min) / 2;
+            if (!LESSEQ(ip, targets->list[mid].end))
+                min = mid + 1;
+            else
+                max = mid;
+        }
+        return min < targets->list_len && LESSEQ(targets->list[min].begin, ip);
+    }
 
     for (i = 0; i < targets->list_len; i++) {
         struct Range6 *range = &targets->list[i];
@@ -459,34 +474,28 @@ int128_t range6list_count(const struct Range6List *targets) {
 /***************************************************************************
  ***************************************************************************/
 ipv6address range6list_pick(const struct Range6List *targets, uint64_t index) {
-    size_t        maxmax = targets->list_len;
-    size_t        min    = 0;
-    size_t        max    = targets->list_len;
-    size_t        mid;
     const size_t *picker = targets->picker;
+    size_t        len    = targets->list_len;
+    size_t        half;
 
     if (picker == NULL) {
         LOG(LEVEL_ERROR, "ipv6 picker is null\n");
         exit(1);
     }
 
-    for (;;) {
-        mid = min + (max - min) / 2;
-        if (index < picker[mid]) {
-            max = mid;
-            continue;
-        }
-        if (index >= picker[mid]) {
-            if (mid + 1 == maxmax)
-                break;
-            else if (index < picker[mid + 1])
-                break;
-            else
-                min = mid + 1;
-        }
+    /*
+     * Same branchless binary search as rangelist_pick.
+     */
+    while (len > 1) {
+        half = len / 2;
+        PREFETCH(&picker[half / 2]);
+        PREFETCH(&picker[half + half / 2]);
+        picker = (picker[half] <= index) ? picker + half : picker;
+        len -= half;
     }
 
-    return _int128_add64(targets->list[mid].begin, (index - picker[mid]));
+    return _int128_add64(targets->list[picker - targets->picker].begin,
+                         (index - *picker));
 }
 
 /***************************************************************************
@@ -641,4 +650,47 @@ int ranges6_selftest() {
         return 1;
 
     return 0;
-}
\ No newline at end of file
+}
+
+#define RANGES6_BENCH_PICKS 10000000ULL
+
+void ranges6_benchmark() {
+    static const unsigned counts[] = {10, 10000, 1000000};
+    volatile uint64_t     result   = 0;
+    uint64_t              start, stop;
+    uint64_t              range, x;
+    unsigned              seed;
+
+    puts("-- range6list pick --");
+
+    for (unsigned i = 0; i < ARRAY_SIZE(counts); i++) {
+        struct Range6List targets[1] = {{0}};
+        ipv6address       begin      = {0x20010DB800000000ULL, 0};
+        ipv6address       end        = begin;
+
+        seed = 1;
+        for (unsigned j = 0; j < counts[i]; j++) {
+            begin.lo = end.lo + r_rand(&seed) % 256 + 2;
+            end.lo   = begin.lo + r_rand(&seed) % 256;
+            range6list_add_range(targets, begin, end);
+        }
+        range6list_optimize(targets);
+        range = range6list_count(targets).lo;
+
+        x     = 1;
+        start = pixie_nanotime();
+        for (uint64_t n = 0; n < RANGES6_BENCH_PICKS; n++) {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            result += range6list_pick(targets, ((x >> 32) * range) >> 32).lo;
+        }
+        stop = pixie_nanotime();
+
+        printf("%8u ranges: branchless %6.2f-ns/pick\n",
+               (unsigned)targets->list_len,
+               (double)(stop - start) / RANGES6_BENCH_PICKS);
+
+        range6list_remove_all(targets);
+    }
+
+    putchar('\n');
+}
@@ -164,4 +164,6 @@ void range6list_sort(struct Range6List *targets);
 
 int ranges6_selftest();
 
+void ranges6_benchmark();
+
 #endif
@@ -0,0 +1,561 @@
+#include "target-trie.h"
+#include "../util-misc/cross.h"
+#include "../util-data/fine-malloc.h"
+#include "../util-out/logger.h"
+#include "../pixie/pixie-timer.h"
+
+#include <string.h>
+
+#define TRIE_EMPTY 0
+#define TRIE_FULL  1
+#define TRIE_PART  2
+
+typedef struct TrieNode {
+    uint64_t vector; /*bit i set if child i is an internal node*/
+    uint64_t leaf;   /*bit i set if child i is a leaf in the set*/
+    uint32_t base;   /*index of the first internal child*/
+} TrieNode;
+
+typedef struct TrieFamily {
+    /*TRIE_EMPTY, TRIE_FULL or index of node*/
+    uint32_t *top;
+    /*node 0 and 1 are reserved for TRIE_EMPTY and TRIE_FULL*/
+    TrieNode *nodes;
+    uint32_t  node_count;
+    uint32_t  node_size;
+    unsigned  width;
+} TrieFamily;
+
+struct TargetTrie {
+    TrieFamily v4;
+    TrieFamily v6;
+};
+
+/*
+ * Addresses of both families are handled as 128-bit integers while building
+ * and walking, IPv4 is just in the low 32 bits.
+ */
+static inline bool _u128_less(ipv6address a, ipv6address b) {
+    return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+static inline ipv6address _u128_or(ipv6address a, ipv6address b) {
+    a.hi |= b.hi;
+    a.lo |= b.lo;
+    return a;
+}
+
+static inline ipv6address _u128_shl(uint64_t v, unsigned shift) {
+    ipv6address r = {0, 0};
+
+    if (shift >= 64) {
+        r.hi = v << (shift - 64);
+    } else {
+        r.lo = v << shift;
+        if (shift)
+            r.hi = v >> (64 - shift);
+    }
+    return r;
+}
+
+/*a value with the low bits set*/
+static inline ipv6address _u128_ones(unsigned bits) {
+    ipv6address r = {0, 0};
+
+    if (bits >= 64) {
+        r.lo = ~0ULL;
+        if (bits > 64)
+            r.hi = ~0ULL >> (128 - bits);
+    } else if (bits) {
+        r.lo = ~0ULL >> (64 - bits);
+    }
+    return r;
+}
+
+/*n bits of a from the shift-th lowest bit*/
+static inline unsigned _u128_bits(ipv6address a, unsigned shift, unsigned n) {
+    uint64_t x;
+
+    if (shift >= 64)
+        x = a.hi >> (shift - 64);
+    else if (shift == 0)
+        x = a.lo;
+    else
+        x = (a.lo >> shift) | (a.hi << (64 - shift));
+
+    return (unsigned)(x & ((1ULL << n) - 1));
+}
+
+static inline unsigned _trie_stride(unsigned width, unsigned depth) {
+    return width - depth < TRIE_STRIDE ? width - depth : TRIE_STRIDE;
+}
+
+static uint32_t _trie_alloc(TrieFamily *fam, unsigned count) {
+    uint32_t idx = fam->node_count;
+
+    if (fam->node_count + count > fam->node_size) {
+        while (fam->node_count + count > fam->node_size)
+            fam->node_size = fam->node_size * 2 + 64;
+        fam->nodes =
+            REALLOCARRAY(fam->nodes, fam->node_size, sizeof(*fam->nodes));
+    }
+    memset(&fam->nodes[idx], 0, count * sizeof(*fam->nodes));
+    fam->node_count += count;
+
+    return idx;
+}
+
+/**
+ * Check how the sorted ranges cover [lo, hi].
+ * @param cursor moves forward to the first range not ending before lo.
+ */
+static unsigned _trie_classify(const struct Range6 *list, size_t len,
+                               size_t *cursor, ipv6address lo,
+                               ipv6address hi) {
+    size_t c = *cursor;
+
+    while (c < len && _u128_less(list[c].end, lo))
+        c++;
+    *cursor = c;
+
+    if (c == len || _u128_less(hi, list[c].begin))
+        return TRIE_EMPTY;
+    if (!_u128_less(lo, list[c].begin) && !_u128_less(list[c].end, hi))
+        return TRIE_FULL;
+    return TRIE_PART;
+}
+
+static void _trie_build(TrieFamily *fam, uint32_t idx, ipv6address prefix,
+                        unsigned depth, const struct Range6 *list, size_t len,
+                        size_t cursor) {
+    unsigned    n      = _trie_stride(fam->width, depth);
+    unsigned    shift  = fam->width - depth - n;
+    ipv6address ones   = _u128_ones(shift);
+    uint64_t    vector = 0;
+    uint64_t    leaf   = 0;
+    ipv6address lo[1 << TRIE_STRIDE];
+    size_t      cur[1 << TRIE_STRIDE];
+    uint32_t    base;
+
+    for (unsigned i = 0; i < (1U << n); i++) {
+        lo[i] = _u128_or(prefix, _u128_shl(i, shift));
+
+        switch (_trie_classify(list, len, &cursor, lo[i],
+                               _u128_or(lo[i], ones))) {
+            case TRIE_FULL:
+                leaf |= 1ULL << i;
+                break;
+            case TRIE_PART:
+                vector |= 1ULL << i;
+                cur[i] = cursor;
+                break;
+        }
+    }
+
+    /*children must be contiguous, allocate them at once*/
+    base                   = _trie_alloc(fam, POPCNT64(vector));
+    fam->nodes[idx].vector = vector;
+    fam->nodes[idx].leaf   = leaf;
+    fam->nodes[idx].base   = base;
+
+    for (unsigned i = 0; i < (1U << n); i++) {
+        if (vector & (1ULL << i))
+            _trie_build(fam, base++, lo[i], depth + n, list, len, cur[i]);
+    }
+}
+
+static void _trie_build_family(TrieFamily *fam, unsigned width,
+                               const struct Range6 *list, size_t len) {
+    unsigned    shift  = width - TRIE_TOP_BITS;
+    ipv6address ones   = _u128_ones(shift);
+    size_t      cursor = 0;
+    ipv6address lo;
+    uint32_t    idx;
+
+    fam->width = width;
+    fam->top   = CALLOC(1U << TRIE_TOP_BITS, sizeof(*fam->top));
+    _trie_alloc(fam, 2);
+
+    for (unsigned i = 0; i < (1U << TRIE_TOP_BITS); i++) {
+        lo = _u128_shl(i, shift);
+
+        switch (_trie_classify(list, len, &cursor, lo, _u128_or(lo, ones))) {
+            case TRIE_FULL:
+                fam->top[i] = TRIE_FULL;
+                break;
+            case TRIE_PART:
+                idx         = _trie_alloc(fam, 1);
+                fam->top[i] = idx;
+                _trie_build(fam, idx, lo, TRIE_TOP_BITS, list, len, cursor);
+                break;
+        }
+    }
+}
+
+TargetTrie *targettrie_create(const TargetSet *targets) {
+    TargetTrie       *trie = CALLOC(1, sizeof(*trie));
+    struct RangeList  ipv4 = {0};
+    struct Range6List ipv6 = {0};
+    struct Range6    *list4;
+
+    /*sorted copies*/
+    rangelist_merge(&ipv4, &targets->ipv4);
+    range6list_merge(&ipv6, &targets->ipv6);
+    range6list_sort(&ipv6);
+
+    list4 = CALLOC(ipv4.list_len + 1, sizeof(*list4));
+    for (size_t i = 0; i < ipv4.list_len; i++) {
+        list4[i].begin.lo = ipv4.list[i].begin;
+        list4[i].end.lo   = ipv4.list[i].end;
+    }
+
+    _trie_build_family(&trie->v4, 32, list4, ipv4.list_len);
+    _trie_build_family(&trie->v6, 128, ipv6.list, ipv6.list_len);
+
+    FREE(list4);
+    rangelist_remove_all(&ipv4);
+    range6list_remove_all(&ipv6);
+
+    LOG(LEVEL_DEBUG, "(target trie) built with %u IPv4 nodes, %u IPv6 nodes\n",
+        trie->v4.node_count, trie->v6.node_count);
+
+    return trie;
+}
+
+void targettrie_destroy(TargetTrie *trie) {
+    if (!trie)
+        return;
+
+    FREE(trie->v4.top);
+    FREE(trie->v4.nodes);
+    FREE(trie->v6.top);
+    FREE(trie->v6.nodes);
+    FREE(trie);
+}
+
+bool targettrie_has_ipv4(const TargetTrie *trie, ipv4address ip) {
+    const TrieFamily *fam   = &trie->v4;
+    uint32_t          idx   = fam->top[ip >> (32 - TRIE_TOP_BITS)];
+    unsigned          depth = TRIE_TOP_BITS;
+    const TrieNode   *node;
+    unsigned          n;
+    uint64_t          bit;
+
+    if (idx <= TRIE_FULL)
+        return idx == TRIE_FULL;
+
+    node = &fam->nodes[idx];
+    for (;;) {
+        n = _trie_stride(32, depth);
+        depth += n;
+        bit = 1ULL << ((ip >> (32 - depth)) & ((1U << n) - 1));
+
+        if (!(node->vector & bit))
+            return (node->leaf & bit) != 0;
+
+        node = &fam->nodes[node->base + POPCNT64(node->vector & (bit - 1))];
+    }
+}
+
+bool targettrie_has_ipv6(const TargetTrie *trie, ipv6address ip) {
+    const TrieFamily *fam   = &trie->v6;
+    uint32_t          idx   = fam->top[ip.hi >> (64 - TRIE_TOP_BITS)];
+    unsigned          depth = TRIE_TOP_BITS;
+    const TrieNode   *node;
+    unsigned          n;
+    uint64_t          bit;
+
+    if (idx <= TRIE_FULL)
+        return idx == TRIE_FULL;
+
+    node = &fam->nodes[idx];
+    for (;;) {
+        n = _trie_stride(128, depth);
+        depth += n;
+        bit = 1ULL << _u128_bits(ip, 128 - depth, n);
+
+        if (!(node->vector & bit))
+            return (node->leaf & bit) != 0;
+
+        node = &fam->nodes[node->base + POPCNT64(node->vector & (bit - 1))];
+    }
+}
+
+bool targettrie_has_ip(const TargetTrie *trie, ipaddress ip) {
+    if (ip.version == 6)
+        return targettrie_has_ipv6(trie, ip.ipv6);
+    else
+        return targettrie_has_ipv4(trie, ip.ipv4);
+}
+
+/**
+ * Add the part of [lo, hi] in q to out.
+ */
+static void _trie_hit(ipv6address lo, ipv6address hi, const struct Range6 *q,
+                      struct Range6List *out) {
+    if (_u128_less(lo, q->begin))
+        lo = q->begin;
+    if (_u128_less(q->end, hi))
+        hi = q->end;
+    range6list_add_range(out, lo, hi);
+}
+
+/**
+ * Collect all leaves in the set under the node which intersect with q.
+ * NOTE: the node must intersect with q.
+ */
+static void _trie_walk(const TrieFamily *fam, const TrieNode *node,
+                       ipv6address prefix, unsigned depth,
+                       const struct Range6 *q, struct Range6List *out) {
+    unsigned    n     = _trie_stride(fam->width, depth);
+    unsigned    shift = fam->width - depth - n;
+    ipv6address ones  = _u128_ones(shift);
+    ipv6address end   = _u128_or(prefix, _u128_ones(shift + n));
+    unsigned    first = 0;
+    unsigned    last  = (1U << n) - 1;
+    ipv6address lo;
+    uint64_t    bit;
+
+    if (_u128_less(prefix, q->begin))
+        first = _u128_bits(q->begin, shift, n);
+    if (_u128_less(q->end, end))
+        last = _u128_bits(q->end, shift, n);
+
+    for (unsigned i = first; i <= last; i++) {
+        bit = 1ULL << i;
+        lo  = _u128_or(prefix, _u128_shl(i, shift));
+
+        if (node->vector & bit) {
+            _trie_walk(fam,
+                       &fam->nodes[node->base +
+                                   POPCNT64(node->vector & (bit - 1))],
+                       lo, depth + n, q, out);
+        } else if (node->leaf & bit) {
+            _trie_hit(lo, _u128_or(lo, ones), q, out);
+        }
+    }
+}
+
+static void _trie_walk_top(const TrieFamily *fam, const struct Range6 *q,
+                           struct Range6List *out) {
+    unsigned    shift = fam->width - TRIE_TOP_BITS;
+    ipv6address ones  = _u128_ones(shift);
+    unsigned    first = _u128_bits(q->begin, shift, TRIE_TOP_BITS);
+    unsigned    last  = _u128_bits(q->end, shift, TRIE_TOP_BITS);
+    ipv6address lo;
+
+    for (unsigned i = first; i <= last; i++) {
+        lo = _u128_shl(i, shift);
+
+        if (fam->top[i] == TRIE_FULL)
+            _trie_hit(lo, _u128_or(lo, ones), q, out);
+        else if (fam->top[i] != TRIE_EMPTY)
+            _trie_walk(fam, &fam->nodes[fam->top[i]], lo, TRIE_TOP_BITS, q,
+                       out);
+    }
+}
+
+void targettrie_filter(const TargetTrie *trie, TargetSet *targets) {
+    struct Range6List hits  = {0};
+    struct RangeList  hits4 = {0};
+    struct Range6     q     = {{0, 0}, {0, 0}};
+
+    for (unsigned i = 0; i < targets->ipv4.list_len; i++) {
+        q.begin.lo = targets->ipv4.list[i].begin;
+        q.end.lo   = targets->ipv4.list[i].end;
+        _trie_walk_top(&trie->v4, &q, &hits);
+    }
+    if (hits.list_len) {
+        for (size_t i = 0; i < hits.list_len; i++) {
+            rangelist_add_range(&hits4, (unsigned)hits.list[i].begin.lo,
+                                (unsigned)hits.list[i].end.lo);
+        }
+        rangelist_exclude(&targets->ipv4, &hits4);
+        rangelist_remove_all(&hits4);
+    }
+    range6list_remove_all(&hits);
+
+    for (size_t i = 0; i < targets->ipv6.list_len; i++) {
+        _trie_walk_top(&trie->v6, &targets->ipv6.list[i], &hits);
+    }
+    if (hits.list_len)
+        range6list_exclude(&targets->ipv6, &hits);
+    range6list_remove_all(&hits);
+}
+
+size_t targettrie_node_count(const TargetTrie *trie) {
+    return (size_t)trie->v4.node_count + trie->v6.node_count;
+}
+
+static unsigned _trie_rand(unsigned *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed ^ (*seed >> 16);
+}
+
+int targettrie_selftest() {
+    TargetSet   set      = {0};
+    TargetSet   line     = {0};
+    TargetTrie *trie     = NULL;
+    unsigned    seed     = 7;
+    unsigned    ip       = 0;
+    ipv6address ip6      = {0x20010DB800000000ULL, 0};
+    ipv6address ip6_end;
+    int         err      = 0;
+
+    /*mixed sizes of ranges, from single addresses to big blocks*/
+    for (unsigned i = 0; i < 3000; i++) {
+        unsigned len = (i % 3 == 0) ? 0 : _trie_rand(&seed) % 5000;
+        ip += _trie_rand(&seed) % 100000 + 2;
+        rangelist_add_range(&set.ipv4, ip, ip + len);
+        ip += len;
+    }
+    rangelist_add_range(&set.ipv4, 0xF0000000, 0xFFFFFFFF);
+    for (unsigned i = 0; i < 1000; i++) {
+        ip6.lo += _trie_rand(&seed) % 1000 + 2;
+        ip6_end = ip6;
+        ip6_end.lo += (i & 1) ? 0 : _trie_rand(&seed) % 300;
+        range6list_add_range(&set.ipv6, ip6, ip6_end);
+        ip6.lo = ip6_end.lo;
+    }
+    ip6.hi = 0x20010DB900000000ULL;
+    ip6.lo = 0;
+    ip6_end.hi = ip6.hi | 0xFFFFFFFF;
+    ip6_end.lo = ~0ULL;
+    range6list_add_range(&set.ipv6, ip6, ip6_end);
+
+    trie = targettrie_create(&set);
+
+    /*compare with range lists, especially at boundaries*/
+    for (unsigned i = 0; i < set.ipv4.list_len; i++) {
+        struct Range r = set.ipv4.list[i];
+
+        if (!targettrie_has_ipv4(trie, r.begin) ||
+            !targettrie_has_ipv4(trie, r.end) ||
+            targettrie_has_ipv4(trie, r.begin - 1) ||
+            (r.end != 0xFFFFFFFF && targettrie_has_ipv4(trie, r.end + 1))) {
+            err = 1;
+            break;
+        }
+    }
+    for (unsigned i = 0; i < 100000 && !err; i++) {
+        ip = _trie_rand(&seed) ^ (_trie_rand(&seed) << 16);
+        if (targettrie_has_ipv4(trie, ip) !=
+            rangelist_is_contains(&set.ipv4, ip))
+            err = 1;
+    }
+    for (size_t i = 0; i < set.ipv6.list_len && !err; i++) {
+        struct Range6 r = set.ipv6.list[i];
+
+        ip6 = r.begin;
+        ip6.lo--;
+        ip6_end = r.end;
+        ip6_end.lo++;
+        if (!targettrie_has_ipv6(trie, r.begin) ||
+            !targettrie_has_ipv6(trie, r.end) ||
+            (r.begin.lo && targettrie_has_ipv6(trie, ip6)) ||
+            (ip6_end.lo && targettrie_has_ipv6(trie, ip6_end)))
+            err = 1;
+    }
+
+    /*filter must be the same as excluding by range lists*/
+    if (!err) {
+        TargetSet expect = {0};
+
+        rangelist_add_range(&line.ipv4, 0x00010000, 0x00FFFFFF);
+        rangelist_add_range(&line.ipv4, set.ipv4.list[100].begin,
+                            set.ipv4.list[100].begin);
+        rangelist_add_range(&line.ipv4, 0xEFFFFFF0, 0xF000000F);
+        ip6.hi     = 0x20010DB800000000ULL;
+        ip6.lo     = 0;
+        ip6_end.hi = 0x20010DB900000000ULL;
+        ip6_end.lo = 0xFF;
+        range6list_add_range(&line.ipv6, ip6, ip6_end);
+
+        rangelist_merge(&expect.ipv4, &line.ipv4);
+        for (size_t i = 0; i < line.ipv6.list_len; i++)
+            range6list_add_range(&expect.ipv6, line.ipv6.list[i].begin,
+                                 line.ipv6.list[i].end);
+        targetset_apply_excludes(&expect, &set);
+        targetset_optimize(&expect);
+
+        targettrie_filter(trie, &line);
+        targetset_optimize(&line);
+
+        if (line.ipv4.list_len != expect.ipv4.list_len ||
+            memcmp(line.ipv4.list, expect.ipv4.list,
+                   line.ipv4.list_len * sizeof(line.ipv4.list[0])) ||
+            line.ipv6.list_len != expect.ipv6.list_len ||
+            memcmp(line.ipv6.list, expect.ipv6.list,
+                   line.ipv6.list_len * sizeof(line.ipv6.list[0])))
+            err = 1;
+
+        targetset_remove_all(&expect);
+    }
+
+    targettrie_destroy(trie);
+    targetset_remove_all(&set);
+    targetset_remove_all(&line);
+
+    if (err) {
+        LOG(LEVEL_ERROR, "target trie: selftest failed\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+#define TRIE_BENCH_LOOKUPS 10000000ULL
+
+void targettrie_benchmark() {
+    static const unsigned counts[] = {10000, 1000000};
+    volatile unsigned     result   = 0;
+    unsigned              seed;
+    uint64_t              start, stop;
+    double                ns_trie, ns_list;
+
+    puts("-- target trie --");
+
+    for (unsigned i = 0; i < ARRAY_SIZE(counts); i++) {
+        TargetSet   set = {0};
+        TargetTrie *trie;
+        unsigned    ip;
+
+        /*blocklist of random single addresses and small blocks*/
+        seed = 1;
+        for (unsigned j = 0; j < counts[i]; j++) {
+            ip = _trie_rand(&seed) ^ (_trie_rand(&seed) << 16);
+            rangelist_add_range(&set.ipv4, ip, ip + (j & 1 ? 0 : j % 256));
+        }
+        targetset_optimize(&set);
+
+        start = pixie_nanotime();
+        trie  = targettrie_create(&set);
+        stop  = pixie_nanotime();
+        printf("%8u ranges: built in %.2f-ms with %.2f-MB\n",
+               set.ipv4.list_len, (double)(stop - start) / 1000000.0,
+               (double)targettrie_node_count(trie) * sizeof(TrieNode) /
+                   1024.0 / 1024.0);
+
+        seed  = 2;
+        start = pixie_nanotime();
+        for (uint64_t n = 0; n < TRIE_BENCH_LOOKUPS; n++)
+            result += targettrie_has_ipv4(trie, _trie_rand(&seed));
+        stop    = pixie_nanotime();
+        ns_trie = (double)(stop - start) / TRIE_BENCH_LOOKUPS;
+
+        seed  = 2;
+        start = pixie_nanotime();
+        for (uint64_t n = 0; n < TRIE_BENCH_LOOKUPS; n++)
+            result += rangelist_is_contains(&set.ipv4, _trie_rand(&seed));
+        stop    = pixie_nanotime();
+        ns_list = (double)(stop - start) / TRIE_BENCH_LOOKUPS;
+
+        printf("%8u ranges: trie %6.2f-ns/lookup, rangelist %6.2f-ns/lookup\n",
+               set.ipv4.list_len, ns_trie, ns_list);
+
+        targettrie_destroy(trie);
+        targetset_remove_all(&set);
+    }
+
+    putchar('\n');
+}
@@ -0,0 +1,58 @@
+/*
+ Compressed prefix trie for membership lookups of TargetSet
+
+ RangeList is good at enumerating targets by index, but checking whether an
+ address is in a list of millions of ranges is a search over the whole list.
+ Streaming generators check every line of hitlists against blocklists, so
+ we build a poptrie-like structure from IP ranges of a TargetSet:
+
+ - The first TRIE_TOP_BITS bits index a direct table.
+ - Then every level consumes up to TRIE_STRIDE bits. A node has a bitmap of
+   which children are internal nodes and a bitmap of which leaf children
+   are in the set. Internal children of a node are stored contiguously, so
+   the child is found by a popcount instead of a pointer per child.
+
+ Lookup costs at most 3 node visits for IPv4 and 19 for IPv6, whatever the
+ count of ranges. The trie is read-only after built and could be shared by
+ threads.
+ */
+#ifndef TARGET_TRIE_H
+#define TARGET_TRIE_H
+#include <stdbool.h>
+#include "target-set.h"
+
+#define TRIE_TOP_BITS 16
+#define TRIE_STRIDE   6
+
+typedef struct TargetTrie TargetTrie;
+
+/**
+ * Build trie from IPv4 and IPv6 ranges of targets, ports are ignored.
+ */
+TargetTrie *targettrie_create(const TargetSet *targets);
+
+void targettrie_destroy(TargetTrie *trie);
+
+bool targettrie_has_ipv4(const TargetTrie *trie, ipv4address ip);
+
+bool targettrie_has_ipv6(const TargetTrie *trie, ipv6address ip);
+
+bool targettrie_has_ip(const TargetTrie *trie, ipaddress ip);
+
+/**
+ * Remove all addresses in trie from IP ranges of targets. It walks only the
+ * paths covered by targets, so it's cheap for small targets like a line of
+ * hitlist whatever the size of trie.
+ */
+void targettrie_filter(const TargetTrie *trie, TargetSet *targets);
+
+/**
+ * @return count of trie nodes.
+ */
+size_t targettrie_node_count(const TargetTrie *trie);
+
+int targettrie_selftest();
+
+void targettrie_benchmark();
+
+#endif
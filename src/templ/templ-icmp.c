@@ -67,9 +67,8 @@ static size_t icmp_echo_create_by_template_ipv4(
     uint16_t identifier, uint16_t sequence, uint16_t ip_id, uint8_t ttl,
     unsigned char *payload, size_t payload_length, unsigned char *px,
     size_t sizeof_px) {
-    uint64_t xsum_icmp;
+    unsigned xsum_icmp;
     unsigned xsum_ip;
-    unsigned icmp_length;
     unsigned offset_ip  = tmpl->ipv4.offset_ip;
     unsigned offset_tcp = tmpl->ipv4.offset_tcp;
     unsigned r_len      = tmpl->ipv4.offset_app + payload_length;
@@ -117,26 +116,24 @@ static size_t icmp_echo_create_by_template_ipv4(
     U32_TO_BE(px + offset_ip + 12, ip_me);
     U32_TO_BE(px + offset_ip + 16, ip_them);
 
-    /*fake ip header checksum*/
-    px[offset_ip + 10] = (unsigned char)(0);
-    px[offset_ip + 11] = (unsigned char)(0);
-
-    xsum_ip =
-        (unsigned)~checksum_ip_header(px, offset_ip, tmpl->ipv4.offset_app);
-
-    U16_TO_BE(px + offset_ip + 10, xsum_ip);
+    /* add just filled fields to the precomputed partial checksum */
+    xsum_ip = tmpl->ipv4.xsum_ip + BE_TO_U16(px + offset_ip + 2) +
+              BE_TO_U16(px + offset_ip + 4) + BE_TO_U16(px + offset_ip + 8);
+    xsum_ip = checksum_add_u32(xsum_ip, ip_me);
+    xsum_ip = checksum_add_u32(xsum_ip, ip_them);
+    U16_TO_BE(px + offset_ip + 10, checksum_fold(xsum_ip));
 
     /*
      * Now do the checksum for the higher layer protocols
      */
-    xsum_icmp = 0;
-
     U16_TO_BE(px + offset_tcp + 4, identifier);
     U16_TO_BE(px + offset_tcp + 6, sequence);
 
-    icmp_length = r_len - (tmpl->ipv4.offset_tcp - tmpl->ipv4.offset_ip);
-    xsum_icmp   = (unsigned)~checksum_icmp(px, offset_tcp, icmp_length);
-    U16_TO_BE(px + offset_tcp + 2, xsum_icmp);
+    /* ICMPv4 has no pseudo header */
+    xsum_icmp   = tmpl->ipv4.xsum_l4 + identifier + sequence;
+    xsum_icmp += checksum_partial(px + tmpl->ipv4.offset_app,
+                                  r_len - tmpl->ipv4.offset_app);
+    U16_TO_BE(px + offset_tcp + 2, checksum_fold(xsum_icmp));
 
     return r_len;
 }
@@ -145,7 +142,7 @@ static size_t icmp_echo_create_by_template_ipv6(
     const TmplPkt *tmpl, ipv6address ip_them, ipv6address ip_me,
     uint16_t identifier, uint16_t sequence, uint8_t ttl, unsigned char *payload,
     size_t payload_length, unsigned char *px, size_t sizeof_px) {
-    uint64_t xsum_icmp;
+    unsigned xsum_icmp;
     unsigned icmp_length;
     unsigned offset_ip  = tmpl->ipv6.offset_ip;
     unsigned offset_tcp = tmpl->ipv6.offset_tcp;
@@ -205,10 +202,16 @@ static size_t icmp_echo_create_by_template_ipv6(
      */
     U16_TO_BE(px + offset_tcp + 4, identifier);
     U16_TO_BE(px + offset_tcp + 6, sequence);
-    xsum_icmp =
-        checksum_ipv6(px + offset_ip + 8, px + offset_ip + 24,
-                      IP_PROTO_IPv6_ICMP, r_len - offset_tcp, px + offset_tcp);
-    U16_TO_BE(px + offset_tcp + 2, xsum_icmp);
+
+    xsum_icmp = tmpl->ipv6.xsum_l4 + (r_len - offset_tcp);
+    xsum_icmp = checksum_add_u64(xsum_icmp, ip_me.hi);
+    xsum_icmp = checksum_add_u64(xsum_icmp, ip_me.lo);
+    xsum_icmp = checksum_add_u64(xsum_icmp, ip_them.hi);
+    xsum_icmp = checksum_add_u64(xsum_icmp, ip_them.lo);
+    xsum_icmp += identifier + sequence;
+    xsum_icmp += checksum_partial(px + tmpl->ipv6.offset_app,
+                                  r_len - tmpl->ipv6.offset_app);
+    U16_TO_BE(px + offset_tcp + 2, checksum_fold(xsum_icmp));
 
     return r_len;
 }
@@ -256,9 +259,8 @@ static size_t icmp_timestamp_create_by_template_ipv4(
     unsigned char *px, size_t sizeof_px) {
     unsigned offset_ip;
     unsigned offset_tcp;
-    uint64_t xsum_icmp;
+    unsigned xsum_icmp;
     unsigned xsum_ip;
-    unsigned icmp_length;
     unsigned r_len = sizeof_px;
 
     /* Create some shorter local variables to work with */
@@ -302,28 +304,27 @@ static size_t icmp_timestamp_create_by_template_ipv4(
     U32_TO_BE(px + offset_ip + 12, ip_me);
     U32_TO_BE(px + offset_ip + 16, ip_them);
 
-    /*fake ip header checksum*/
-    px[offset_ip + 10] = (unsigned char)(0);
-    px[offset_ip + 11] = (unsigned char)(0);
-
-    xsum_ip = (unsigned)~checksum_ip_header(px, offset_ip, tmpl->ipv4.length);
-
-    U16_TO_BE(px + offset_ip + 10, xsum_ip);
+    /* add just filled fields to the precomputed partial checksum */
+    xsum_ip = tmpl->ipv4.xsum_ip + BE_TO_U16(px + offset_ip + 2) +
+              BE_TO_U16(px + offset_ip + 4) + BE_TO_U16(px + offset_ip + 8);
+    xsum_ip = checksum_add_u32(xsum_ip, ip_me);
+    xsum_ip = checksum_add_u32(xsum_ip, ip_them);
+    U16_TO_BE(px + offset_ip + 10, checksum_fold(xsum_ip));
 
     /*
      * Now do the checksum for the higher layer protocols
      */
-    xsum_icmp = 0;
-
     U16_TO_BE(px + offset_tcp + 4, identifier);
     U16_TO_BE(px + offset_tcp + 6, sequence);
     U32_TO_BE(px + offset_tcp + 8, origin_time);
     U32_TO_BE(px + offset_tcp + 12, recv_time);
     U32_TO_BE(px + offset_tcp + 16, trans_time);
 
-    icmp_length = ip_len - (tmpl->ipv4.offset_tcp - tmpl->ipv4.offset_ip);
-    xsum_icmp   = (unsigned)~checksum_icmp(px, offset_tcp, icmp_length);
-    U16_TO_BE(px + offset_tcp + 2, xsum_icmp);
+    xsum_icmp = tmpl->ipv4.xsum_l4 + identifier + sequence;
+    xsum_icmp = checksum_add_u32(xsum_icmp, origin_time);
+    xsum_icmp = checksum_add_u32(xsum_icmp, recv_time);
+    xsum_icmp = checksum_add_u32(xsum_icmp, trans_time);
+    U16_TO_BE(px + offset_tcp + 2, checksum_fold(xsum_icmp));
 
     return r_len;
 }
@@ -6,6 +6,8 @@
 #include "templ-tcp.h"
 #include "templ-opts.h"
 #include "templ-icmp.h"
+#include "templ-udp.h"
+#include "templ-sctp.h"
 #include "../version.h"
 #include "../target/target-rangeport.h"
 #include "../proto/proto-preprocess.h"
@@ -274,7 +276,7 @@ static void _template_init_ipv6(TmplPkt *tmpl, macaddress_t router_mac_ipv6,
 
     /* Zero out everything and start from scratch */
     if (tmpl->ipv6.packet) {
-        free(tmpl->ipv6.packet);
+        FREE(tmpl->ipv6.packet);
         memset(&tmpl->ipv6, 0, sizeof(tmpl->ipv6));
     }
 
@@ -372,6 +374,98 @@ static void _template_init_ipv6(TmplPkt *tmpl, macaddress_t router_mac_ipv6,
     tmpl->ipv6.offset_app = parsed.app_offset;
 }
 
+/**
+ * Partial checksum of [offset, offset+length) in px but regarding the bytes
+ * of [offset+zero_from, offset+zero_to) as zero.
+ * NOTE: zero_from must be even.
+ */
+static unsigned _xsum_except(const unsigned char *px, unsigned offset,
+                             unsigned length, unsigned zero_from,
+                             unsigned zero_to) {
+    unsigned sum;
+
+    if (zero_to > length)
+        zero_to = length;
+    if (zero_from > zero_to)
+        zero_from = zero_to;
+    sum = checksum_partial(px + offset, zero_from);
+    sum += checksum_partial(px + offset + zero_to, length - zero_to);
+    return sum;
+}
+
+/***************************************************************************
+ * Precompute partial checksums(RFC 1624) of fields that never change between
+ * packets. Fields filled for every packet are excluded, so creators only add
+ * them and fold the sum instead of walking over the whole headers again.
+ * NOTE: TTL is also excluded because it could be set after init.
+ ***************************************************************************/
+static void _template_init_xsum(TmplPkt *tmpl) {
+    const unsigned char *px4         = tmpl->ipv4.packet;
+    const unsigned char *px6         = tmpl->ipv6.packet;
+    unsigned             offset_ip4  = tmpl->ipv4.offset_ip;
+    unsigned             offset_tcp4 = tmpl->ipv4.offset_tcp;
+    unsigned             offset_tcp6 = tmpl->ipv6.offset_tcp;
+    unsigned             len4;
+    unsigned             len6;
+    unsigned char       *buf;
+    unsigned             i;
+
+    /* IPv4 header: total length, id, ttl&proto, checksum and addresses */
+    len4               = (px4[offset_ip4] & 0xF) * 4;
+    tmpl->ipv4.xsum_ip = checksum_partial(px4 + offset_ip4, 2) +
+                         checksum_partial(px4 + offset_ip4 + 6, 2) +
+                         _xsum_except(px4, offset_ip4, len4, 0, 20);
+
+    len4 = tmpl->ipv4.offset_app - offset_tcp4;
+    len6 = tmpl->ipv6.offset_app - offset_tcp6;
+
+    switch (tmpl->tmpl_type) {
+        case TmplType_TCP:
+            /* ports, seqno, ackno, flags, window and checksum */
+            len4               = (px4[offset_tcp4 + 12] & 0xF0) >> 2;
+            tmpl->ipv4.xsum_l4 = IP_PROTO_TCP;
+            tmpl->ipv4.xsum_l4 += _xsum_except(px4, offset_tcp4, len4, 0, 18);
+            tmpl->ipv6.xsum_l4 = IP_PROTO_TCP;
+            tmpl->ipv6.xsum_l4 += _xsum_except(px6, offset_tcp6, len6, 0, 18);
+            break;
+        case TmplType_UDP:
+            /* every field of UDP header is filled for each packet */
+            tmpl->ipv4.xsum_l4 = IP_PROTO_UDP;
+            tmpl->ipv6.xsum_l4 = IP_PROTO_UDP;
+            break;
+        case TmplType_ICMP_ECHO:
+            /* checksum, id and sequence. No pseudo header in ICMPv4 */
+            tmpl->ipv4.xsum_l4 = _xsum_except(px4, offset_tcp4, len4, 2, 8);
+            tmpl->ipv6.xsum_l4 = IP_PROTO_IPv6_ICMP;
+            tmpl->ipv6.xsum_l4 += _xsum_except(px6, offset_tcp6, len6, 2, 8);
+            break;
+        case TmplType_ICMP_TS:
+            /* checksum, id, sequence and timestamps */
+            len4               = tmpl->ipv4.length - offset_tcp4;
+            tmpl->ipv4.xsum_l4 = _xsum_except(px4, offset_tcp4, len4, 2, 20);
+            break;
+        case TmplType_SCTP:
+            /* CRC32c is linear: get it with ports and init tag zeroed, then
+             * XOR contributions of their bytes for every packet */
+            len4 = tmpl->ipv4.length - offset_tcp4;
+            buf  = MALLOC(len4);
+            memcpy(buf, px4 + offset_tcp4, len4);
+            memset(buf + 0, 0, 4);
+            memset(buf + 16, 0, 4);
+            tmpl->ipv4.xsum_l4 = checksum_sctp(buf, len4);
+            tmpl->ipv6.xsum_l4 = tmpl->ipv4.xsum_l4;
+            FREE(buf);
+
+            tmpl->sctp_crc = MALLOC(SCTP_CRC_BYTES * sizeof(*tmpl->sctp_crc));
+            for (i = 0; i < SCTP_CRC_BYTES; i++)
+                checksum_sctp_byte_table(i < 4 ? i : 12 + i, len4,
+                                         tmpl->sctp_crc[i]);
+            break;
+        default:
+            break;
+    }
+}
+
 /***************************************************************************
  * Here we take a packet template, parse it, then make it easier to work
  * with.
@@ -511,6 +605,8 @@ static void _template_init(TmplPkt *tmpl, macaddress_t source_mac,
 
     /* Now create an IPv6 template based upon the IPv4 template */
     _template_init_ipv6(tmpl, router_mac_ipv6, data_link_type);
+
+    _template_init_xsum(tmpl);
 }
 
 /***************************************************************************
@@ -544,7 +640,7 @@ void template_packet_init(TmplSet *templset, macaddress_t source_mac,
     _template_init(&templset->pkts[TmplType_TCP_SYN], source_mac,
                    router_mac_ipv4, router_mac_ipv6, buf, length, data_link);
     templset->count++;
-    free(buf);
+    FREE(buf);
 
     /* [TCP] */
     _template_init(&templset->pkts[TmplType_TCP_RST], source_mac,
@@ -584,6 +680,16 @@ void template_packet_init(TmplSet *templset, macaddress_t source_mac,
     templset->count++;
 }
 
+void template_packet_close(TmplSet *templset) {
+    for (unsigned i = 0; i < templset->count; i++) {
+        TmplPkt *tmpl = &templset->pkts[i];
+        FREE(tmpl->ipv4.packet);
+        FREE(tmpl->ipv6.packet);
+        FREE(tmpl->sctp_crc);
+    }
+    templset->count = 0;
+}
+
 void template_set_tcp_syn_window_of_default(unsigned window) {
     U16_TO_BE(default_tcp_syn_template + 48, window);
 }
@@ -691,6 +797,114 @@ void template_packet_set_vlan(TmplPkt *tmpl_pkt, unsigned vlan) {
     tmpl_pkt->ipv4.offset_app += 4;
 }
 
+/***************************************************************************
+ * Packets created with precomputed partial checksums must pass the full
+ * checksum verification.
+ ***************************************************************************/
+static int _template_xsum_selftest(const TmplSet *tmplset) {
+    const TmplPkt *tmpl;
+    unsigned char  px[2048]    = {0};
+    unsigned char  payload[25] = "incremental checksum test";
+    ipaddress      ip4_me      = {.ipv4 = 0x0A000001, .version = 4};
+    ipaddress      ip4_them    = {.ipv4 = 0xC0A8FE73, .version = 4};
+    ipaddress      ip6_me      = {.version = 6};
+    ipaddress      ip6_them    = {.version = 6};
+    unsigned       off_ip;
+    unsigned       off_tcp;
+    size_t         len;
+    int            failures = 0;
+
+    ip6_me.ipv6.hi   = 0x20010DB800000000ULL;
+    ip6_me.ipv6.lo   = 0x0000000000000001ULL;
+    ip6_them.ipv6.hi = 0x20010DB8FFFF1234ULL;
+    ip6_them.ipv6.lo = 0xABCDEF0123456789ULL;
+
+    /* [TCP] */
+    tmpl    = &tmplset->pkts[TmplType_TCP];
+    off_ip  = tmpl->ipv4.offset_ip;
+    off_tcp = tmpl->ipv4.offset_tcp;
+    len = tcp_create_by_template(tmpl, ip4_them, 443, ip4_me, 61234, 0x12345678,
+                                 0x9ABCDEF0, 0x18, 0, 0, payload,
+                                 sizeof(payload), px, sizeof(px));
+    failures += checksum_ip_header(px, off_ip, off_tcp) != 0xFFFF;
+    failures += checksum_tcp(px, off_ip, off_tcp, len - off_tcp) != 0xFFFF;
+
+    off_ip  = tmpl->ipv6.offset_ip;
+    off_tcp = tmpl->ipv6.offset_tcp;
+    len = tcp_create_by_template(tmpl, ip6_them, 443, ip6_me, 61234, 0x12345678,
+                                 0x9ABCDEF0, 0x18, 0, 1024, payload,
+                                 sizeof(payload), px, sizeof(px));
+    failures += checksum_ipv6(px + off_ip + 8, px + off_ip + 24, IP_PROTO_TCP,
+                              len - off_tcp, px + off_tcp) !=
+                BE_TO_U16(px + off_tcp + 16);
+
+    /* [UDP] */
+    tmpl    = &tmplset->pkts[TmplType_UDP];
+    off_ip  = tmpl->ipv4.offset_ip;
+    off_tcp = tmpl->ipv4.offset_tcp;
+    len = udp_create_by_template(tmpl, ip4_them, 53, ip4_me, 61234, 0, payload,
+                                 sizeof(payload), px, sizeof(px));
+    failures += checksum_ip_header(px, off_ip, off_tcp) != 0xFFFF;
+    failures += checksum_udp(px, off_ip, off_tcp, len - off_tcp) != 0xFFFF;
+
+    off_ip  = tmpl->ipv6.offset_ip;
+    off_tcp = tmpl->ipv6.offset_tcp;
+    len = udp_create_by_template(tmpl, ip6_them, 53, ip6_me, 61234, 0, payload,
+                                 sizeof(payload), px, sizeof(px));
+    failures += checksum_ipv6(px + off_ip + 8, px + off_ip + 24, IP_PROTO_UDP,
+                              len - off_tcp, px + off_tcp) !=
+                BE_TO_U16(px + off_tcp + 6);
+
+    /* [ICMP ping] */
+    tmpl    = &tmplset->pkts[TmplType_ICMP_ECHO];
+    off_ip  = tmpl->ipv4.offset_ip;
+    off_tcp = tmpl->ipv4.offset_tcp;
+    len     = icmp_echo_create_by_template(tmpl, ip4_them, ip4_me, 0x1234, 7,
+                                           0x5678, 64, payload, sizeof(payload),
+                                           px, sizeof(px));
+    failures += checksum_ip_header(px, off_ip, off_tcp) != 0xFFFF;
+    failures += checksum_icmp(px, off_tcp, len - off_tcp) != 0xFFFF;
+
+    off_ip  = tmpl->ipv6.offset_ip;
+    off_tcp = tmpl->ipv6.offset_tcp;
+    len     = icmp_echo_create_by_template(tmpl, ip6_them, ip6_me, 0x1234, 7,
+                                           0x5678, 64, payload, sizeof(payload),
+                                           px, sizeof(px));
+    failures += checksum_ipv6(px + off_ip + 8, px + off_ip + 24,
+                              IP_PROTO_IPv6_ICMP, len - off_tcp,
+                              px + off_tcp) != BE_TO_U16(px + off_tcp + 2);
+
+    /* [ICMP timestamp] */
+    tmpl    = &tmplset->pkts[TmplType_ICMP_TS];
+    off_ip  = tmpl->ipv4.offset_ip;
+    off_tcp = tmpl->ipv4.offset_tcp;
+    len     = icmp_timestamp_create_by_template(
+        tmpl, ip4_them, ip4_me, 0x1234, 7, 0x5678, 0, 0x01020304, 0xA0B0C0D0,
+        0xFFFFFFFF, px, sizeof(px));
+    failures += checksum_ip_header(px, off_ip, off_tcp) != 0xFFFF;
+    failures += checksum_icmp(px, off_tcp, len - off_tcp) != 0xFFFF;
+
+    /* [SCTP] */
+    tmpl    = &tmplset->pkts[TmplType_SCTP];
+    off_ip  = tmpl->ipv4.offset_ip;
+    off_tcp = tmpl->ipv4.offset_tcp;
+    len     = sctp_create_by_template(tmpl, ip4_them, 36412, ip4_me, 61234,
+                                      0xDEADBEEF, 0, px, sizeof(px));
+    failures += checksum_ip_header(px, off_ip, off_tcp) != 0xFFFF;
+    failures += checksum_sctp(px + off_tcp, len - off_tcp) !=
+                (unsigned)BE_TO_U32(px + off_tcp + 8);
+
+    off_tcp = tmpl->ipv6.offset_tcp;
+    len     = sctp_create_by_template(tmpl, ip6_them, 36412, ip6_me, 61234,
+                                      0x01234567, 0, px, sizeof(px));
+    failures += checksum_sctp(px + off_tcp, len - off_tcp) !=
+                (unsigned)BE_TO_U32(px + off_tcp + 8);
+
+    if (failures)
+        LOG(LEVEL_ERROR, "(template) incremental checksum selftest failed\n");
+    return failures;
+}
+
 /***************************************************************************
  ***************************************************************************/
 int template_selftest() {
@@ -720,6 +934,10 @@ int template_selftest() {
     failures += tmplset->pkts[TmplType_ARP].tmpl_type != TmplType_ARP;
     failures += tmplset->pkts[TmplType_NDP_NS].tmpl_type != TmplType_NDP_NS;
 
+    failures += _template_xsum_selftest(tmplset);
+
+    template_packet_close(tmplset);
+
     if (failures)
         LOG(LEVEL_ERROR, "(template) selftest failed\n");
     return failures;
@@ -34,6 +34,11 @@ void template_packet_init(TmplSet *templset, macaddress_t source_mac,
                           macaddress_t router_mac_ipv6, int data_link,
                           uint64_t entropy, const TmplOpt *templ_opts);
 
+/***************************************************************************
+ * Frees packets and SCTP CRC tables of all templates in templateset
+ ***************************************************************************/
+void template_packet_close(TmplSet *templset);
+
 /***************************************************************************
  * Overwrites the Window of default tcp syn template
  ***************************************************************************/
@@ -18,6 +18,11 @@ TmplSet templ_copy(const TmplSet *templset) {
         memcpy(p2->ipv4.packet, p1->ipv4.packet, p2->ipv4.length);
         p2->ipv6.packet = MALLOC(2048 + p2->ipv6.length);
         memcpy(p2->ipv6.packet, p1->ipv6.packet, p2->ipv6.length);
+        if (p1->sctp_crc) {
+            p2->sctp_crc = MALLOC(SCTP_CRC_BYTES * sizeof(*p2->sctp_crc));
+            memcpy(p2->sctp_crc, p1->sctp_crc,
+                   SCTP_CRC_BYTES * sizeof(*p2->sctp_crc));
+        }
     }
 
     return result;
@@ -34,6 +39,11 @@ TmplPkt templ_packet_copy(const TmplPkt *tmpl_pkt) {
     memcpy(p2->ipv4.packet, p1->ipv4.packet, p2->ipv4.length);
     p2->ipv6.packet = MALLOC(2048 + p2->ipv6.length);
     memcpy(p2->ipv6.packet, p1->ipv6.packet, p2->ipv6.length);
+    if (p1->sctp_crc) {
+        p2->sctp_crc = MALLOC(SCTP_CRC_BYTES * sizeof(*p2->sctp_crc));
+        memcpy(p2->sctp_crc, p1->sctp_crc,
+               SCTP_CRC_BYTES * sizeof(*p2->sctp_crc));
+    }
 
     return result;
 }
\ No newline at end of file
@@ -23,6 +23,9 @@ typedef enum Template_TYPE {
     TmplType_Count,
 } TmplType;
 
+/*count of bytes in ports and init tag of SCTP*/
+#define SCTP_CRC_BYTES 8
+
 typedef struct TemplatePacket {
     struct {
         unsigned       length; /*packet len*/
@@ -30,6 +33,11 @@ typedef struct TemplatePacket {
         unsigned       offset_tcp;
         unsigned       offset_app;
         unsigned       ip_ttl;
+        /*partial checksum of constant fields in ip header*/
+        unsigned       xsum_ip;
+        /*partial checksum of constant fields in transport header,
+          or CRC32c with ports and init tag zeroed for SCTP*/
+        unsigned       xsum_l4;
         unsigned char *packet;
     } ipv4;
     struct {
@@ -38,8 +46,13 @@ typedef struct TemplatePacket {
         unsigned       offset_tcp;
         unsigned       offset_app;
         unsigned       ip_ttl;
+        /*partial checksum of constant fields in transport header,
+          or CRC32c with ports and init tag zeroed for SCTP*/
+        unsigned       xsum_l4;
         unsigned char *packet;
     } ipv6;
+    /*CRC32c contributions of bytes in ports and init tag for SCTP*/
+    unsigned (*sctp_crc)[256];
     TmplType tmpl_type;
 } TmplPkt;
 
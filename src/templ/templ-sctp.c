@@ -102,6 +102,19 @@
 #include "../util-data/data-convert.h"
 #include "../proto/proto-preprocess.h"
 
+/**
+ * CRC32c contributions of ports and init tag. They were zeroed in the CRC32c
+ * precomputed in template.
+ */
+static inline unsigned _sctp_crc_fields(const TmplPkt       *tmpl,
+                                        const unsigned char *sctp) {
+    unsigned (*crc)[256] = tmpl->sctp_crc;
+
+    return crc[0][sctp[0]] ^ crc[1][sctp[1]] ^ crc[2][sctp[2]] ^
+           crc[3][sctp[3]] ^ crc[4][sctp[16]] ^ crc[5][sctp[17]] ^
+           crc[6][sctp[18]] ^ crc[7][sctp[19]];
+}
+
 static size_t
 sctp_create_by_template_ipv4(const TmplPkt *tmpl, ipv4address ip_them,
                              unsigned port_them, ipv4address ip_me,
@@ -109,7 +122,7 @@ sctp_create_by_template_ipv4(const TmplPkt *tmpl, ipv4address ip_them,
                              unsigned char *px, size_t sizeof_px) {
     unsigned offset_ip;
     unsigned offset_tcp;
-    uint64_t xsum_sctp;
+    unsigned xsum_sctp;
     unsigned xsum_ip;
 
     unsigned ip_id = ip_them ^ port_them ^ init_tag;
@@ -149,32 +162,30 @@ sctp_create_by_template_ipv4(const TmplPkt *tmpl, ipv4address ip_them,
     unsigned ip_len   = tmpl->ipv4.length - tmpl->ipv4.offset_ip;
     px[offset_ip + 2] = (unsigned char)(ip_len >> 8);
     px[offset_ip + 3] = (unsigned char)(ip_len >> 0);
-    U16_EQUAL_TO_BE(px + offset_ip + 4, ip_id);
+    U16_TO_BE(px + offset_ip + 4, ip_id);
 
     if (ttl)
         px[offset_ip + 8] = (unsigned char)(ttl);
 
-    U32_EQUAL_TO_BE(px + offset_ip + 12, ip_me);
-    U32_EQUAL_TO_BE(px + offset_ip + 16, ip_them);
-
-    px[offset_ip + 10] = (unsigned char)(0);
-    px[offset_ip + 11] = (unsigned char)(0);
-
-    xsum_ip =
-        (unsigned)~checksum_ip_header(px, offset_ip, tmpl->ipv4.offset_app);
+    U32_TO_BE(px + offset_ip + 12, ip_me);
+    U32_TO_BE(px + offset_ip + 16, ip_them);
 
-    U16_EQUAL_TO_BE(px + offset_ip + 10, xsum_ip);
+    /* add just filled fields to the precomputed partial checksum */
+    xsum_ip = tmpl->ipv4.xsum_ip + BE_TO_U16(px + offset_ip + 2) +
+              BE_TO_U16(px + offset_ip + 4) + BE_TO_U16(px + offset_ip + 8);
+    xsum_ip = checksum_add_u32(xsum_ip, ip_me);
+    xsum_ip = checksum_add_u32(xsum_ip, ip_them);
+    U16_TO_BE(px + offset_ip + 10, checksum_fold(xsum_ip));
 
     /*
      * Now do the checksum for the higher layer protocols
      */
-    xsum_sctp = 0;
-    U16_EQUAL_TO_BE(px + offset_tcp + 0, port_me);
-    U16_EQUAL_TO_BE(px + offset_tcp + 2, port_them);
-    U32_EQUAL_TO_BE(px + offset_tcp + 16, init_tag);
+    U16_TO_BE(px + offset_tcp + 0, port_me);
+    U16_TO_BE(px + offset_tcp + 2, port_them);
+    U32_TO_BE(px + offset_tcp + 16, init_tag);
 
-    xsum_sctp = checksum_sctp(px + offset_tcp, tmpl->ipv4.length - offset_tcp);
-    U32_EQUAL_TO_BE(px + offset_tcp + 8, xsum_sctp);
+    xsum_sctp = tmpl->ipv4.xsum_l4 ^ _sctp_crc_fields(tmpl, px + offset_tcp);
+    U32_TO_BE(px + offset_tcp + 8, xsum_sctp);
 
     return r_len;
 }
@@ -186,7 +197,7 @@ sctp_create_by_template_ipv6(const TmplPkt *tmpl, ipv6address ip_them,
                              unsigned char *px, size_t sizeof_px) {
     unsigned offset_ip;
     unsigned offset_tcp;
-    uint64_t xsum_sctp;
+    unsigned xsum_sctp;
 
     unsigned r_len = sizeof_px;
 
@@ -242,7 +253,7 @@ sctp_create_by_template_ipv6(const TmplPkt *tmpl, ipv6address ip_them,
     U16_TO_BE(px + offset_tcp + 2, port_them);
     U32_TO_BE(px + offset_tcp + 16, init_tag);
 
-    xsum_sctp = checksum_sctp(px + offset_tcp, tmpl->ipv6.length - offset_tcp);
+    xsum_sctp = tmpl->ipv6.xsum_l4 ^ _sctp_crc_fields(tmpl, px + offset_tcp);
     U32_TO_BE(px + offset_tcp + 8, xsum_sctp);
 
     return r_len;
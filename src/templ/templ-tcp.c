@@ -1080,6 +1080,20 @@ void tcp_set_window(unsigned char *px, size_t px_length, unsigned window) {
     U16_TO_BE(px + offset + 16, xsum);
 }
 
+/**
+ * Partial checksum of TCP header fields filled for every packet: ports,
+ * seqno, ackno, flags and window. They are excluded from the precomputed
+ * partial checksum of template.
+ */
+static inline unsigned _tcp_xsum_fields(const unsigned char *tcp) {
+    unsigned sum = 0;
+    unsigned i;
+
+    for (i = 0; i < 16; i += 2)
+        sum += BE_TO_U16(tcp + i);
+    return sum;
+}
+
 size_t tcp_create_by_template(const TmplPkt *tmpl, ipaddress ip_them,
                               unsigned port_them, ipaddress ip_me,
                               unsigned port_me, unsigned seqno, unsigned ackno,
@@ -1093,7 +1107,7 @@ size_t tcp_create_by_template(const TmplPkt *tmpl, ipaddress ip_them,
         return 0;
     }
 
-    uint64_t xsum_ip;
+    unsigned xsum_ip;
     unsigned xsum_tcp;
 
     if (ip_them.version == 4) {
@@ -1126,9 +1140,12 @@ size_t tcp_create_by_template(const TmplPkt *tmpl, ipaddress ip_them,
         U32_TO_BE(px + offset_ip + 12, ip_me.ipv4);
         U32_TO_BE(px + offset_ip + 16, ip_them.ipv4);
 
-        xsum_ip =
-            (unsigned)~checksum_ip_header(px, offset_ip, tmpl->ipv4.offset_app);
-        U16_TO_BE(px + offset_ip + 10, xsum_ip);
+        /* add just filled fields to the precomputed partial checksum */
+        xsum_ip = tmpl->ipv4.xsum_ip + BE_TO_U16(px + offset_ip + 2) +
+                  BE_TO_U16(px + offset_ip + 4) + BE_TO_U16(px + offset_ip + 8);
+        xsum_ip = checksum_add_u32(xsum_ip, ip_me.ipv4);
+        xsum_ip = checksum_add_u32(xsum_ip, ip_them.ipv4);
+        U16_TO_BE(px + offset_ip + 10, checksum_fold(xsum_ip));
 
         /*
          * now do the same for TCP
@@ -1143,14 +1160,13 @@ size_t tcp_create_by_template(const TmplPkt *tmpl, ipaddress ip_them,
         if (win)
             U16_TO_BE(px + offset_tcp + 14, win);
 
-        px[offset_tcp + 16] = (unsigned char)(0 >> 8);
-        px[offset_tcp + 17] = (unsigned char)(0 >> 0);
-
-        xsum_tcp = checksum_tcp(px, tmpl->ipv4.offset_ip, tmpl->ipv4.offset_tcp,
-                                new_length - tmpl->ipv4.offset_tcp);
-        xsum_tcp = ~xsum_tcp;
+        xsum_tcp = tmpl->ipv4.xsum_l4 + (unsigned)(new_length - offset_tcp);
+        xsum_tcp = checksum_add_u32(xsum_tcp, ip_me.ipv4);
+        xsum_tcp = checksum_add_u32(xsum_tcp, ip_them.ipv4);
+        xsum_tcp += _tcp_xsum_fields(px + offset_tcp);
+        xsum_tcp += checksum_partial(px + offset_payload, payload_length);
 
-        U16_TO_BE(px + offset_tcp + 16, xsum_tcp);
+        U16_TO_BE(px + offset_tcp + 16, checksum_fold(xsum_tcp));
 
         if (new_length < 60) {
             memset(px + new_length, 0, 60 - new_length);
@@ -1208,13 +1224,16 @@ size_t tcp_create_by_template(const TmplPkt *tmpl, ipaddress ip_them,
         if (win)
             U16_TO_BE(px + offset_tcp + 14, win);
 
-        px[offset_tcp + 16] = (unsigned char)(0 >> 8);
-        px[offset_tcp + 17] = (unsigned char)(0 >> 0);
+        xsum_tcp = tmpl->ipv6.xsum_l4 +
+                   (unsigned)((offset_app - offset_tcp) + payload_length);
+        xsum_tcp = checksum_add_u64(xsum_tcp, ip_me.ipv6.hi);
+        xsum_tcp = checksum_add_u64(xsum_tcp, ip_me.ipv6.lo);
+        xsum_tcp = checksum_add_u64(xsum_tcp, ip_them.ipv6.hi);
+        xsum_tcp = checksum_add_u64(xsum_tcp, ip_them.ipv6.lo);
+        xsum_tcp += _tcp_xsum_fields(px + offset_tcp);
+        xsum_tcp += checksum_partial(px + offset_app, payload_length);
 
-        xsum_tcp = checksum_ipv6(
-            px + offset_ip + 8, px + offset_ip + 24, IP_PROTO_TCP,
-            (offset_app - offset_tcp) + payload_length, px + offset_tcp);
-        U16_TO_BE(px + offset_tcp + 16, xsum_tcp);
+        U16_TO_BE(px + offset_tcp + 16, checksum_fold(xsum_tcp));
 
         return offset_app + payload_length;
     }
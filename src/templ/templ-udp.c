@@ -40,11 +40,19 @@
 #include "../proto/proto-preprocess.h"
 #include "../target/target.h"
 
+/**
+ * Partial checksum of UDP header fields filled for every packet: ports and
+ * length. Length in pseudo header should be added separately.
+ */
+static inline unsigned _udp_xsum_fields(const unsigned char *udp) {
+    return BE_TO_U16(udp + 0) + BE_TO_U16(udp + 2) + BE_TO_U16(udp + 4);
+}
+
 static size_t udp_create_by_template_ipv4(
     const TmplPkt *tmpl, ipv4address ip_them, unsigned port_them,
     ipv4address ip_me, unsigned port_me, unsigned ttl, unsigned char *payload,
     size_t payload_length, unsigned char *px, size_t sizeof_px) {
-    uint64_t xsum_udp;
+    unsigned xsum_udp;
     unsigned xsum_ip;
     unsigned offset_ip  = tmpl->ipv4.offset_ip;
     unsigned offset_tcp = tmpl->ipv4.offset_tcp;
@@ -93,26 +101,26 @@ static size_t udp_create_by_template_ipv4(
     U32_TO_BE(px + offset_ip + 12, ip_me);
     U32_TO_BE(px + offset_ip + 16, ip_them);
 
-    px[offset_ip + 10] = (unsigned char)(0);
-    px[offset_ip + 11] = (unsigned char)(0);
-
-    xsum_ip =
-        (unsigned)~checksum_ip_header(px, offset_ip, tmpl->ipv4.offset_app);
-    U16_TO_BE(px + offset_ip + 10, xsum_ip);
+    /* add just filled fields to the precomputed partial checksum */
+    xsum_ip = tmpl->ipv4.xsum_ip + BE_TO_U16(px + offset_ip + 2) +
+              BE_TO_U16(px + offset_ip + 4) + BE_TO_U16(px + offset_ip + 8);
+    xsum_ip = checksum_add_u32(xsum_ip, ip_me);
+    xsum_ip = checksum_add_u32(xsum_ip, ip_them);
+    U16_TO_BE(px + offset_ip + 10, checksum_fold(xsum_ip));
 
     /*
      * Now do the checksum for the higher layer protocols
      */
-    xsum_udp = 0;
     U16_TO_BE(px + offset_tcp + 0, port_me);
     U16_TO_BE(px + offset_tcp + 2, port_them);
     U16_TO_BE(px + offset_tcp + 4, r_len - tmpl->ipv4.offset_app + 8);
 
-    px[offset_tcp + 6] = (unsigned char)(0);
-    px[offset_tcp + 7] = (unsigned char)(0);
-    xsum_udp = checksum_udp(px, offset_ip, offset_tcp, r_len - offset_tcp);
-    xsum_udp = ~xsum_udp;
-    U16_TO_BE(px + offset_tcp + 6, xsum_udp);
+    xsum_udp = tmpl->ipv4.xsum_l4 + (r_len - offset_tcp);
+    xsum_udp = checksum_add_u32(xsum_udp, ip_me);
+    xsum_udp = checksum_add_u32(xsum_udp, ip_them);
+    xsum_udp += _udp_xsum_fields(px + offset_tcp);
+    xsum_udp += checksum_partial(px + tmpl->ipv4.offset_app, payload_length);
+    U16_TO_BE(px + offset_tcp + 6, checksum_fold(xsum_udp));
 
     return r_len;
 }
@@ -121,7 +129,7 @@ static size_t udp_create_by_template_ipv6(
     const TmplPkt *tmpl, ipv6address ip_them, unsigned port_them,
     ipv6address ip_me, unsigned port_me, unsigned ttl, unsigned char *payload,
     size_t payload_length, unsigned char *px, size_t sizeof_px) {
-    uint64_t xsum_udp;
+    unsigned xsum_udp;
     unsigned offset_ip  = tmpl->ipv6.offset_ip;
     unsigned offset_tcp = tmpl->ipv6.offset_tcp;
     unsigned r_len      = tmpl->ipv6.offset_app + payload_length;
@@ -179,11 +187,15 @@ static size_t udp_create_by_template_ipv6(
     U16_TO_BE(px + offset_tcp + 2, port_them);
     U16_TO_BE(px + offset_tcp + 4, r_len - tmpl->ipv6.offset_app + 8);
 
-    px[offset_tcp + 6] = (unsigned char)(0);
-    px[offset_tcp + 7] = (unsigned char)(0);
-    xsum_udp           = checksum_ipv6(px + offset_ip + 8, px + offset_ip + 24,
-                                       IP_PROTO_UDP, r_len - offset_tcp, px + offset_tcp);
-    U16_TO_BE(px + offset_tcp + 6, xsum_udp);
+    xsum_udp = tmpl->ipv6.xsum_l4 + (r_len - offset_tcp);
+    xsum_udp = checksum_add_u64(xsum_udp, ip_me.hi);
+    xsum_udp = checksum_add_u64(xsum_udp, ip_me.lo);
+    xsum_udp = checksum_add_u64(xsum_udp, ip_them.hi);
+    xsum_udp = checksum_add_u64(xsum_udp, ip_them.lo);
+    xsum_udp += _udp_xsum_fields(px + offset_tcp);
+    xsum_udp += checksum_partial(px + tmpl->ipv6.offset_app,
+                                 r_len - tmpl->ipv6.offset_app);
+    U16_TO_BE(px + offset_tcp + 6, checksum_fold(xsum_udp));
 
     return r_len;
 }
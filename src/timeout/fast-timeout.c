@@ -1,106 +1,335 @@
 /**
- * KLUDGE
+ * All expire time spec of events are the same, so an event always goes into
+ * the slot of now + spec. Producers push events into slots of their own
+ * wheels with CAS and the only consumer swaps the whole list of an expired
+ * slot with NULL. Lists are never popped one by one, so there's no ABA.
  *
- * This is a simple and fast version of event-timeout. All expire time spec of
- * events are the same. So we just use a linked list to save and just pop
- * events from head instead of going around all the nodes.
- *
- * FIXME: It must has a better data sructure and algorithm to handle the
- * timeout event in our complex condition(operating in multi-threads, etc). But
- * I'm lazy to get a new one. I feel tired to fix new bugs in these days...
+ * An event could be pushed into a slot a round later than the consumer if
+ * it was too slow. Such events are pushed back while draining and handled
+ * in the next round of wheel.
  */
 #include "fast-timeout.h"
 #include "../util-data/fine-malloc.h"
+#include "../pixie/pixie-timer.h"
+#include "../util-misc/cross.h"
+#include "../util-out/logger.h"
 
-typedef struct FastTmEntry FEntry;
+#include <stdio.h>
+#include <string.h>
 
-struct FastTmHandler {
-    time_t     spec;
-    lfqueue_t *queue;
-    /*oldest event poped from queue*/
-    FEntry    *oldest;
-};
+#if defined(_MSC_VER)
+#include <windows.h>
+#define FT_CAS(ptr, old, val)                                                  \
+    (InterlockedCompareExchangePointer((PVOID volatile *)(ptr), (val),         \
+                                       (old)) == (old))
+#define FT_XCHG(ptr, val)                                                      \
+    InterlockedExchangePointer((PVOID volatile *)(ptr), (val))
+#else
+#define FT_CAS(ptr, old, val) __sync_bool_compare_and_swap((ptr), (old), (val))
+#define FT_XCHG(ptr, val)     __sync_lock_test_and_set((ptr), (val))
+#endif
+
+#define FT_WHEEL_MASK   (FT_WHEEL_SIZE - 1)
+#define FT_BENCH_EVENTS 1000000
+
+typedef struct FastTmChunk {
+    struct FastTmChunk *next;
+} FChunk;
 
-struct FastTmEntry {
-    /*time the Entry was create*/
-    time_t timestamp;
-    /*point to correspond event or struct*/
-    void  *event;
+struct FastTmHandler {
+    FTable                *table;
+    /*all handlers of table for consumer*/
+    struct FastTmHandler  *next;
+    FEntry *volatile       slots[FT_WHEEL_SIZE];
+    /*next tick to drain, only for consumer*/
+    uint64_t               cursor;
+    /*pool only for owner*/
+    FEntry                *free_list;
+    /*events freed by other threads*/
+    FEntry *volatile       returned;
+    uint64_t volatile      added;
 };
 
 struct FastTmTable {
-    /*What time spec elapses before now should an event be timeout*/
-    time_t    spec;
-    lfqueue_t queue_t;
+    /*What ticks elapse before now should an event be timeout*/
+    uint64_t                       spec;
+    uint64_t                       tick_usec;
+    size_t                         event_size;
+    struct FastTmHandler *volatile handlers;
+    FChunk *volatile               chunks;
+    /*expired events drained from wheels, only for consumer*/
+    FEntry                        *ready;
+    uint64_t                       drained;
+    uint64_t volatile              popped;
 };
 
-FTable *ft_init_table(time_t spec) {
-    FTable *table = MALLOC(sizeof(FTable));
-    lfqueue_init(&table->queue_t);
-    table->spec = spec;
+static inline uint64_t _ft_now(const FTable *table) {
+    return pixie_gettime() / table->tick_usec;
+}
+
+static inline void _ft_push(FEntry *volatile *head, FEntry *entry) {
+    FEntry *old;
+    do {
+        old         = *head;
+        entry->next = old;
+    } while (!FT_CAS(head, old, entry));
+}
+
+FTable *ft_init_table(uint64_t spec_ms, size_t event_size) {
+    FTable  *table = CALLOC(1, sizeof(FTable));
+    uint64_t tick  = 1;
+
+    /*keep a half of wheel as headroom for a slow consumer*/
+    if (spec_ms > FT_WHEEL_SIZE / 2)
+        tick = (spec_ms + FT_WHEEL_SIZE / 2 - 1) / (FT_WHEEL_SIZE / 2);
+
+    table->tick_usec  = tick * 1000;
+    table->spec       = (spec_ms + tick - 1) / tick;
+    /*keep events aligned*/
+    table->event_size = (event_size + 15) & ~(size_t)15;
+    table->drained    = _ft_now(table);
 
     return table;
 }
 
 FHandler *ft_get_handler(FTable *table) {
-    FHandler *handler = MALLOC(sizeof(FHandler));
-    handler->spec     = table->spec;
-    handler->queue    = &table->queue_t;
-    handler->oldest   = NULL;
+    FHandler *handler = CALLOC(1, sizeof(FHandler));
+    FHandler *old;
+
+    handler->table  = table;
+    handler->cursor = _ft_now(table);
+
+    do {
+        old           = table->handlers;
+        handler->next = old;
+    } while (!FT_CAS(&table->handlers, old, handler));
 
     return handler;
 }
 
-void ft_add_event(FHandler *handler, void *event, time_t now) {
-    FEntry *entry    = MALLOC(sizeof(FEntry));
-    entry->timestamp = now;
-    entry->event     = event;
+static void _ft_grow_pool(FHandler *handler) {
+    FTable *table = handler->table;
+    /*header of chunk takes an event size to keep alignment*/
+    FChunk *chunk = MALLOC((FT_POOL_CHUNK + 1) * table->event_size);
+    char   *px    = (char *)chunk + table->event_size;
+    FChunk *old;
 
-    lfqueue_enq(handler->queue, entry);
-}
+    do {
+        old         = table->chunks;
+        chunk->next = old;
+    } while (!FT_CAS(&table->chunks, old, chunk));
 
-void *ft_pop_event(FHandler *handler, time_t now) {
-    if (!handler->oldest) {
-        handler->oldest = lfqueue_deq(handler->queue);
-        /*no event*/
-        if (!handler->oldest)
-            return NULL;
+    for (unsigned i = 0; i < FT_POOL_CHUNK; i++) {
+        FEntry *entry      = (FEntry *)(px + i * table->event_size);
+        entry->next        = handler->free_list;
+        handler->free_list = entry;
     }
+}
 
-    if (now - handler->oldest->timestamp >= handler->spec) {
-        void *ret = handler->oldest->event;
-        FREE(handler->oldest);
-        return ret;
+void *ft_alloc_event(FHandler *handler) {
+    FEntry *entry;
+
+    if (!handler->free_list) {
+        handler->free_list = FT_XCHG(&handler->returned, NULL);
+        if (!handler->free_list)
+            _ft_grow_pool(handler);
     }
 
-    return NULL;
+    entry              = handler->free_list;
+    handler->free_list = entry->next;
+
+    memset(entry, 0, handler->table->event_size);
+    entry->owner = handler;
+
+    return entry;
 }
 
-void ft_close_handler(FHandler *handler) {
-    if (handler->oldest) {
-        FREE(handler->oldest->event);
-        free(handler->oldest);
-        handler->oldest = NULL;
+void ft_free_event(void *event) {
+    FEntry *entry = event;
+    _ft_push(&entry->owner->returned, entry);
+}
+
+void ft_add_event(FHandler *handler, void *event) {
+    FTable *table = handler->table;
+    FEntry *entry = event;
+
+    entry->expire = _ft_now(table) + table->spec;
+    handler->added++;
+
+    _ft_push(&handler->slots[entry->expire & FT_WHEEL_MASK], entry);
+}
+
+/**
+ * Move events of expired slots in the wheel to ready list.
+ */
+static void _ft_drain_wheel(FTable *table, FHandler *wheel, uint64_t now) {
+    /*new wheel from a later clock*/
+    if (wheel->cursor > now)
+        return;
+    /*all slots would be visited in a round*/
+    if (now - wheel->cursor >= FT_WHEEL_SIZE)
+        wheel->cursor = now - FT_WHEEL_SIZE + 1;
+
+    for (; wheel->cursor <= now; wheel->cursor++) {
+        FEntry *volatile *slot = &wheel->slots[wheel->cursor & FT_WHEEL_MASK];
+        FEntry           *entry;
+        FEntry           *next;
+
+        if (!*slot)
+            continue;
+
+        for (entry = FT_XCHG(slot, NULL); entry; entry = next) {
+            next = entry->next;
+            if (entry->expire <= now) {
+                entry->next  = table->ready;
+                table->ready = entry;
+            } else {
+                _ft_push(slot, entry);
+            }
+        }
     }
+}
+
+void *ft_pop_event(FHandler *handler) {
+    FTable *table = handler->table;
+    FEntry *entry;
+
+    if (!table->ready) {
+        uint64_t now = _ft_now(table);
+        if (now == table->drained)
+            return NULL;
+
+        for (FHandler *h = table->handlers; h; h = h->next)
+            _ft_drain_wheel(table, h, now);
+        table->drained = now;
 
-    free(handler);
+        if (!table->ready)
+            return NULL;
+    }
+
+    entry        = table->ready;
+    table->ready = entry->next;
+    table->popped++;
+
+    return entry;
+}
+
+uint64_t ft_event_count(FHandler *handler) {
+    FTable  *table = handler->table;
+    uint64_t added = 0;
+
+    for (FHandler *h = table->handlers; h; h = h->next)
+        added += h->added;
+
+    return added > table->popped ? added - table->popped : 0;
+}
+
+void ft_close_handler(FHandler *handler) {
+    /*wheel and pool are still used by the consumer until table closed*/
+    UNUSEDPARM(handler);
 }
 
 void ft_close_table(FTable *table) {
-    FEntry *entry = lfqueue_deq(&table->queue_t);
-    while (entry) {
-        FREE(entry->event);
-        free(entry);
-        entry = lfqueue_deq(&table->queue_t);
+    FHandler *handler = table->handlers;
+    FChunk   *chunk   = table->chunks;
+
+    while (handler) {
+        FHandler *next = handler->next;
+        FREE(handler);
+        handler = next;
     }
-    lfqueue_destroy(&table->queue_t);
+
+    while (chunk) {
+        FChunk *next = chunk->next;
+        FREE(chunk);
+        chunk = next;
+    }
+
     FREE(table);
 }
 
-uint64_t ft_event_count(FHandler *handler) {
-    uint64_t ret;
-    ret = lfqueue_size(handler->queue);
-    if (handler->oldest)
-        ret++;
-    return ret;
-}
\ No newline at end of file
+typedef struct FtTestEvent {
+    FEntry   entry;
+    unsigned id;
+} FtTestEvent;
+
+int ft_selftest() {
+    FTable      *table = ft_init_table(20, sizeof(FtTestEvent));
+    FHandler    *h1    = ft_get_handler(table);
+    FHandler    *h2    = ft_get_handler(table);
+    FtTestEvent *event;
+    uint64_t     sum   = 0;
+    unsigned     count = 0;
+    int          err   = 0;
+
+    for (unsigned i = 1; i <= 3000; i++) {
+        event     = ft_alloc_event(i & 1 ? h1 : h2);
+        event->id = i;
+        ft_add_event(i & 1 ? h1 : h2, event);
+    }
+
+    /*none of them expires so soon*/
+    if (ft_pop_event(h1) || ft_event_count(h1) != 3000)
+        err = 1;
+
+    pixie_mssleep(50);
+    while ((event = ft_pop_event(h1))) {
+        sum += event->id;
+        count++;
+        ft_free_event(event);
+    }
+    if (count != 3000 || sum != 3000 * 3001 / 2 || ft_event_count(h1) != 0)
+        err = 1;
+
+    /*freed events are reused by their pool*/
+    event = ft_alloc_event(h2);
+    if (event->entry.owner != h2 || event->id != 0)
+        err = 1;
+    ft_free_event(event);
+
+    ft_close_handler(h1);
+    ft_close_handler(h2);
+    ft_close_table(table);
+
+    if (err)
+        LOG(LEVEL_ERROR, "(fast-timeout) selftest failed\n");
+
+    return err;
+}
+
+void ft_benchmark() {
+    FTable   *table = ft_init_table(1, sizeof(FtTestEvent));
+    FHandler *h     = ft_get_handler(table);
+    uint64_t  start, stop;
+    unsigned  popped = 0;
+    void     *event;
+
+    puts("-- fast-timeout --");
+
+    /*warm up the pool*/
+    for (unsigned i = 0; i < FT_BENCH_EVENTS; i++)
+        ft_add_event(h, ft_alloc_event(h));
+    pixie_mssleep(5);
+    while ((event = ft_pop_event(h)))
+        ft_free_event(event);
+
+    start = pixie_nanotime();
+    for (unsigned i = 0; i < FT_BENCH_EVENTS; i++)
+        ft_add_event(h, ft_alloc_event(h));
+    stop = pixie_nanotime();
+    printf("add events: %.2f ns/event\n",
+           (double)(stop - start) / FT_BENCH_EVENTS);
+
+    pixie_mssleep(5);
+    start = pixie_nanotime();
+    while ((event = ft_pop_event(h))) {
+        ft_free_event(event);
+        popped++;
+    }
+    stop = pixie_nanotime();
+    printf("pop events: %.2f ns/event (%u popped)\n\n",
+           (double)(stop - start) / FT_BENCH_EVENTS, popped);
+
+    ft_close_handler(h);
+    ft_close_table(table);
+}
@@ -1,70 +1,116 @@
+/*
+ Fast-timeout with timing wheels
+
+ Every thread adding events gets its own handler with a timing wheel of
+ FT_WHEEL_SIZE slots. An event is pushed into the slot of its expire tick
+ without any lock, and the consumer takes the whole list of a slot at once
+ after the tick passed. A tick is 1 millisecond if the spec is short enough
+ to be covered by half of the wheel, or a bit longer to cover it.
+
+ Events are allocated from the pool of handler and their entries of wheel
+ are stored inside them, so no malloc is needed for adding an event.
+ Events could be freed in any thread and go back to the pool of handler.
+ */
 #ifndef FAST_TIMEOUT_H
 #define FAST_TIMEOUT_H
 
+#include <stddef.h>
 #include <stdint.h>
-#include <stdint.h>
-#include <time.h>
 
-#include "../util-data/lfqueue.h"
+#define FT_WHEEL_SIZE  8192
+/*events allocated for a pool at once*/
+#define FT_POOL_CHUNK  1024
 
 typedef struct FastTmHandler FHandler;
 typedef struct FastTmTable   FTable;
 
+/**
+ * Intrusive entry of fast-timeout.
+ * !Must be the first member of events.
+ */
+typedef struct FastTmEntry {
+    struct FastTmEntry   *next;
+    /*tick the event expires at*/
+    uint64_t              expire;
+    /*handler whose pool owns the event*/
+    struct FastTmHandler *owner;
+} FEntry;
+
 /**
  * Create a fast-timeout table to manage timeout events
  *
- * @param table type of fast-timeout table.
- * @param spec What time spec elapses before now should an event be timeout
+ * @param spec_ms What time elapses before now should an event be timeout
+ * @param event_size size of events begin with an FEntry.
  * @return fast-timeout table.
  */
-FTable *ft_init_table(time_t spec);
+FTable *ft_init_table(uint64_t spec_ms, size_t event_size);
 
 /**
  * Got a handler from fast-timeout table to add or pop timeout events in one
  * thread.
  *
+ * ! Thread Safe.
+ *
  * @param table fast-timeout table.
  * @return fast-timeout table handler.
  */
 FHandler *ft_get_handler(FTable *table);
 
 /**
- * Add an event to fast-timeout table through the handler.
- * Time of the event will be set with now by the func.
- * So put our event in as fast as we can.
+ * Allocate a zeroed event from the pool of handler.
+ * !Only in the thread owning the handler.
+ */
+void *ft_alloc_event(FHandler *handler);
+
+/**
+ * Give an event back to the pool it was allocated from.
  *
  * ! Thread Safe.
+ */
+void ft_free_event(void *event);
+
+/**
+ * Add an event allocated by ft_alloc_event to fast-timeout table through the
+ * handler. Time of the event will be set with now by the func.
+ * So put our event in as fast as we can.
+ *
+ * !Only in the thread owning the handler.
  *
  * @param handler a handler of fast-timeout table.
  * @param event event that need to set timeout
- * @param now must be time of now
  */
-void ft_add_event(FHandler *handler, void *event, time_t now);
+void ft_add_event(FHandler *handler, void *event);
 
 /**
  * Pop up an event meets timeout now.
  * We should pop up events until get NULL every time.
+ * Expired slots of all wheels are drained in bulk while the tick goes on.
  *
- * !Thread Safe
+ * !Only one thread could pop events of a table.
  *
  * @param handler a handler of fast-timeout table.
  * @return an event meets timeout or NULL because all events are safe.
  */
-void *ft_pop_event(FHandler *handler, time_t now);
+void *ft_pop_event(FHandler *handler);
 
 /**
- * Get event count(with the oldest one)
+ * Get count of events not popped in the table.
  */
 uint64_t ft_event_count(FHandler *handler);
 
 /**
- * Clean up the fast-timeout table handler
+ * Stop using the handler in its thread.
+ * Its events still could be popped and freed until the table is closed.
  */
 void ft_close_handler(FHandler *handler);
 
 /**
- * Clean up the fast-timeout table with its entries.
+ * Clean up the fast-timeout table with all its events.
  */
 void ft_close_table(FTable *table);
 
-#endif
\ No newline at end of file
+int ft_selftest();
+
+void ft_benchmark();
+
+#endif
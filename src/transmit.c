@@ -28,6 +28,38 @@
 #include "util-out/logger.h"
 #include "util-data/fine-malloc.h"
 #include "util-scan/throttle.h"
+#include "util-scan/prefix-limit.h"
+
+/*targets generated in a batch, refilled when all were sent*/
+#define TX_GENERATE_BATCH 64
+
+/**
+ * Use `generate_batch` func if the generator has, or just generate one.
+ */
+static inline unsigned _generate_targets(Generator *generator,
+                                         unsigned tx_index, uint64_t start,
+                                         uint64_t increment, uint64_t repeat,
+                                         struct source_t *src, Target *out) {
+    if (generator->generate_batch_cb)
+        return generator->generate_batch_cb(tx_index, start, increment,
+                                            TX_GENERATE_BATCH, repeat, src,
+                                            out);
+
+    out[0] = generator->generate_cb(tx_index, start, repeat, src);
+    return 1;
+}
+
+/**
+ * Give tokens of the batch back before sleeping for deferred targets, so other
+ * tx threads could use them.
+ */
+static void _tx_wait_prefix(Throttler *throttler, PrefixLimiter *plimit,
+                            uint64_t *batch_size) {
+    throttler_put_back(throttler, *batch_size);
+    throttler_give_back(throttler);
+    *batch_size = 0;
+    prefix_limit_wait(plimit);
+}
 
 static void _adapter_get_source_addresses(const XConf     *xconf,
                                           struct source_t *src) {
@@ -44,17 +76,18 @@ static void _adapter_get_source_addresses(const XConf     *xconf,
 }
 
 void transmit_thread(void *v) {
-    TxThread     *parms        = (TxThread *)v;
-    const XConf  *xconf        = parms->xconf;
-    Throttler    *throttler    = parms->throttler;
-    Adapter      *adapter      = xconf->nic.adapter;
-    AdapterCache *acache       = NULL;
-    uint64_t      packets_sent = 0;
-    unsigned      increment    = xconf->shard.of * xconf->tx_thread_count;
-    uint64_t      entropy      = xconf->seed;
-    ScanTmEvent  *tm_event     = NULL;
-    FHandler     *ft_handler   = NULL;
-    Generator    *generator    = xconf->generator;
+    TxThread      *parms        = (TxThread *)v;
+    const XConf   *xconf        = parms->xconf;
+    Throttler     *throttler    = parms->throttler;
+    Adapter       *adapter      = xconf->nic.adapter;
+    AdapterCache  *acache       = NULL;
+    uint64_t       packets_sent = 0;
+    unsigned       increment    = xconf->shard.of * xconf->tx_thread_count;
+    uint64_t       entropy      = xconf->seed;
+    ScanTmEvent   *tm_event     = NULL;
+    FHandler      *ft_handler   = NULL;
+    Generator     *generator    = xconf->generator;
+    PrefixLimiter *plimit       = NULL;
 
     /* Wait to make sure receive_thread is ready */
     pixie_usleep(1000000);
@@ -64,19 +97,7 @@ void transmit_thread(void *v) {
     snprintf(th_name, sizeof(th_name), XTATE_NAME "-xmit #%u", parms->tx_index);
     pixie_set_thread_name(th_name);
 
-    /* Lock threads to the CPUs one by one in this order:
-     *     1.Tx threads
-     *     2.Rx thread
-     *     3.Rx handle threads
-     * TODO: Make CPU locking be settable.
-     */
-    if (pixie_cpu_get_count() > 1 && !xconf->is_no_cpu_bind) {
-        unsigned cpu_count = pixie_cpu_get_count();
-        unsigned cpu_index = parms->tx_index;
-        /* I think it is better to make (cpu>=cpu_count) threads free */
-        if (cpu_index < cpu_count)
-            pixie_cpu_set_affinity(cpu_index);
-    }
+    xconf_bind_cpu(xconf, CpuRole_Tx, parms->tx_index);
 
     /* Normally, we have just one source address. In special cases, though
      * we can have multiple. */
@@ -86,18 +107,34 @@ void transmit_thread(void *v) {
     /**
      * init tx's own adapter transmit cache.
      */
-    acache = rawsock_init_cache(xconf->is_sendq);
+    acache = rawsock_init_cache(adapter, xconf->is_sendq);
 
     if (xconf->is_fast_timeout) {
         ft_handler = ft_get_handler(xconf->ft_table);
     }
 
-    throttler_start(throttler, xconf->max_rate / xconf->tx_thread_count);
+    throttler_start(throttler, parms->rate_bucket);
+
+    if (xconf->prefix_rate) {
+        plimit = prefix_limit_create(
+            (double)xconf->prefix_rate / xconf->tx_thread_count,
+            xconf->prefix_v4_len, xconf->prefix_v6_len,
+            prefix_limit_count_prefixes(&xconf->targets, xconf->prefix_v4_len,
+                                        xconf->prefix_v6_len));
+    }
 
     /*Declared out of infinite loop to keep balance of stack*/
     uint64_t start;
     uint64_t batch_size;
     unsigned more_idx;
+    /*targets[tgt_idx] is the target of index i*/
+    Target   targets[TX_GENERATE_BATCH];
+    unsigned tgt_count;
+    unsigned tgt_idx;
+    /*current target is from reorder buffer of prefix limiter*/
+    Target   deferred;
+    uint64_t deferred_index;
+    bool     is_deferred;
 
 infinite:;
 
@@ -113,23 +150,76 @@ infinite:;
     LOG(LEVEL_DEBUG, "(tx thread) starting main loop from: %llu inc: %llu\n",
         start, increment);
 
-    more_idx = 0;
-    for (uint64_t i = start; generator->hasmore_cb(parms->tx_index, i);) {
-        batch_size = throttler_next_batch(throttler, packets_sent);
-
-        /*Transmit packets from stack first */
+    more_idx       = 0;
+    tgt_count      = 0;
+    tgt_idx        = 0;
+    is_deferred    = false;
+    deferred_index = start;
+    for (uint64_t i = start;
+         tgt_idx < tgt_count || more_idx ||
+         generator->hasmore_cb(parms->tx_index, i) ||
+         (plimit && prefix_limit_count(plimit));) {
+        /*Transmit packets from stack first with higher priority*/
+        batch_size = throttler_next_prior(
+            throttler, packets_sent,
+            rte_ring_count(xconf->stack->transmit_queue));
         stack_flush_packets(xconf->stack, adapter, acache, &packets_sent,
                             &batch_size);
+        throttler_put_back(throttler, batch_size);
+
+        batch_size = throttler_next_batch(throttler, packets_sent);
+
+        if (plimit)
+            prefix_limit_tick(plimit, pixie_nanotime());
+
+        while (batch_size) {
+            /*deferred targets go first after their prefixes are ready*/
+            if (more_idx == 0)
+                is_deferred = plimit && prefix_limit_pop(plimit, &deferred,
+                                                         &deferred_index);
+
+            if (!is_deferred && tgt_idx == tgt_count) {
+                if (!generator->hasmore_cb(parms->tx_index, i)) {
+                    /*only deferred targets left*/
+                    if (plimit)
+                        _tx_wait_prefix(throttler, plimit, &batch_size);
+                    break;
+                }
+                /*stream generators may have no more after the batch*/
+                parms->has_pending = true;
+                tgt_count =
+                    _generate_targets(generator, parms->tx_index, i, increment,
+                                      parms->my_repeat, &src, targets);
+                tgt_idx   = 0;
+                if (tgt_count == 0)
+                    break;
+            }
+
+            /*defer the new target if its prefix is over budget*/
+            if (!is_deferred && more_idx == 0 && plimit &&
+                !prefix_limit_take(plimit, &targets[tgt_idx])) {
+                if (prefix_limit_defer(plimit, &targets[tgt_idx], i)) {
+                    i += increment;
+                    tgt_idx++;
+                } else {
+                    /*reorder buffer is full*/
+                    _tx_wait_prefix(throttler, plimit, &batch_size);
+                    break;
+                }
+                if (time_to_finish_tx)
+                    break;
+                continue;
+            }
 
-        while (batch_size && generator->hasmore_cb(parms->tx_index, i)) {
             ScanTarget target = {.index = more_idx};
 
-            target.target = generator->generate_cb(parms->tx_index, i,
-                                                   parms->my_repeat, &src);
+            target.target = is_deferred ? deferred : targets[tgt_idx];
 
             /*if we don't use fast-timeout, do not malloc more memory*/
             if (!tm_event) {
-                tm_event = CALLOC(1, sizeof(ScanTmEvent));
+                tm_event = xconf->is_fast_timeout
+                               ? ft_alloc_event(ft_handler)
+                               : CALLOC(1, sizeof(ScanTmEvent));
             }
 
             tm_event->target.ip_proto  = target.target.ip_proto;
@@ -159,7 +249,7 @@ infinite:;
 
                 /*add timeout event*/
                 if (xconf->is_fast_timeout && tm_event->need_timeout) {
-                    ft_add_event(ft_handler, tm_event, global_now);
+                    ft_add_event(ft_handler, tm_event);
                     tm_event = NULL;
                 } else {
                     tm_event->need_timeout = 0;
@@ -170,7 +260,10 @@ infinite:;
             if (more) {
                 more_idx++;
             } else {
-                i += increment;
+                if (!is_deferred) {
+                    i += increment;
+                    tgt_idx++;
+                }
                 more_idx = 0;
             }
 
@@ -182,8 +275,20 @@ infinite:;
 
         } /* end of batch */
 
-        /* save our current location for resuming */
-        parms->my_index = i;
+        throttler_put_back(throttler, batch_size);
+
+        /* save our current location for resuming, deferred targets not sent
+         * yet are before it */
+        if (plimit) {
+            parms->my_index = prefix_limit_resume_index(
+                plimit, is_deferred && more_idx && deferred_index < i
+                            ? deferred_index
+                            : i);
+        } else {
+            parms->my_index = i;
+        }
+        parms->has_pending = tgt_idx < tgt_count || more_idx ||
+                             (plimit && prefix_limit_count(plimit));
 
         /* If the user pressed <ctrl-c>, then we need to exit and save state.*/
         if (time_to_finish_tx) {
@@ -199,6 +304,9 @@ infinite:;
         if ((xconf->repeat && parms->my_repeat < xconf->repeat) ||
             !xconf->repeat) {
             parms->my_repeat++;
+            /*responses from now on belong to the new round*/
+            if (parms->my_repeat > global_round)
+                global_round = (unsigned)parms->my_repeat;
             goto infinite;
         }
     }
@@ -216,19 +324,40 @@ infinite:;
      * flush. So do explicit flush for less latency.
      */
     while (!time_to_finish_rx) {
-        batch_size = throttler_next_batch(throttler, packets_sent);
+        uint64_t last_sent = packets_sent;
+
+        batch_size = throttler_next_prior(
+            throttler, packets_sent,
+            rte_ring_count(xconf->stack->transmit_queue));
         stack_flush_packets(xconf->stack, adapter, acache, &packets_sent,
                             &batch_size);
+        throttler_put_back(throttler, batch_size);
         rawsock_flush(adapter, acache);
+
+        /*busy-poll for a while then park until packets to be sent*/
+        if (packets_sent == last_sent) {
+            pixie_wait_waiter(xconf->stack->transmit_waiter,
+                              RTE_XTATE_PARK_MSEC, rte_ring_is_ready,
+                              xconf->stack->transmit_queue);
+        }
     }
 
     /*clean adapter transmit cache*/
     rawsock_close_cache(acache);
     acache = NULL;
 
+    if (tm_event) {
+        if (xconf->is_fast_timeout)
+            ft_free_event(tm_event);
+        else
+            FREE(tm_event);
+    }
+
     if (xconf->is_fast_timeout)
         ft_close_handler(ft_handler);
 
+    prefix_limit_destroy(plimit);
+
     parms->done_transmitting = true;
     LOG(LEVEL_DEBUG, "exiting transmit thread #%u                    \n",
         parms->tx_index);
@@ -21,8 +21,12 @@ typedef struct TxThreadConfig {
     volatile uint64_t my_index;
     /*current repeat count of this tx thread that count from 0 */
     volatile uint64_t my_repeat;
+    /*generated targets in batch are waiting to be sent*/
+    volatile bool     has_pending;
     /*for rate limitation*/
     Throttler         throttler[1];
+    /*shared by all tx threads for rate limitation*/
+    RateBucket       *rate_bucket;
     /*statistics*/
     uint64_t          total_sent;
     /*thread handler(id for process)*/
@@ -75,8 +75,10 @@
 #include "../pixie/pixie-threads.h"
 #include <errno.h>
 
-#define RTE_XTATE_DEQ_USEC 100
-#define RTE_XTATE_ENQ_USEC 1000
+#define RTE_XTATE_DEQ_USEC  100
+#define RTE_XTATE_ENQ_USEC  1000
+/*max time for consumers to park on an empty ring before checking exiting*/
+#define RTE_XTATE_PARK_MSEC 10
 
 #ifndef ENOBUFS
 #define ENOBUFS 119
@@ -947,6 +949,16 @@ static inline unsigned rte_ring_free_count(const struct rte_ring *r) {
     return ((cons_tail - prod_tail - 1) & r->prod.mask);
 }
 
+/**
+ * Test if any entry in a ring. It's for the `is_ready` of pixie_wait_waiter.
+ *
+ * @param r
+ *   A pointer to the ring structure.
+ */
+static inline bool rte_ring_is_ready(void *r) {
+    return !rte_ring_empty((const struct rte_ring *)r);
+}
+
 /**
  * Dump the status of all rings on the console
  */
@@ -9,13 +9,26 @@
     Modified: sharkocha 2024
 */
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "checksum.h"
 #include "../target/target.h"
 #include "../util-out/logger.h"
+#include "../pixie/pixie-timer.h"
+#include "../util-data/data-convert.h"
+#include "../util-data/fine-malloc.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CHECKSUM_X86_SIMD 1
+#endif
+
+typedef unsigned (*checksum_calc_func)(const void *vbuf, size_t length);
 
 /**
- * Calculates the checksum over a buffer.
+ * Calculates the checksum over a buffer byte-pair by byte-pair.
  * @param checksum
  *      The value of the pseudo-header checksum that this sum will be
  *      added to. This value must be calculated separately. This
@@ -26,7 +39,7 @@
  *      The buffer that we are checksumming, such as all the
  *      payload after an IPv4 or IPv6 header.
  */
-static unsigned _checksum_calculate(const void *vbuf, size_t length) {
+static unsigned _checksum_calc_generic(const void *vbuf, size_t length) {
     unsigned             sum = 0;
     size_t               i;
     const unsigned char *buf = (const unsigned char *)vbuf;
@@ -53,6 +66,159 @@ static unsigned _checksum_calculate(const void *vbuf, size_t length) {
     return sum;
 }
 
+/**
+ * Fold 64-bit sum of native-endian words into 16 bits in big-endian order.
+ * One's complement sum is independent of byte order(RFC 1071), so we could
+ * sum words in native order and just swap the bytes of folded result.
+ */
+static unsigned _checksum_native_finish(uint64_t sum) {
+    const union {
+        uint16_t      u16;
+        unsigned char u8[2];
+    } endian = {.u16 = 1};
+
+    sum = (sum >> 32) + (sum & 0xFFFFFFFF);
+    sum = (sum >> 32) + (sum & 0xFFFFFFFF);
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum = (sum >> 16) + (sum & 0xFFFF);
+
+    if (endian.u8[0]) /*little-endian*/
+        sum = ((sum & 0xFF) << 8) | (sum >> 8);
+
+    return (unsigned)sum;
+}
+
+/**
+ * Sum native-endian 32-bit words with a 64-bit accumulator, so no carry
+ * need to be handled in loop.
+ */
+static uint64_t _checksum_native_sum(const unsigned char *buf, size_t length,
+                                     uint64_t sum) {
+    uint32_t w32;
+    uint16_t w16;
+
+    for (; length >= 16; buf += 16, length -= 16) {
+        uint32_t w[4];
+        memcpy(w, buf, 16);
+        sum += (uint64_t)w[0] + w[1] + w[2] + w[3];
+    }
+    for (; length >= 4; buf += 4, length -= 4) {
+        memcpy(&w32, buf, 4);
+        sum += w32;
+    }
+    if (length >= 2) {
+        memcpy(&w16, buf, 2);
+        sum += w16;
+        buf += 2;
+        length -= 2;
+    }
+    /* the last byte is padded with zero in network order */
+    if (length) {
+        w16 = 0;
+        memcpy(&w16, buf, 1);
+        sum += w16;
+    }
+
+    return sum;
+}
+
+static unsigned _checksum_calc_u64(const void *vbuf, size_t length) {
+    return _checksum_native_finish(
+        _checksum_native_sum((const unsigned char *)vbuf, length, 0));
+}
+
+#ifdef CHECKSUM_X86_SIMD
+
+/*
+ * SIMD kernels widen 16-bit words to 32-bit lanes. A lane gets at most
+ * 2*0xFFFF per round, so we flush lanes to 64-bit sum before overflowing.
+ */
+#define CHECKSUM_SIMD_FLUSH 16384
+
+__attribute__((target("sse2"))) static unsigned
+_checksum_calc_sse2(const void *vbuf, size_t length) {
+    const unsigned char *buf  = (const unsigned char *)vbuf;
+    const __m128i        zero = _mm_setzero_si128();
+    uint64_t             sum  = 0;
+    uint32_t             lanes[4];
+
+    while (length >= 16) {
+        __m128i  acc    = _mm_setzero_si128();
+        unsigned rounds = 0;
+
+        for (; length >= 16 && rounds < CHECKSUM_SIMD_FLUSH; rounds++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)buf);
+            acc       = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc       = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+            buf += 16;
+            length -= 16;
+        }
+
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    return _checksum_native_finish(_checksum_native_sum(buf, length, sum));
+}
+
+__attribute__((target("avx2"))) static unsigned
+_checksum_calc_avx2(const void *vbuf, size_t length) {
+    const unsigned char *buf  = (const unsigned char *)vbuf;
+    const __m256i        zero = _mm256_setzero_si256();
+    uint64_t             sum  = 0;
+    uint32_t             lanes[8];
+
+    while (length >= 32) {
+        __m256i  acc    = _mm256_setzero_si256();
+        unsigned rounds = 0;
+
+        for (; length >= 32 && rounds < CHECKSUM_SIMD_FLUSH; rounds++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)buf);
+            acc       = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc       = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+            buf += 32;
+            length -= 32;
+        }
+
+        _mm256_storeu_si256((__m256i *)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+               lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    }
+
+    return _checksum_native_finish(_checksum_native_sum(buf, length, sum));
+}
+
+static int _checksum_has_sse2() { return __builtin_cpu_supports("sse2"); }
+
+static int _checksum_has_avx2() { return __builtin_cpu_supports("avx2"); }
+
+#endif /*CHECKSUM_X86_SIMD*/
+
+static int _checksum_has_always() { return 1; }
+
+/**
+ * All kernels return a sum congruent to the sum of big-endian 16-bit words
+ * modulo 0xFFFF. So results could be added but not subtracted.
+ * Ordered from the slowest to the fastest.
+ */
+static const struct {
+    const char        *name;
+    checksum_calc_func calc;
+    int (*is_supported)();
+} _checksum_kernels[] = {
+    {"generic", _checksum_calc_generic, _checksum_has_always},
+    {"scalar-u64", _checksum_calc_u64, _checksum_has_always},
+#ifdef CHECKSUM_X86_SIMD
+    {"sse2", _checksum_calc_sse2, _checksum_has_sse2},
+    {"avx2", _checksum_calc_avx2, _checksum_has_avx2},
+#endif
+    {0},
+};
+
+/*generic one until checksum_init*/
+static checksum_calc_func _checksum_calculate = _checksum_calc_generic;
+
 /**
  * After we sum up all the numbers involved, we must "fold" the upper
  * 16-bits back into the lower 16-bits. Since something like 0x1FFFF
@@ -68,6 +234,22 @@ static unsigned _checksum_finish(unsigned sum) {
     return (~sum) & 0xFFFF;
 }
 
+/**
+ * Fold without reversing the bits.
+ */
+static unsigned _checksum_reduce(uint64_t sum) {
+    sum = (sum >> 32) + (sum & 0xFFFFFFFF);
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    return (unsigned)sum;
+}
+
+/**
+ * Remove a 16-bit word from sum by adding its 1s-complement(RFC 1624).
+ */
+#define CHECKSUM_REMOVE(sum, px) ((sum) += (~((px)[0] << 8 | (px)[1])) & 0xFFFF)
+
 unsigned checksum_ipv4(unsigned ip_src, unsigned ip_dst, unsigned ip_proto,
                        size_t payload_length, const void *payload) {
     unsigned             sum;
@@ -87,21 +269,21 @@ unsigned checksum_ipv4(unsigned ip_src, unsigned ip_dst, unsigned ip_proto,
     switch (ip_proto) {
         case IP_PROTO_Other:
             sum = _checksum_calculate(buf, payload_length);
-            sum -= buf[10] << 8 |
-                   buf[11]; /* pretend the existing checksum field is zero */
+            /* pretend the existing checksum field is zero */
+            CHECKSUM_REMOVE(sum, buf + 10);
             break;
         case IP_PROTO_ICMP:
-            sum -= buf[2] << 8 | buf[3];
+            CHECKSUM_REMOVE(sum, buf + 2);
             break;
         case IP_PROTO_IGMP: /* IGMP - group message - has no pseudo header */
             sum = _checksum_calculate(payload, payload_length);
-            sum -= buf[2] << 8 | buf[3];
+            CHECKSUM_REMOVE(sum, buf + 2);
             break;
         case IP_PROTO_TCP:
-            sum -= buf[16] << 8 | buf[17];
+            CHECKSUM_REMOVE(sum, buf + 16);
             break;
         case IP_PROTO_UDP:
-            sum -= buf[6] << 8 | buf[7];
+            CHECKSUM_REMOVE(sum, buf + 6);
             break;
         default:
             return 0xFFFFFFFF;
@@ -132,13 +314,13 @@ unsigned checksum_ipv6(const unsigned char *ip_src, const unsigned char *ip_dst,
             return 0;
         case IP_PROTO_ICMP:
         case IP_PROTO_IPv6_ICMP:
-            sum -= buf[2] << 8 | buf[3];
+            CHECKSUM_REMOVE(sum, buf + 2);
             break;
         case IP_PROTO_TCP:
-            sum -= buf[16] << 8 | buf[17];
+            CHECKSUM_REMOVE(sum, buf + 16);
             break;
         case IP_PROTO_UDP:
-            sum -= buf[6] << 8 | buf[7];
+            CHECKSUM_REMOVE(sum, buf + 6);
             break;
         default:
             return 0xFFFFFFFF;
@@ -149,12 +331,14 @@ unsigned checksum_ipv6(const unsigned char *ip_src, const unsigned char *ip_dst,
     return sum;
 }
 
+unsigned checksum_partial(const void *buf, size_t length) {
+    return _checksum_calculate(buf, length);
+}
+
 unsigned checksum_ip_header(const unsigned char *px, unsigned offset,
                             unsigned max_offset) {
     unsigned header_length = (px[offset] & 0xF) * 4;
     unsigned header_offset = offset + header_length;
-    unsigned xsum          = 0;
-    unsigned i;
 
     /* restrict border of header */
     if (max_offset < offset + header_length) {
@@ -162,99 +346,49 @@ unsigned checksum_ip_header(const unsigned char *px, unsigned offset,
         header_offset = max_offset;
     }
 
-    /* add all the two-byte words together */
-    xsum = 0;
-    for (i = offset; i < header_offset; i += 2) {
-        xsum += px[i] << 8 | px[i + 1];
-    }
-
-    /* if more than 16 bits in result, reduce to 16 bits */
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
-
-    return xsum;
+    return _checksum_reduce(
+        _checksum_calculate(px + offset, header_offset - offset));
 }
 
 /***************************************************************************
  ***************************************************************************/
 unsigned checksum_icmp(const unsigned char *px, unsigned offset_icmp,
                        size_t icmp_length) {
-    uint64_t xsum = 0;
-    unsigned i;
-
-    for (i = 0; i < icmp_length; i += 2) {
-        xsum += px[offset_icmp + i] << 8 | px[offset_icmp + i + 1];
-    }
-
-    xsum -= (icmp_length & 1) *
-            px[offset_icmp + i -
-               1]; /* yea I know going off end of packet is bad so sue me */
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
-
-    return (unsigned)xsum;
+    return _checksum_reduce(_checksum_calculate(px + offset_icmp, icmp_length));
 }
 
 /***************************************************************************
  ***************************************************************************/
 unsigned checksum_udp(const unsigned char *px, unsigned offset_ip,
                       unsigned offset_tcp, size_t tcp_length) {
-    uint64_t xsum = 0;
-    unsigned i;
+    uint64_t xsum;
 
     /* pseudo checksum */
     xsum = 17;
     xsum += tcp_length;
-    xsum += px[offset_ip + 12] << 8 | px[offset_ip + 13];
-    xsum += px[offset_ip + 14] << 8 | px[offset_ip + 15];
-    xsum += px[offset_ip + 16] << 8 | px[offset_ip + 17];
-    xsum += px[offset_ip + 18] << 8 | px[offset_ip + 19];
-
-    /* TCP checksum */
-    for (i = 0; i < tcp_length; i += 2) {
-        xsum += px[offset_tcp + i] << 8 | px[offset_tcp + i + 1];
-    }
+    xsum += _checksum_calculate(px + offset_ip + 12, 8);
 
-    xsum -= (tcp_length & 1) *
-            px[offset_tcp + i -
-               1]; /* yea I know going off end of packet is bad so sue me */
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
+    /* UDP checksum */
+    xsum += _checksum_calculate(px + offset_tcp, tcp_length);
 
-    return (unsigned)xsum;
+    return _checksum_reduce(xsum);
 }
 
 /***************************************************************************
  ***************************************************************************/
 unsigned checksum_tcp(const unsigned char *px, unsigned offset_ip,
                       unsigned offset_tcp, size_t tcp_length) {
-    uint64_t xsum = 0;
-    unsigned i;
+    uint64_t xsum;
 
     /* pseudo checksum */
     xsum = 6;
     xsum += tcp_length;
-    xsum += px[offset_ip + 12] << 8 | px[offset_ip + 13];
-    xsum += px[offset_ip + 14] << 8 | px[offset_ip + 15];
-    xsum += px[offset_ip + 16] << 8 | px[offset_ip + 17];
-    xsum += px[offset_ip + 18] << 8 | px[offset_ip + 19];
+    xsum += _checksum_calculate(px + offset_ip + 12, 8);
 
     /* TCP checksum */
-    for (i = 0; i < tcp_length; i += 2) {
-        xsum += px[offset_tcp + i] << 8 | px[offset_tcp + i + 1];
-    }
-
-    xsum -= (tcp_length & 1) *
-            px[offset_tcp + i -
-               1]; /* yea I know going off end of packet is bad so sue me */
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
-    xsum = (xsum & 0xFFFF) + (xsum >> 16);
+    xsum += _checksum_calculate(px + offset_tcp, tcp_length);
 
-    return (unsigned)xsum;
+    return _checksum_reduce(xsum);
 }
 
 #define CRC32C_POLY  0x1EDC6F41
@@ -315,26 +449,139 @@ static unsigned crc_c[256] = {
     0xAD7D5351L,
 };
 
-unsigned checksum_sctp(const void *vbuffer, size_t sctp_length) {
-    const unsigned char *buffer = (const unsigned char *)vbuffer;
-    unsigned             i;
-    unsigned             crc32 = (unsigned)~0;
-    unsigned             result;
-    unsigned char        byte0, byte1, byte2, byte3;
-
-    for (i = 0; i < 8; i++) {
-        CRC32C(crc32, buffer[i]);
+typedef uint32_t (*crc32c_func)(uint32_t crc, const unsigned char *buf,
+                                size_t length);
+
+/*
+ * Tables for slicing-by-8, crc_c is the first one and others are generated
+ * by checksum_init.
+ */
+static uint32_t crc_c8[8][256];
+
+static uint32_t _crc32c_bytewise(uint32_t crc, const unsigned char *buf,
+                                 size_t length) {
+    size_t i;
+
+    for (i = 0; i < length; i++)
+        CRC32C(crc, buf[i]);
+    return crc;
+}
+
+/**
+ * Process 8 bytes with 8 lookups in independent tables per round.
+ */
+static uint32_t _crc32c_slice8(uint32_t crc, const unsigned char *buf,
+                               size_t length) {
+    for (; length >= 8; buf += 8, length -= 8) {
+        crc ^= (uint32_t)LE_TO_U32(buf);
+        crc = crc_c8[7][crc & 0xFF] ^ crc_c8[6][(crc >> 8) & 0xFF] ^
+              crc_c8[5][(crc >> 16) & 0xFF] ^ crc_c8[4][crc >> 24] ^
+              crc_c8[3][buf[4]] ^ crc_c8[2][buf[5]] ^ crc_c8[1][buf[6]] ^
+              crc_c8[0][buf[7]];
+    }
+
+    return _crc32c_bytewise(crc, buf, length);
+}
+
+#ifdef CHECKSUM_X86_SIMD
+/**
+ * The crc32 instruction of SSE4.2 uses the CRC32c polynomial exactly.
+ */
+__attribute__((target("sse4.2"))) static uint32_t
+_crc32c_sse42(uint32_t crc, const unsigned char *buf, size_t length) {
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    uint64_t w64;
+
+    for (; length >= 8; buf += 8, length -= 8) {
+        memcpy(&w64, buf, 8);
+        crc64 = _mm_crc32_u64(crc64, w64);
+    }
+    crc = (uint32_t)crc64;
+#endif
+    uint32_t w32;
+
+    for (; length >= 4; buf += 4, length -= 4) {
+        memcpy(&w32, buf, 4);
+        crc = _mm_crc32_u32(crc, w32);
+    }
+    for (; length; buf++, length--)
+        crc = _mm_crc32_u8(crc, *buf);
+
+    return crc;
+}
+
+static int _checksum_has_sse42() { return __builtin_cpu_supports("sse4.2"); }
+#endif /*CHECKSUM_X86_SIMD*/
+
+/**
+ * Ordered from the slowest to the fastest.
+ */
+static const struct {
+    const char *name;
+    crc32c_func update;
+    int (*is_supported)();
+} _crc32c_kernels[] = {
+    {"bytewise", _crc32c_bytewise, _checksum_has_always},
+    {"slice-by-8", _crc32c_slice8, _checksum_has_always},
+#ifdef CHECKSUM_X86_SIMD
+    {"sse4.2", _crc32c_sse42, _checksum_has_sse42},
+#endif
+    {0},
+};
+
+/*bytewise one until checksum_init*/
+static crc32c_func _crc32c_update = _crc32c_bytewise;
+
+/**
+ * Generate tables of slicing-by-8 and choose the fastest kernels supported by
+ * CPU.
+ */
+void checksum_init() {
+    checksum_calc_func calc   = _checksum_calc_generic;
+    crc32c_func        update = _crc32c_bytewise;
+    unsigned           i, k;
+
+    for (i = 0; _checksum_kernels[i].name; i++) {
+        if (_checksum_kernels[i].is_supported())
+            calc = _checksum_kernels[i].calc;
     }
 
-    CRC32C(crc32, 0);
-    CRC32C(crc32, 0);
-    CRC32C(crc32, 0);
-    CRC32C(crc32, 0);
+    for (i = 0; i < 256; i++) {
+        crc_c8[0][i] = crc_c[i];
+        for (k = 1; k < 8; k++)
+            crc_c8[k][i] =
+                (crc_c8[k - 1][i] >> 8) ^ crc_c[crc_c8[k - 1][i] & 0xFF];
+    }
 
-    for (i = 12; i < sctp_length; i++) {
-        CRC32C(crc32, buffer[i]);
+    for (i = 0; _crc32c_kernels[i].name; i++) {
+        if (_crc32c_kernels[i].is_supported())
+            update = _crc32c_kernels[i].update;
     }
-    result = ~crc32;
+
+    _checksum_calculate = calc;
+    _crc32c_update      = update;
+}
+
+/**
+ * The CRC is "reflected", so the result has bytes swapped compared to the
+ * value in network order. We do an explicit byte swap.
+ */
+static uint32_t _crc32c_swap(uint32_t crc) {
+    return ((crc & 0xFF) << 24) | ((crc & 0xFF00) << 8) |
+           ((crc >> 8) & 0xFF00) | (crc >> 24);
+}
+
+unsigned checksum_sctp(const void *vbuffer, size_t sctp_length) {
+    static const unsigned char zero[4] = {0};
+    const unsigned char       *buffer  = (const unsigned char *)vbuffer;
+    uint32_t                   crc32   = ~(uint32_t)0;
+
+    /* pretend the existing checksum field is zero */
+    crc32 = _crc32c_update(crc32, buffer, 8);
+    crc32 = _crc32c_update(crc32, zero, 4);
+    if (sctp_length > 12)
+        crc32 = _crc32c_update(crc32, buffer + 12, sctp_length - 12);
 
     /*  result  now holds the negated polynomial remainder;
      *  since the table and algorithm is "reflected" [williams95].
@@ -349,14 +596,27 @@ unsigned checksum_sctp(const void *vbuffer, size_t sctp_length) {
      *  byte swap.  On a little-endian machine, this byte swap and
      *  the final ntohl cancel out and could be elided.
      */
+    return _crc32c_swap(~crc32);
+}
 
-    byte0 = result & 0xff;
-    byte1 = (result >> 8) & 0xff;
-    byte2 = (result >> 16) & 0xff;
-    byte3 = (result >> 24) & 0xff;
-
-    crc32 = ((byte0 << 24) | (byte1 << 16) | (byte2 << 8) | byte3);
-    return (crc32);
+void checksum_sctp_byte_table(unsigned offset, size_t sctp_length,
+                              unsigned table[256]) {
+    static const unsigned char zero[64] = {0};
+    unsigned char              value;
+    uint32_t                   crc32;
+    size_t                     left;
+    unsigned                   i;
+
+    for (i = 0; i < 256; i++) {
+        /* leading zero bytes keep a zero register unchanged */
+        value = (unsigned char)i;
+        crc32 = _crc32c_update(0, &value, 1);
+        for (left = sctp_length - offset - 1; left > sizeof(zero);
+             left -= sizeof(zero))
+            crc32 = _crc32c_update(crc32, zero, sizeof(zero));
+        crc32    = _crc32c_update(crc32, zero, left);
+        table[i] = _crc32c_swap(crc32);
+    }
 }
 
 /*
@@ -430,6 +690,99 @@ static struct {
      IP_PROTO_TCP},
     {0}};
 
+static const char *_checksum_kernel_name() {
+    unsigned i;
+
+    for (i = 0; _checksum_kernels[i].name; i++) {
+        if (_checksum_kernels[i].calc == _checksum_calculate)
+            return _checksum_kernels[i].name;
+    }
+    return "unknown";
+}
+
+static const char *_crc32c_kernel_name() {
+    unsigned i;
+
+    for (i = 0; _crc32c_kernels[i].name; i++) {
+        if (_crc32c_kernels[i].update == _crc32c_update)
+            return _crc32c_kernels[i].name;
+    }
+    return "unknown";
+}
+
+/**
+ * Compare results of all supported kernels with the generic one in different
+ * lengths and alignments. A long buffer of 0xFF tests the overflow of sums.
+ */
+static int _checksum_kernels_selftest() {
+    unsigned char *buf;
+    size_t         big_len = 600 * 1024;
+    unsigned       seed    = 7;
+    unsigned       expected;
+    unsigned       i, off;
+    size_t         len;
+
+    buf = MALLOC(big_len + 8);
+    for (len = 0; len < 2048; len++) {
+        seed     = seed * 1103515245 + 12345;
+        buf[len] = (unsigned char)(seed >> 16);
+    }
+
+    for (i = 1; _checksum_kernels[i].name; i++) {
+        if (!_checksum_kernels[i].is_supported())
+            continue;
+        for (off = 0; off < 4; off++) {
+            for (len = 0; len < 1600; len += (len < 80 ? 1 : 37)) {
+                expected =
+                    _checksum_reduce(_checksum_calc_generic(buf + off, len));
+                if (_checksum_reduce(_checksum_kernels[i].calc(
+                        buf + off, len)) != expected) {
+                    LOG(LEVEL_ERROR,
+                        "(checksum) kernel %s failed at len=%u off=%u\n",
+                        _checksum_kernels[i].name, (unsigned)len, off);
+                    FREE(buf);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    for (i = 1; _crc32c_kernels[i].name; i++) {
+        if (!_crc32c_kernels[i].is_supported())
+            continue;
+        for (off = 0; off < 4; off++) {
+            for (len = 0; len < 1600; len += (len < 80 ? 1 : 37)) {
+                expected = _crc32c_bytewise(~0u, buf + off, len);
+                if (_crc32c_kernels[i].update(~0u, buf + off, len) !=
+                    expected) {
+                    LOG(LEVEL_ERROR,
+                        "(checksum) crc32c kernel %s failed at len=%u off=%u\n",
+                        _crc32c_kernels[i].name, (unsigned)len, off);
+                    FREE(buf);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    /* the sum of 0xFFFF words is 0 in 1s-complement and odd byte left */
+    memset(buf, 0xFF, big_len + 8);
+    for (i = 1; _checksum_kernels[i].name; i++) {
+        if (!_checksum_kernels[i].is_supported())
+            continue;
+        if (_checksum_reduce(_checksum_kernels[i].calc(buf + 1, big_len + 1)) !=
+            0xFF00) {
+            LOG(LEVEL_ERROR, "(checksum) kernel %s failed in long buffer\n",
+                _checksum_kernels[i].name);
+            FREE(buf);
+            return 1;
+        }
+    }
+
+    FREE(buf);
+    return 0;
+}
+
 int checksum_selftest() {
     unsigned sum;
     unsigned xsum;
@@ -464,5 +817,80 @@ int checksum_selftest() {
     if (xsum != 0x58e45d36)
         return 1;
 
+    /* All kernels must agree with the generic one */
+    if (_checksum_kernels_selftest())
+        return 1;
+
     return 0; /* success */
 }
+
+/***************************************************************************
+ ***************************************************************************/
+#define CHECKSUM_BENCH_BYTES (256ULL * 1024 * 1024)
+
+void checksum_benchmark() {
+    static const unsigned sizes[] = {64, 256, 576, 1500};
+    unsigned char         buf[1500];
+    unsigned              seed = 1;
+    unsigned              i, j;
+    uint64_t              n, count;
+    uint64_t              start, stop;
+    volatile unsigned     result = 0;
+
+    puts("-- checksum --");
+
+    for (i = 0; i < sizeof(buf); i++) {
+        seed   = seed * 1103515245 + 12345;
+        buf[i] = (unsigned char)(seed >> 16);
+    }
+
+    for (i = 0; _checksum_kernels[i].name; i++) {
+        if (!_checksum_kernels[i].is_supported()) {
+            printf("%-10s: not supported\n", _checksum_kernels[i].name);
+            continue;
+        }
+
+        for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+            count = CHECKSUM_BENCH_BYTES / sizes[j];
+
+            start = pixie_nanotime();
+            for (n = 0; n < count; n++)
+                result += _checksum_kernels[i].calc(buf, sizes[j]);
+            stop = pixie_nanotime();
+
+            printf("%-10s %4uB: %7.2f-ns/call %7.2f-Gbps\n",
+                   _checksum_kernels[i].name, sizes[j],
+                   (double)(stop - start) / count,
+                   CHECKSUM_BENCH_BYTES * 8.0 / (double)(stop - start));
+        }
+    }
+
+    printf("selected: %s\n\n", _checksum_kernel_name());
+
+    puts("-- crc32c --");
+    printf("selected: %s\n", _crc32c_kernel_name());
+
+    for (i = 0; _crc32c_kernels[i].name; i++) {
+        if (!_crc32c_kernels[i].is_supported()) {
+            printf("%-10s: not supported\n", _crc32c_kernels[i].name);
+            continue;
+        }
+
+        for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+            count = CHECKSUM_BENCH_BYTES / 4 / sizes[j];
+
+            start = pixie_nanotime();
+            for (n = 0; n < count; n++)
+                result += _crc32c_kernels[i].update(~0u, buf, sizes[j]);
+            stop = pixie_nanotime();
+
+            printf("%-10s %4uB: %7.2f-ns/call %7.2f-Gbps\n",
+                   _crc32c_kernels[i].name, sizes[j],
+                   (double)(stop - start) / count,
+                   count * sizes[j] * 8.0 / (double)(stop - start));
+        }
+    }
+    printf("\n");
+
+    (void)result;
+}
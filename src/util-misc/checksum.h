@@ -11,6 +11,13 @@
 #ifndef CHECKSUM_H
 #define CHECKSUM_H
 #include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Choose the fastest checksum and CRC32c kernels supported by CPU.
+ * !Must be called once before any thread starts, or generic kernels are used.
+ */
+void checksum_init();
 
 /**
  * Calculate a checksum for IPv4 packets for generic pkts
@@ -62,8 +69,60 @@ unsigned checksum_udp(const unsigned char *px, unsigned offset_ip,
 unsigned checksum_tcp(const unsigned char *px, unsigned offset_ip,
                       unsigned offset_tcp, size_t tcp_length);
 
+/**
+ * CRC32c of SCTP packet. The existing checksum field is regarded as zero.
+ * The fastest kernel(bytewise, slicing-by-8 or SSE4.2) is selected by
+ * checksum_init.
+ */
 unsigned checksum_sctp(const void *vbuffer, size_t sctp_length);
 
+/**
+ * CRC32c is linear, so the checksum of a SCTP packet equals the checksum of
+ * the packet with some bytes zeroed XOR contributions of those bytes.
+ * Fill the table with contributions of every value of the byte at offset in
+ * SCTP packet of sctp_length. They are in the same byte order as the result
+ * of checksum_sctp.
+ * NOTE: offset cannot be in the checksum field.
+ */
+void checksum_sctp_byte_table(unsigned offset, size_t sctp_length,
+                              unsigned table[256]);
+
+/***************************************************************************
+ * Partial checksum for incremental updating(RFC 1624).
+ * A partial sum is congruent to the sum of big-endian 16-bit words modulo
+ * 0xFFFF, but it may be folded already. Sums of different parts could be
+ * added together and folded only once at last. So constant parts of a packet
+ * could be summed in advance, and just fields changed for every packet need
+ * to be added.
+ * NOTE: Never subtract partial sums, add 1s-complement of a word to remove it.
+ ***************************************************************************/
+unsigned checksum_partial(const void *buf, size_t length);
+
+static inline unsigned checksum_add_u32(unsigned sum, uint32_t x) {
+    return sum + (x >> 16) + (x & 0xFFFF);
+}
+
+static inline unsigned checksum_add_u64(unsigned sum, uint64_t x) {
+    return checksum_add_u32(checksum_add_u32(sum, (uint32_t)(x >> 32)),
+                            (uint32_t)x);
+}
+
+/**
+ * Fold the partial sum and reverse the bits to get final checksum.
+ */
+static inline unsigned checksum_fold(unsigned sum) {
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    return (~sum) & 0xFFFF;
+}
+
 int checksum_selftest();
 
+/**
+ * Compare throughput of checksum kernels(generic, 64-bit scalar, SSE2, AVX2)
+ * and CRC32c kernels(bytewise, slicing-by-8, SSE4.2) in different sizes of
+ * buffer. The fastest supported one is selected by checksum_init.
+ */
+void checksum_benchmark();
+
 #endif
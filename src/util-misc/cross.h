@@ -45,6 +45,33 @@ typedef enum { false = 0, true = 1 } bool;
 #define UNUSEDPARM(x) (void)x
 #endif
 
+// prefetch
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#define PREFETCH(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#elif defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch((p))
+#endif
+
+// popcount
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define POPCNT64(x) ((unsigned)__popcnt64(x))
+#elif defined(__GNUC__)
+#define POPCNT64(x) ((unsigned)__builtin_popcountll(x))
+#endif
+
+// count trailing zeros, x must not be 0
+#if defined(_MSC_VER)
+static __inline unsigned CTZ32(unsigned x) {
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (unsigned)i;
+}
+#elif defined(__GNUC__)
+#define CTZ32(x) ((unsigned)__builtin_ctz(x))
+#endif
+
 #ifndef max
 #define max(a, b)                                                              \
     ({                                                                         \
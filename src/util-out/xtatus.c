@@ -21,6 +21,8 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
     double      sent_rate         = 0.0;
     double      hit_rate          = 0.0;
     double      kpps              = item->cur_pps / 1000;
+    /*jitter is only meaningful with --pacing*/
+    char        jitter_json[40]   = "";
 
     const char *json_fmt_infinite = "{"
                                     "\"state\":\"infinite\","
@@ -37,6 +39,7 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                                     "\"txq\":%.2f%%,"
                                     "\"rxq\":%.2f%%,"
                                     "\"hit\":%.2f%%,"
+                                    "%s"
                                     "\"add status\":\"%s\""
                                     "}\n";
 
@@ -56,6 +59,7 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                                    "\"txq\":%.2f%%,"
                                    "\"rxq\":%.2f%%,"
                                    "\"hit\":%.2f%%,"
+                                   "%s"
                                    "\"add status\":\"%s\""
                                    "}\n";
 
@@ -77,6 +81,7 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                                    "\"txq\":%.2f%%,"
                                    "\"rxq\":%.2f%%,"
                                    "\"hit\":%.2f%%,"
+                                   "%s"
                                    "\"transmit\":"
                                    "{"
                                    "\"sent\":%" PRIu64 ","
@@ -115,6 +120,7 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                                    "\"tm_event\":%" PRIu64 ","
                                    "\"txq\":%.2f%%,"
                                    "\"rxq\":%.2f%%,"
+                                   "%s"
                                    "\"hit\":%.2f%%"
                                    "},"
                                    "\"add status\":\"%s\""
@@ -188,6 +194,10 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
         hit_rate = (100.0 * item->total_successed) / ((double)item->total_sent);
     }
 
+    if (item->print_in_json && xtatus->print_jitter)
+        snprintf(jitter_json, sizeof(jitter_json), "\"jitter us\":%.2f,",
+                 item->jitter);
+
     if (!xtatus->no_ansi)
         LOG(LEVEL_OUT, XPRINT_CLEAR_LINE);
 
@@ -203,7 +213,8 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                 LOG(LEVEL_OUT, fmt, (int)item->exiting_secs, kpps,
                     item->cur_pps, sent_rate, successed_rate, item->cur_count,
                     item->total_tm_event, item->tx_queue_ratio,
-                    item->rx_queue_ratio, hit_rate, item->add_status);
+                    item->rx_queue_ratio, hit_rate, jitter_json,
+                    item->add_status);
             } else {
                 fmt = "rate:%6.2f-kpps, waiting %d-secs, sent/s=%.0f, "
                       "[+]/s=%.0f";
@@ -227,6 +238,11 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                     LOG(LEVEL_OUT, fmt, hit_rate);
                 }
 
+                if (xtatus->print_jitter) {
+                    fmt = ", %.2fus-jitter";
+                    LOG(LEVEL_OUT, fmt, item->jitter);
+                }
+
                 if (item->add_status[0]) {
                     fmt = ", %s";
                     LOG(LEVEL_OUT, fmt, item->add_status);
@@ -239,7 +255,8 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                 LOG(LEVEL_OUT, fmt, kpps, item->cur_pps, sent_rate,
                     successed_rate, item->cur_count, item->repeat_count,
                     item->total_tm_event, item->tx_queue_ratio,
-                    item->rx_queue_ratio, hit_rate, item->add_status);
+                    item->rx_queue_ratio, hit_rate, jitter_json,
+                    item->add_status);
             } else {
                 fmt = "rate:%6.2f-kpps, round=%" PRIu64
                       ", sent/s=%.0f, [+]/s=%.0f";
@@ -263,6 +280,11 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                     LOG(LEVEL_OUT, fmt, hit_rate);
                 }
 
+                if (xtatus->print_jitter) {
+                    fmt = ", %.2fus-jitter";
+                    LOG(LEVEL_OUT, fmt, item->jitter);
+                }
+
                 if (item->add_status[0]) {
                     fmt = ", %s";
                     LOG(LEVEL_OUT, fmt, item->add_status);
@@ -278,9 +300,9 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                     percent_done, (int)item->exiting_secs,
                     item->total_successed, item->total_failed, item->total_info,
                     item->total_tm_event, item->tx_queue_ratio,
-                    item->rx_queue_ratio, hit_rate, item->cur_count,
-                    item->max_count, item->max_count - item->cur_count,
-                    item->add_status);
+                    item->rx_queue_ratio, hit_rate, jitter_json,
+                    item->cur_count, item->max_count,
+                    item->max_count - item->cur_count, item->add_status);
             } else {
                 fmt = "rate:%6.2f-kpps, %5.2f%% done, waiting %d-secs, "
                       "[+]=%" PRIu64 ", [x]=%" PRIu64;
@@ -310,6 +332,11 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                     LOG(LEVEL_OUT, fmt, hit_rate);
                 }
 
+                if (xtatus->print_jitter) {
+                    fmt = ", %.2fus-jitter";
+                    LOG(LEVEL_OUT, fmt, item->jitter);
+                }
+
                 if (item->add_status[0]) {
                     fmt = ", %s";
                     LOG(LEVEL_OUT, fmt, item->add_status);
@@ -326,7 +353,8 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                     item->max_count, item->max_count - item->cur_count,
                     item->total_successed, item->total_failed, item->total_info,
                     item->total_tm_event, item->tx_queue_ratio,
-                    item->rx_queue_ratio, hit_rate, item->add_status);
+                    item->rx_queue_ratio, jitter_json, hit_rate,
+                    item->add_status);
             } else {
                 fmt = "rate:%6.2f-kpps, %5.2f%% done,%4u:%02u:%02u remaining, "
                       "[+]=%" PRIu64 ", [x]=%" PRIu64;
@@ -358,6 +386,11 @@ void xtatus_print(Xtatus *xtatus, XtatusItem *item) {
                     LOG(LEVEL_OUT, fmt, hit_rate);
                 }
 
+                if (xtatus->print_jitter) {
+                    fmt = ", %.2fus-jitter";
+                    LOG(LEVEL_OUT, fmt, item->jitter);
+                }
+
                 if (item->add_status[0]) {
                     fmt = ", %s";
                     LOG(LEVEL_OUT, fmt, item->add_status);
@@ -14,6 +14,8 @@ typedef struct XtatusPrintItem {
     double   cur_pps;
     double   tx_queue_ratio;
     double   rx_queue_ratio;
+    /*average lateness(us) of departures in pacing mode*/
+    double   jitter;
     uint64_t total_successed;
     uint64_t total_failed;
     uint64_t total_info;
@@ -45,6 +47,7 @@ typedef struct XtatusPrinter {
     unsigned print_info_num : 1;
     unsigned print_ft_event : 1;
     unsigned print_hit_rate : 1;
+    unsigned print_jitter   : 1;
 } Xtatus;
 
 void xtatus_print(Xtatus *xtatus, XtatusItem *item);
@@ -6,6 +6,30 @@
 #include "../stack/stack-ndpv6.h"
 #include "../stub/stub-pcap-dlt.h"
 
+/***************************************************************************
+ * ADAPTER/NETWORK-INTERFACE
+ *
+ * If no network interface was configured, we need to go hunt down
+ * the best Interface to use. We do this by choosing the first
+ * interface with a "default route" (aka. "gateway") defined
+ ***************************************************************************/
+int initialize_adapter_name(const XConf *xconf, char *ifname, size_t len) {
+    if (xconf->nic.ifname[0]) {
+        snprintf(ifname, len, "%s", xconf->nic.ifname);
+        return 0;
+    }
+
+    /* no adapter specified, so find a default one */
+    ifname[0] = '\0';
+    if (rawsock_get_default_interface(ifname, len) || ifname[0] == '\0') {
+        LOG(LEVEL_ERROR, "could not determine default interface\n");
+        LOG(LEVEL_ERROR, "    try \"--interface ethX\"\n");
+        return -1;
+    }
+
+    return 0;
+}
+
 /***************************************************************************
  * Initialize the network adapter.
  *
@@ -20,44 +44,34 @@
 int initialize_adapter(XConf *xconf, bool has_ipv4_targets,
                        bool has_ipv6_targets) {
     ipaddress_formatted_t fmt;
-    char                 *ifname;
-    char                  ifname2[256];
+    char                  ifname[256];
     unsigned              adapter_ip     = 0;
-    AdapterCache         *tmp_acache     = rawsock_init_cache(false);
+    AdapterCache         *tmp_acache     = rawsock_init_cache(NULL, false);
     bool                  is_usable_ipv4 = !has_ipv4_targets;
     bool                  is_usable_ipv6 = !has_ipv6_targets;
 
-    /*
-     * ADAPTER/NETWORK-INTERFACE
-     *
-     * If no network interface was configured, we need to go hunt down
-     * the best Interface to use. We do this by choosing the first
-     * interface with a "default route" (aka. "gateway") defined
-     */
-    if (xconf->nic.ifname[0])
-        ifname = xconf->nic.ifname;
-    else {
-        /* no adapter specified, so find a default one */
-        int err;
-        ifname2[0] = '\0';
-        err        = rawsock_get_default_interface(ifname2, sizeof(ifname2));
-        if (err || ifname2[0] == '\0') {
-            LOG(LEVEL_ERROR, "could not determine default interface\n");
-            LOG(LEVEL_ERROR, "    try \"--interface ethX\"\n");
-            rawsock_close_cache(tmp_acache);
-            return -1;
-        }
-        ifname = ifname2;
+    if (initialize_adapter_name(xconf, ifname, sizeof(ifname)) != 0) {
+        rawsock_close_cache(tmp_acache);
+        return -1;
     }
     LOG(LEVEL_DEBUG, "interface = %s\n", ifname);
 
     /*
      * START ADAPTER
      */
+    if (xconf->rx_thread_count > 1 && !xconf->is_afpacket) {
+        LOG(LEVEL_ERROR, "multiple receive threads need AF_PACKET mode\n");
+        LOG(LEVEL_HINT, "use --af-packet or set --rx-thread-count to 1\n");
+        rawsock_close_cache(tmp_acache);
+        return -1;
+    }
+    xconf->afp_opt.fanout_count = xconf->rx_thread_count;
+
     xconf->nic.adapter = rawsock_init_adapter(
-        ifname, xconf->is_pfring, xconf->is_sendq, xconf->packet_trace,
-        xconf->is_offline, xconf->nic.is_vlan, xconf->nic.vlan_id,
-        xconf->nic.snaplen);
+        ifname, xconf->is_pfring, xconf->is_afpacket ? &xconf->afp_opt : NULL,
+        xconf->is_afxdp ? &xconf->xdp_opt : NULL, xconf->is_sendq,
+        xconf->packet_trace, xconf->is_offline, xconf->nic.is_vlan,
+        xconf->nic.vlan_id, xconf->nic.snaplen);
     if (xconf->nic.adapter == 0) {
         LOG(LEVEL_ERROR, "(if:%s) init failed\n", ifname);
         rawsock_close_cache(tmp_acache);
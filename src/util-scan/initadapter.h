@@ -3,6 +3,12 @@
 
 #include "../xconf.h"
 
+/**
+ * Get name of the configured adapter, or the default one if not configured.
+ * The static configuration is not changed.
+ */
+int initialize_adapter_name(const XConf *xconf, char *ifname, size_t len);
+
 /**
  * Discover the local network adapter parameters, such as which
  * MAC address we are using and the MAC addresses of the
@@ -0,0 +1,390 @@
+#include "prefix-limit.h"
+#include "../pixie/pixie-timer.h"
+#include "../util-data/fine-malloc.h"
+#include "../util-out/logger.h"
+
+#include <inttypes.h>
+
+typedef struct PrefixSlot {
+    /*hash of prefix, 0 for empty*/
+    uint64_t tag;
+    /*time(ns) when the prefix could receive the next probe*/
+    uint64_t next;
+} PfxSlot;
+
+typedef struct PrefixDeferred {
+    Target   target;
+    uint64_t index;
+    uint64_t due;
+    bool     is_popped;
+} PfxDeferred;
+
+struct PrefixLimiter {
+    PfxSlot     *slots;
+    uint64_t     bucket_mask;
+    /*ns per probe to a prefix*/
+    uint64_t     interval;
+    uint64_t     now;
+    unsigned     v4_len;
+    unsigned     v6_len;
+    /*reorder buffer in the order targets were deferred*/
+    PfxDeferred *defer;
+    unsigned     head;
+    unsigned     tail;
+    /*min-heap of positions in reorder buffer by due time*/
+    unsigned    *heap;
+    unsigned     heap_len;
+};
+
+PrefixLimiter *prefix_limit_create(double rate, unsigned v4_len,
+                                   unsigned v6_len, uint64_t prefix_count) {
+    PrefixLimiter *pl;
+    uint64_t       size = PFX_TABLE_DFT;
+
+    if (rate < 0.000001)
+        rate = 0.000001;
+
+    /*twice buckets than prefixes keep full buckets rare*/
+    if (prefix_count) {
+        for (size = PFX_TABLE_MIN;
+             size < PFX_TABLE_MAX && size / PFX_WAYS / 2 < prefix_count;
+             size <<= 1)
+            ;
+    }
+
+    pl              = CALLOC(1, sizeof(*pl));
+    pl->slots       = CALLOC(size, sizeof(*pl->slots));
+    pl->bucket_mask = size / PFX_WAYS - 1;
+    pl->defer       = CALLOC(PFX_DEFER_SIZE, sizeof(*pl->defer));
+    pl->heap        = CALLOC(PFX_DEFER_SIZE, sizeof(*pl->heap));
+    pl->interval    = (uint64_t)(1000000000.0 / rate);
+    pl->v4_len      = v4_len > 32 ? 32 : v4_len;
+    pl->v6_len      = v6_len > 128 ? 128 : v6_len;
+
+    LOG(LEVEL_DEBUG, "(prefix limit) %" PRIu64 " slots for prefixes\n", size);
+
+    return pl;
+}
+
+static inline uint64_t _add_saturated(uint64_t a, uint64_t b) {
+    return a + b < a ? UINT64_MAX : a + b;
+}
+
+uint64_t prefix_limit_count_prefixes(const TargetSet *targets, unsigned v4_len,
+                                     unsigned v6_len) {
+    const struct RangeList  *v4    = &targets->ipv4;
+    const struct Range6List *v6    = &targets->ipv6;
+    uint64_t                 count = 0;
+    uint64_t                 first, last, prev;
+    unsigned                 shift;
+
+    /*ranges are sorted, so neighbours may share a prefix at edges*/
+    shift = v4_len >= 32 ? 0 : 32 - v4_len;
+    prev  = UINT64_MAX;
+    for (unsigned i = 0; i < v4->list_len; i++) {
+        first = shift == 32 ? 0 : v4->list[i].begin >> shift;
+        last  = shift == 32 ? 0 : v4->list[i].end >> shift;
+        count += last - first + (first != prev);
+        prev = last;
+    }
+
+    prev = UINT64_MAX;
+    for (size_t i = 0; i < v6->list_len; i++) {
+        const struct Range6 *r = &v6->list[i];
+        if (v6_len > 64) {
+            /*count of addresses instead*/
+            if (r->end.hi != r->begin.hi)
+                return UINT64_MAX;
+            count = _add_saturated(count, r->end.lo - r->begin.lo);
+            count = _add_saturated(count, 1);
+            continue;
+        }
+        shift = 64 - v6_len;
+        first = shift == 64 ? 0 : r->begin.hi >> shift;
+        last  = shift == 64 ? 0 : r->end.hi >> shift;
+        count = _add_saturated(count, last - first);
+        count = _add_saturated(count, first != prev);
+        prev  = last;
+    }
+
+    return count;
+}
+
+void prefix_limit_destroy(PrefixLimiter *pl) {
+    if (!pl)
+        return;
+
+    FREE(pl->slots);
+    FREE(pl->defer);
+    FREE(pl->heap);
+    FREE(pl);
+}
+
+void prefix_limit_tick(PrefixLimiter *pl, uint64_t now_ns) {
+    pl->now = now_ns;
+}
+
+static uint64_t *_prefix_slot(PrefixLimiter *pl, const Target *target) {
+    const ipaddress *ip = &target->ip_them;
+    uint64_t         hi = 0, lo = 0;
+    PfxSlot         *bucket;
+    PfxSlot         *free_slot = NULL;
+
+    if (ip->version == 4) {
+        if (pl->v4_len)
+            hi = ip->ipv4 >> (32 - pl->v4_len);
+        lo = 4;
+    } else {
+        if (pl->v6_len >= 64) {
+            hi = ip->ipv6.hi;
+            if (pl->v6_len > 64)
+                lo = ip->ipv6.lo >> (128 - pl->v6_len);
+        } else if (pl->v6_len) {
+            hi = ip->ipv6.hi >> (64 - pl->v6_len);
+        }
+        lo ^= 6ULL << 56;
+    }
+
+    hi = (hi * 0x9E3779B97F4A7C15ULL) ^ (lo * 0xC2B2AE3D27D4EB4FULL);
+    hi ^= hi >> 29;
+    hi = hi ? hi : 1;
+
+    bucket = &pl->slots[((hi >> 32) & pl->bucket_mask) * PFX_WAYS];
+
+    for (unsigned i = 0; i < PFX_WAYS; i++) {
+        if (bucket[i].tag == hi)
+            return &bucket[i].next;
+        /*slot of an idle prefix could be reused*/
+        if (!free_slot && bucket[i].next <= pl->now)
+            free_slot = &bucket[i];
+    }
+
+    /*all prefixes in the bucket are active, share the budget*/
+    if (!free_slot)
+        return &bucket[0].next;
+
+    free_slot->tag  = hi;
+    free_slot->next = 0;
+
+    return &free_slot->next;
+}
+
+bool prefix_limit_take(PrefixLimiter *pl, const Target *target) {
+    uint64_t *slot = _prefix_slot(pl, target);
+
+    if (*slot > pl->now)
+        return false;
+
+    *slot = pl->now + pl->interval;
+    return true;
+}
+
+static inline uint64_t _heap_due(const PrefixLimiter *pl, unsigned i) {
+    return pl->defer[pl->heap[i]].due;
+}
+
+static inline void _heap_swap(PrefixLimiter *pl, unsigned i, unsigned j) {
+    unsigned tmp = pl->heap[i];
+    pl->heap[i]  = pl->heap[j];
+    pl->heap[j]  = tmp;
+}
+
+bool prefix_limit_defer(PrefixLimiter *pl, const Target *target,
+                        uint64_t index) {
+    uint64_t *slot = _prefix_slot(pl, target);
+    unsigned  pos, i;
+
+    if (pl->tail - pl->head >= PFX_DEFER_SIZE)
+        return false;
+
+    pos                      = pl->tail++ & (PFX_DEFER_SIZE - 1);
+    pl->defer[pos].target    = *target;
+    pl->defer[pos].index     = index;
+    pl->defer[pos].due       = *slot > pl->now ? *slot : pl->now;
+    pl->defer[pos].is_popped = false;
+    *slot                    = pl->defer[pos].due + pl->interval;
+
+    /*sift up*/
+    i           = pl->heap_len++;
+    pl->heap[i] = pos;
+    while (i && _heap_due(pl, (i - 1) / 2) > _heap_due(pl, i)) {
+        _heap_swap(pl, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+
+    return true;
+}
+
+bool prefix_limit_pop(PrefixLimiter *pl, Target *target, uint64_t *index) {
+    PfxDeferred *dfr;
+    unsigned     i, child;
+
+    if (pl->heap_len == 0 || _heap_due(pl, 0) > pl->now)
+        return false;
+
+    dfr            = &pl->defer[pl->heap[0]];
+    *target        = dfr->target;
+    *index         = dfr->index;
+    dfr->is_popped = true;
+
+    /*sift down*/
+    pl->heap[0] = pl->heap[--pl->heap_len];
+    for (i = 0; (child = 2 * i + 1) < pl->heap_len; i = child) {
+        if (child + 1 < pl->heap_len &&
+            _heap_due(pl, child + 1) < _heap_due(pl, child))
+            child++;
+        if (_heap_due(pl, i) <= _heap_due(pl, child))
+            break;
+        _heap_swap(pl, i, child);
+    }
+
+    /*free positions of popped targets in deferred order*/
+    while (pl->head != pl->tail &&
+           pl->defer[pl->head & (PFX_DEFER_SIZE - 1)].is_popped)
+        pl->head++;
+
+    return true;
+}
+
+void prefix_limit_wait(PrefixLimiter *pl) {
+    uint64_t wait;
+
+    if (pl->heap_len && _heap_due(pl, 0) > pl->now) {
+        wait = (_heap_due(pl, 0) - pl->now) / 1000;
+        if (wait > 100000)
+            wait = 100000;
+        if (wait)
+            pixie_usleep(wait);
+    }
+
+    pl->now = pixie_nanotime();
+}
+
+unsigned prefix_limit_count(const PrefixLimiter *pl) { return pl->heap_len; }
+
+uint64_t prefix_limit_resume_index(const PrefixLimiter *pl, uint64_t index) {
+    uint64_t first;
+
+    if (pl->head == pl->tail)
+        return index;
+
+    first = pl->defer[pl->head & (PFX_DEFER_SIZE - 1)].index;
+    return first < index ? first : index;
+}
+
+int prefix_limit_selftest() {
+    PrefixLimiter *pl;
+    Target         t1 = {0}, t2 = {0}, got;
+    uint64_t       index;
+    int            err = 0;
+
+    /*10 probes/s to a /24 and a /48*/
+    pl = prefix_limit_create(10, 24, 48, 0);
+
+    t1.ip_them.version = 4;
+    t1.ip_them.ipv4    = 0x0A000001;
+    t2.ip_them.version = 4;
+    t2.ip_them.ipv4    = 0x0A0000FE;
+
+    prefix_limit_tick(pl, 1000000000ULL);
+    if (!prefix_limit_take(pl, &t1))
+        err = 1;
+    /*the same /24 is over budget now*/
+    if (prefix_limit_take(pl, &t2))
+        err = 1;
+    if (!prefix_limit_defer(pl, &t2, 100) || prefix_limit_count(pl) != 1)
+        err = 1;
+    /*and the next probe is reserved a slot after the deferred one*/
+    if (!prefix_limit_defer(pl, &t1, 101) || prefix_limit_count(pl) != 2)
+        err = 1;
+    if (prefix_limit_pop(pl, &got, &index))
+        err = 1;
+    /*deferred targets are not sent yet*/
+    if (prefix_limit_resume_index(pl, 102) != 100)
+        err = 1;
+
+    prefix_limit_tick(pl, 1100000000ULL);
+    if (!prefix_limit_pop(pl, &got, &index) ||
+        got.ip_them.ipv4 != t2.ip_them.ipv4 || index != 100)
+        err = 1;
+    if (prefix_limit_pop(pl, &got, &index))
+        err = 1;
+    if (prefix_limit_resume_index(pl, 102) != 101)
+        err = 1;
+
+    prefix_limit_tick(pl, 1200000000ULL);
+    if (!prefix_limit_pop(pl, &got, &index) ||
+        got.ip_them.ipv4 != t1.ip_them.ipv4 || index != 101)
+        err = 1;
+    if (prefix_limit_count(pl) != 0 ||
+        prefix_limit_resume_index(pl, 102) != 102)
+        err = 1;
+
+    /*a hot prefix doesn't block targets of others which are due earlier*/
+    prefix_limit_tick(pl, 2000000000ULL);
+    for (unsigned i = 0; i < 3; i++) {
+        if (!prefix_limit_defer(pl, &t1, 200 + i))
+            err = 1;
+    }
+    t2.ip_them.ipv4 = 0x0B000001;
+    prefix_limit_tick(pl, 2050000000ULL);
+    if (!prefix_limit_take(pl, &t2) || prefix_limit_take(pl, &t2) ||
+        !prefix_limit_defer(pl, &t2, 203))
+        err = 1;
+    prefix_limit_tick(pl, 2170000000ULL);
+    if (!prefix_limit_pop(pl, &got, &index) || index != 200)
+        err = 1;
+    if (!prefix_limit_pop(pl, &got, &index) || index != 201)
+        err = 1;
+    if (!prefix_limit_pop(pl, &got, &index) || index != 203)
+        err = 1;
+    if (prefix_limit_pop(pl, &got, &index))
+        err = 1;
+    if (prefix_limit_resume_index(pl, 204) != 202)
+        err = 1;
+
+    /*other prefixes are not affected*/
+    t1.ip_them.version = 6;
+    t1.ip_them.ipv6.hi = 0x20010DB800010000ULL;
+    t1.ip_them.ipv6.lo = 1;
+    t2.ip_them.version = 6;
+    t2.ip_them.ipv6.hi = 0x20010DB800020000ULL;
+    t2.ip_them.ipv6.lo = 1;
+    if (!prefix_limit_take(pl, &t1) || !prefix_limit_take(pl, &t2))
+        err = 1;
+    t2.ip_them.ipv6.hi = 0x20010DB80001FFFFULL;
+    if (prefix_limit_take(pl, &t2))
+        err = 1;
+
+    prefix_limit_destroy(pl);
+
+    /*neighbour ranges share prefixes at edges*/
+    TargetSet targets = {0};
+    rangelist_add_range(&targets.ipv4, 0x0A000000, 0x0A0001FF);
+    rangelist_add_range(&targets.ipv4, 0x0A000205, 0x0A000206);
+    rangelist_add_range(&targets.ipv4, 0x0A000209, 0x0A000301);
+    rangelist_sort(&targets.ipv4);
+    if (prefix_limit_count_prefixes(&targets, 24, 48) != 4 ||
+        prefix_limit_count_prefixes(&targets, 0, 48) != 1 ||
+        prefix_limit_count_prefixes(&targets, 32, 48) != 763)
+        err = 1;
+    rangelist_remove_all(&targets.ipv4);
+
+    /*distinct prefixes of targets hardly share budgets in a sized table*/
+    pl = prefix_limit_create(10, 24, 48, 1024);
+    prefix_limit_tick(pl, 1000000000ULL);
+    t1.ip_them.version = 4;
+    for (unsigned i = 0; i < 1024; i++) {
+        t1.ip_them.ipv4 = (0x0A0000 + i) << 8;
+        if (!prefix_limit_take(pl, &t1))
+            err = 1;
+    }
+    prefix_limit_destroy(pl);
+
+    if (err) {
+        LOG(LEVEL_ERROR, "prefix limiter: selftest failed\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ Per-destination-prefix rate limiter
+
+ Even with BlackRock randomization, scanning many ports lands lots of probes
+ on the same /24 (or /64) within short windows. That triggers IDS and ICMP
+ rate limits of the destination network and lowers our response rate.
+
+ The limiter keeps times when prefixes are allowed to receive the next probe
+ in a hash table sized from the count of target prefixes. Every bucket has
+ PFX_WAYS slots tagged by the hash of prefix, and slots of expired prefixes
+ are reused. Only if a bucket is full of active prefixes, they share the
+ budget, which is just stricter.
+
+ Targets whose prefix is over budget are not dropped but reserved a later
+ slot and deferred into a reorder buffer. They are popped by due time in a
+ min-heap, so a hot prefix won't block targets of other prefixes. The buffer
+ also keeps the order they were deferred in, so we know the smallest index of
+ targets not sent yet to resume from.
+
+ Every tx thread owns one limiter without locking.
+ */
+#ifndef PREFIX_LIMIT_H
+#define PREFIX_LIMIT_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "../target/target.h"
+#include "../target/target-set.h"
+
+#define PFX_WAYS       4       /*slots in a bucket*/
+#define PFX_TABLE_MIN  4096    /*must be power of 2*/
+#define PFX_TABLE_MAX  1048576 /*must be power of 2*/
+/*for unknown count of prefixes, e.g. targets from stream generators*/
+#define PFX_TABLE_DFT  65536 /*must be power of 2*/
+#define PFX_DEFER_SIZE 4096  /*must be power of 2*/
+
+typedef struct PrefixLimiter PrefixLimiter;
+
+/**
+ * @param rate max packets per second to a prefix.
+ * @param v4_len prefix length of IPv4 destinations.
+ * @param v6_len prefix length of IPv6 destinations.
+ * @param prefix_count count of target prefixes to size the table, 0 if
+ * unknown.
+ */
+PrefixLimiter *prefix_limit_create(double rate, unsigned v4_len,
+                                   unsigned v6_len, uint64_t prefix_count);
+
+/**
+ * Count distinct prefixes of addresses in target set. It's an upper bound for
+ * IPv6 prefixes longer than 64.
+ */
+uint64_t prefix_limit_count_prefixes(const TargetSet *targets, unsigned v4_len,
+                                     unsigned v6_len);
+
+void prefix_limit_destroy(PrefixLimiter *pl);
+
+/**
+ * Update the clock of limiter. Call it once per batch is precise enough.
+ * @param now_ns timestamp in nanoseconds.
+ */
+void prefix_limit_tick(PrefixLimiter *pl, uint64_t now_ns);
+
+/**
+ * Take the budget for a probe to the target.
+ * @return true if it could be sent now.
+ */
+bool prefix_limit_take(PrefixLimiter *pl, const Target *target);
+
+/**
+ * Reserve a later slot for the target over budget and put it into reorder
+ * buffer.
+ * @param index index of the target for resuming, must be increasing.
+ * @return false if the reorder buffer is full.
+ */
+bool prefix_limit_defer(PrefixLimiter *pl, const Target *target,
+                        uint64_t index);
+
+/**
+ * Get the deferred target with the earliest slot if its slot has come.
+ * @param index set as the index of target.
+ * @return true if got one.
+ */
+bool prefix_limit_pop(PrefixLimiter *pl, Target *target, uint64_t *index);
+
+/**
+ * Sleep until the earliest slot of deferred targets comes (at most 100ms)
+ * and update the clock.
+ */
+void prefix_limit_wait(PrefixLimiter *pl);
+
+/**
+ * @return count of deferred targets.
+ */
+unsigned prefix_limit_count(const PrefixLimiter *pl);
+
+/**
+ * @param index index of the next target not deferred.
+ * @return the smallest index of targets not sent yet, so we could resume
+ * from it without losing deferred ones.
+ */
+uint64_t prefix_limit_resume_index(const PrefixLimiter *pl, uint64_t index);
+
+int prefix_limit_selftest();
+
+#endif
@@ -0,0 +1,142 @@
+#include "rate-control.h"
+#include "../util-out/logger.h"
+
+#include <string.h>
+
+void rate_control_init(RateControl *rc, double min_rate, double max_rate,
+                       uint64_t now_usec) {
+    memset(rc, 0, sizeof(*rc));
+
+    if (min_rate > max_rate)
+        min_rate = max_rate;
+
+    rc->min_rate  = min_rate;
+    rc->max_rate  = max_rate;
+    rc->rate      = max_rate;
+    rc->last_time = now_usec;
+}
+
+/**
+ * @return reason of congestion, or NULL if no congestion.
+ */
+static const char *_rate_control_congested(RateControl       *rc,
+                                           const RateSignals *sig) {
+    const char *reason = NULL;
+    uint64_t    sent   = sig->total_sent - rc->last.total_sent;
+    uint64_t    resp   = sig->total_responsed - rc->last.total_responsed;
+
+    if (sig->rx_drops > rc->last.rx_drops)
+        reason = "rx drops";
+    else if (sig->dispatch_full > rc->last.dispatch_full)
+        reason = "dispatch queue full";
+    else if (sig->rx_queue_ratio < RC_LOW_FREE)
+        reason = "handle queue busy";
+    else if (sig->tx_queue_ratio < RC_LOW_FREE)
+        reason = "stack queue busy";
+
+    if (sent >= RC_RESP_MIN) {
+        double ratio = (double)resp / (double)sent;
+
+        if (!reason && ratio < rc->resp_ratio * RC_RESP_DROP)
+            reason = "response decay";
+
+        if (rc->resp_ratio > 0)
+            rc->resp_ratio = rc->resp_ratio * 0.8 + ratio * 0.2;
+        else
+            rc->resp_ratio = ratio;
+    }
+
+    return reason;
+}
+
+double rate_control_update(RateControl *rc, const RateSignals *sig,
+                           uint64_t now_usec) {
+    double      elapsed = (now_usec - rc->last_time) / 1000000.0;
+    const char *reason  = _rate_control_congested(rc, sig);
+
+    if (reason) {
+        if (now_usec - rc->last_decrease >= RC_HOLD_USEC) {
+            rc->rate *= RC_DECREASE;
+            if (rc->rate < rc->min_rate)
+                rc->rate = rc->min_rate;
+            rc->last_decrease = now_usec;
+            rc->reason        = reason;
+
+            LOG(LEVEL_DEBUG, "(rate control) decrease to %.2f-pps for %s\n",
+                rc->rate, reason);
+        }
+    } else {
+        rc->rate += rc->max_rate * RC_INCREASE * elapsed;
+        if (rc->rate > rc->max_rate)
+            rc->rate = rc->max_rate;
+    }
+
+    rc->last      = *sig;
+    rc->last_time = now_usec;
+
+    return rc->rate;
+}
+
+int rate_control_selftest() {
+    RateControl rc;
+    RateSignals sig = {.rx_queue_ratio = 100.0, .tx_queue_ratio = 100.0};
+    uint64_t    now = 10 * RC_HOLD_USEC;
+    int         err = 0;
+
+    rate_control_init(&rc, 100.0, 1000.0, now);
+
+    now += 1000000;
+    if (rate_control_update(&rc, &sig, now) != 1000.0)
+        err = 1;
+
+    /*multiplicative decrease, but only once in holding time*/
+    sig.rx_drops = 5;
+    now += 500000;
+    if (rate_control_update(&rc, &sig, now) != 1000.0 * RC_DECREASE)
+        err = 1;
+    sig.dispatch_full = 1;
+    now += 500000;
+    if (rate_control_update(&rc, &sig, now) != 1000.0 * RC_DECREASE)
+        err = 1;
+
+    /*additive increase*/
+    now += 1000000;
+    if (rate_control_update(&rc, &sig, now) !=
+        1000.0 * RC_DECREASE + 1000.0 * RC_INCREASE)
+        err = 1;
+
+    /*busy queue*/
+    sig.rx_queue_ratio = RC_LOW_FREE / 2;
+    now += RC_HOLD_USEC;
+    if (rate_control_update(&rc, &sig, now) >= 1000.0 * RC_DECREASE)
+        err = 1;
+    sig.rx_queue_ratio = 100.0;
+
+    /*decay of response ratio*/
+    sig.total_sent      += RC_RESP_MIN * 10;
+    sig.total_responsed += RC_RESP_MIN;
+    now += RC_HOLD_USEC;
+    rate_control_update(&rc, &sig, now);
+    sig.total_sent      += RC_RESP_MIN * 10;
+    sig.total_responsed += RC_RESP_MIN / 10;
+    now += RC_HOLD_USEC;
+    rate_control_update(&rc, &sig, now);
+    if (rc.last_decrease != now || strcmp(rc.reason, "response decay"))
+        err = 1;
+
+    /*never lower than the min*/
+    for (unsigned i = 0; i < 20; i++) {
+        sig.rx_drops++;
+        now += RC_HOLD_USEC;
+        rate_control_update(&rc, &sig, now);
+    }
+    if (rc.rate != 100.0)
+        err = 1;
+
+    if (err) {
+        LOG(LEVEL_ERROR, "rate control: selftest failed\n");
+        return 1;
+    }
+
+    return 0;
+}
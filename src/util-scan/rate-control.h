@@ -0,0 +1,71 @@
+/*
+ Adaptive rate controller
+
+ A fixed rate for the whole scan is either too slow or saturates something:
+ the upstream link, the rx ring of kernel, or the queues between our rx
+ thread and handle threads. This controller watches these signals and
+ adjusts the target rate of throttler in AIMD way (like TCP congestion
+ control) within bounds given by user:
+
+ - cut the rate by RC_DECREASE once any congestion signal appears, at most
+   once per RC_HOLD_USEC for the signals to reflect the new rate.
+ - increase the rate by RC_INCREASE of the max rate per second otherwise.
+
+ Congestion signals are new drops of rx ring, new full events of dispatch
+ queue, handle queues or stack queue less than RC_LOW_FREE% free, and the
+ response ratio(responses per sent) sharply lower than its moving average,
+ which means responses are lost somewhere.
+ */
+#ifndef RATE_CONTROL_H
+#define RATE_CONTROL_H
+#include <stdint.h>
+
+#define RC_DECREASE  0.7
+#define RC_INCREASE  0.02
+#define RC_HOLD_USEC 1000000
+#define RC_LOW_FREE  25.0
+/*the response ratio lower than this part of its average means loss*/
+#define RC_RESP_DROP 0.5
+/*min sent packets for a meaningful response ratio*/
+#define RC_RESP_MIN  1000
+
+/**
+ * Signals sampled periodically, counters are in total.
+ */
+typedef struct RateSignals {
+    uint64_t rx_drops;
+    uint64_t dispatch_full;
+    /*free ratio(%) of the most busy handle queue*/
+    double   rx_queue_ratio;
+    /*free ratio(%) of stack queue*/
+    double   tx_queue_ratio;
+    uint64_t total_sent;
+    uint64_t total_responsed;
+} RateSignals;
+
+typedef struct RateControl {
+    double      min_rate;
+    double      max_rate;
+    double      rate;
+    uint64_t    last_time;
+    uint64_t    last_decrease;
+    RateSignals last;
+    /*moving average of response ratio*/
+    double      resp_ratio;
+    /*why we decreased last time, for debugging*/
+    const char *reason;
+} RateControl;
+
+void rate_control_init(RateControl *rc, double min_rate, double max_rate,
+                       uint64_t now_usec);
+
+/**
+ * Feed sampled signals to controller.
+ * @return the new target rate.
+ */
+double rate_control_update(RateControl *rc, const RateSignals *sig,
+                           uint64_t now_usec);
+
+int rate_control_selftest();
+
+#endif
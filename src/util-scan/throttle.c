@@ -15,33 +15,188 @@
     where somebody suspends the computer for a few days, then wake it up,
     at which point the system tries sending a million packets/second instead
     of the desired thousand packets/second.
+
+    All tx threads share one token bucket, so a stalled thread doesn't lower
+    the total rate and others could use its budget. The bucket is kept as the
+    time when all taken tokens are paid off (GCRA), and threads take tokens
+    in chunks by CAS into their local caches. Credit saved while idle is
+    limited by THR_BURST_USEC.
+    Responses of stack are allowed to take tokens ahead of now by up to
+    THR_BURST_USEC, so new probes have to wait for them but the aggregate
+    rate is still exact.
+
+    Chunks of 100us are micro-bursts at high rates and could overflow buffers
+    of upstream routers. In pacing mode, chunks are limited to the burst size,
+    so bursts depart one by one on the timeline.
 */
 #include "throttle.h"
 
 #include "../pixie/pixie-timer.h"
+#include "../pixie/pixie-threads.h"
 #include "../util-out/logger.h"
 
 #include <string.h>
 #include <stdio.h>
 
+/*ps*/
+static inline uint64_t _bucket_now(const RateBucket *bucket) {
+    return (pixie_nanotime() - bucket->start_ns) * 1000ULL;
+}
+
+/***************************************************************************
+ ***************************************************************************/
+void throttler_bucket_init(RateBucket *bucket, double max_rate,
+                           unsigned pacing_burst) {
+    memset(bucket, 0, sizeof(*bucket));
+
+    bucket->pacing_burst = pacing_burst;
+    bucket->burst        = THR_BURST_USEC * 1000000ULL;
+    bucket->start_ns     = pixie_nanotime();
+    bucket->tat          = 0;
+
+    throttler_bucket_set_rate(bucket, max_rate);
+
+    LOG(LEVEL_DEBUG, "starting throttler, rate = %0.2f-pps, pacing = %u\n",
+        bucket->max_rate, pacing_burst);
+}
+
 /***************************************************************************
  ***************************************************************************/
-void throttler_start(Throttler *throttler, double max_rate) {
-    unsigned i;
+void throttler_bucket_set_rate(RateBucket *bucket, double max_rate) {
+    uint64_t interval;
+    uint64_t prior_depth;
+    double   chunk;
+
+    if (max_rate < 0.000001)
+        max_rate = 0.000001;
+
+    interval = (uint64_t)(1000000000000.0 / max_rate);
+    interval = interval ? interval : 1;
+
+    /*keep the credit in pacing mode, so we could catch up after being late*/
+    if (bucket->pacing_burst) {
+        chunk       = bucket->pacing_burst;
+        prior_depth = bucket->pacing_burst * interval;
+    } else {
+        chunk = max_rate * THR_CHUNK_USEC / 1000000.0;
+        if (chunk < 1)
+            chunk = 1;
+        if (chunk > THR_CHUNK_MAX)
+            chunk = THR_CHUNK_MAX;
+
+        prior_depth = THR_BURST_USEC * 1000000ULL;
+    }
 
+    /*tx threads read them without lock while taking tokens*/
+    pixie_atomic_store_u64(&bucket->chunk, (uint64_t)chunk);
+    pixie_atomic_store_u64(&bucket->prior_depth, prior_depth);
+    pixie_atomic_store_u64(&bucket->interval, interval);
+    bucket->max_rate = max_rate;
+}
+
+/***************************************************************************
+ ***************************************************************************/
+void throttler_start(Throttler *throttler, RateBucket *bucket) {
     memset(throttler, 0, sizeof(*throttler));
 
-    throttler->max_rate = max_rate;
+    throttler->bucket         = bucket;
+    throttler->last_timestamp = pixie_nanotime();
+}
+
+/***************************************************************************
+ * Take up to `want` tokens that are available before now+depth.
+ * Return 0 and set the time(ps) to wait if no token available.
+ * Set how late(ps) we are behind the schedule if not idle.
+ ***************************************************************************/
+static uint64_t _bucket_take(RateBucket *bucket, uint64_t depth, uint64_t want,
+                             uint64_t *wait, uint64_t *late) {
+    /*rate could be changed meanwhile, so use the same interval in a take*/
+    uint64_t interval = pixie_atomic_load_u64(&bucket->interval);
+    uint64_t now      = _bucket_now(bucket);
+    uint64_t old, base, limit, count, tat;
+
+    do {
+        old   = bucket->tat;
+        base  = old;
+        *late = 0;
+
+        /*don't save too much credit while idle or suspended*/
+        if (now > bucket->burst && base < now - bucket->burst)
+            base = now - bucket->burst;
+
+        limit = now + depth;
+        if (limit < base + interval) {
+            *wait = base + interval - limit;
+            return 0;
+        }
+
+        if (base == old && now > base + interval)
+            *late = now - (base + interval);
 
-    for (i = 0; i < ARRAY_SIZE(throttler->buckets); i++) {
-        throttler->buckets[i].timestamp    = pixie_gettime();
-        throttler->buckets[i].packet_count = 0;
+        count = (limit - base) / interval;
+        if (count > want)
+            count = want;
+        tat = base + count * interval;
+    } while (!pixie_locked_CAS64(&bucket->tat, tat, old));
+
+    return count;
+}
+
+/***************************************************************************
+ * Take tokens into local cache, pause until at least one token got.
+ ***************************************************************************/
+static void _throttler_fill(Throttler *throttler, uint64_t depth,
+                            uint64_t want) {
+    RateBucket *bucket = throttler->bucket;
+    uint64_t    count;
+    uint64_t    wait = 0;
+    uint64_t    late = 0;
+
+    for (;;) {
+        count = _bucket_take(bucket, depth, want, &wait, &late);
+        if (count) {
+            throttler->tokens += count;
+            if (bucket->pacing_burst) {
+                throttler->late_sum += late;
+                throttler->late_count++;
+            }
+            return;
+        }
+
+        /* Sleep if we have to wait long, or spin for precision. The sleep is
+         * limited to respond to changes like <ctrl-c> quickly. In pacing mode
+         * we wake up early and spin to the departure because of the coarse
+         * granularity of sleeping. */
+        wait /= 1000000ULL;
+        if (bucket->pacing_burst)
+            wait = wait > THR_SPIN_USEC ? wait - THR_SPIN_USEC : 0;
+        if (wait > 100000)
+            wait = 100000;
+        if (wait)
+            pixie_usleep(wait);
     }
+}
 
-    throttler->batch_size = 1;
+static void _throttler_update_rate(Throttler *throttler,
+                                   uint64_t   packet_count) {
+    uint64_t timestamp = pixie_nanotime();
+    uint64_t elapsed   = timestamp - throttler->last_timestamp;
 
-    LOG(LEVEL_DEBUG, "starting throttler, rate = %0.2f-pps\n",
-        throttler->max_rate);
+    if (elapsed < THR_RATE_USEC * 1000ULL)
+        return;
+
+    throttler->current_rate =
+        1.0 * (packet_count - throttler->last_packet_count) /
+        (elapsed / 1000000000.0);
+    throttler->last_timestamp    = timestamp;
+    throttler->last_packet_count = packet_count;
+
+    if (throttler->late_count) {
+        throttler->current_jitter =
+            throttler->late_sum / 1000000.0 / throttler->late_count;
+        throttler->late_sum   = 0;
+        throttler->late_count = 0;
+    }
 }
 
 /***************************************************************************
@@ -55,108 +210,62 @@ void throttler_start(Throttler *throttler, double max_rate) {
  * it'll pause and wait until it's ready to send a packet.
  ***************************************************************************/
 uint64_t throttler_next_batch(Throttler *throttler, uint64_t packet_count) {
-    uint64_t timestamp;
-    uint64_t index;
-    uint64_t old_timestamp;
-    uint64_t old_packet_count;
-
-    double current_rate;
-    double max_rate = throttler->max_rate;
-
-again:
-
-    /* NOTE: this uses CLOCK_MONOTONIC_RAW on Linux, so the timstamp doesn't
-     * move forward when the machine is suspended */
-    timestamp = pixie_gettime();
-
-    /*
-     * We record that last batch of buckets, and average the rate over all of
-     * them.
-     */
-    index                               = (throttler->index) & (THR_CACHE - 1);
-    throttler->buckets[index].timestamp = timestamp;
-    throttler->buckets[index].packet_count = packet_count;
-
-    index            = (++throttler->index) & (THR_CACHE - 1);
-    old_timestamp    = throttler->buckets[index].timestamp;
-    old_packet_count = throttler->buckets[index].packet_count;
-
-    /*
-     * If the delay is more than 1-second, then we should reset the system
-     * in order to avoid transmitting too fast.
-     */
-    if (timestamp - old_timestamp > 1000000) {
-        // throttler_start(throttler, throttler->max_rate);
-        throttler->batch_size = 1;
-        goto again;
-    }
+    uint64_t count;
 
-    /*
-     * Calculate the recent rate.
-     * NOTE: this isn't the rate "since start", but only the "recent" rate.
-     * That's so that if the system pauses for a while, we don't flood the
-     * network trying to catch up.
-     */
-    current_rate = 1.0 * (packet_count - old_packet_count) /
-                   ((timestamp - old_timestamp) / 1000000.0);
-
-    /*
-     * If we've been going too fast, then <pause> for a moment, then
-     * try again.
-     */
-    if (current_rate > max_rate) {
-        double waittime;
-
-        /* calculate waittime, in seconds */
-        waittime = (current_rate - max_rate) / throttler->max_rate;
-
-        /* At higher rates of speed, we don't actually need to wait the full
-         * interval. It's better to have a much smaller interval, so that
-         * we converge back on the true rate faster */
-        waittime *= 0.1;
-
-        /* This is in case of gross failure of the system. This should never
-         * actually happen, unless there is a bug. Really, I ought to make
-         * this an 'assert()' instead to fail and fix the bug rather than
-         * silently continuing, but I'm too lazy */
-        if (waittime > 0.1)
-            waittime = 0.1;
-
-        /* Since we've exceeded the speed limit, we should reduce the
-         * batch size slightly. We don't do it only by a little bit to
-         * avoid over-correcting. We want to converge on the correct
-         * speed gradually. Note that since this happens hundreds or
-         * thousands of times a second, the convergence is very fast
-         * even with 0.1% adjustment */
-        throttler->batch_size *= 0.999;
-
-        /* Now we wait for a bit */
-        pixie_usleep((uint64_t)(waittime * 1000000.0));
-
-        /* There are two choices here. We could either return immediately,
-         * or we can loop around again. Right now, the code loops around
-         * again in order to support very slow rates, such as 0.5 packets
-         * per second. Nobody would want to run a scanner that slowly of
-         * course, but it's great for testing */
-        // return (uint64_t)throttler->batch_size;
-        goto again;
-    }
+    _throttler_update_rate(throttler, packet_count);
+
+    if (!throttler->tokens)
+        _throttler_fill(throttler, 0,
+                        pixie_atomic_load_u64(&throttler->bucket->chunk));
+
+    count             = throttler->tokens;
+    throttler->tokens = 0;
+
+    return count;
+}
+
+/***************************************************************************
+ ***************************************************************************/
+uint64_t throttler_next_prior(Throttler *throttler, uint64_t packet_count,
+                              uint64_t want) {
+    uint64_t count;
+
+    _throttler_update_rate(throttler, packet_count);
+
+    if (!want)
+        return 0;
+
+    if (!throttler->tokens)
+        _throttler_fill(
+            throttler, pixie_atomic_load_u64(&throttler->bucket->prior_depth),
+            want);
+
+    count = throttler->tokens < want ? throttler->tokens : want;
+    throttler->tokens -= count;
+
+    return count;
+}
+
+/***************************************************************************
+ ***************************************************************************/
+void throttler_put_back(Throttler *throttler, uint64_t count) {
+    throttler->tokens += count;
+}
+
+/***************************************************************************
+ ***************************************************************************/
+void throttler_give_back(Throttler *throttler) {
+    RateBucket *bucket = throttler->bucket;
+    uint64_t    paid, old, tat;
+
+    if (!throttler->tokens)
+        return;
+
+    paid = throttler->tokens * pixie_atomic_load_u64(&bucket->interval);
+    do {
+        old = bucket->tat;
+        tat = old > paid ? old - paid : 0;
+    } while (!pixie_locked_CAS64(&bucket->tat, tat, old));
 
-    /*
-     * Calculate how many packets are needed to catch up again to the current
-     * rate, and return that.
-     *
-     * NOTE: this is almost always going to have the value of 1 (one). Only at
-     * very high speeds (above 100,000 packets/second) will this value get
-     * larger.
-     */
-    throttler->batch_size *= 1.005;
-    if (throttler->batch_size > 10000)
-        throttler->batch_size = 10000;
-    throttler->current_rate = current_rate;
-
-    throttler->test_timestamp    = timestamp;
-    throttler->test_packet_count = packet_count;
-
-    return (uint64_t)throttler->batch_size;
+    throttler->tokens = 0;
 }
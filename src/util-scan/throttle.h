@@ -2,30 +2,103 @@
 #define THROTTLE_H
 #include <stdint.h>
 
-#define THR_CACHE 256 /*must be power of 2*/
+/*idle credit of the bucket and how far responses could borrow ahead*/
+#define THR_BURST_USEC 1000
+/*tokens taken by a thread at once into its local cache*/
+#define THR_CHUNK_USEC 100
+/*max tokens taken by a thread at once*/
+#define THR_CHUNK_MAX  10000
+/*interval to update the recent rate*/
+#define THR_RATE_USEC  100000
+/*in pacing mode, busy-wait if the next departure is closer than this*/
+#define THR_SPIN_USEC  100
 
-typedef struct RateThrottler {
-    double   max_rate;
-    double   current_rate;
-    double   batch_size;
-    unsigned index;
+/**
+ * A token bucket shared by all tx threads, so the aggregate rate is exact
+ * whatever threads stall or burst.
+ * It is kept as the time that all taken tokens are paid off (GCRA) and
+ * updated by CAS without lock.
+ */
+typedef struct RateBucket {
+    /*time(ps since start) when all taken tokens are paid*/
+    volatile uint64_t tat;
+    uint64_t          start_ns;
+    /*time(ps) per token, published atomically with chunk and prior_depth*/
+    volatile uint64_t interval;
+    /*max credit(ps) saved while idle*/
+    uint64_t          burst;
+    /*how far(ps) responses could take tokens ahead of now*/
+    volatile uint64_t prior_depth;
+    /*tokens taken by a thread at once*/
+    volatile uint64_t chunk;
+    double            max_rate;
+    /*send in bursts of this with precise spacing, 0 for no pacing*/
+    unsigned          pacing_burst;
+} RateBucket;
 
-    struct {
-        uint64_t timestamp;
-        uint64_t packet_count;
-    } buckets[THR_CACHE];
+/**
+ * Per-thread state with a local cache of tokens taken from the shared bucket.
+ */
+typedef struct RateThrottler {
+    RateBucket *bucket;
+    double      current_rate;
+    /*recent average lateness(us) of departures behind the schedule*/
+    double      current_jitter;
+    /*tokens taken from bucket but not used yet*/
+    uint64_t    tokens;
+    /*for recent rate*/
+    uint64_t    last_timestamp;
+    uint64_t    last_packet_count;
+    uint64_t    late_sum;
+    uint64_t    late_count;
+} Throttler;
 
-    uint64_t test_timestamp;
-    uint64_t test_packet_count;
+/**
+ * @param pacing_burst send packets in bursts of this size with precise spacing
+ * between bursts against the clock, busy-waiting below THR_SPIN_USEC and
+ * sleeping above. 0 for the normal mode.
+ */
+void throttler_bucket_init(RateBucket *bucket, double max_rate,
+                           unsigned pacing_burst);
 
-} Throttler;
+/**
+ * Change the rate on the fly while tx threads are running.
+ * !Only one thread could change the rate.
+ */
+void throttler_bucket_set_rate(RateBucket *bucket, double max_rate);
 
-void throttler_start(Throttler *status, double max_rate);
+void throttler_start(Throttler *throttler, RateBucket *bucket);
 
 /**
+ * Get tokens for new probes. It'll pause until at least one token available.
  * @param throttler throttler that has been started
- * @param count how many packets we have sent
+ * @param packet_count how many packets we have sent
+ * @return count of packets could be sent, at least 1.
  */
 uint64_t throttler_next_batch(Throttler *throttler, uint64_t packet_count);
 
+/**
+ * Get tokens for responses of stack(e.g. ACKs and data of HLTCP) with higher
+ * priority than new probes. Responses could take tokens ahead of probes, so
+ * they won't starve behind a flood of probes, but still share the aggregate
+ * rate.
+ * It'll pause until at least one token available if want isn't 0.
+ * @param packet_count how many packets we have sent
+ * @param want count of packets waiting to be sent.
+ * @return count of packets could be sent, no more than want.
+ */
+uint64_t throttler_next_prior(Throttler *throttler, uint64_t packet_count,
+                              uint64_t want);
+
+/**
+ * Put unused tokens back to local cache for the next batch.
+ */
+void throttler_put_back(Throttler *throttler, uint64_t count);
+
+/**
+ * Give all tokens in local cache back to the shared bucket, so other threads
+ * could use them while we are sleeping for something else.
+ */
+void throttler_give_back(Throttler *throttler);
+
 #endif
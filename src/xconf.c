@@ -3,6 +3,7 @@
 
 #include "xconf.h"
 #include "version.h"
+#include "receive.h"
 #include "smack/smack.h"
 #include "nmap/nmap-service.h"
 
@@ -17,6 +18,8 @@
 
 #include "dedup/dedup.h"
 #include "util-scan/rstfilter.h"
+#include "util-scan/prefix-limit.h"
+#include "util-scan/rate-control.h"
 #include "util-data/safe-string.h"
 #include "util-data/fine-malloc.h"
 #include "util-data/data-chain.h"
@@ -30,10 +33,12 @@
 #include "target/target-ipaddress.h"
 #include "target/target-parse.h"
 #include "target/target-rangeport.h"
+#include "target/target-trie.h"
 
 #include "proto/proto-http-maker.h"
 
 #include "pixie/pixie-timer.h"
+#include "pixie/pixie-threads.h"
 
 #ifdef WIN32
 #include <direct.h>
@@ -856,6 +861,225 @@ static ConfRes SET_pfring(void *conf, const char *name, const char *value) {
     return Conf_OK;
 }
 
+static ConfRes SET_afpacket(void *conf, const char *name, const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->is_afpacket || xconf->echo_all)
+            fprintf(xconf->echo, "af-packet = %s\n",
+                    xconf->is_afpacket ? "true" : "false");
+        return 0;
+    }
+
+    xconf->is_afpacket = parse_str_bool(value);
+
+    return Conf_OK;
+}
+
+static ConfRes SET_afpacket_block_size(void *conf, const char *name,
+                                       const char *value) {
+    XConf *xconf = (XConf *)conf;
+    if (xconf->echo) {
+        if (xconf->afp_opt.block_size != XCONF_DFT_AFP_BLOCK_SIZE ||
+            xconf->echo_all) {
+            fprintf(xconf->echo, "af-packet-block-size = %u\n",
+                    xconf->afp_opt.block_size);
+        }
+        return 0;
+    }
+
+    uint64_t v = parse_str_int(value);
+    if (v < 4096 || !is_power_of_two(v)) {
+        LOG(LEVEL_ERROR, "%s: block size must be power of 2 and >= 4096.\n",
+            name);
+        return Conf_ERR;
+    } else if (v > UINT_MAX / 2) {
+        LOG(LEVEL_ERROR, "%s: block size exceeded size limit.\n", name);
+        return Conf_ERR;
+    }
+
+    xconf->afp_opt.block_size = (unsigned)v;
+
+    return Conf_OK;
+}
+
+static ConfRes SET_afpacket_block_count(void *conf, const char *name,
+                                        const char *value) {
+    XConf *xconf = (XConf *)conf;
+    if (xconf->echo) {
+        if (xconf->afp_opt.block_count != XCONF_DFT_AFP_BLOCK_COUNT ||
+            xconf->echo_all) {
+            fprintf(xconf->echo, "af-packet-block-count = %u\n",
+                    xconf->afp_opt.block_count);
+        }
+        return 0;
+    }
+
+    unsigned count = parse_str_int(value);
+    if (count == 0) {
+        LOG(LEVEL_ERROR, "%s: block count cannot be zero.\n", name);
+        return Conf_ERR;
+    }
+
+    xconf->afp_opt.block_count = count;
+
+    return Conf_OK;
+}
+
+static ConfRes SET_afpacket_block_timeout(void *conf, const char *name,
+                                          const char *value) {
+    XConf *xconf = (XConf *)conf;
+    if (xconf->echo) {
+        if (xconf->afp_opt.block_timeout != XCONF_DFT_AFP_BLOCK_TIMEOUT ||
+            xconf->echo_all) {
+            fprintf(xconf->echo, "af-packet-block-timeout = %u\n",
+                    xconf->afp_opt.block_timeout);
+        }
+        return 0;
+    }
+
+    unsigned tov = parse_str_int(value);
+    if (tov == 0) {
+        LOG(LEVEL_ERROR, "%s: block timeout cannot be zero.\n", name);
+        return Conf_ERR;
+    }
+
+    xconf->afp_opt.block_timeout = tov;
+
+    return Conf_OK;
+}
+
+static ConfRes SET_afpacket_tx_ring(void *conf, const char *name,
+                                    const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->afp_opt.is_tx_ring || xconf->echo_all)
+            fprintf(xconf->echo, "af-packet-tx-ring = %s\n",
+                    xconf->afp_opt.is_tx_ring ? "true" : "false");
+        return 0;
+    }
+
+    xconf->afp_opt.is_tx_ring = parse_str_bool(value);
+    if (xconf->afp_opt.is_tx_ring)
+        xconf->is_afpacket = 1;
+
+    return Conf_OK;
+}
+
+static ConfRes SET_afpacket_tx_frames(void *conf, const char *name,
+                                      const char *value) {
+    XConf *xconf = (XConf *)conf;
+    if (xconf->echo) {
+        if (xconf->afp_opt.tx_frame_count != XCONF_DFT_AFP_TX_FRAME_COUNT ||
+            xconf->echo_all) {
+            fprintf(xconf->echo, "af-packet-tx-frames = %u\n",
+                    xconf->afp_opt.tx_frame_count);
+        }
+        return 0;
+    }
+
+    uint64_t v = parse_str_int(value);
+    if (v < 32 || !is_power_of_two(v)) {
+        LOG(LEVEL_ERROR, "%s: tx frames must be power of 2 and >= 32.\n",
+            name);
+        return Conf_ERR;
+    } else if (v > 1024 * 1024) {
+        LOG(LEVEL_ERROR, "%s: tx frames exceeded size limit.\n", name);
+        return Conf_ERR;
+    }
+
+    xconf->afp_opt.tx_frame_count = (unsigned)v;
+
+    return Conf_OK;
+}
+
+static ConfRes SET_afxdp(void *conf, const char *name, const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->is_afxdp || xconf->echo_all)
+            fprintf(xconf->echo, "af-xdp = %s\n",
+                    xconf->is_afxdp ? "true" : "false");
+        return 0;
+    }
+
+    xconf->is_afxdp = parse_str_bool(value);
+
+    return Conf_OK;
+}
+
+static ConfRes SET_afxdp_zerocopy(void *conf, const char *name,
+                                  const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->xdp_opt.is_zerocopy || xconf->echo_all)
+            fprintf(xconf->echo, "af-xdp-zerocopy = %s\n",
+                    xconf->xdp_opt.is_zerocopy ? "true" : "false");
+        return 0;
+    }
+
+    xconf->xdp_opt.is_zerocopy = parse_str_bool(value);
+    if (xconf->xdp_opt.is_zerocopy)
+        xconf->is_afxdp = 1;
+
+    return Conf_OK;
+}
+
+static ConfRes SET_afxdp_queues(void *conf, const char *name,
+                                const char *value) {
+    XConf *xconf = (XConf *)conf;
+    if (xconf->echo) {
+        if (xconf->xdp_opt.queue_count != XCONF_DFT_XDP_QUEUE_COUNT ||
+            xconf->echo_all) {
+            fprintf(xconf->echo, "af-xdp-queues = %u\n",
+                    xconf->xdp_opt.queue_count);
+        }
+        return 0;
+    }
+
+    unsigned count = parse_str_int(value);
+    if (count == 0 || count > 1024) {
+        LOG(LEVEL_ERROR, "%s: queue count must be in 1~1024.\n", name);
+        return Conf_ERR;
+    }
+
+    xconf->xdp_opt.queue_count = count;
+
+    return Conf_OK;
+}
+
+static ConfRes SET_afxdp_frames(void *conf, const char *name,
+                                const char *value) {
+    XConf *xconf = (XConf *)conf;
+    if (xconf->echo) {
+        if (xconf->xdp_opt.frame_count != XCONF_DFT_XDP_FRAME_COUNT ||
+            xconf->echo_all) {
+            fprintf(xconf->echo, "af-xdp-frames = %u\n",
+                    xconf->xdp_opt.frame_count);
+        }
+        return 0;
+    }
+
+    uint64_t v = parse_str_int(value);
+    if (v < 64 || !is_power_of_two(v)) {
+        LOG(LEVEL_ERROR, "%s: frames must be power of 2 and >= 64.\n", name);
+        return Conf_ERR;
+    } else if (v > 1024 * 1024) {
+        LOG(LEVEL_ERROR, "%s: frames exceeded size limit.\n", name);
+        return Conf_ERR;
+    }
+
+    xconf->xdp_opt.frame_count = (unsigned)v;
+
+    return Conf_OK;
+}
+
 static ConfRes SET_noresume(void *conf, const char *name, const char *value) {
     XConf *xconf = (XConf *)conf;
     if (xconf->echo) {
@@ -963,6 +1187,118 @@ static ConfRes SET_dedup_win(void *conf, const char *name, const char *value) {
     return Conf_OK;
 }
 
+static ConfRes SET_dedup_type(void *conf, const char *name,
+                              const char *value) {
+    XConf *xconf = (XConf *)conf;
+    if (xconf->echo) {
+        if (xconf->dedup_type != Dedup_Default || xconf->echo_all)
+            fprintf(xconf->echo, "dedup-type = %s\n",
+                    dedup_type_to_name(xconf->dedup_type));
+        return 0;
+    }
+
+    DedupType type = dedup_type_by_name(value);
+    if (type == Dedup_Unknown) {
+        LOG(LEVEL_ERROR, "%s: no dedup type named %s.\n", name, value);
+        return Conf_ERR;
+    }
+    if (!dedup_type_is_available(type)) {
+        LOG(LEVEL_ERROR, "%s: %s was not built in.\n", name, value);
+        return Conf_ERR;
+    }
+
+    xconf->dedup_type = type;
+
+    return Conf_OK;
+}
+
+static ConfRes SET_dedup_fp_rate(void *conf, const char *name,
+                                 const char *value) {
+    XConf *xconf = (XConf *)conf;
+    if (xconf->echo) {
+        if (xconf->dedup_fp_rate > 0 || xconf->echo_all)
+            fprintf(xconf->echo, "dedup-fp-rate = %g\n", xconf->dedup_fp_rate);
+        return 0;
+    }
+
+    char  *end;
+    double rate = strtod(value, &end);
+    if (end == value || *end != '\0' || rate <= 0 || rate >= 1) {
+        LOG(LEVEL_ERROR, "%s: need a rate between 0 and 1.\n", name);
+        return Conf_ERR;
+    }
+
+    xconf->dedup_fp_rate = rate;
+
+    return Conf_OK;
+}
+
+static ConfRes SET_dedup_mem_limit(void *conf, const char *name,
+                                   const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+    if (xconf->echo) {
+        if (xconf->dedup_mem_limit || xconf->echo_all)
+            fprintf(xconf->echo, "dedup-mem-limit = %" PRIu64 "\n",
+                    xconf->dedup_mem_limit);
+        return 0;
+    }
+
+    xconf->dedup_mem_limit = parse_str_size(value);
+
+    return Conf_OK;
+}
+
+static ConfRes SET_dedup_in_handler(void *conf, const char *name,
+                                    const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+    if (xconf->echo) {
+        if (xconf->is_dedup_in_handler || xconf->echo_all) {
+            fprintf(xconf->echo, "dedup-in-handler = %s\n",
+                    xconf->is_dedup_in_handler ? "true" : "false");
+        }
+        return 0;
+    }
+
+    xconf->is_dedup_in_handler = parse_str_bool(value);
+
+    return Conf_OK;
+}
+
+static ConfRes SET_dedup_filename(void *conf, const char *name,
+                                  const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+    if (xconf->echo) {
+        if (xconf->dedup_filename[0])
+            fprintf(xconf->echo, "dedup-file = \"%s\"\n",
+                    xconf->dedup_filename);
+        return 0;
+    }
+    if (value)
+        safe_strcpy(xconf->dedup_filename, sizeof(xconf->dedup_filename),
+                    value);
+    return Conf_OK;
+}
+
+static ConfRes SET_dedup_per_round(void *conf, const char *name,
+                                   const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+    if (xconf->echo) {
+        if (xconf->is_dedup_per_round || xconf->echo_all) {
+            fprintf(xconf->echo, "dedup-per-round = %s\n",
+                    xconf->is_dedup_per_round ? "true" : "false");
+        }
+        return 0;
+    }
+
+    xconf->is_dedup_per_round = parse_str_bool(value);
+
+    return Conf_OK;
+}
+
 static ConfRes SET_stack_buf_count(void *conf, const char *name,
                                    const char *value) {
     XConf *xconf = (XConf *)conf;
@@ -1082,6 +1418,28 @@ static ConfRes SET_rx_handler_count(void *conf, const char *name,
     return Conf_OK;
 }
 
+static ConfRes SET_rx_thread_count(void *conf, const char *name,
+                                   const char *value) {
+    XConf *xconf = (XConf *)conf;
+    if (xconf->echo) {
+        if (xconf->rx_thread_count > 1 || xconf->echo_all) {
+            fprintf(xconf->echo, "rx-thread-count = %u\n",
+                    xconf->rx_thread_count);
+        }
+        return 0;
+    }
+
+    unsigned count = parse_str_int(value);
+    if (count == 0) {
+        LOG(LEVEL_ERROR, "%s: receive thread count cannot be zero.\n", name);
+        return Conf_ERR;
+    }
+
+    xconf->rx_thread_count = count;
+
+    return Conf_OK;
+}
+
 static ConfRes SET_tx_thread_count(void *conf, const char *name,
                                    const char *value) {
     XConf *xconf = (XConf *)conf;
@@ -1787,6 +2145,114 @@ static ConfRes SET_no_cpu_bind(void *conf, const char *name,
     return Conf_OK;
 }
 
+static const char *cpu_role_names[CpuRole_Count] = {
+    [CpuRole_Tx]       = "tx",
+    [CpuRole_Rx]       = "rx",
+    [CpuRole_Dispatch] = "dispatch",
+    [CpuRole_Handle]   = "handle",
+};
+
+static ConfRes SET_cpu_map(void *conf, const char *name, const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        for (unsigned r = 0; r < CpuRole_Count; r++) {
+            if (xconf->cpu_map[r].count == 0)
+                continue;
+            fprintf(xconf->echo, "cpu-map = %s=", cpu_role_names[r]);
+            for (unsigned i = 0; i < xconf->cpu_map[r].count; i++)
+                fprintf(xconf->echo, "%s%u", i ? "," : "",
+                        xconf->cpu_map[r].cpus[i]);
+            fprintf(xconf->echo, "\n");
+        }
+        return 0;
+    }
+
+    const char *list = strchr(value, '=');
+    if (list == NULL) {
+        LOG(LEVEL_ERROR, "(cpu-map) expect <role>=<cpu-list>: %s\n", value);
+        return Conf_ERR;
+    }
+
+    unsigned r;
+    for (r = 0; r < CpuRole_Count; r++) {
+        size_t len = strlen(cpu_role_names[r]);
+        if ((size_t)(list - value) == len &&
+            strncmp(value, cpu_role_names[r], len) == 0)
+            break;
+    }
+    if (r == CpuRole_Count) {
+        LOG(LEVEL_ERROR, "(cpu-map) unknown role: %.*s\n",
+            (int)(list - value), value);
+        LOG(LEVEL_HINT, "roles are tx, rx, dispatch and handle.\n");
+        return Conf_ERR;
+    }
+
+    int count =
+        pixie_cpu_parse_list(list + 1, xconf->cpu_map[r].cpus, XCONF_MAX_CPU_MAP);
+    if (count <= 0) {
+        LOG(LEVEL_ERROR, "(cpu-map) bad cpu list: %s\n", list + 1);
+        xconf->cpu_map[r].count = 0;
+        return Conf_ERR;
+    }
+    xconf->cpu_map[r].count = (unsigned)count;
+
+    return Conf_OK;
+}
+
+static ConfRes SET_numa_node(void *conf, const char *name,
+                             const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->numa_node != XCONF_DFT_NUMA_NODE || xconf->echo_all) {
+            fprintf(xconf->echo, "numa-node = %d\n", xconf->numa_node);
+        }
+        return 0;
+    }
+
+    if (!isdigit(value[0])) {
+        LOG(LEVEL_ERROR, "(numa-node) expect a node number: %s\n", value);
+        return Conf_ERR;
+    }
+    xconf->numa_node = (int)parse_str_int(value);
+
+    return Conf_OK;
+}
+
+static ConfRes SET_idle_spin(void *conf, const char *name,
+                             const char *value) {
+    XConf *xconf = (XConf *)conf;
+    if (xconf->echo) {
+        if (xconf->idle_spin_usec != XCONF_DFT_IDLE_SPIN_USEC ||
+            xconf->echo_all) {
+            fprintf(xconf->echo, "idle-spin = %u\n", xconf->idle_spin_usec);
+        }
+        return 0;
+    }
+
+    xconf->idle_spin_usec = (unsigned)parse_str_int(value);
+
+    return Conf_OK;
+}
+
+static ConfRes SET_no_dispatch(void *conf, const char *name,
+                               const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->is_no_dispatch || xconf->echo_all)
+            fprintf(xconf->echo, "no-dispatch-thread = %s\n",
+                    xconf->is_no_dispatch ? "true" : "false");
+        return 0;
+    }
+    xconf->is_no_dispatch = parse_str_bool(value);
+    return Conf_OK;
+}
+
 static ConfRes SET_static_seed(void *conf, const char *name,
                                const char *value) {
     XConf *xconf = (XConf *)conf;
@@ -1822,7 +2288,8 @@ static ConfRes SET_fast_timeout(void *conf, const char *name,
     if (xconf->echo) {
         if (xconf->is_fast_timeout || xconf->echo_all) {
             if (xconf->is_fast_timeout) {
-                fprintf(xconf->echo, "timeout = %" PRId64 "\n", xconf->ft_spec);
+                fprintf(xconf->echo, "timeout = %g\n",
+                        xconf->ft_spec_ms / 1000.0);
             } else {
                 fprintf(xconf->echo, "timeout = false\n");
             }
@@ -1830,21 +2297,25 @@ static ConfRes SET_fast_timeout(void *conf, const char *name,
         return 0;
     }
 
-    if (is_str_bool(value)) {
+    /*"0.5" is not a switch word*/
+    if (is_str_bool(value) && !strchr(value, '.')) {
         if (parse_str_bool(value)) {
             xconf->is_fast_timeout = 1;
         }
-    } else if (is_str_int(value)) {
-        int spec = parse_str_int(value);
-        if (spec <= 0) {
+    } else {
+        char  *end;
+        double spec = strtod(value, &end);
+        if (end == value || *end != '\0')
+            goto fail;
+        /*at least a millisecond*/
+        if (spec < 0.001) {
             LOG(LEVEL_ERROR, "%s: need a switch word or a positive number.\n",
                 name);
             return Conf_ERR;
         }
         xconf->is_fast_timeout = 1;
-        xconf->ft_spec         = (time_t)spec;
-    } else
-        goto fail;
+        xconf->ft_spec_ms      = (uint64_t)(spec * 1000 + 0.5);
+    }
 
     return Conf_OK;
 fail:
@@ -2059,6 +2530,124 @@ static ConfRes SET_rate(void *conf, const char *name, const char *value) {
     return Conf_OK;
 }
 
+static ConfRes SET_adaptive_rate(void *conf, const char *name,
+                                 const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->is_adaptive_rate || xconf->echo_all)
+            fprintf(xconf->echo, "adaptive-rate = %s\n",
+                    xconf->is_adaptive_rate ? "true" : "false");
+        return 0;
+    }
+    xconf->is_adaptive_rate = parse_str_bool(value);
+    return Conf_OK;
+}
+
+static ConfRes SET_min_rate(void *conf, const char *name, const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->min_rate > 0 || xconf->echo_all)
+            fprintf(xconf->echo, "min-rate = %-10.0f\n", xconf->min_rate);
+        return 0;
+    }
+
+    xconf->min_rate = (double)parse_str_int(value);
+
+    return Conf_OK;
+}
+
+static ConfRes SET_pacing(void *conf, const char *name, const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->is_pacing || xconf->echo_all)
+            fprintf(xconf->echo, "pacing = %s\n",
+                    xconf->is_pacing ? "true" : "false");
+        return 0;
+    }
+    xconf->is_pacing = parse_str_bool(value);
+    return Conf_OK;
+}
+
+static ConfRes SET_pacing_burst(void *conf, const char *name,
+                                const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->pacing_burst != XCONF_DFT_PACING_BURST || xconf->echo_all)
+            fprintf(xconf->echo, "pacing-burst = %u\n", xconf->pacing_burst);
+        return 0;
+    }
+
+    xconf->pacing_burst = (unsigned)parse_str_int(value);
+    if (xconf->pacing_burst == 0) {
+        LOG(LEVEL_ERROR, "(CONF) %s must be larger than 0.\n", name);
+        return Conf_ERR;
+    }
+
+    return Conf_OK;
+}
+
+static ConfRes SET_prefix_rate(void *conf, const char *name,
+                               const char *value) {
+    XConf *xconf = (XConf *)conf;
+    UNUSEDPARM(name);
+
+    if (xconf->echo) {
+        if (xconf->prefix_rate || xconf->echo_all)
+            fprintf(xconf->echo, "prefix-rate = %u\n", xconf->prefix_rate);
+        return 0;
+    }
+
+    xconf->prefix_rate = (unsigned)parse_str_int(value);
+
+    return Conf_OK;
+}
+
+static ConfRes SET_prefix_v4_len(void *conf, const char *name,
+                                 const char *value) {
+    XConf *xconf = (XConf *)conf;
+
+    if (xconf->echo) {
+        if (xconf->prefix_v4_len != XCONF_DFT_PREFIX_V4_LEN || xconf->echo_all)
+            fprintf(xconf->echo, "prefix-v4-len = %u\n", xconf->prefix_v4_len);
+        return 0;
+    }
+
+    xconf->prefix_v4_len = (unsigned)parse_str_int(value);
+    if (xconf->prefix_v4_len > 32) {
+        LOG(LEVEL_ERROR, "(CONF) %s must be in range [0, 32].\n", name);
+        return Conf_ERR;
+    }
+
+    return Conf_OK;
+}
+
+static ConfRes SET_prefix_v6_len(void *conf, const char *name,
+                                 const char *value) {
+    XConf *xconf = (XConf *)conf;
+
+    if (xconf->echo) {
+        if (xconf->prefix_v6_len != XCONF_DFT_PREFIX_V6_LEN || xconf->echo_all)
+            fprintf(xconf->echo, "prefix-v6-len = %u\n", xconf->prefix_v6_len);
+        return 0;
+    }
+
+    xconf->prefix_v6_len = (unsigned)parse_str_int(value);
+    if (xconf->prefix_v6_len > 128) {
+        LOG(LEVEL_ERROR, "(CONF) %s must be in range [0, 128].\n", name);
+        return Conf_ERR;
+    }
+
+    return Conf_OK;
+}
+
 static ConfRes SET_max_packet_len(void *conf, const char *name,
                                   const char *value) {
     XConf *xconf = (XConf *)conf;
@@ -2516,6 +3105,57 @@ ConfParam config_parameters[] = {
      "do 2.5 million packets per second. The PF_RING driver is needed to get "
      "to 25 million packets/second. This rate(packets per second) is for total"
      " speed of all transmit threads."},
+    {"adaptive-rate",
+     SET_adaptive_rate,
+     Type_FLAG,
+     {"auto-rate", 0},
+     "Adjust the transmit rate on the fly between --min-rate and --rate in "
+     "AIMD way. The rate is cut once congestion appears, i.e. drops of "
+     "receive ring, full dispatch queue, busy handle or stack queues and sharp"
+     " decay of response ratio. Then it increases slowly again."},
+    {"min-rate",
+     SET_min_rate,
+     Type_ARG,
+     {0},
+     "Specifies the lower bound of rate(packets per second) for "
+     "--adaptive-rate. (Default 1% of --rate)"},
+    {"pacing",
+     SET_pacing,
+     Type_FLAG,
+     {0},
+     "Transmit packets with precise spacing against the clock instead of in "
+     "batches of 100us. It avoids micro-bursts overflowing buffers of upstream"
+     " routers at high rates, but costs more CPU on busy-waiting. Average "
+     "lateness of departures is shown as jitter in the status line."},
+    {"pacing-burst",
+     SET_pacing_burst,
+     Type_ARG,
+     {0},
+     "Specifies how many packets to send in a burst in --pacing mode. Larger "
+     "bursts cost less CPU but are less smooth. (Default 1)"},
+    {"prefix-rate",
+     SET_prefix_rate,
+     Type_ARG,
+     {0},
+     "Specifies the max rate(packets per second) to a destination prefix, "
+     "which avoids triggering IDS and ICMP rate limits of target networks "
+     "while scanning many ports. Targets over budget are deferred into a "
+     "reorder buffer and sent later instead of being dropped. The rate is "
+     "divided among transmit threads. (Default 0 for no limit)\n"
+     "NOTE: Prefixes are hashed into a compact table, so collided prefixes "
+     "share the same budget."},
+    {"prefix-v4-len",
+     SET_prefix_v4_len,
+     Type_ARG,
+     {0},
+     "Specifies the prefix length of IPv4 destinations for --prefix-rate. "
+     "(Default 24)"},
+    {"prefix-v6-len",
+     SET_prefix_v6_len,
+     Type_ARG,
+     {0},
+     "Specifies the prefix length of IPv6 destinations for --prefix-rate. "
+     "(Default 64)"},
     {"wait",
      SET_wait,
      Type_ARG,
@@ -2544,18 +3184,30 @@ ConfParam config_parameters[] = {
      Type_ARG,
      {"tx-count", "tx-num", 0},
      "Specify the number of transmit threads. " XTATE_NAME_TITLE_CASE " could"
-     " has multiple transmit threads but only one receive thread. Every "
-     "thread will be lock on a CPU kernel if the number of all threads is no"
-     " more than kernel's.\n"
+     " has multiple transmit threads but only one receive thread in default. "
+     "Every thread will be lock on a CPU kernel if the number of all threads "
+     "is no more than kernel's.\n"
      "NOTE: Default valude is 4. However, 4 transmit threads could got a stable"
      " and high send rate in most conditions."},
+    {"rx-thread-count",
+     SET_rx_thread_count,
+     Type_ARG,
+     {"rx-thread-num", 0},
+     "Specify the number of receive threads in AF_PACKET mode. Every receive "
+     "thread owns a socket of a PACKET_FANOUT group, and kernel hashes "
+     "packets by source IP to them. So responses from the same target always"
+     " land on the same receive thread with its own dedup table and pcap file"
+     " (suffixed with thread index except the first one). Receive threads "
+     "enqueue packets into receive handler threads directly without dispatch"
+     " thread in this mode.\n"
+     "NOTE: Needs --af-packet and Linux kernel 4.5 or later. (Default 1)"},
     {"rx-handler-count",
      SET_rx_handler_count,
      Type_ARG,
      {"rx-count", "rx-num", 0},
      "Specify the number of receive handler threads. " XTATE_NAME_TITLE_CASE
      " could"
-     " has multiple receive handler threads but only one receive thread. Every "
+     " has multiple receive handler threads for receive threads. Every "
      "handler thread will be dispatched recv packets by (dst_IP, dst_Port, "
      "src_IP, src_Port) and executes the `handler_cb` of ScanModule. This is "
      "for some necessary but slow action while ScanModule handling consecutive"
@@ -2564,6 +3216,28 @@ ConfParam config_parameters[] = {
      " with consecutive communication (e.g. results processing), it is better"
      " to use special thread-pool.\n"
      "The number of receive handler must be the power of 2. (Default 1)"},
+    {"no-dispatch-thread",
+     SET_no_dispatch,
+     Type_FLAG,
+     {"no-dispatch", 0},
+     "Let the receive thread sort packets into queues of receive handler "
+     "threads by itself instead of passing them through a dispatch thread. "
+     "This saves a thread, a queue hop and the sleeping latency of dispatch "
+     "thread while idle, but costs more work on the receive thread. It is "
+     "always the case while having multiple receive threads.\n"
+     "NOTE: Use --benchmark to compare both ways in different count of "
+     "receive handler threads."},
+    {"idle-spin",
+     SET_idle_spin,
+     Type_ARG,
+     {"busy-poll", 0},
+     "Set how many microseconds an idle thread (dispatch thread, receive "
+     "handler threads and transmit threads after scanning) busy-polls its "
+     "queue before parking. Parked threads are woken up by producers of "
+     "queues at once, so they don't burn CPU while idle (e.g. in --wait phase)"
+     " and busy ones don't sleep a fixed time for every empty polling. Set 0"
+     " to park at once for saving CPU, or a larger one for lower latency. "
+     "(Default 50)"},
     {"d",
      SET_log_level,
      Type_FLAG,
@@ -3135,16 +3809,16 @@ ConfParam config_parameters[] = {
      Type_ARG,
      {"use-timeout", 0},
      "Specifies whether or how many timeouts(sec) should ScanModule use like"
-     " --timeout true, --timeout 15. Some ScanModules could use timeout "
-     "function of " XTATE_NAME_TITLE_CASE
+     " --timeout true, --timeout 15, --timeout 0.5. Some ScanModules could "
+     "use timeout function of " XTATE_NAME_TITLE_CASE
      " to result some unresponsed targets and "
-     "do some operation.\n"
+     "do some operation. Timeouts are in milliseconds precision if they are "
+     "not longer than 4 seconds.\n"
      "NOTE: Timeout mechanism may use more memory and cause block on the Rx"
-     " thread while in high-speed send rate. Also the way I used to handle "
-     "the timeout event is kludge. I guess that it can be not that precise "
-     "sometimes because of the dedup mechanism. Although it can bring some "
-     "convenient effects in some scanning, I recommend not to use it if "
-     "possible. However, " XTATE_NAME_TITLE_CASE
+     " thread while in high-speed send rate. I guess that it can be not that"
+     " precise sometimes because of the dedup mechanism. Although it can "
+     "bring some convenient effects in some scanning, I recommend not to use"
+     " it if possible. However, " XTATE_NAME_TITLE_CASE
      " was originally born in stateless "
      "mode:)"},
     {"no-dedup",
@@ -3166,6 +3840,75 @@ ConfParam config_parameters[] = {
      "automaticly if built with libjudy. In this condition, window size means"
      " the actual size of slide window. I didn't identify the performance and "
      "advantages between them and left the choice to users."},
+    {"dedup-type",
+     SET_dedup_type,
+     Type_ARG,
+     {0},
+     "Select the backend of deduplication table:\n"
+     "  cachehash: LRU of exact results in judy array, needs libjudy. It's "
+     "the default one if built with libjudy.\n"
+     "  masscan: hash buckets from masscan with LRU in every bucket. It's the "
+     "default one if built without libjudy.\n"
+     "  fingerprint: fixed-memory table of 64-bit fingerprints in cache-line "
+     "buckets, about 10.5 bytes per entry of window. It evicts the oldest "
+     "entry in a pair of buckets and is the fastest one in most cases.\n"
+     "  bloom: probabilistic dedup by a rotating pair of blocked Bloom "
+     "filters, sized by --dedup-fp-rate and --dedup-mem-limit. Results seen"
+     " in the last window to 2 windows are deduplicated. The memory is bounded"
+     " and much smaller than others for huge windows of infinite scans, but "
+     "genuine results could be dropped as false positives.\n"
+     "NOTE: Use --benchmark to compare them."},
+    {"dedup-in-handler",
+     SET_dedup_in_handler,
+     Type_FLAG,
+     {"handler-dedup", 0},
+     "Do deduplication in receive handler threads instead of receive threads."
+     " Every handler thread keeps its own dedup table as a shard for targets "
+     "dispatched to it by ip_them, so the cost of dedup scales with "
+     "--rx-handler-count and receive threads only validate and dispatch "
+     "packets. Fast-timeout events are forwarded to the handler owning the "
+     "target to be deduped in the same shard.\n"
+     "NOTE: Every handler thread has a dedup table of --dedup-win."},
+    {"dedup-fp-rate",
+     SET_dedup_fp_rate,
+     Type_ARG,
+     {0},
+     "Set the expected false positive rate of probabilistic dedup like "
+     "`--dedup-type bloom`. Default is 0.0001. Every 10 times lower rate "
+     "costs about 5 more bits per entry of window."},
+    {"dedup-mem-limit",
+     SET_dedup_mem_limit,
+     Type_ARG,
+     {"dedup-mem", 0},
+     "Set the max memory of probabilistic dedup like `--dedup-type bloom` "
+     "for every dedup table, e.g. 2GB. The false positive rate will be higher"
+     " than --dedup-fp-rate if the memory is not enough for it, and the "
+     "actual rate will be logged."},
+    {"dedup-file",
+     SET_dedup_filename,
+     Type_ARG,
+     {"dedup-snapshot", 0},
+     "Keep dedup tables in a memory-mapped snapshot file instead of heap. "
+     "Tables are saved to the file on exit and loaded on next start, so "
+     "results reported by previous runs(e.g. resumed with --resume-index) "
+     "will not be output again. The file is reset if it doesn't match the "
+     "current dedup type and window. Every table has its own file with a "
+     "suffix of its index like `file.1` except the first one. Files record "
+     "how tables were sharded, and are refused if --rx-thread-count, "
+     "--rx-handler-count or --dedup-in-handler was changed between runs.\n"
+     "NOTE1: Only works with `--dedup-type fingerprint` or `--dedup-type "
+     "bloom`.\n"
+     "NOTE2: Source ports are part of deduplicated tuples, so set the same "
+     "--source-port and --seed for runs to share the results."},
+    {"dedup-per-round",
+     SET_dedup_per_round,
+     Type_FLAG,
+     {0},
+     "Tag deduplicated results with the round of --repeat or --infinite. So "
+     "results are only deduplicated in the same round and every round "
+     "outputs its full results. By default, results of all rounds share the"
+     " same dedup table and only new ones will be output.\n"
+     "NOTE: Old rounds are evicted as the dedup window slides."},
     {"stack-buf-count",
      SET_stack_buf_count,
      Type_ARG,
@@ -3187,6 +3930,82 @@ ConfParam config_parameters[] = {
      {0},
      "Force the use of the PF_RING driver. The program will exit if PF_RING "
      "DNA drvers are not available."},
+    {"af-packet",
+     SET_afpacket,
+     Type_FLAG,
+     {"afpacket", 0},
+     "Use native AF_PACKET socket with memory-mapped TPACKET_V3 ring to "
+     "receive packets instead of libpcap on Linux. Kernel hands over packets "
+     "in blocks, so that we could receive millions of packets per second "
+     "without per-packet syscall or copying. This needs no special driver or "
+     "license like PF_RING.\n"
+     "NOTE: BPF filter still needs libpcap to be compiled."},
+    {"af-packet-block-size",
+     SET_afpacket_block_size,
+     Type_ARG,
+     {"afp-block-size", 0},
+     "Set the bytes of one block in the rx ring of AF_PACKET mode. It must be"
+     " power of 2 and a multiple of page size. (Default 1048576)"},
+    {"af-packet-block-count",
+     SET_afpacket_block_count,
+     Type_ARG,
+     {"afp-block-count", 0},
+     "Set the count of blocks in the rx ring of AF_PACKET mode. The memory "
+     "cost of ring is block-size*block-count. (Default 64)"},
+    {"af-packet-block-timeout",
+     SET_afpacket_block_timeout,
+     Type_ARG,
+     {"afp-block-timeout", 0},
+     "Set milliseconds before kernel hands over a block that is not full in"
+     " AF_PACKET mode. Smaller value means lower latency for responses in low"
+     " rate. (Default 10)"},
+    {"af-packet-tx-ring",
+     SET_afpacket_tx_ring,
+     Type_FLAG,
+     {"afp-tx-ring", 0},
+     "Transmit packets with memory-mapped PACKET_TX_RING in AF_PACKET mode. "
+     "Every tx thread owns its own tx ring, copies packets into it and kicks "
+     "kernel by a single syscall for a batch of packets. This implies "
+     "--af-packet.\n"
+     "NOTE: Packets are queued until a batch is filled, so it's not "
+     "recommended in very low send rate, just like sendqueue."},
+    {"af-packet-tx-frames",
+     SET_afpacket_tx_frames,
+     Type_ARG,
+     {"afp-tx-frames", 0},
+     "Set the count of 2048-byte frames in tx ring of every tx thread in "
+     "AF_PACKET mode. It must be power of 2 and >= 32. (Default 4096)"},
+    {"af-xdp",
+     SET_afxdp,
+     Type_FLAG,
+     {"afxdp", "xdp", 0},
+     "Use AF_XDP sockets to receive and transmit packets on Linux. An XDP "
+     "program loaded by " XTATE_NAME " redirects packets of the interface to "
+     "one XSK per NIC queue, and packets are passed by descriptors of UMEM "
+     "frames. It runs in generic XDP and copy mode by default, so it works on"
+     " any driver including veth. Tx threads share XSKs in round robin.\n"
+     "NOTE: All packets received on the bound queues are taken away from "
+     "kernel stack, so use a dedicated interface. And AF_XDP mode needs Linux "
+     "kernel 5.9 or later."},
+    {"af-xdp-queues",
+     SET_afxdp_queues,
+     Type_ARG,
+     {"xdp-queues", 0},
+     "Set the count of NIC queues to bind XSKs in AF_XDP mode, from queue 0. "
+     "(Default 1)"},
+    {"af-xdp-frames",
+     SET_afxdp_frames,
+     Type_ARG,
+     {"xdp-frames", 0},
+     "Set the count of 2048-byte UMEM frames for each XSK in AF_XDP mode, "
+     "half for rx and half for tx. It must be power of 2 and >= 64. "
+     "(Default 4096)"},
+    {"af-xdp-zerocopy",
+     SET_afxdp_zerocopy,
+     Type_FLAG,
+     {"xdp-zerocopy", 0},
+     "Attach XDP program in native mode and bind XSKs with zero-copy in "
+     "AF_XDP mode. It needs driver support. This implies --af-xdp."},
     {"send-queue",
      SET_send_queue,
      Type_FLAG,
@@ -3247,7 +4066,31 @@ ConfParam config_parameters[] = {
      "    2.Rx Threads\n"
      "    3.Rx Handle Threads\n"
      "NOTE2: As you can see, 3 threads need to be binded at least. (1 tx "
-     "thread, 1 rx thread and 1 rx handle thread)"},
+     "thread, 1 rx thread and 1 rx handle thread)\n"
+     "NOTE3: NUMA memory preference is also disabled by this switch."},
+    {"cpu-map",
+     SET_cpu_map,
+     Type_ARG,
+     {0},
+     "Bind threads of a role to the specified CPUs instead of the default "
+     "order, in the format of <role>=<cpu-list>. Roles are tx, rx, dispatch "
+     "and handle. The cpu-list is in format of taskset like 0-3,8. Threads of"
+     " a role use CPUs in the list round robin. Use it once for each role. "
+     "e.g.\n"
+     "    --cpu-map tx=0-3 --cpu-map rx=4 --cpu-map dispatch=5 --cpu-map "
+     "handle=6-7\n"
+     "NOTE: Roles not mapped still follow the default order, and dispatch "
+     "thread is not bound in default."},
+    {"numa-node",
+     SET_numa_node,
+     Type_ARG,
+     {0},
+     "Specifies the NUMA node to put our threads and memory on. In default, "
+     XTATE_NAME_TITLE_CASE " finds the node which the adapter is attached to."
+     " Then rings, packet pools and tables are preferred to be allocated on "
+     "the node, and the default CPU-binding order is on CPUs of the node. So "
+     "that multi-socket machines don't pay for cross-node traffic on every "
+     "packet."},
 
     /*Put it at last for better "help" output*/
     {"TARGET_OUTPUT", SET_target_output, 0, {0}, NULL},
@@ -3775,10 +4618,45 @@ void xconf_benchmark(unsigned blackrock_rounds) {
     blackrock1_benchmark(blackrock_rounds);
     blackrock2_benchmark(blackrock_rounds);
     smack_benchmark();
+    checksum_benchmark();
+    receive_benchmark();
+    ranges_benchmark();
+    ranges6_benchmark();
+    targettrie_benchmark();
+    dedup_benchmark();
+    ft_benchmark();
 }
 
 /***************************************************************************
  ***************************************************************************/
+void xconf_bind_cpu(const XConf *xconf, enum CpuRole role, unsigned index) {
+    if (xconf->is_no_cpu_bind || pixie_cpu_get_count() <= 1)
+        return;
+
+    if (xconf->cpu_map[role].count) {
+        pixie_cpu_set_affinity(
+            xconf->cpu_map[role].cpus[index % xconf->cpu_map[role].count]);
+        return;
+    }
+
+    if (role == CpuRole_Dispatch)
+        return;
+
+    unsigned order = index;
+    if (role == CpuRole_Rx || role == CpuRole_Handle)
+        order += xconf->tx_thread_count;
+    if (role == CpuRole_Handle)
+        order += xconf->rx_thread_count;
+
+    /* I think it is better to make (cpu>=cpu_count) threads free */
+    if (xconf->numa_cpu_count) {
+        if (order < xconf->numa_cpu_count)
+            pixie_cpu_set_affinity(xconf->numa_cpus[order]);
+    } else if (order < pixie_cpu_get_count()) {
+        pixie_cpu_set_affinity(order);
+    }
+}
+
 static int xconf_self_selftest() {
     char test[] = " test 1 ";
 
@@ -3800,6 +4678,21 @@ static int xconf_self_selftest() {
             goto failure;
     }
 
+    /* */
+    {
+        unsigned cpus[8];
+
+        if (pixie_cpu_parse_list("0-2,5, 7\n", cpus, 8) != 5 ||
+            cpus[2] != 2 || cpus[3] != 5 || cpus[4] != 7)
+            goto failure;
+        if (pixie_cpu_parse_list("0-8", cpus, 8) != -1)
+            goto failure;
+        if (pixie_cpu_parse_list("3-1", cpus, 8) != -1)
+            goto failure;
+        if (pixie_cpu_parse_list("1,x", cpus, 8) != -1)
+            goto failure;
+    }
+
     return 0;
 failure:
     LOG(LEVEL_ERROR, "(xconf) selftest failed\n");
@@ -3818,8 +4711,10 @@ void xconf_selftest() {
         x += ipv6address_selftest();
         x += ranges_selftest();
         x += ranges6_selftest();
+        x += targettrie_selftest();
         x += rangesport_selftest();
         x += dedup_selftest();
+        x += ft_selftest();
         x += checksum_selftest();
         x += smack_selftest();
         x += blackrock1_selftest();
@@ -3833,6 +4728,8 @@ void xconf_selftest() {
         x += rte_ring_selftest();
         x += xconf_self_selftest();
         x += rstfilter_selftest();
+        x += prefix_limit_selftest();
+        x += rate_control_selftest();
         x += base64_selftest();
         x += datachain_selftest();
         x += proto_http_maker_selftest();
@@ -9,10 +9,12 @@
 #include "util-data/safe-string.h"
 #include "util-misc/cross.h"
 #include "timeout/fast-timeout.h"
+#include "dedup/dedup.h"
 #include "target/target-ipaddress.h"
 #include "target/target-set.h"
 #include "stack/stack-src.h"
 #include "stack/stack-queue.h"
+#include "rawsock/rawsock.h"
 #include "generate-modules/generate-modules.h"
 #include "output-modules/output-modules.h"
 #include "probe-modules/probe-modules.h"
@@ -25,6 +27,7 @@
 very low impact on scan rate */
 #define XCONF_DFT_BLACKROCK_ROUNDS   14
 #define XCONF_DFT_TX_THD_COUNT       1
+#define XCONF_DFT_RX_THD_COUNT       1
 #define XCONF_DFT_RX_HDL_COUNT       1
 #define XCONF_DFT_STACK_BUF_COUNT    16384
 #define XCONF_DFT_DISPATCH_BUF_COUNT 16384
@@ -37,14 +40,37 @@ very low impact on scan rate */
 #define XCONF_DFT_PORT_RANGE         256
 #define XCONF_DFT_SNAPLEN            65535 /*also the max*/
 #define XCONF_DFT_MAX_PKT_LEN        1514
+#define XCONF_DFT_IDLE_SPIN_USEC     50
+#define XCONF_DFT_PACING_BURST       1
+#define XCONF_DFT_PREFIX_V4_LEN      24
+#define XCONF_DFT_PREFIX_V6_LEN      64
+#define XCONF_DFT_NUMA_NODE          -1 /*node of the adapter*/
+#define XCONF_MAX_CPU_MAP            256
 #define XCONF_DFT_PACKET_TTL         128
 #define XCONF_DFT_TCP_SYN_WINSIZE    64240
 #define XCONF_DFT_TCP_OTHER_WINSIZE  1024
+#define XCONF_DFT_AFP_BLOCK_SIZE     1048576
+#define XCONF_DFT_AFP_BLOCK_COUNT    64
+#define XCONF_DFT_AFP_BLOCK_TIMEOUT  10
+#define XCONF_DFT_AFP_TX_FRAME_COUNT 4096
+#define XCONF_DFT_XDP_QUEUE_COUNT    1
+#define XCONF_DFT_XDP_FRAME_COUNT    4096
 
 typedef struct Adapter         Adapter;
 typedef struct TemplateSet     TmplSet;
 typedef struct TemplateOptions TmplOpt;
 
+/**
+ * roles of threads to be bound to CPUs
+ */
+enum CpuRole {
+    CpuRole_Tx = 0,
+    CpuRole_Rx,
+    CpuRole_Dispatch,
+    CpuRole_Handle,
+    CpuRole_Count,
+};
+
 enum Operation {
     Operation_Default = 0,  /* nothing specified, so print usage */
     Operation_Scan,         /* do scan */
@@ -146,16 +172,26 @@ typedef struct XtateConf {
      * */
     char          *bpf_filter;
     char           pcap_filename[256];
+    /*snapshot file of dedup tables*/
+    char           dedup_filename[256];
     /**
      * template for packet making quickly.
      */
     TmplSet       *tmplset;
     TmplOpt       *templ_opts;
+    /**
+     * ring geometry of AF_PACKET mode
+     */
+    AFPacketOpt    afp_opt;
+    /**
+     * queues and UMEM of AF_XDP mode
+     */
+    AFXDPOpt       xdp_opt;
     /**
      * Use fast-timeout table to handle simple timeout events;
      */
     FTable        *ft_table;
-    time_t         ft_spec; /*timeout seconds*/
+    uint64_t       ft_spec_ms; /*timeout milliseconds*/
     /**
      * probe module
      * */
@@ -177,14 +213,31 @@ typedef struct XtateConf {
     OutConf        out_conf;
     /**
      * We could set the number of transmit threads.
-     * NOTE: Always only one receiving thread for consistency of dedup, timeout
-     * and packets recording....
-     * But, we have recv-handlers in multi threads to exec handle_cb of
+     * NOTE: Only one receiving thread in default for consistency of dedup,
+     * timeout and packets recording....
+     * In AF_PACKET mode, we could have multiple receiving threads in a
+     * PACKET_FANOUT group. Kernel hashes packets by ip_them to them, so each
+     * one keeps its own dedup shard and pcap file consistently.
+     * And, we have recv-handlers in multi threads to exec handle_cb of
      * ScanModule. Now we could set the number of recv-handlers in the power
      * of 2.
      */
     unsigned       tx_thread_count;
+    unsigned       rx_thread_count;
     unsigned       rx_handler_count;
+    /**
+     * CPU lists of thread roles set by --cpu-map. Threads of a role use the
+     * CPUs in round robin. Roles without list follow the default order on
+     * CPUs of numa_cpus(or all CPUs if NUMA unknown).
+     * Memory is preferred on numa_node, -1 for the node of adapter.
+     */
+    struct {
+        unsigned cpus[XCONF_MAX_CPU_MAP];
+        unsigned count;
+    } cpu_map[CpuRole_Count];
+    int            numa_node;
+    unsigned       numa_cpus[XCONF_MAX_CPU_MAP];
+    unsigned       numa_cpu_count;
     /**
      * other switches
      * */
@@ -192,14 +245,27 @@ typedef struct XtateConf {
     uint64_t       seed;
     uint64_t       repeat;
     double         max_rate;
+    /*lower bound of --adaptive-rate, 0 for 1% of max_rate*/
+    double         min_rate;
     unsigned       wait;
     unsigned       dedup_win;
+    DedupType      dedup_type;
+    /*for probabilistic dedup, 0 for default*/
+    double         dedup_fp_rate;
+    /*for probabilistic dedup, 0 for no limit*/
+    uint64_t       dedup_mem_limit;
     unsigned       dispatch_buf_count;
     uint64_t       tcb_count;
     unsigned       tcp_init_window;
     unsigned       tcp_window;
     unsigned       packet_ttl;
     unsigned       max_packet_len;
+    unsigned       idle_spin_usec;
+    unsigned       pacing_burst;
+    /*max rate to a destination prefix, 0 for no limit*/
+    unsigned       prefix_rate;
+    unsigned       prefix_v4_len;
+    unsigned       prefix_v6_len;
     unsigned       packet_trace         : 1;
     unsigned       is_no_ansi           : 1;
     unsigned       is_no_status         : 1;
@@ -208,16 +274,23 @@ typedef struct XtateConf {
     unsigned       is_status_info_num   : 1;
     unsigned       is_status_hit_rate   : 1;
     unsigned       is_pfring            : 1;
+    unsigned       is_afpacket          : 1;
+    unsigned       is_afxdp             : 1;
     unsigned       is_sendq             : 1;
     unsigned       is_offline           : 1;
     unsigned       is_nodedup           : 1;
+    unsigned       is_dedup_in_handler  : 1;
+    unsigned       is_dedup_per_round   : 1;
     unsigned       is_noresume          : 1;
     unsigned       is_infinite          : 1;
     unsigned       is_fast_timeout      : 1;
     unsigned       is_bypass_os         : 1;
     unsigned       is_no_bpf            : 1;
     unsigned       is_no_cpu_bind       : 1;
+    unsigned       is_no_dispatch       : 1;
     unsigned       is_static_seed       : 1;
+    unsigned       is_pacing            : 1;
+    unsigned       is_adaptive_rate     : 1;
     unsigned       no_escape_char       : 1;
     unsigned       set_ipv4_adapter     : 1;
     unsigned       set_ipv6_adapter     : 1;
@@ -272,4 +345,14 @@ void xconf_selftest();
 
 void xconf_benchmark(unsigned blackrock_rounds);
 
+/**
+ * Bind current thread to CPU by --cpu-map or the default order:
+ *     1.Tx threads
+ *     2.Rx threads
+ *     3.Rx handle threads
+ * Dispatch thread is free unless it's mapped.
+ * @param index index of the thread in its role.
+ */
+void xconf_bind_cpu(const XConf *xconf, enum CpuRole role, unsigned index);
+
 #endif